@@ -0,0 +1,201 @@
+/*
+ * Copyright (c) 2020 Michael Clark <michaeljclark@mac.com>
+ *
+ * Permission to use, copy, modify, and/or distribute this software for any
+ * purpose with or without fee is hereby granted, provided that the above
+ * copyright notice and this permission notice appear in all copies.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS" AND THE AUTHOR DISCLAIMS ALL WARRANTIES
+ * WITH REGARD TO THIS SOFTWARE INCLUDING ALL IMPLIED WARRANTIES OF
+ * MERCHANTABILITY AND FITNESS. IN NO EVENT SHALL THE AUTHOR BE LIABLE FOR
+ * ANY SPECIAL, DIRECT, INDIRECT, OR CONSEQUENTIAL DAMAGES OR ANY DAMAGES
+ * WHATSOEVER RESULTING FROM LOSS OF USE, DATA OR PROFITS, WHETHER IN AN
+ * ACTION OF CONTRACT, NEGLIGENCE OR OTHER TORTIOUS ACTION, ARISING OUT OF
+ * OR IN CONNECTION WITH THE USE OR PERFORMANCE OF THIS SOFTWARE.
+ */
+
+#pragma once
+
+/*
+ * frustum culling interface
+ *
+ * planes are extracted from a combined projection * view matrix such as
+ * the product of mat4x4_frustum and a view matrix (Gribb and Hartmann).
+ * the batch tests take bounding volumes in structure-of-arrays form and
+ * test 4 (SSE2) or 8 (AVX2) objects per instruction against each plane,
+ * writing the indices of visible objects to a compact list.
+ */
+
+enum { FRUSTUM_PLANES = 6 };
+
+typedef struct
+{
+    vec4 planes[FRUSTUM_PLANES];
+} frustum_t;
+
+static void frustum_from_matrix(frustum_t *f, mat4x4 pv);
+static int frustum_test_sphere(const frustum_t *f, const float *c, float r);
+static int frustum_test_aabb(const frustum_t *f, const float *c, const float *e);
+static size_t frustum_cull_spheres(const frustum_t *f, uint *visible,
+    const float *x, const float *y, const float *z, const float *r, size_t n);
+static size_t frustum_cull_aabbs(const frustum_t *f, uint *visible,
+    const float *cx, const float *cy, const float *cz,
+    const float *ex, const float *ey, const float *ez, size_t n);
+
+/*
+ * frustum culling implementation
+ */
+
+static void frustum_from_matrix(frustum_t *f, mat4x4 pv)
+{
+    /* left, right, bottom, top, near, far: row 3 +/- rows 0, 1, 2 */
+    for (int i = 0; i < FRUSTUM_PLANES; i++) {
+        int row = i >> 1;
+        float sign = (i & 1) ? -1.f : 1.f;
+        for (int k = 0; k < 4; k++) {
+            f->planes[i][k] = pv[k][3] + sign * pv[k][row];
+        }
+        float len = sqrtf(f->planes[i][0] * f->planes[i][0] +
+                          f->planes[i][1] * f->planes[i][1] +
+                          f->planes[i][2] * f->planes[i][2]);
+        if (len > 1e-20f) {
+            vec4_scale(f->planes[i], f->planes[i], 1.f / len);
+        } else {
+            /* far plane at infinity in float precision: always inside */
+            f->planes[i][0] = f->planes[i][1] = f->planes[i][2] = 0.f;
+            f->planes[i][3] = 1.f;
+        }
+    }
+}
+
+static int frustum_test_sphere(const frustum_t *f, const float *c, float r)
+{
+    for (int i = 0; i < FRUSTUM_PLANES; i++) {
+        const float *p = f->planes[i];
+        if (p[0] * c[0] + p[1] * c[1] + p[2] * c[2] + p[3] < -r) return 0;
+    }
+    return 1;
+}
+
+static int frustum_test_aabb(const frustum_t *f, const float *c, const float *e)
+{
+    for (int i = 0; i < FRUSTUM_PLANES; i++) {
+        const float *p = f->planes[i];
+        float d = p[0] * c[0] + p[1] * c[1] + p[2] * c[2] + p[3];
+        float r = fabsf(p[0]) * e[0] + fabsf(p[1]) * e[1] + fabsf(p[2]) * e[2];
+        if (d < -r) return 0;
+    }
+    return 1;
+}
+
+/* branch-free compaction of the set bits of mask into index list */
+static size_t frustum_emit(uint *visible, size_t k, uint mask, size_t base, int width)
+{
+    for (int b = 0; b < width; b++) {
+        visible[k] = (uint)(base + b);
+        k += (mask >> b) & 1;
+    }
+    return k;
+}
+
+static size_t frustum_cull_spheres(const frustum_t *f, uint *visible,
+    const float *x, const float *y, const float *z, const float *r, size_t n)
+{
+    size_t i = 0, k = 0;
+#if defined(LINMATH_AVX2)
+    for (; i < (n & ~(size_t)7); i += 8) {
+        __m256 vx = _mm256_loadu_ps(x + i), vy = _mm256_loadu_ps(y + i);
+        __m256 vz = _mm256_loadu_ps(z + i);
+        __m256 nr = _mm256_sub_ps(_mm256_setzero_ps(), _mm256_loadu_ps(r + i));
+        __m256 in = _mm256_castsi256_ps(_mm256_set1_epi32(-1));
+        for (int j = 0; j < FRUSTUM_PLANES; j++) {
+            const float *p = f->planes[j];
+            __m256 d = _mm256_set1_ps(p[3]);
+            d = linmath_madd256(_mm256_set1_ps(p[0]), vx, d);
+            d = linmath_madd256(_mm256_set1_ps(p[1]), vy, d);
+            d = linmath_madd256(_mm256_set1_ps(p[2]), vz, d);
+            in = _mm256_and_ps(in, _mm256_cmp_ps(d, nr, _CMP_GE_OQ));
+        }
+        k = frustum_emit(visible, k, _mm256_movemask_ps(in), i, 8);
+    }
+#endif
+#if defined(LINMATH_SSE2)
+    for (; i < (n & ~(size_t)3); i += 4) {
+        __m128 vx = _mm_loadu_ps(x + i), vy = _mm_loadu_ps(y + i);
+        __m128 vz = _mm_loadu_ps(z + i);
+        __m128 nr = _mm_sub_ps(_mm_setzero_ps(), _mm_loadu_ps(r + i));
+        __m128 in = _mm_castsi128_ps(_mm_set1_epi32(-1));
+        for (int j = 0; j < FRUSTUM_PLANES; j++) {
+            const float *p = f->planes[j];
+            __m128 d = _mm_set1_ps(p[3]);
+            d = linmath_madd(_mm_set1_ps(p[0]), vx, d);
+            d = linmath_madd(_mm_set1_ps(p[1]), vy, d);
+            d = linmath_madd(_mm_set1_ps(p[2]), vz, d);
+            in = _mm_and_ps(in, _mm_cmpge_ps(d, nr));
+        }
+        k = frustum_emit(visible, k, _mm_movemask_ps(in), i, 4);
+    }
+#endif
+    for (; i < n; i++) {
+        float c[3] = { x[i], y[i], z[i] };
+        visible[k] = (uint)i;
+        k += frustum_test_sphere(f, c, r[i]);
+    }
+    return k;
+}
+
+static size_t frustum_cull_aabbs(const frustum_t *f, uint *visible,
+    const float *cx, const float *cy, const float *cz,
+    const float *ex, const float *ey, const float *ez, size_t n)
+{
+    size_t i = 0, k = 0;
+#if defined(LINMATH_AVX2)
+    for (; i < (n & ~(size_t)7); i += 8) {
+        __m256 vx = _mm256_loadu_ps(cx + i), vy = _mm256_loadu_ps(cy + i);
+        __m256 vz = _mm256_loadu_ps(cz + i);
+        __m256 wx = _mm256_loadu_ps(ex + i), wy = _mm256_loadu_ps(ey + i);
+        __m256 wz = _mm256_loadu_ps(ez + i);
+        __m256 in = _mm256_castsi256_ps(_mm256_set1_epi32(-1));
+        for (int j = 0; j < FRUSTUM_PLANES; j++) {
+            const float *p = f->planes[j];
+            __m256 d = _mm256_set1_ps(p[3]);
+            d = linmath_madd256(_mm256_set1_ps(p[0]), vx, d);
+            d = linmath_madd256(_mm256_set1_ps(p[1]), vy, d);
+            d = linmath_madd256(_mm256_set1_ps(p[2]), vz, d);
+            __m256 r = _mm256_mul_ps(_mm256_set1_ps(fabsf(p[0])), wx);
+            r = linmath_madd256(_mm256_set1_ps(fabsf(p[1])), wy, r);
+            r = linmath_madd256(_mm256_set1_ps(fabsf(p[2])), wz, r);
+            in = _mm256_and_ps(in, _mm256_cmp_ps(_mm256_add_ps(d, r),
+                _mm256_setzero_ps(), _CMP_GE_OQ));
+        }
+        k = frustum_emit(visible, k, _mm256_movemask_ps(in), i, 8);
+    }
+#endif
+#if defined(LINMATH_SSE2)
+    for (; i < (n & ~(size_t)3); i += 4) {
+        __m128 vx = _mm_loadu_ps(cx + i), vy = _mm_loadu_ps(cy + i);
+        __m128 vz = _mm_loadu_ps(cz + i);
+        __m128 wx = _mm_loadu_ps(ex + i), wy = _mm_loadu_ps(ey + i);
+        __m128 wz = _mm_loadu_ps(ez + i);
+        __m128 in = _mm_castsi128_ps(_mm_set1_epi32(-1));
+        for (int j = 0; j < FRUSTUM_PLANES; j++) {
+            const float *p = f->planes[j];
+            __m128 d = _mm_set1_ps(p[3]);
+            d = linmath_madd(_mm_set1_ps(p[0]), vx, d);
+            d = linmath_madd(_mm_set1_ps(p[1]), vy, d);
+            d = linmath_madd(_mm_set1_ps(p[2]), vz, d);
+            __m128 r = _mm_mul_ps(_mm_set1_ps(fabsf(p[0])), wx);
+            r = linmath_madd(_mm_set1_ps(fabsf(p[1])), wy, r);
+            r = linmath_madd(_mm_set1_ps(fabsf(p[2])), wz, r);
+            in = _mm_and_ps(in, _mm_cmpge_ps(_mm_add_ps(d, r), _mm_setzero_ps()));
+        }
+        k = frustum_emit(visible, k, _mm_movemask_ps(in), i, 4);
+    }
+#endif
+    for (; i < n; i++) {
+        float c[3] = { cx[i], cy[i], cz[i] }, e[3] = { ex[i], ey[i], ez[i] };
+        visible[k] = (uint)i;
+        k += frustum_test_aabb(f, c, e);
+    }
+    return k;
+}
@@ -18,6 +18,9 @@
 
 /*
  * vertex buffer, index buffer and shader loading interface
+ *
+ * define GL2_UTIL_NO_GL before including to use the buffer abstraction
+ * in tools that have no OpenGL headers or context.
  */
 
 typedef unsigned uint;
@@ -38,6 +41,7 @@ typedef union { double vec[2]; struct { double x, y;       }; struct { double r,
 typedef union { double vec[3]; struct { double x, y, z;    }; struct { double r, g, b;    }; } vec3d;
 typedef union { double vec[4]; struct { double x, y, z, w; }; struct { double r, g, b, a; }; } vec4d;
 
+#if !defined(GL2_UTIL_NO_GL)
 typedef struct
 {
     const char *name;
@@ -50,6 +54,7 @@ typedef struct
     GLuint count;
     GLuint size;
 } attr_list;
+#endif
 
 typedef struct
 {
@@ -65,12 +70,60 @@ typedef struct
     vec4f col;
 } vertex;
 
+/*
+ * packed vertex, 20 bytes: position as snorm16 relative to the mesh bounds,
+ * normal as octahedral snorm16, uv as unorm16 relative to the uv bounds
+ * and color as rgba8. positions are expanded by a dequantization matrix
+ * folded into the model matrix, uvs by a scale and offset, and normals by
+ * an octahedral decode in the vertex shader.
+ */
+typedef struct
+{
+    short pos[4];
+    short norm[2];
+    unsigned short uv[2];
+    unsigned char col[4];
+} vertex_packed;
+
+/*
+ * array buffers grow through an allocator, NULL meaning malloc and realloc.
+ * resize returns a block of new_size bytes holding the contents of the old
+ * block, which is NULL with old_size zero for the first allocation, and
+ * release frees a block. sizes are always passed so backends need no
+ * block headers.
+ */
+typedef struct array_allocator array_allocator;
+
+struct array_allocator
+{
+    void* (*resize)(array_allocator *a, void *ptr, size_t old_size, size_t new_size);
+    void (*release)(array_allocator *a, void *ptr, size_t size);
+};
+
+typedef struct array_arena_block array_arena_block;
+
+struct array_arena_block
+{
+    array_arena_block *next;
+    size_t size;
+    size_t used;
+};
+
+typedef struct
+{
+    array_allocator alloc;
+    array_arena_block *block;
+    size_t block_size;
+} array_arena;
+
 typedef struct
 {
     size_t stride;
     size_t capacity;
     size_t count;
     char *data;
+    array_allocator *alloc;
+    uint max_index;             /* largest index added, index buffers only */
 } array_buffer;
 
 typedef array_buffer vertex_buffer;
@@ -84,6 +137,7 @@ typedef enum
     primitive_topology_quad_strip,
 } primitive_type;
 
+#if !defined(GL2_UTIL_NO_GL)
 static GLuint compile_shader(GLenum type, const char *filename);
 static GLuint link_program(const GLuint *shaders, GLuint numshaders,
     GLuint (*bindfn)(GLuint prog));
@@ -94,33 +148,81 @@ static void vertex_array_pointer(const char *attr, GLint size,
 static void vertex_array_1f(const char *attr, float v1);
 static void uniform_1i(const char *uniform, GLint i);
 static void uniform_3f(const char *uniform, GLfloat v1, GLfloat v2, GLfloat v3);
+static void uniform_4fv(const char *uniform, const GLfloat *v);
 static void uniform_matrix_4fv(const char *uniform, const GLfloat *mat);
+static GLenum index_buffer_type(index_buffer *ib);
+#endif
+
+static void array_arena_init(array_arena *arena, size_t block_size);
+static void array_arena_reset(array_arena *arena);
+static void array_arena_destroy(array_arena *arena);
+#if defined(MAP_ANONYMOUS)
+static array_allocator* array_allocator_vm();
+#endif
 
 static void array_buffer_init(array_buffer *sb,
     size_t stride, size_t capacity);
+static void array_buffer_init_alloc(array_buffer *sb,
+    size_t stride, size_t capacity, array_allocator *alloc);
 static void array_buffer_destroy(array_buffer *sb);
+static void array_buffer_reserve(array_buffer *sb, size_t capacity);
 static void* array_buffer_data(array_buffer *sb);
 static size_t array_buffer_size(array_buffer *sb);
 static size_t array_buffer_stride(array_buffer *sb);
 static uint array_buffer_count(array_buffer *sb);
 static uint array_buffer_add(array_buffer *sb, void *data);
+static uint array_buffer_add_n(array_buffer *sb, const void *data, size_t count);
 
 static void vertex_buffer_init(vertex_buffer *vb);
+static void vertex_buffer_init_alloc(vertex_buffer *vb, array_allocator *alloc);
 static void vertex_buffer_destroy(vertex_buffer *vb);
+static void vertex_buffer_reserve(vertex_buffer *vb, size_t count);
 static void* vertex_buffer_data(vertex_buffer *vb);
 static size_t vertex_buffer_size(vertex_buffer *vb);
 static uint vertex_buffer_count(vertex_buffer *vb);
 static uint vertex_buffer_add(vertex_buffer *vb, vertex vertex);
+static uint vertex_buffer_add_n(vertex_buffer *vb, const vertex *v, size_t count);
+static void vertex_buffer_transform(vertex_buffer *vb, mat4x4 m, mat4x4 n,
+    size_t offset, size_t count);
+static void vertex_buffer_bounds(vertex_buffer *vb, vec3 lo, vec3 hi);
+static void vertex_buffer_pack(array_buffer *pb, vertex_buffer *vb,
+    mat4x4 dequant, vec4 uv_dequant);
+static void vertex_dequant_identity(mat4x4 dequant, vec4 uv_dequant);
+static void vertex_pack_n(vertex_packed *dst, const vertex *src,
+    vec3 center, vec3 extent, vec4 uv_dequant, size_t n);
+static void vertex_unpack_n(vertex *dst, const vertex_packed *src,
+    vec3 center, vec3 extent, vec4 uv_dequant, size_t n);
 
 static void index_buffer_init(index_buffer *ib);
+static void index_buffer_init_alloc(index_buffer *ib, array_allocator *alloc);
 static void index_buffer_destroy(index_buffer *ib);
+static void index_buffer_reserve(index_buffer *ib, size_t count);
 static void* index_buffer_data(index_buffer *ib);
 static size_t index_buffer_size(index_buffer *ib);
 static uint index_buffer_count(index_buffer *ib);
 static void index_buffer_add(index_buffer *ib,
     const uint *data, uint count, uint addend);
+static void index_buffer_add_pattern(index_buffer *ib, const uint *pattern,
+    uint length, uint step, size_t count, uint addend);
 static void index_buffer_add_primitves(index_buffer *ib,
     primitive_type type, uint count, uint addend);
+static uint index_buffer_push(index_buffer *ib, uint index);
+static uint index_buffer_get(index_buffer *ib, size_t i);
+static size_t index_buffer_narrow(index_buffer *ib);
+static void index_offset_n(uint *dst, const uint *src, uint addend, size_t n);
+static uint index_max_n(const uint *src, size_t n);
+
+/*
+ * typed access without the stride-generic memcpy. T must match the
+ * stride the buffer was created with. push evaluates to the new index.
+ * index_buffer_at is only valid before an index buffer is narrowed.
+ */
+#define array_buffer_at(sb,T,i) (((T*)(sb)->data)[i])
+#define array_buffer_push(sb,T,v) (array_buffer_grow((sb), (sb)->count + 1), \
+    array_buffer_at((sb),T,(sb)->count) = (v), (uint)(sb)->count++)
+#define vertex_buffer_at(vb,i) array_buffer_at(vb,vertex,i)
+#define vertex_buffer_push(vb,v) array_buffer_push(vb,vertex,v)
+#define index_buffer_at(ib,i) array_buffer_at(ib,uint,i)
 
 /*
  * vertex, index and generic array buffer implementation
@@ -129,18 +231,220 @@ static void index_buffer_add_primitves(index_buffer *ib,
 enum { VERTEX_BUFFER_INITIAL_COUNT = 16 };
 enum { INDEX_BUFFER_INITIAL_COUNT = 64 };
 
-static void array_buffer_init(array_buffer *sb, size_t stride, size_t capacity)
+/*
+ * arena allocator
+ *
+ * bump allocates from a list of blocks, for short-lived mesh construction.
+ * the most recent allocation is resized in place while the block has room,
+ * so a single growing buffer never copies within a block; older blocks are
+ * only reclaimed in bulk by array_arena_reset or array_arena_destroy.
+ */
+
+enum { ARRAY_ARENA_ALIGN = 16, ARRAY_ARENA_BLOCK_SIZE = 1 << 20 };
+
+static size_t array_arena_align(size_t size)
 {
-    sb->stride = stride;
+    return (size + ARRAY_ARENA_ALIGN - 1) & ~(size_t)(ARRAY_ARENA_ALIGN - 1);
+}
+
+static char* array_arena_base(array_arena_block *b)
+{
+    return (char*)b + array_arena_align(sizeof(array_arena_block));
+}
+
+static void* array_arena_resize(array_allocator *a, void *ptr,
+    size_t old_size, size_t new_size)
+{
+    array_arena *arena = (array_arena*)a;
+    array_arena_block *b = arena->block;
+    old_size = array_arena_align(old_size);
+    new_size = array_arena_align(new_size);
+
+    /* grow or shrink the top allocation in place */
+    if (ptr && b && (char*)ptr + old_size == array_arena_base(b) + b->used &&
+        b->used - old_size + new_size <= b->size) {
+        b->used = b->used - old_size + new_size;
+        return ptr;
+    }
+
+    /* a buffer that outgrew its own block takes the block with it */
+    if (ptr && b && ptr == array_arena_base(b) && b->used == old_size) {
+        b = (array_arena_block*)realloc(b,
+            array_arena_align(sizeof(array_arena_block)) + new_size);
+        b->size = b->used = new_size;
+        arena->block = b;
+        return array_arena_base(b);
+    }
+
+    if (!b || b->used + new_size > b->size) {
+        size_t size = new_size > arena->block_size ? new_size : arena->block_size;
+        b = (array_arena_block*)malloc(
+            array_arena_align(sizeof(array_arena_block)) + size);
+        b->next = arena->block;
+        b->size = size;
+        b->used = 0;
+        arena->block = b;
+    }
+    char *p = array_arena_base(b) + b->used;
+    b->used += new_size;
+    if (ptr) {
+        memcpy(p, ptr, old_size < new_size ? old_size : new_size);
+    }
+    return p;
+}
+
+static void array_arena_release(array_allocator *a, void *ptr, size_t size)
+{
+    array_arena *arena = (array_arena*)a;
+    array_arena_block *b = arena->block;
+    size = array_arena_align(size);
+    if (b && (char*)ptr + size == array_arena_base(b) + b->used) {
+        b->used -= size;
+    }
+}
+
+static void array_arena_init(array_arena *arena, size_t block_size)
+{
+    arena->alloc.resize = array_arena_resize;
+    arena->alloc.release = array_arena_release;
+    arena->block = NULL;
+    arena->block_size = block_size ? block_size : ARRAY_ARENA_BLOCK_SIZE;
+}
+
+static void array_arena_reset(array_arena *arena)
+{
+    array_arena_block *b = arena->block;
+    while (b) {
+        array_arena_block *next = b->next;
+        free(b);
+        b = next;
+    }
+    arena->block = NULL;
+}
+
+static void array_arena_destroy(array_arena *arena)
+{
+    array_arena_reset(arena);
+}
+
+/*
+ * virtual memory allocator
+ *
+ * maps anonymous pages for huge buffers. on Linux mremap grows a mapping
+ * by moving page table entries rather than copying, elsewhere the contents
+ * are copied into a new mapping. enabled when sys/mman.h is included, and
+ * _GNU_SOURCE must be defined for mremap.
+ */
+
+#if defined(MAP_ANONYMOUS)
+enum { ARRAY_VM_PAGE = 4096 };
+
+static size_t array_vm_round(size_t size)
+{
+    return (size + ARRAY_VM_PAGE - 1) & ~(size_t)(ARRAY_VM_PAGE - 1);
+}
+
+static void* array_vm_resize(array_allocator *a, void *ptr,
+    size_t old_size, size_t new_size)
+{
+    void *p;
+    old_size = array_vm_round(old_size);
+    new_size = array_vm_round(new_size);
+    if (ptr && old_size == new_size) {
+        return ptr;
+    }
+#if defined(MREMAP_MAYMOVE)
+    if (ptr) {
+        p = mremap(ptr, old_size, new_size, MREMAP_MAYMOVE);
+        return p == MAP_FAILED ? NULL : p;
+    }
+#endif
+    p = mmap(NULL, new_size, PROT_READ | PROT_WRITE,
+        MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+    if (p == MAP_FAILED) {
+        return NULL;
+    }
+    if (ptr) {
+        memcpy(p, ptr, old_size < new_size ? old_size : new_size);
+        munmap(ptr, old_size);
+    }
+    return p;
+}
+
+static void array_vm_release(array_allocator *a, void *ptr, size_t size)
+{
+    munmap(ptr, array_vm_round(size));
+}
+
+static array_allocator* array_allocator_vm()
+{
+    static array_allocator vm = { array_vm_resize, array_vm_release };
+    return &vm;
+}
+#endif
+
+/*
+ * array buffer
+ */
+
+static void array_buffer_resize(array_buffer *sb, size_t capacity)
+{
+    if (sb->alloc) {
+        sb->data = (char*)sb->alloc->resize(sb->alloc, sb->data,
+            sb->stride * sb->capacity, sb->stride * capacity);
+    } else {
+        sb->data = (char*)realloc(sb->data, sb->stride * capacity);
+    }
+    assert(sb->data || !capacity);
     sb->capacity = capacity;
+}
+
+static void array_buffer_init_alloc(array_buffer *sb,
+    size_t stride, size_t capacity, array_allocator *alloc)
+{
+    sb->stride = stride;
+    sb->capacity = 0;
     sb->count = 0;
-    sb->data = (char*)malloc(sb->stride * sb->capacity);
+    sb->data = NULL;
+    sb->alloc = alloc;
+    sb->max_index = 0;
+    array_buffer_resize(sb, capacity);
+}
+
+static void array_buffer_init(array_buffer *sb, size_t stride, size_t capacity)
+{
+    array_buffer_init_alloc(sb, stride, capacity, NULL);
 }
 
 static void array_buffer_destroy(array_buffer *sb)
 {
-    free(sb->data);
+    if (sb->alloc) {
+        sb->alloc->release(sb->alloc, sb->data, sb->stride * sb->capacity);
+    } else {
+        free(sb->data);
+    }
     sb->data = NULL;
+    sb->capacity = 0;
+    sb->count = 0;
+    sb->max_index = 0;
+}
+
+/* set the capacity to at least capacity elements, without doubling */
+static void array_buffer_reserve(array_buffer *sb, size_t capacity)
+{
+    if (capacity > sb->capacity) {
+        array_buffer_resize(sb, capacity);
+    }
+}
+
+/* double the capacity until count elements fit */
+static void array_buffer_grow(array_buffer *sb, size_t count)
+{
+    if (count > sb->capacity) {
+        size_t capacity = sb->capacity ? sb->capacity : 1;
+        while (capacity < count) capacity <<= 1;
+        array_buffer_resize(sb, capacity);
+    }
 }
 
 static uint array_buffer_count(array_buffer *sb)
@@ -165,25 +469,42 @@ static size_t array_buffer_size(array_buffer *sb)
 
 static uint array_buffer_add(array_buffer *sb, void *data)
 {
-    if (sb->count >= sb->capacity) {
-        sb->capacity <<= 1;
-        sb->data = (char*)realloc(sb->data, sb->stride * sb->capacity);
-    }
+    array_buffer_grow(sb, sb->count + 1);
     uint idx = sb->count++;
     memcpy(sb->data + (idx * sb->stride), data, sb->stride);
     return idx;
 }
 
+/* append count elements with one capacity check, returning the first index */
+static uint array_buffer_add_n(array_buffer *sb, const void *data, size_t count)
+{
+    array_buffer_grow(sb, sb->count + count);
+    uint idx = sb->count;
+    memcpy(sb->data + (idx * sb->stride), data, sb->stride * count);
+    sb->count += count;
+    return idx;
+}
+
 static void vertex_buffer_init(vertex_buffer *vb)
 {
     array_buffer_init(vb, sizeof(vertex), VERTEX_BUFFER_INITIAL_COUNT);
 }
 
+static void vertex_buffer_init_alloc(vertex_buffer *vb, array_allocator *alloc)
+{
+    array_buffer_init_alloc(vb, sizeof(vertex), VERTEX_BUFFER_INITIAL_COUNT, alloc);
+}
+
 static void vertex_buffer_destroy(vertex_buffer *vb)
 {
     array_buffer_destroy(vb);
 }
 
+static void vertex_buffer_reserve(vertex_buffer *vb, size_t count)
+{
+    array_buffer_reserve(vb, count);
+}
+
 static uint vertex_buffer_count(vertex_buffer *vb)
 {
     return array_buffer_count(vb);
@@ -201,7 +522,204 @@ static size_t vertex_buffer_size(vertex_buffer *vb)
 
 static uint vertex_buffer_add(vertex_buffer *vb, vertex v)
 {
-    return array_buffer_add(vb, &v);
+    return vertex_buffer_push(vb, v);
+}
+
+static uint vertex_buffer_add_n(vertex_buffer *vb, const vertex *v, size_t count)
+{
+    return array_buffer_add_n(vb, v, count);
+}
+
+/*
+ * transform positions by m and normals by the normal matrix n in place
+ * for count vertices starting at offset, using the strided linmath kernel.
+ */
+static void vertex_buffer_transform(vertex_buffer *vb, mat4x4 m, mat4x4 n,
+    size_t offset, size_t count)
+{
+    vertex *v = (vertex*)vb->data + offset;
+    mat4x4_mul_vec3_stride(&v->pos, sizeof(vertex), m,
+        &v->pos, sizeof(vertex), 1.f, count);
+    mat4x4_mul_vec3_stride(&v->norm, sizeof(vertex), n,
+        &v->norm, sizeof(vertex), 0.f, count);
+}
+
+static void vertex_buffer_bounds(vertex_buffer *vb, vec3 lo, vec3 hi)
+{
+    size_t count = vb->count;
+    for (int k = 0; k < 3; k++) {
+        lo[k] = count ? INFINITY : 0.f;
+        hi[k] = count ? -INFINITY : 0.f;
+    }
+    for (size_t i = 0; i < count; i++) {
+        vertex *v = ((vertex*)vb->data) + i;
+        for (int k = 0; k < 3; k++) {
+            lo[k] = fminf(lo[k], v->pos.vec[k]);
+            hi[k] = fmaxf(hi[k], v->pos.vec[k]);
+        }
+    }
+}
+
+/*
+ * vertex quantization
+ */
+
+static float clamp_float(float x, float lo, float hi)
+{
+    return x < lo ? lo : x > hi ? hi : x;
+}
+
+static short float_to_snorm16(float x)
+{
+    x = clamp_float(x, -1.f, 1.f) * 32767.f;
+    return (short)(x + (x >= 0.f ? 0.5f : -0.5f));
+}
+
+static float snorm16_to_float(short x)
+{
+    return x < -32767 ? -1.f : (float)x / 32767.f;
+}
+
+static unsigned short float_to_unorm16(float x)
+{
+    return (unsigned short)(clamp_float(x, 0.f, 1.f) * 65535.f + 0.5f);
+}
+
+static unsigned char float_to_unorm8(float x)
+{
+    return (unsigned char)(clamp_float(x, 0.f, 1.f) * 255.f + 0.5f);
+}
+
+static float oct_sign(float x)
+{
+    return x >= 0.f ? 1.f : -1.f;
+}
+
+/* project the unit sphere onto an octahedron unfolded into [-1,1]^2 */
+static void oct_encode(short e[2], const float n[3])
+{
+    float l1 = fabsf(n[0]) + fabsf(n[1]) + fabsf(n[2]);
+    float u = l1 > 0.f ? n[0] / l1 : 0.f, v = l1 > 0.f ? n[1] / l1 : 0.f;
+    if (n[2] < 0.f) {
+        float t = (1.f - fabsf(v)) * oct_sign(u);
+        v = (1.f - fabsf(u)) * oct_sign(v);
+        u = t;
+    }
+    e[0] = float_to_snorm16(u);
+    e[1] = float_to_snorm16(v);
+}
+
+static void oct_decode(float n[3], const short e[2])
+{
+    float u = snorm16_to_float(e[0]), v = snorm16_to_float(e[1]);
+    float z = 1.f - fabsf(u) - fabsf(v);
+    if (z < 0.f) {
+        float t = (1.f - fabsf(v)) * oct_sign(u);
+        v = (1.f - fabsf(u)) * oct_sign(v);
+        u = t;
+    }
+    float l = sqrtf(u * u + v * v + z * z);
+    n[0] = u / l;
+    n[1] = v / l;
+    n[2] = z / l;
+}
+
+/*
+ * positions are mapped from center +/- extent to [-1,1], and uvs from
+ * offset to offset + scale to [0,1], with uv_dequant holding the scale in
+ * xy and the offset in zw. the snorm16 decode is x/32767, as in GL 4.2
+ * and later; older GL uses (2x+1)/65535 which differs by less than half
+ * a quantum.
+ */
+static void vertex_pack_n(vertex_packed *dst, const vertex *src,
+    vec3 center, vec3 extent, vec4 uv_dequant, size_t n)
+{
+    vec3 inv;
+    vec2 uv_inv;
+    for (int k = 0; k < 3; k++) {
+        inv[k] = extent[k] > 0.f ? 1.f / extent[k] : 0.f;
+    }
+    for (int k = 0; k < 2; k++) {
+        uv_inv[k] = uv_dequant[k] > 0.f ? 1.f / uv_dequant[k] : 0.f;
+    }
+    for (size_t i = 0; i < n; i++) {
+        for (int k = 0; k < 3; k++) {
+            dst[i].pos[k] = float_to_snorm16((src[i].pos.vec[k] - center[k]) * inv[k]);
+        }
+        dst[i].pos[3] = 0;
+        oct_encode(dst[i].norm, src[i].norm.vec);
+        dst[i].uv[0] = float_to_unorm16((src[i].uv.x - uv_dequant[2]) * uv_inv[0]);
+        dst[i].uv[1] = float_to_unorm16((src[i].uv.y - uv_dequant[3]) * uv_inv[1]);
+        for (int k = 0; k < 4; k++) {
+            dst[i].col[k] = float_to_unorm8(src[i].col.vec[k]);
+        }
+    }
+}
+
+static void vertex_unpack_n(vertex *dst, const vertex_packed *src,
+    vec3 center, vec3 extent, vec4 uv_dequant, size_t n)
+{
+    for (size_t i = 0; i < n; i++) {
+        for (int k = 0; k < 3; k++) {
+            dst[i].pos.vec[k] = center[k] + snorm16_to_float(src[i].pos[k]) * extent[k];
+        }
+        oct_decode(dst[i].norm.vec, src[i].norm);
+        dst[i].uv.x = (float)src[i].uv[0] / 65535.f * uv_dequant[0] + uv_dequant[2];
+        dst[i].uv.y = (float)src[i].uv[1] / 65535.f * uv_dequant[1] + uv_dequant[3];
+        for (int k = 0; k < 4; k++) {
+            dst[i].col.vec[k] = (float)src[i].col[k] / 255.f;
+        }
+    }
+}
+
+/* the dequantization of unpacked vertices, which leaves them unchanged */
+static void vertex_dequant_identity(mat4x4 dequant, vec4 uv_dequant)
+{
+    mat4x4_identity(dequant);
+    uv_dequant[0] = uv_dequant[1] = 1.f;
+    uv_dequant[2] = uv_dequant[3] = 0.f;
+}
+
+/*
+ * append the vertices of vb to pb, which has a stride of vertex_packed,
+ * quantized to the bounds of vb. dequant receives the matrix that maps
+ * packed positions back to model space, to be post-multiplied onto the
+ * model matrix. the normal matrix is unchanged. uv_dequant receives the
+ * uv scale and offset, which is the identity for uvs within [0,1] so
+ * tiled uvs only give up precision when present.
+ */
+static void vertex_buffer_pack(array_buffer *pb, vertex_buffer *vb,
+    mat4x4 dequant, vec4 uv_dequant)
+{
+    vec3 lo, hi, center, extent;
+    vec2 uv_lo = { 0.f, 0.f }, uv_hi = { 1.f, 1.f };
+    const vertex *v = (const vertex*)vb->data;
+    assert(pb->stride == sizeof(vertex_packed));
+    vertex_buffer_bounds(vb, lo, hi);
+    for (int k = 0; k < 3; k++) {
+        center[k] = (lo[k] + hi[k]) * 0.5f;
+        extent[k] = (hi[k] - lo[k]) * 0.5f;
+    }
+    for (size_t i = 0; i < vb->count; i++) {
+        for (int k = 0; k < 2; k++) {
+            uv_lo[k] = fminf(uv_lo[k], v[i].uv.vec[k]);
+            uv_hi[k] = fmaxf(uv_hi[k], v[i].uv.vec[k]);
+        }
+    }
+    vertex_dequant_identity(dequant, uv_dequant);
+    for (int k = 0; k < 2; k++) {
+        uv_dequant[k] = uv_hi[k] - uv_lo[k];
+        uv_dequant[k + 2] = uv_lo[k];
+    }
+    array_buffer_grow(pb, pb->count + vb->count);
+    vertex_pack_n((vertex_packed*)pb->data + pb->count, v,
+        center, extent, uv_dequant, vb->count);
+    pb->count += vb->count;
+
+    for (int k = 0; k < 3; k++) {
+        dequant[k][k] = extent[k];
+        dequant[3][k] = center[k];
+    }
 }
 
 static void vertex_buffer_dump(vertex_buffer *vb)
@@ -228,11 +746,21 @@ static void index_buffer_init(index_buffer *ib)
     return array_buffer_init(ib, sizeof(uint), INDEX_BUFFER_INITIAL_COUNT);
 }
 
+static void index_buffer_init_alloc(index_buffer *ib, array_allocator *alloc)
+{
+    array_buffer_init_alloc(ib, sizeof(uint), INDEX_BUFFER_INITIAL_COUNT, alloc);
+}
+
 static void index_buffer_destroy(index_buffer *ib)
 {
     return array_buffer_destroy(ib);
 }
 
+static void index_buffer_reserve(index_buffer *ib, size_t count)
+{
+    array_buffer_reserve(ib, count);
+}
+
 static uint index_buffer_count(index_buffer *ib)
 {
     return array_buffer_count(ib);
@@ -248,17 +776,125 @@ static size_t index_buffer_size(index_buffer *ib)
     return array_buffer_size(ib);
 }
 
+/*
+ * dst[i] = src[i] + addend. src may be dst, or a range that does not
+ * overlap dst, as the vector loops load a block before storing it.
+ */
+static void index_offset_n(uint *dst, const uint *src, uint addend, size_t n)
+{
+    size_t i = 0;
+#if defined(LINMATH_AVX2)
+    __m256i a8 = _mm256_set1_epi32((int)addend);
+    for (; i < (n & ~(size_t)7); i += 8) {
+        __m256i v = _mm256_loadu_si256((const __m256i*)(src + i));
+        _mm256_storeu_si256((__m256i*)(dst + i), _mm256_add_epi32(v, a8));
+    }
+#endif
+#if defined(LINMATH_SSE2)
+    __m128i a4 = _mm_set1_epi32((int)addend);
+    for (; i < (n & ~(size_t)3); i += 4) {
+        __m128i v = _mm_loadu_si128((const __m128i*)(src + i));
+        _mm_storeu_si128((__m128i*)(dst + i), _mm_add_epi32(v, a4));
+    }
+#endif
+    for (; i < n; i++) {
+        dst[i] = src[i] + addend;
+    }
+}
+
+static uint index_max_n(const uint *src, size_t n)
+{
+    uint m = 0;
+    for (size_t i = 0; i < n; i++) {
+        m = src[i] > m ? src[i] : m;
+    }
+    return m;
+}
+
+static void index_buffer_track(index_buffer *ib, uint index)
+{
+    ib->max_index = index > ib->max_index ? index : ib->max_index;
+}
+
+static uint index_buffer_push(index_buffer *ib, uint index)
+{
+    assert(ib->stride == sizeof(uint));
+    index_buffer_track(ib, index);
+    return array_buffer_push(ib, uint, index);
+}
+
 static void index_buffer_add(index_buffer *ib,
     const uint *data, uint count, uint addend)
 {
-    if (ib->count + count >= ib->capacity) {
-        do { ib->capacity <<= 1; }
-        while (ib->count + count > ib->capacity);
-        ib->data = realloc(ib->data, sizeof(uint) * ib->capacity);
+    assert(ib->stride == sizeof(uint));
+    array_buffer_grow(ib, ib->count + count);
+    index_offset_n((uint*)ib->data + ib->count, data, addend, count);
+    if (count) {
+        index_buffer_track(ib, index_max_n(data, count) + addend);
     }
-    for (uint i = 0; i < count; i++) {
-        ((uint*)ib->data)[ib->count++] = data[i] + addend;
+    ib->count += count;
+}
+
+enum { INDEX_PATTERN_RUN = 1024 };
+
+/*
+ * emit count copies of pattern, adding step to the addend for each copy.
+ * the first eight copies are written out, which is a whole number of
+ * vectors for any pattern length, and the rest are copied from the run
+ * just written with its addend offset, so the source is still in cache.
+ */
+static void index_buffer_add_pattern(index_buffer *ib, const uint *pattern,
+    uint length, uint step, size_t count, uint addend)
+{
+    assert(ib->stride == sizeof(uint));
+    array_buffer_grow(ib, ib->count + length * count);
+    uint *out = (uint*)ib->data + ib->count;
+    size_t done = count < 8 ? count : 8;
+    for (size_t i = 0; i < done; i++) {
+        index_offset_n(out + i * length, pattern, addend + (uint)i * step, length);
+    }
+    while (done < count) {
+        size_t n = done < INDEX_PATTERN_RUN ? done : INDEX_PATTERN_RUN;
+        if (n > count - done) n = count - done;
+        index_offset_n(out + done * length, out + (done - n) * length,
+            (uint)n * step, n * length);
+        done += n;
     }
+    if (count && length) {
+        index_buffer_track(ib, index_max_n(pattern, length) + addend +
+            (uint)(count - 1) * step);
+    }
+    ib->count += length * count;
+}
+
+static uint index_buffer_get(index_buffer *ib, size_t i)
+{
+    if (ib->stride == sizeof(unsigned short)) {
+        return ((unsigned short*)ib->data)[i];
+    }
+    return ((uint*)ib->data)[i];
+}
+
+/*
+ * store the indices as 16-bit in place when the largest index fits,
+ * halving index memory and fetch bandwidth, and return the new stride.
+ * the allocation keeps its size in bytes. call once the mesh is built,
+ * as the add functions only append 32-bit indices.
+ */
+static size_t index_buffer_narrow(index_buffer *ib)
+{
+    if (ib->stride != sizeof(uint) || ib->max_index > 0xffff) {
+        return ib->stride;
+    }
+    /* each 16-bit store lands at or below the 32-bit load it came from */
+    uint *src = (uint*)ib->data;
+    unsigned short *dst = (unsigned short*)ib->data;
+    for (size_t i = 0; i < ib->count; i++) {
+        dst[i] = (unsigned short)src[i];
+    }
+    ib->stride = sizeof(unsigned short);
+    ib->capacity *= 2;
+    return ib->stride;
 }
 
 static void index_buffer_add_primitves(index_buffer *ib,
@@ -270,29 +906,17 @@ static void index_buffer_add_primitves(index_buffer *ib,
 
     switch (type) {
     case primitive_topology_triangles:
-        for (size_t i = 0; i < count; i++) {
-            index_buffer_add(ib, tri, 3, addend);
-            addend += 3;
-        }
+        index_buffer_add_pattern(ib, tri, 3, 3, count, addend);
         break;
     case primitive_topology_triangle_strip:
         assert((count&1) == 0);
-        for (size_t i = 0; i < count; i += 2) {
-            index_buffer_add(ib, tri_strip, 6, addend);
-            addend += 2;
-        }
+        index_buffer_add_pattern(ib, tri_strip, 6, 2, count >> 1, addend);
         break;
     case primitive_topology_quads:
-        for (size_t i = 0; i < count; i++) {
-            index_buffer_add(ib, quads, 6, addend);
-            addend += 4;
-        }
+        index_buffer_add_pattern(ib, quads, 6, 4, count, addend);
         break;
     case primitive_topology_quad_strip:
-        for (size_t i = 0; i < count; i++) {
-            index_buffer_add(ib, tri_strip, 6, addend);
-            addend += 2;
-        }
+        index_buffer_add_pattern(ib, tri_strip, 6, 2, count, addend);
         break;
     }
 }
@@ -305,13 +929,14 @@ static void index_buffer_dump(index_buffer *ib)
     size_t i;
     for (i = 0; i < count; i++) {
         if (i % width == 0) printf("  [%7zu] = ", i);
-        printf("%7u", ((uint*)ib->data)[i]);
+        printf("%7u", index_buffer_get(ib, i));
         if (i % width == width-1) printf("\n");
     }
     if (i % width != 0) printf("\n");
     printf("}\n");
 }
 
+#if !defined(GL2_UTIL_NO_GL)
 static attr_list attrs;
 static attr_list uniforms;
 
@@ -347,18 +972,30 @@ static GLuint attr_list_set(attr_list *list, const char*name, GLuint val)
 found:
     return (list->arr[idx].val = val);
 }
+#endif
 
 /*
  * shader utilties
  */
 
+/*
+ * when set, load_file first asks load_file_lookup, which returns 0 and a
+ * view of the file, or -1 to fall back to the filesystem. views may point
+ * into a mapped archive (see pack_file.h), so loaded files are read-only.
+ */
+static int (*load_file_lookup)(const char *filename, buffer *buf);
+
 static buffer load_file(const char *filename)
 {
     FILE *f;
     struct stat statbuf;
     char *buf;
     size_t nread;
+    buffer view;
 
+    if (load_file_lookup && load_file_lookup(filename, &view) == 0) {
+        return view;
+    }
     if ((f = fopen(filename, "r")) == NULL) {
         printf("gears_create_shader_from_file: open: %s: %s",
             filename, strerror(errno));
@@ -378,6 +1015,8 @@ static buffer load_file(const char *filename)
     return (buffer){buf, (size_t)statbuf.st_size};
 }
 
+#if !defined(GL2_UTIL_NO_GL)
+
 /*
  * code in this header assumes OpenGL 3.2 and OpenGL ES 3.1 as dependencies
  * that can be statically linked. given the code support multiple loaders,
@@ -584,15 +1223,21 @@ static GLuint link_program(const GLuint *shaders, GLuint numshaders,
     return program;
 }
 
+static void vertex_buffer_create(GLuint *obj, GLenum target,
+    void *data, size_t size)
+{
+    glGenBuffers(1, obj);
+    glBindBuffer(target, *obj);
+    glBufferData(target, size, data, GL_STATIC_DRAW);
+    glBindBuffer(target, *obj);
+}
+
 static void buffer_object_create_offset(GLuint *obj, GLenum target,
     array_buffer *ab, size_t offset, size_t count)
 {
     size_t size = array_buffer_stride(ab) * count;
     char *data = (char*)array_buffer_data(ab) + array_buffer_stride(ab) * offset;
-    glGenBuffers(1, obj);
-    glBindBuffer(target, *obj);
-    glBufferData(target, size, (void*)data, GL_STATIC_DRAW);
-    glBindBuffer(target, *obj);
+    vertex_buffer_create(obj, target, data, size);
 }
 
 static void buffer_object_create(GLuint *obj, GLenum target, array_buffer *ab)
@@ -600,6 +1245,11 @@ static void buffer_object_create(GLuint *obj, GLenum target, array_buffer *ab)
     return buffer_object_create_offset(obj, target, ab, 0, array_buffer_count(ab));
 }
 
+static GLenum index_buffer_type(index_buffer *ib)
+{
+    return ib->stride == sizeof(unsigned short) ? GL_UNSIGNED_SHORT : GL_UNSIGNED_INT;
+}
+
 static void vertex_array_pointer(const char *attr, GLint size,
     GLenum type, GLboolean norm, size_t stride, size_t offset)
 {
@@ -635,6 +1285,14 @@ static void uniform_3f(const char *uniform, GLfloat v1, GLfloat v2, GLfloat v3)
     }
 }
 
+static void uniform_4fv(const char *uniform, const GLfloat *v)
+{
+    GLuint val;
+    if ((val = attr_list_value(&uniforms, uniform)) != ATTR_NOT_FOUND) {
+        glUniform4fv(val, 1, v);
+    }
+}
+
 static void uniform_matrix_4fv(const char *uniform, const GLfloat *mat)
 {
     GLuint val;
@@ -642,3 +1300,5 @@ static void uniform_matrix_4fv(const char *uniform, const GLfloat *mat)
         glUniformMatrix4fv(val, 1, GL_FALSE, mat);
     }
 }
+
+#endif
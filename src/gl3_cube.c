@@ -8,6 +8,9 @@
 #include <assert.h>
 #include <errno.h>
 #include <sys/stat.h>
+#include <sys/mman.h>
+#include <fcntl.h>
+#include <unistd.h>
 
 #define _USE_MATH_DEFINES
 #include <math.h>
@@ -24,6 +27,14 @@
 
 #include "linmath.h"
 #include "gl2_util.h"
+#include "frustum.h"
+#include "scene_graph.h"
+#include "object_store.h"
+#include "pack_file.h"
+
+#if defined(HAVE_PACK_EMBED)
+#include "glcube_pack.inc"
+#endif
 
 typedef struct model_object {
     GLuint vao;
@@ -31,7 +42,9 @@ typedef struct model_object {
     GLuint ibo;
     vertex_buffer vb;
     index_buffer ib;
-    mat4x4 m, v;
+    vec4 bounds;
+    mat4x4 dequant;
+    vec4 uv_dequant;
 } model_object_t;
 
 typedef struct zoom_state {
@@ -43,14 +56,18 @@ typedef struct zoom_state {
 
 static const char* frag_shader_filename = "shaders/cube.v150.fsh";
 static const char* vert_shader_filename = "shaders/cube.v150.vsh";
+static pack_file asset_pack;
 
 static GLfloat t = 0.f;
 static bool help = 0;
 static bool debug = 0;
 static bool animation = 1;
+static bool packed = 0;
 static GLuint program;
 static mat4x4 v, p;
 static model_object_t mo[1];
+static scene_graph_t scene;
+static object_store_t objects;
 static zoom_state_t state = { 32.0f, { 0.f }, { 0.f }, { 20.f, 30.f, 0.f } }, state_save;
 static const float min_zoom = 16.0f, max_zoom = 32768.0f;
 static bool mouse_left_drag = false;
@@ -62,16 +79,50 @@ static void model_object_init(model_object_t *mo)
     index_buffer_init(&mo->ib);
 }
 
+static void model_object_attribs()
+{
+    if (packed) {
+        vertex_array_pointer("a_pos", 3, GL_SHORT, 1,
+            sizeof(vertex_packed), offsetof(vertex_packed,pos));
+        vertex_array_pointer("a_normal", 2, GL_SHORT, 1,
+            sizeof(vertex_packed), offsetof(vertex_packed,norm));
+        vertex_array_pointer("a_uv", 2, GL_UNSIGNED_SHORT, 1,
+            sizeof(vertex_packed), offsetof(vertex_packed,uv));
+        vertex_array_pointer("a_color", 4, GL_UNSIGNED_BYTE, 1,
+            sizeof(vertex_packed), offsetof(vertex_packed,col));
+    } else {
+        vertex_array_pointer("a_pos", 3, GL_FLOAT, 0, sizeof(vertex), offsetof(vertex,pos));
+        vertex_array_pointer("a_normal", 3, GL_FLOAT, 0, sizeof(vertex), offsetof(vertex,norm));
+        vertex_array_pointer("a_uv", 2, GL_FLOAT, 0, sizeof(vertex), offsetof(vertex,uv));
+        vertex_array_pointer("a_color", 4, GL_FLOAT, 0, sizeof(vertex), offsetof(vertex,col));
+    }
+}
+
 static void model_object_freeze(model_object_t *mo)
 {
+    vec3 lo, hi;
+    vertex_buffer_bounds(&mo->vb, lo, hi);
+    for (int k = 0; k < 3; k++) {
+        mo->bounds[k] = (lo[k] + hi[k]) * 0.5f;
+    }
+    mo->bounds[3] = sqrtf((hi[0]-lo[0])*(hi[0]-lo[0]) + (hi[1]-lo[1])*(hi[1]-lo[1]) +
+                          (hi[2]-lo[2])*(hi[2]-lo[2])) * 0.5f;
+
     glGenVertexArrays(1, &mo->vao);
     glBindVertexArray(mo->vao);
-    buffer_object_create(&mo->vbo, GL_ARRAY_BUFFER, &mo->vb);
+    if (packed) {
+        array_buffer pb;
+        array_buffer_init(&pb, sizeof(vertex_packed), vertex_buffer_count(&mo->vb));
+        vertex_buffer_pack(&pb, &mo->vb, mo->dequant, mo->uv_dequant);
+        buffer_object_create(&mo->vbo, GL_ARRAY_BUFFER, &pb);
+        array_buffer_destroy(&pb);
+    } else {
+        vertex_dequant_identity(mo->dequant, mo->uv_dequant);
+        buffer_object_create(&mo->vbo, GL_ARRAY_BUFFER, &mo->vb);
+    }
+    index_buffer_narrow(&mo->ib);
     buffer_object_create(&mo->ibo, GL_ELEMENT_ARRAY_BUFFER, &mo->ib);
-    vertex_array_pointer("a_pos", 3, GL_FLOAT, 0, sizeof(vertex), offsetof(vertex,pos));
-    vertex_array_pointer("a_normal", 3, GL_FLOAT, 0, sizeof(vertex), offsetof(vertex,norm));
-    vertex_array_pointer("a_uv", 2, GL_FLOAT, 0, sizeof(vertex), offsetof(vertex,uv));
-    vertex_array_pointer("a_color", 4, GL_FLOAT, 0, sizeof(vertex), offsetof(vertex,col));
+    model_object_attribs();
 }
 
 static void model_object_cube(model_object_t *mo, float s, vec4f col)
@@ -105,22 +156,23 @@ static void model_object_cube(model_object_t *mo, float s, vec4f col)
 
     uint idx = vertex_buffer_count(&mo->vb);
     for (int i = 0; i < 6; i++) {
-        for (int j = 0; j < 4; j++) {
-            vertex v;
-            v.pos.x = f[i][0][0]*t[j].pos.x + f[i][0][1]*t[j].pos.y + f[i][0][2]*t[j].pos.z;
-            v.pos.y = f[i][1][0]*t[j].pos.x + f[i][1][1]*t[j].pos.y + f[i][1][2]*t[j].pos.z;
-            v.pos.z = f[i][2][0]*t[j].pos.x + f[i][2][1]*t[j].pos.y + f[i][2][2]*t[j].pos.z;
-            v.norm.x = f[i][0][0]*t[j].norm.x + f[i][0][1]*t[j].norm.y + f[i][0][2]*t[j].norm.z;
-            v.norm.y = f[i][1][0]*t[j].norm.x + f[i][1][1]*t[j].norm.y + f[i][1][2]*t[j].norm.z;
-            v.norm.z = f[i][2][0]*t[j].norm.x + f[i][2][1]*t[j].norm.y + f[i][2][2]*t[j].norm.z;
-            v.uv.x = t[j].uv.x;
-            v.uv.y = t[j].uv.y;
-            v.col.r = colors[i][0];
-            v.col.g = colors[i][1];
-            v.col.b = colors[i][2];
-            v.col.a = colors[i][3];
-            vertex_buffer_add(&mo->vb, v);
+        /* face rotation as a column-major matrix; orthonormal, so it is
+         * also the normal matrix */
+        mat4x4 m = {
+            { f[i][0][0], f[i][1][0], f[i][2][0], 0 },
+            { f[i][0][1], f[i][1][1], f[i][2][1], 0 },
+            { f[i][0][2], f[i][1][2], f[i][2][2], 0 },
+            { 0, 0, 0, 1 },
+        };
+        uint face = vertex_buffer_add_n(&mo->vb, t, 4);
+        for (uint j = face; j < face + 4; j++) {
+            vertex *v = &vertex_buffer_at(&mo->vb, j);
+            v->col.r = colors[i][0];
+            v->col.g = colors[i][1];
+            v->col.b = colors[i][2];
+            v->col.a = colors[i][3];
         }
+        vertex_buffer_transform(&mo->vb, m, m, face, 4);
     }
     index_buffer_add_primitves(&mo->ib, primitive_topology_quads, 6, idx);
 }
@@ -129,18 +181,27 @@ static float degrees_to_radians(float a) { return a * M_PI / 180.0f; }
 
 static void model_matrix_transform(mat4x4 m, vec3 scale, vec3 trans, vec3 rot)
 {
-    mat4x4_identity(m);
-    mat4x4_scale_aniso(m, m, scale[0], scale[1], scale[2]);
-    mat4x4_translate_in_place(m, trans[0], trans[1], trans[2]);
-    mat4x4_rotate_X(m, m, degrees_to_radians(rot[0]));
-    mat4x4_rotate_Y(m, m, degrees_to_radians(rot[1]));
-    mat4x4_rotate_Z(m, m, degrees_to_radians(rot[2]));
+    vec3 rad = {
+        degrees_to_radians(rot[0]),
+        degrees_to_radians(rot[1]),
+        degrees_to_radians(rot[2])
+    };
+    mat4x4_compose_euler(m, scale, trans, rad);
 }
 
-static void model_update_matrices(model_object_t *mo)
+static void model_update_matrices(model_object_t *mo, mat4x4 m)
 {
-    uniform_matrix_4fv("u_model", (const GLfloat *)mo[0].m);
-    uniform_matrix_4fv("u_view", (const GLfloat *)mo[0].v);
+    mat4x4 mv, pmv, mvp, md, inv, normal;
+    mat4x4_mul(mv, v, m);
+    mat4x4_mul(pmv, p, mv);
+    mat4x4_mul(mvp, pmv, mo->dequant);
+    mat4x4_mul(md, m, mo->dequant);
+    mat4x4_invert(inv, mv);
+    mat4x4_transpose(normal, inv);
+    uniform_matrix_4fv("u_mvp", (const GLfloat *)mvp);
+    uniform_matrix_4fv("u_model", (const GLfloat *)md);
+    uniform_matrix_4fv("u_normal", (const GLfloat *)normal);
+    uniform_4fv("u_uv_dequant", mo->uv_dequant);
 }
 
 static void model_object_draw(model_object_t *mo)
@@ -148,7 +209,7 @@ static void model_object_draw(model_object_t *mo)
     glBindVertexArray(mo->vao);
     glBindBuffer(GL_ARRAY_BUFFER, mo->vbo);
     glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, mo->ibo);
-    glDrawElements(GL_TRIANGLES, (GLsizei)mo->ib.count, GL_UNSIGNED_INT, (void*)0);
+    glDrawElements(GL_TRIANGLES, (GLsizei)mo->ib.count, index_buffer_type(&mo->ib), (void*)0);
 }
 
 static void draw()
@@ -156,16 +217,35 @@ static void draw()
     glClearColor(0.11f, 0.54f, 0.54f, 1.f);
     glClear(GL_COLOR_BUFFER_BIT | GL_DEPTH_BUFFER_BIT);
 
-    vec3 model_scale = { 1.0f, 1.0f, 1.0f };
-    vec3 model_trans = { 0.0f, 0.0f, 0.0f };
-    vec3 model_rot = { 0.25f * t, 0.5f * t, 0.75f * t };
     vec3 view_scale = { 1.0f, 1.0f, 1.0f };
     vec3 view_trans = { state.origin[0] * 0.01f, state.origin[1] * 0.01f, -state.zoom };
+    model_matrix_transform(v, view_scale, view_trans, state.rotation);
 
-    model_matrix_transform(mo[0].m, model_scale, model_trans, model_rot);
-    model_matrix_transform(mo[0].v, view_scale, view_trans, state.rotation);
-    model_update_matrices(&mo[0]);
-    model_object_draw(&mo[0]);
+    if (animation) {
+        for (size_t i = 0; i < objects.count; i++) {
+            vec3 rot = {
+                degrees_to_radians(objects.spin[i][0] * t),
+                degrees_to_radians(objects.spin[i][1] * t),
+                degrees_to_radians(objects.spin[i][2] * t)
+            };
+            scene_graph_set_rotation(&scene, objects.node[i], rot);
+        }
+    }
+    scene_graph_update(&scene);
+    object_store_update_bounds(&objects, &scene);
+
+    mat4x4 pv;
+    frustum_t frustum;
+    mat4x4_mul(pv, p, v);
+    frustum_from_matrix(&frustum, pv);
+    size_t count = frustum_cull_spheres(&frustum, objects.visible,
+        objects.bx, objects.by, objects.bz, objects.br, objects.count);
+    for (size_t k = 0; k < count; k++) {
+        uint i = objects.visible[k];
+        model_object_t *obj = &mo[objects.mesh[i]];
+        model_update_matrices(obj, scene.world[objects.node[i]]);
+        model_object_draw(obj);
+    }
 }
 
 static float last_time, current_time, delta_time;
@@ -187,7 +267,6 @@ void reshape( GLFWwindow* window, int width, int height )
 
     glViewport(0, 0, (GLint) width, (GLint) height);
     mat4x4_frustum(p, -1., 1., -h, h, 5.f, 1e9f);
-    uniform_matrix_4fv("u_projection", (const GLfloat *)p);
 }
 
 static void scroll(GLFWwindow* window, double xoffset, double yoffset)
@@ -276,6 +355,15 @@ static void init()
     model_object_cube(&mo[0], 3.f, (vec4f){0.3f, 0.3f, 0.3f, 1.f});
     model_object_freeze(&mo[0]);
 
+    /* one object drawing the cube mesh, with a scene graph node */
+    scene_graph_init(&scene, 16);
+    object_store_init(&objects, 16);
+    uint i = object_store_index(&objects, object_store_add(&objects));
+    vec3 spin = { 0.25f, 0.5f, 0.75f };
+    objects.node[i] = scene_graph_add(&scene, SCENE_NODE_NONE);
+    object_store_set_mesh(&objects, i, 0, mo[0].bounds);
+    memcpy(objects.spin[i], spin, sizeof(vec3));
+
     if (debug) {
         vertex_buffer_dump(&mo[0].vb);
     }
@@ -283,6 +371,7 @@ static void init()
     /* set light position uniform */
     glUseProgram(program);
     uniform_3f("u_lightpos", 5.f, 5.f, 10.f);
+    uniform_1i("u_octahedral", packed);
 
     /* enable OpenGL capabilities */
     glEnable(GL_CULL_FACE);
@@ -296,6 +385,7 @@ static void print_help(int argc, char **argv)
         "\n"
         "Options:\n"
         "  -d, --debug                        debug geometry\n"
+        "  -p, --packed                       quantized vertex format\n"
         "  -h, --help                         command line help\n",
         argv[0]);
 }
@@ -312,6 +402,9 @@ static void parse_options(int argc, char **argv)
         if (match_opt(argv[i], "-d", "--debug")) {
             debug++;
             i++;
+        } else if (match_opt(argv[i], "-p", "--packed")) {
+            packed = 1;
+            i++;
         } else if (match_opt(argv[i], "-h", "--help")) {
             help++;
             i++;
@@ -328,12 +421,26 @@ static void parse_options(int argc, char **argv)
     }
 }
 
+static void mount_assets()
+{
+#if defined(HAVE_PACK_EMBED)
+    int ret = pack_file_open_memory(&asset_pack, glcube_pack_data,
+        sizeof(glcube_pack_data));
+#else
+    int ret = pack_file_open_exe(&asset_pack, "glcube.pack");
+#endif
+    if (ret == 0) {
+        pack_file_mount(&asset_pack);
+    }
+}
+
 int main(int argc, char *argv[])
 {
     GLFWwindow* window;
     int width, height;
 
     parse_options(argc, argv);
+    mount_assets();
 
     if( !glfwInit() )
     {
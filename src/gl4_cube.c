@@ -7,11 +7,18 @@
 #include <string.h>
 #include <assert.h>
 #include <errno.h>
+#include <time.h>
 #include <sys/stat.h>
+#include <sys/mman.h>
+#include <fcntl.h>
 
 #define _USE_MATH_DEFINES
 #include <math.h>
 #include <stdbool.h>
+#include <pthread.h>
+#include <stdatomic.h>
+#include <sched.h>
+#include <unistd.h>
 
 #ifdef HAVE_GLAD
 #include <glad/glad.h>
@@ -24,13 +31,51 @@
 
 #include "linmath.h"
 #include "gl2_util.h"
+#include "frustum.h"
+#include "scene_graph.h"
+#include "object_store.h"
+#include "job_system.h"
+#include "mesh_opt.h"
+#include "meshlet.h"
+#include "mesh_simplify.h"
+#include "mesh_codec.h"
+#include "mesh_cache.h"
+#include "mesh_import.h"
+#include "scene_file.h"
+#include "mesh_pager.h"
+#include "texture_file.h"
+#include "texture_stream.h"
+#include "pack_file.h"
 
-typedef struct mvp_t {
-    mat4x4 projection;
+#if defined(HAVE_PACK_EMBED)
+#include "glcube_pack.inc"
+#endif
+
+/* per-mesh uniforms, set once per mesh each frame */
+typedef struct mesh_uniforms_t {
+    vec3 lightpos;
+    float octahedral;
+    float textured;
+    float reserved[3];
+    vec4 uv_dequant;
+} mesh_uniforms_t;
+
+/* per-instance data, read by the vertex shader from the instance buffer */
+typedef struct instance_t {
+    mat4x4 mvp;
     mat4x4 model;
-    mat4x4 view;
-    vec4 lightpos;
-} mvp_t;
+    mat4x4 normal;
+    vec4 color;
+} instance_t;
+
+/* layout of a glMultiDrawElementsIndirect command */
+typedef struct draw_command_t {
+    GLuint count;
+    GLuint instance_count;
+    GLuint first_index;
+    GLint base_vertex;
+    GLuint base_instance;
+} draw_command_t;
 
 typedef struct model_object {
     GLuint vao;
@@ -39,10 +84,32 @@ typedef struct model_object {
     GLuint ubo;
     vertex_buffer vb;
     index_buffer ib;
-    mat4x4 m, v;
-    mvp_t mvp;
+    GLenum index_type;
+    size_t index_stride;
+    vec4 bounds;
+    mat4x4 dequant;
+    vec4 uv_dequant;
+    meshlet_set ms;
+    mesh_lod lod;
+    size_t command_first;       /* this frame's range of draw commands */
+    size_t command_count;
+    uint page;                  /* MESH_PAGE_NONE if always resident */
+    char *path;
+    uint texture;               /* TEXTURE_NONE if untextured */
 } model_object_t;
 
+/* geometry of a paged model, read by the I/O thread for upload */
+typedef struct model_page {
+    void *vertices;
+    void *indices;
+    size_t vertex_size;
+    size_t index_size;
+    size_t vertex_stride;
+    size_t index_stride;
+    mesh_lod lod;
+    meshlet_set ms;
+} model_page_t;
+
 typedef struct zoom_state {
     float zoom;
     vec2 mouse_pos;
@@ -52,14 +119,85 @@ typedef struct zoom_state {
 
 static const char* frag_shader_filename = "shaders/cube.v450.fsh";
 static const char* vert_shader_filename = "shaders/cube.v450.vsh";
+static pack_file asset_pack;
 
 static GLfloat t = 0.f;
 static bool help = 0;
 static bool debug = 0;
 static bool animation = 1;
+static bool packed = 0;
+static const char *cache_filename;
+static const char *mesh_filename;
+static const char *scene_filename;
+static const char *texture_filename;
+static bool compress = 0;
+static size_t page_budget = 256;  /* MiB */
+static float lod_pixels = 1.f;
+static float lod_scale = 1.f;
+static const float lod_errors[] = { 0.002f, 0.008f, 0.032f, 0.128f };
 static GLuint program;
 static mat4x4 v, p;
-static model_object_t mo[1];
+/* the default model is mo[0], followed by the scene meshes */
+enum { MODEL_MAX = 64 };
+static model_object_t mo[MODEL_MAX];
+static uint model_count = 1;
+static scene_graph_t scene;
+static object_store_t objects;
+static job_system_t jobs;
+static mesh_pager pager;
+static texture_stream textures;
+static GLFWwindow *upload_window;
+static int threads = 0;
+static vec3 lightpos = { 5.f, 5.f, 10.f };
+
+/* per-frame state shared by the update and draw preparation jobs */
+enum { FRAME_GRAIN = 1024 };
+static frustum_t frustum;
+static instance_t *draw_instance;
+static uint *draw_lod;
+static float *draw_depth;
+static size_t *draw_count;
+static size_t draw_capacity;
+
+/*
+ * meshlet draw commands of the full detail instances, culled by the
+ * prepare jobs. each chunk of FRAME_GRAIN objects appends to its own
+ * array, and draw_command_first and draw_command_count give the range of
+ * an object's commands in its chunk. base_instance is set by frame_build.
+ */
+typedef struct frame_chunk {
+    draw_command_t *commands;
+    size_t command_count;
+    size_t command_capacity;
+    uint *meshlets;             /* meshlet_cull output */
+    size_t meshlet_capacity;
+} frame_chunk_t;
+
+static frame_chunk_t *draw_chunks;
+static size_t draw_chunk_count;
+static uint *draw_command_first;
+static uint *draw_command_count;
+/*
+ * drawn instances, grouped by mesh and level of detail, and the indirect
+ * commands drawing them. a_instance is an instanced attribute reading
+ * instance_ids, which holds 0..n-1, so each command's base_instance
+ * selects its range of the instance buffer.
+ */
+static instance_t *frame_instances;
+static uint *frame_objects;
+static size_t frame_capacity;
+static draw_command_t *frame_commands;
+static size_t frame_command_count, frame_command_capacity;
+static GLuint instance_buffer, command_buffer, instance_ids;
+static size_t instance_ids_capacity;
+static atomic_uint first_moved = OBJECT_NONE;
+/* scene instances are read in batches until the frame budget is spent */
+enum { SCENE_BATCH = 4096 };
+static const double scene_budget = 0.004;
+static scene_reader scene_in;
+static scene_instance *scene_batch;
+static uint scene_model[SCENE_MESH_MAX];
+
 static zoom_state_t state = { 32.0f, { 0.f }, { 0.f }, { 20.f, 30.f, 0.f } }, state_save;
 static const float min_zoom = 16.0f, max_zoom = 32768.0f;
 static bool mouse_left_drag = false;
@@ -69,18 +207,339 @@ static void model_object_init(model_object_t *mo)
 {
     vertex_buffer_init(&mo->vb);
     index_buffer_init(&mo->ib);
+    meshlet_set_init(&mo->ms);
+    mo->page = MESH_PAGE_NONE;
+    mo->texture = TEXTURE_NONE;
+}
+
+static const mesh_cache_attrib* model_object_layout(size_t *stride)
+{
+    *stride = packed ? sizeof(vertex_packed) : sizeof(vertex);
+    return packed ? mesh_layout_packed : mesh_layout_vertex;
+}
+
+static GLenum model_attrib_type(uint type)
+{
+    switch (type) {
+    case mesh_attrib_short: return GL_SHORT;
+    case mesh_attrib_ushort: return GL_UNSIGNED_SHORT;
+    case mesh_attrib_ubyte: return GL_UNSIGNED_BYTE;
+    default: return GL_FLOAT;
+    }
 }
 
-static void model_object_freeze(model_object_t *mo)
+/* point a_instance of the bound vertex array at the instance ids */
+static void model_instance_attrib()
 {
+    GLuint loc = attr_list_value(&attrs, "a_instance");
+    if (loc == ATTR_NOT_FOUND) return;
+    glBindBuffer(GL_ARRAY_BUFFER, instance_ids);
+    glEnableVertexAttribArray(loc);
+    glVertexAttribIPointer(loc, 1, GL_UNSIGNED_INT, sizeof(GLuint), (const void*)0);
+    glVertexAttribDivisor(loc, 1);
+}
+
+/*
+ * create the uniform, vertex array and buffer objects from vertex and
+ * index data in upload format, either freshly frozen or mapped from a mesh cache.
+ */
+static void model_object_upload(model_object_t *mo,
+    const mesh_cache_attrib *attribs, uint attrib_count,
+    const void *vertices, size_t vertex_size, size_t vertex_stride,
+    const void *indices, size_t index_size, size_t index_stride)
+{
+    glGenBuffers(1, &mo->ubo);
+    glBindBuffer(GL_UNIFORM_BUFFER, mo->ubo);
+    glBufferData(GL_UNIFORM_BUFFER, sizeof(mesh_uniforms_t), NULL, GL_DYNAMIC_DRAW);
+    glBindBuffer(GL_UNIFORM_BUFFER, 0);
+
     glGenVertexArrays(1, &mo->vao);
     glBindVertexArray(mo->vao);
-    buffer_object_create(&mo->vbo, GL_ARRAY_BUFFER, &mo->vb);
-    buffer_object_create(&mo->ibo, GL_ELEMENT_ARRAY_BUFFER, &mo->ib);
-    vertex_array_pointer("a_pos", 3, GL_FLOAT, 0, sizeof(vertex), offsetof(vertex,pos));
-    vertex_array_pointer("a_normal", 3, GL_FLOAT, 0, sizeof(vertex), offsetof(vertex,norm));
-    vertex_array_pointer("a_uv", 2, GL_FLOAT, 0, sizeof(vertex), offsetof(vertex,uv));
-    vertex_array_pointer("a_color", 4, GL_FLOAT, 0, sizeof(vertex), offsetof(vertex,col));
+    vertex_buffer_create(&mo->vbo, GL_ARRAY_BUFFER, (void*)vertices, vertex_size);
+    vertex_buffer_create(&mo->ibo, GL_ELEMENT_ARRAY_BUFFER, (void*)indices, index_size);
+    for (uint i = 0; i < attrib_count; i++) {
+        vertex_array_pointer(attribs[i].name, attribs[i].components,
+            model_attrib_type(attribs[i].type), attribs[i].normalized,
+            vertex_stride, attribs[i].offset);
+    }
+    model_instance_attrib();
+    mo->index_stride = index_stride;
+    mo->index_type = index_stride == sizeof(unsigned short) ?
+        GL_UNSIGNED_SHORT : GL_UNSIGNED_INT;
+}
+
+/*
+ * load a mesh cache written by model_object_freeze, returning false if it
+ * is missing, invalid, in the other vertex layout or was built from a
+ * source other than the one with this key. compressed caches are
+ * decoded into system memory first, as the vertex decoder reads back the
+ * previous vertex, which is slow from a write-combined buffer mapping.
+ */
+static bool model_object_load(model_object_t *mo, const char *filename,
+    const mesh_cache_key *source)
+{
+    mesh_cache mc;
+    size_t stride;
+    const mesh_cache_attrib *layout = model_object_layout(&stride);
+
+    if (mesh_cache_map(&mc, filename) < 0) {
+        return false;
+    }
+    if (!mesh_cache_match(&mc, layout, MESH_LAYOUT_ATTRIBS, stride) ||
+            !mesh_cache_fresh(&mc, source)) {
+        mesh_cache_unmap(&mc);
+        return false;
+    }
+    const mesh_cache_header *h = mc.header;
+    size_t vertex_size = (size_t)h->vertex_count * h->vertex_stride;
+    size_t index_size = (size_t)h->index_count * h->index_stride;
+    const void *vertices = mc.vertices, *indices = mc.indices;
+    void *vtmp = NULL, *itmp = NULL;
+    if (h->flags & mesh_cache_compressed) {
+        vertices = vtmp = malloc(vertex_size);
+        indices = itmp = malloc(index_size);
+        if (mesh_cache_decode_vertices(&mc, vtmp) < 0 ||
+                mesh_cache_decode_indices(&mc, itmp) < 0) {
+            free(itmp);
+            free(vtmp);
+            mesh_cache_unmap(&mc);
+            return false;
+        }
+    }
+    mesh_cache_read_lod(&mc, &mo->lod);
+    mesh_cache_read_meshlets(&mc, &mo->ms);
+    memcpy(mo->bounds, h->bounds, sizeof(vec4));
+    memcpy(mo->dequant, h->dequant, sizeof(mat4x4));
+    memcpy(mo->uv_dequant, h->uv_dequant, sizeof(vec4));
+    model_object_upload(mo, mc.attribs, h->attrib_count,
+        vertices, vertex_size, h->vertex_stride,
+        indices, index_size, h->index_stride);
+    if (debug) {
+        printf("mesh cache: %s: vertices=%u indices=%u lods=%u meshlets=%u "
+            "compressed=%u\n", filename, h->vertex_count, h->index_count,
+            h->lod_count, h->meshlet_count, h->flags & mesh_cache_compressed);
+    }
+    free(itmp);
+    free(vtmp);
+    mesh_cache_unmap(&mc);
+    return true;
+}
+
+/*
+ * delete the GL objects and culling data of a model, leaving its bounds
+ * so that it can still be culled while it is paged out.
+ */
+static void model_object_release(model_object_t *mo)
+{
+    glDeleteVertexArrays(1, &mo->vao);
+    glDeleteBuffers(1, &mo->vbo);
+    glDeleteBuffers(1, &mo->ibo);
+    glDeleteBuffers(1, &mo->ubo);
+    mo->vao = mo->vbo = mo->ibo = mo->ubo = 0;
+    meshlet_set_destroy(&mo->ms);
+    meshlet_set_init(&mo->ms);
+    mo->lod.count = 0;
+}
+
+/*
+ * pager callbacks. a paged model is a mesh cache whose header is read up
+ * front for its bounds and size. the I/O thread maps and decodes it into
+ * host memory, which is freed once the context thread has uploaded it.
+ */
+static void model_page_discard(void *user, void *data)
+{
+    model_page_t *pg = (model_page_t*)data;
+    meshlet_set_destroy(&pg->ms);
+    free(pg->indices);
+    free(pg->vertices);
+    free(pg);
+}
+
+static void* model_page_load(void *user)
+{
+    model_object_t *mo = (model_object_t*)user;
+    mesh_cache mc;
+    size_t stride;
+    const mesh_cache_attrib *layout = model_object_layout(&stride);
+
+    if (mesh_cache_map(&mc, mo->path) < 0) {
+        return NULL;
+    }
+    if (!mesh_cache_match(&mc, layout, MESH_LAYOUT_ATTRIBS, stride)) {
+        mesh_cache_unmap(&mc);
+        return NULL;
+    }
+    const mesh_cache_header *h = mc.header;
+    model_page_t *pg = (model_page_t*)calloc(1, sizeof(model_page_t));
+    pg->vertex_stride = h->vertex_stride;
+    pg->index_stride = h->index_stride;
+    pg->vertex_size = (size_t)h->vertex_count * h->vertex_stride;
+    pg->index_size = (size_t)h->index_count * h->index_stride;
+    pg->vertices = malloc(pg->vertex_size);
+    pg->indices = malloc(pg->index_size);
+    meshlet_set_init(&pg->ms);
+    if (mesh_cache_decode_vertices(&mc, pg->vertices) < 0 ||
+            mesh_cache_decode_indices(&mc, pg->indices) < 0) {
+        model_page_discard(user, pg);
+        mesh_cache_unmap(&mc);
+        return NULL;
+    }
+    mesh_cache_read_lod(&mc, &pg->lod);
+    mesh_cache_read_meshlets(&mc, &pg->ms);
+    mesh_cache_unmap(&mc);
+    return pg;
+}
+
+static size_t model_page_upload(void *user, void *data)
+{
+    model_object_t *mo = (model_object_t*)user;
+    model_page_t *pg = (model_page_t*)data;
+    size_t stride, size = pg->vertex_size + pg->index_size;
+    const mesh_cache_attrib *layout = model_object_layout(&stride);
+
+    mo->lod = pg->lod;
+    meshlet_set_destroy(&mo->ms);
+    mo->ms = pg->ms;
+    meshlet_set_init(&pg->ms);
+    model_object_upload(mo, layout, MESH_LAYOUT_ATTRIBS,
+        pg->vertices, pg->vertex_size, pg->vertex_stride,
+        pg->indices, pg->index_size, pg->index_stride);
+    model_page_discard(user, pg);
+    if (debug) {
+        printf("page in: %s: %zu bytes (resident %zu)\n", mo->path, size,
+            pager.resident + size);
+    }
+    return size;
+}
+
+static void model_page_evict(void *user)
+{
+    model_object_t *mo = (model_object_t*)user;
+    model_object_release(mo);
+    if (debug) {
+        printf("page out: %s\n", mo->path);
+    }
+}
+
+/*
+ * add a mesh cache to the pager, reading only its header, returning
+ * false if it could not be mapped or has a different vertex layout.
+ */
+static bool model_object_page(model_object_t *mo, const char *filename)
+{
+    mesh_cache mc;
+    size_t stride;
+    const mesh_cache_attrib *layout = model_object_layout(&stride);
+
+    if (mesh_cache_map(&mc, filename) < 0) {
+        return false;
+    }
+    if (!mesh_cache_match(&mc, layout, MESH_LAYOUT_ATTRIBS, stride)) {
+        mesh_cache_unmap(&mc);
+        return false;
+    }
+    const mesh_cache_header *h = mc.header;
+    size_t size = (size_t)h->vertex_count * h->vertex_stride +
+        (size_t)h->index_count * h->index_stride;
+    memcpy(mo->bounds, h->bounds, sizeof(vec4));
+    memcpy(mo->dequant, h->dequant, sizeof(mat4x4));
+    memcpy(mo->uv_dequant, h->uv_dequant, sizeof(vec4));
+    mesh_cache_unmap(&mc);
+    mo->path = strdup(filename);
+    mo->page = mesh_pager_add(&pager, mo, size);
+    return true;
+}
+
+static void model_object_freeze(model_object_t *mo, const char *cache,
+    const mesh_cache_key *source)
+{
+    vec3 lo, hi;
+    mesh_stats before, after;
+    size_t vertices = vertex_buffer_count(&mo->vb);
+    mesh_weld(&mo->vb, &mo->ib, 0.f, &jobs);
+    mesh_optimize(&mo->vb, &mo->ib, &before, &after);
+    meshlet_build(&mo->ms, &mo->vb, &mo->ib,
+        MESHLET_MAX_VERTICES, MESHLET_MAX_TRIANGLES);
+    mesh_lod_build(&mo->lod, &mo->vb, &mo->ib, lod_errors,
+        sizeof(lod_errors) / sizeof(lod_errors[0]));
+    if (debug) {
+        printf("mesh: triangles=%zu vertices=%zu->%zu acmr=%.3f->%.3f atvr=%.3f->%.3f "
+            "meshlets=%zu\n", after.triangles, vertices, after.vertices,
+            before.acmr, after.acmr, before.atvr, after.atvr, mo->ms.count);
+        for (uint k = 1; k < mo->lod.count; k++) {
+            printf("lod[%u]: triangles=%u error=%.4f\n", k,
+                mo->lod.levels[k].index_count / 3, mo->lod.levels[k].error);
+        }
+    }
+
+    vertex_buffer_bounds(&mo->vb, lo, hi);
+    for (int k = 0; k < 3; k++) {
+        mo->bounds[k] = (lo[k] + hi[k]) * 0.5f;
+    }
+    mo->bounds[3] = sqrtf((hi[0]-lo[0])*(hi[0]-lo[0]) + (hi[1]-lo[1])*(hi[1]-lo[1]) +
+                          (hi[2]-lo[2])*(hi[2]-lo[2])) * 0.5f;
+
+    size_t stride;
+    const mesh_cache_attrib *layout = model_object_layout(&stride);
+    array_buffer pb, *ub = &mo->vb;
+    if (packed) {
+        array_buffer_init(&pb, sizeof(vertex_packed), vertex_buffer_count(&mo->vb));
+        vertex_buffer_pack(&pb, &mo->vb, mo->dequant, mo->uv_dequant);
+        ub = &pb;
+    } else {
+        vertex_dequant_identity(mo->dequant, mo->uv_dequant);
+    }
+    index_buffer_narrow(&mo->ib);
+    if (cache && mesh_cache_write(cache, layout, MESH_LAYOUT_ATTRIBS,
+            ub, &mo->ib, &mo->lod, &mo->ms, mo->bounds, mo->dequant,
+            mo->uv_dequant, source, compress ? mesh_cache_compressed : 0) < 0) {
+        printf("mesh cache: %s: %s\n", cache, strerror(errno));
+    }
+    model_object_upload(mo, layout, MESH_LAYOUT_ATTRIBS,
+        ub->data, ub->count * ub->stride, stride,
+        mo->ib.data, mo->ib.count * mo->ib.stride, mo->ib.stride);
+    if (packed) {
+        array_buffer_destroy(&pb);
+    }
+
+    /* the buffers are in GL now, so drop the host copies */
+    if (debug) {
+        vertex_buffer_dump(&mo->vb);
+    }
+    vertex_buffer_destroy(&mo->vb);
+    index_buffer_destroy(&mo->ib);
+    vertex_buffer_init(&mo->vb);
+    index_buffer_init(&mo->ib);
+}
+
+/*
+ * import an OBJ or PLY mesh, scaled and centered to fit a cube of half
+ * size s, returning false if the file could not be read.
+ */
+static bool model_object_import(model_object_t *mo, const char *filename, float s)
+{
+    mesh_import_stats stats;
+    vec3 lo, hi;
+    if (mesh_import(&mo->vb, &mo->ib, filename, &jobs, &stats) < 0) {
+        printf("mesh import: %s: %s\n", filename, strerror(errno));
+        return false;
+    }
+    printf("mesh import: %s: vertices=%zu triangles=%zu %.1f MB in %.3fs (%.1f MB/s)\n",
+        filename, stats.vertices, stats.triangles, stats.bytes * 1e-6,
+        stats.seconds, stats.mbps);
+
+    vertex_buffer_bounds(&mo->vb, lo, hi);
+    float extent = fmaxf(hi[0] - lo[0], fmaxf(hi[1] - lo[1], hi[2] - lo[2]));
+    float k = extent > 0.f ? 2.f * s / extent : 1.f;
+    mat4x4 m, n;
+    mat4x4_identity(m);
+    mat4x4_identity(n);
+    for (int i = 0; i < 3; i++) {
+        m[i][i] = k;
+        m[3][i] = -(lo[i] + hi[i]) * 0.5f * k;
+    }
+    vertex_buffer_transform(&mo->vb, m, n, 0, vertex_buffer_count(&mo->vb));
+    return true;
 }
 
 static void model_object_cube(model_object_t *mo, float s, vec4f col)
@@ -114,55 +573,444 @@ static void model_object_cube(model_object_t *mo, float s, vec4f col)
 
     uint idx = vertex_buffer_count(&mo->vb);
     for (int i = 0; i < 6; i++) {
-        for (int j = 0; j < 4; j++) {
-            vertex v;
-            v.pos.x = f[i][0][0]*t[j].pos.x + f[i][0][1]*t[j].pos.y + f[i][0][2]*t[j].pos.z;
-            v.pos.y = f[i][1][0]*t[j].pos.x + f[i][1][1]*t[j].pos.y + f[i][1][2]*t[j].pos.z;
-            v.pos.z = f[i][2][0]*t[j].pos.x + f[i][2][1]*t[j].pos.y + f[i][2][2]*t[j].pos.z;
-            v.norm.x = f[i][0][0]*t[j].norm.x + f[i][0][1]*t[j].norm.y + f[i][0][2]*t[j].norm.z;
-            v.norm.y = f[i][1][0]*t[j].norm.x + f[i][1][1]*t[j].norm.y + f[i][1][2]*t[j].norm.z;
-            v.norm.z = f[i][2][0]*t[j].norm.x + f[i][2][1]*t[j].norm.y + f[i][2][2]*t[j].norm.z;
-            v.uv.x = t[j].uv.x;
-            v.uv.y = t[j].uv.y;
-            v.col.r = colors[i][0];
-            v.col.g = colors[i][1];
-            v.col.b = colors[i][2];
-            v.col.a = colors[i][3];
-            vertex_buffer_add(&mo->vb, v);
+        /* face rotation as a column-major matrix; orthonormal, so it is
+         * also the normal matrix */
+        mat4x4 m = {
+            { f[i][0][0], f[i][1][0], f[i][2][0], 0 },
+            { f[i][0][1], f[i][1][1], f[i][2][1], 0 },
+            { f[i][0][2], f[i][1][2], f[i][2][2], 0 },
+            { 0, 0, 0, 1 },
+        };
+        uint face = vertex_buffer_add_n(&mo->vb, t, 4);
+        for (uint j = face; j < face + 4; j++) {
+            vertex *v = &vertex_buffer_at(&mo->vb, j);
+            v->col.r = colors[i][0];
+            v->col.g = colors[i][1];
+            v->col.b = colors[i][2];
+            v->col.a = colors[i][3];
         }
+        vertex_buffer_transform(&mo->vb, m, m, face, 4);
     }
     index_buffer_add_primitves(&mo->ib, primitive_topology_quads, 6, idx);
 }
 
+/*
+ * load a scene mesh reference: "cube", a mesh cache ending in .mesh, or
+ * an OBJ or PLY file. returns false if it could not be loaded. mesh
+ * caches are paged in and out on demand, the others stay resident.
+ */
+static bool model_object_open(model_object_t *mo, const char *name)
+{
+    size_t len = strlen(name);
+    bool ok = true;
+    model_object_init(mo);
+    if (len > 5 && strcmp(name + len - 5, ".mesh") == 0) {
+        ok = model_object_page(mo, name);
+    } else if (strcmp(name, "cube") == 0) {
+        model_object_cube(mo, 3.f, (vec4f){0.3f, 0.3f, 0.3f, 1.f});
+        model_object_freeze(mo, NULL, NULL);
+    } else if ((ok = model_object_import(mo, name, 3.f))) {
+        model_object_freeze(mo, NULL, NULL);
+    }
+    if (!ok) {
+        meshlet_set_destroy(&mo->ms);
+        vertex_buffer_destroy(&mo->vb);
+        index_buffer_destroy(&mo->ib);
+    }
+    return ok;
+}
+
 static float degrees_to_radians(float a) { return a * M_PI / 180.0f; }
 
 static void model_matrix_transform(mat4x4 m, vec3 scale, vec3 trans, vec3 rot)
 {
-    mat4x4_identity(m);
-    mat4x4_scale_aniso(m, m, scale[0], scale[1], scale[2]);
-    mat4x4_translate_in_place(m, trans[0], trans[1], trans[2]);
-    mat4x4_rotate_X(m, m, degrees_to_radians(rot[0]));
-    mat4x4_rotate_Y(m, m, degrees_to_radians(rot[1]));
-    mat4x4_rotate_Z(m, m, degrees_to_radians(rot[2]));
+    vec3 rad = {
+        degrees_to_radians(rot[0]),
+        degrees_to_radians(rot[1]),
+        degrees_to_radians(rot[2])
+    };
+    mat4x4_compose_euler(m, scale, trans, rad);
 }
 
-static void model_update_matrices(model_object_t *mo)
+static void model_update_matrices(model_object_t *mo, instance_t *inst, mat4x4 m)
 {
-    memcpy(mo[0].mvp.model, mo[0].m, sizeof(mo[0].m));
-    memcpy(mo[0].mvp.view, mo[0].v, sizeof(mo[0].v));
+    mat4x4 mv, pmv, inv;
+    mat4x4_mul(mv, v, m);
+    mat4x4_mul(pmv, p, mv);
+    mat4x4_mul(inst->mvp, pmv, mo->dequant);
+    mat4x4_mul(inst->model, m, mo->dequant);
+    mat4x4_invert(inv, mv);
+    mat4x4_transpose(inst->normal, inv);
+}
 
-    glBindBuffer(GL_UNIFORM_BUFFER, mo->ubo);
-    glBufferSubData(GL_UNIFORM_BUFFER, 0, sizeof(mo[0].mvp), &mo[0].mvp);
-    glBindBuffer(GL_UNIFORM_BUFFER, 0);
+/* the full detail mesh is drawn by meshlet when it has more than one */
+static bool model_object_meshlets(model_object_t *mo, uint lod)
+{
+    return lod == 0 && mo->ms.count > 1;
 }
 
+/*
+ * cull the meshlets of object i against the frustum and normal cones, in
+ * model space, appending a command per visible meshlet to the chunk.
+ */
+static void frame_chunk_cull(frame_chunk_t *fc, model_object_t *mo, uint i)
+{
+    size_t need = fc->command_count + mo->ms.count;
+    if (need > fc->command_capacity) {
+        fc->command_capacity = need > fc->command_capacity * 2 ?
+            need : fc->command_capacity * 2;
+        fc->commands = (draw_command_t*)realloc(fc->commands,
+            fc->command_capacity * sizeof(draw_command_t));
+    }
+    if (mo->ms.count > fc->meshlet_capacity) {
+        fc->meshlet_capacity = mo->ms.count;
+        fc->meshlets = (uint*)realloc(fc->meshlets, fc->meshlet_capacity * sizeof(uint));
+    }
+
+    mat4x4 mv, pmv, inv;
+    mat4x4_mul(mv, v, scene.world[objects.node[i]]);
+    mat4x4_mul(pmv, p, mv);
+    mat4x4_invert(inv, mv);
+    vec3 eye = { inv[3][0], inv[3][1], inv[3][2] };
+    size_t visible = meshlet_cull(&mo->ms, fc->meshlets, pmv, eye);
+    draw_command_first[i] = (uint)fc->command_count;
+    draw_command_count[i] = (uint)visible;
+    for (size_t k = 0; k < visible; k++) {
+        meshlet *ml = &mo->ms.meshlets[fc->meshlets[k]];
+        fc->commands[fc->command_count++] = (draw_command_t){
+            ml->index_count, 1, ml->index_offset, 0, 0 };
+    }
+}
+
+/*
+ * append the commands drawing a mesh's instances in [first, first + count),
+ * which all use level of detail lod. coarse levels are drawn whole with one
+ * instanced command. meshlet commands were culled per instance by the
+ * prepare jobs and are copied from their chunks, pointing base_instance at
+ * the instance's slot.
+ */
+static void frame_commands_add(model_object_t *mo, uint lod, size_t first, size_t count)
+{
+    bool whole = !model_object_meshlets(mo, lod);
+    size_t need = frame_command_count + 1;
+    if (!whole) {
+        need = frame_command_count;
+        for (size_t s = first; s < first + count; s++) {
+            need += draw_command_count[frame_objects[s]];
+        }
+    }
+    if (need > frame_command_capacity) {
+        frame_command_capacity = need > frame_command_capacity * 2 ?
+            need : frame_command_capacity * 2;
+        frame_commands = (draw_command_t*)realloc(frame_commands,
+            frame_command_capacity * sizeof(draw_command_t));
+    }
+    if (whole) {
+        mesh_lod_level *l = &mo->lod.levels[lod];
+        frame_commands[frame_command_count++] = (draw_command_t){
+            l->index_count, (GLuint)count, l->index_offset, 0, (GLuint)first };
+        return;
+    }
+    for (size_t s = first; s < first + count; s++) {
+        uint i = frame_objects[s];
+        draw_command_t *c = draw_chunks[i / FRAME_GRAIN].commands + draw_command_first[i];
+        for (size_t k = 0; k < draw_command_count[i]; k++) {
+            frame_commands[frame_command_count] = c[k];
+            frame_commands[frame_command_count++].base_instance = (GLuint)s;
+        }
+    }
+}
+
+/*
+ * gather the visible instances of the frame into the instance buffer,
+ * grouped by mesh and level of detail, and build the draw commands, so
+ * each mesh is drawn with one glMultiDrawElementsIndirect call. instances
+ * of paged meshes that are not resident are dropped.
+ */
+static void frame_build(size_t n)
+{
+    static size_t counts[MODEL_MAX][MESH_LOD_MAX], next[MODEL_MAX][MESH_LOD_MAX];
+    size_t total = 0;
+
+    memset(counts, 0, sizeof(counts));
+    for (size_t c = 0; c * FRAME_GRAIN < n; c++) {
+        uint *visible = objects.visible + c * FRAME_GRAIN;
+        size_t kept = 0;
+        for (size_t k = 0; k < draw_count[c]; k++) {
+            uint i = visible[k];
+            model_object_t *m = &mo[objects.mesh[i]];
+            if (m->page != MESH_PAGE_NONE &&
+                    !mesh_pager_use(&pager, m->page, draw_depth[i])) {
+                continue;
+            }
+            visible[kept++] = i;
+            counts[objects.mesh[i]][draw_lod[i]]++;
+        }
+        draw_count[c] = kept;
+        total += kept;
+    }
+
+    if (total > frame_capacity) {
+        frame_capacity = total > frame_capacity * 2 ? total : frame_capacity * 2;
+        frame_instances = (instance_t*)realloc(frame_instances,
+            frame_capacity * sizeof(instance_t));
+        frame_objects = (uint*)realloc(frame_objects, frame_capacity * sizeof(uint));
+    }
+    size_t first = 0;
+    for (uint m = 0; m < model_count; m++) {
+        for (uint l = 0; l < MESH_LOD_MAX; l++) {
+            next[m][l] = first;
+            first += counts[m][l];
+        }
+    }
+    for (size_t c = 0; c * FRAME_GRAIN < n; c++) {
+        uint *visible = objects.visible + c * FRAME_GRAIN;
+        for (size_t k = 0; k < draw_count[c]; k++) {
+            uint i = visible[k];
+            size_t slot = next[objects.mesh[i]][draw_lod[i]]++;
+            frame_instances[slot] = draw_instance[i];
+            frame_objects[slot] = i;
+        }
+    }
+    frame_command_count = 0;
+    for (uint m = 0; m < model_count; m++) {
+        mo[m].command_first = frame_command_count;
+        for (uint l = 0; l < MESH_LOD_MAX; l++) {
+            if (counts[m][l]) {
+                frame_commands_add(&mo[m], l, next[m][l] - counts[m][l], counts[m][l]);
+            }
+        }
+        mo[m].command_count = frame_command_count - mo[m].command_first;
+    }
+
+    /* instance_ids keeps its name when it grows, so vertex arrays stay valid */
+    if (total > instance_ids_capacity) {
+        instance_ids_capacity = total > instance_ids_capacity * 2 ?
+            total : instance_ids_capacity * 2;
+        GLuint *ids = (GLuint*)malloc(instance_ids_capacity * sizeof(GLuint));
+        for (size_t k = 0; k < instance_ids_capacity; k++) {
+            ids[k] = (GLuint)k;
+        }
+        glBindBuffer(GL_ARRAY_BUFFER, instance_ids);
+        glBufferData(GL_ARRAY_BUFFER, instance_ids_capacity * sizeof(GLuint),
+            ids, GL_STATIC_DRAW);
+        free(ids);
+    }
+    glBindBuffer(GL_SHADER_STORAGE_BUFFER, instance_buffer);
+    glBufferData(GL_SHADER_STORAGE_BUFFER, total * sizeof(instance_t),
+        frame_instances, GL_STREAM_DRAW);
+    glBindBufferBase(GL_SHADER_STORAGE_BUFFER, 1, instance_buffer);
+    glBindBuffer(GL_DRAW_INDIRECT_BUFFER, command_buffer);
+    glBufferData(GL_DRAW_INDIRECT_BUFFER, frame_command_count * sizeof(draw_command_t),
+        frame_commands, GL_STREAM_DRAW);
+}
+
+/* draw this frame's instances of a mesh with its commands from frame_build */
 static void model_object_draw(model_object_t *mo)
 {
-    glBindVertexArray(mo->vao);
-    glBindBuffer(GL_ARRAY_BUFFER, mo->vbo);
-    glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, mo->ibo);
+    mesh_uniforms_t u = { 0 };
+    if (!mo->command_count) return;
+    memcpy(u.lightpos, lightpos, sizeof(vec3));
+    u.octahedral = packed;
+    memcpy(u.uv_dequant, mo->uv_dequant, sizeof(vec4));
+    u.textured = mo->texture != TEXTURE_NONE &&
+        texture_stream_bind(&textures, mo->texture, 0);
+    glBindBuffer(GL_UNIFORM_BUFFER, mo->ubo);
+    glBufferSubData(GL_UNIFORM_BUFFER, 0, sizeof(mesh_uniforms_t), &u);
+    glBindBuffer(GL_UNIFORM_BUFFER, 0);
     glBindBufferBase(GL_UNIFORM_BUFFER, 0, mo->ubo);
-    glDrawElements(GL_TRIANGLES, (GLsizei)mo->ib.count, GL_UNSIGNED_INT, (void*)0);
+
+    glBindVertexArray(mo->vao);
+    glMultiDrawElementsIndirect(GL_TRIANGLES, mo->index_type,
+        (const void*)(mo->command_first * sizeof(draw_command_t)),
+        (GLsizei)mo->command_count, 0);
+}
+
+/*
+ * frame jobs: animate -> scene graph update -> bounds, culling, draw
+ * matrices and meshlet culling. animate and prepare run in parallel chunks
+ * of FRAME_GRAIN objects; the OpenGL calls and the concatenation of the
+ * draw commands stay on the context thread in draw().
+ */
+
+static void animate_job(job_t *job, void *arg, size_t begin, size_t end)
+{
+    uint first = OBJECT_NONE;
+    for (size_t i = begin; i < end; i++) {
+        uint node = objects.node[i];
+        /* static objects keep the rotation they were placed with */
+        if (!objects.spin[i][0] && !objects.spin[i][1] && !objects.spin[i][2]) {
+            continue;
+        }
+        vec3 rot = {
+            degrees_to_radians(objects.spin[i][0] * t),
+            degrees_to_radians(objects.spin[i][1] * t),
+            degrees_to_radians(objects.spin[i][2] * t)
+        };
+        scene_graph_put_rotation(&scene, node, rot);
+        if (node < first) first = node;
+    }
+    uint prev = atomic_load(&first_moved);
+    while (first < prev && !atomic_compare_exchange_weak(&first_moved, &prev, first));
+}
+
+static void update_job(job_t *job, void *arg, size_t begin, size_t end)
+{
+    uint first = atomic_exchange(&first_moved, OBJECT_NONE);
+    if (first != OBJECT_NONE) {
+        scene_graph_mark(&scene, first);
+    }
+    scene_graph_update(&scene);
+}
+
+static void prepare_job(job_t *job, void *arg, size_t begin, size_t end)
+{
+    uint *visible = objects.visible + begin;
+    frame_chunk_t *fc = &draw_chunks[begin / FRAME_GRAIN];
+    fc->command_count = 0;
+    object_store_update_bounds_range(&objects, &scene, begin, end);
+    size_t count = frustum_cull_spheres(&frustum, visible, objects.bx + begin,
+        objects.by + begin, objects.bz + begin, objects.br + begin, end - begin);
+    for (size_t k = 0; k < count; k++) {
+        uint i = (uint)begin + visible[k];
+        visible[k] = i;
+        model_object_t *m = &mo[objects.mesh[i]];
+        model_update_matrices(m, &draw_instance[i], scene.world[objects.node[i]]);
+        const unsigned char *col = (const unsigned char*)&objects.color[i];
+        for (int c = 0; c < 4; c++) {
+            draw_instance[i].color[c] = col[c] * (1.f / 255.f);
+        }
+
+        /* pixels per model unit at the near side of the bounding sphere */
+        float depth = -(v[0][2] * objects.bx[i] + v[1][2] * objects.by[i] +
+            v[2][2] * objects.bz[i] + v[3][2]) - objects.br[i];
+        float scale = m->bounds[3] > 0.f ? objects.br[i] / m->bounds[3] : 1.f;
+        draw_depth[i] = depth;
+        draw_lod[i] = depth > 0.f ?
+            mesh_lod_select(&m->lod, lod_scale * scale / depth, lod_pixels) : 0;
+        if (model_object_meshlets(m, draw_lod[i])) {
+            frame_chunk_cull(fc, m, i);
+        }
+    }
+    draw_count[begin / FRAME_GRAIN] = count;
+}
+
+static void frame_reserve()
+{
+    if (draw_capacity >= objects.capacity) return;
+    draw_capacity = objects.capacity;
+    draw_instance = (instance_t*)realloc(draw_instance, draw_capacity * sizeof(instance_t));
+    draw_lod = (uint*)realloc(draw_lod, draw_capacity * sizeof(uint));
+    draw_depth = (float*)realloc(draw_depth, draw_capacity * sizeof(float));
+    draw_command_first = (uint*)realloc(draw_command_first, draw_capacity * sizeof(uint));
+    draw_command_count = (uint*)realloc(draw_command_count, draw_capacity * sizeof(uint));
+    size_t chunks = draw_capacity / FRAME_GRAIN + 1;
+    draw_count = (size_t*)realloc(draw_count, chunks * sizeof(size_t));
+    draw_chunks = (frame_chunk_t*)realloc(draw_chunks, chunks * sizeof(frame_chunk_t));
+    memset(draw_chunks + draw_chunk_count, 0,
+        (chunks - draw_chunk_count) * sizeof(frame_chunk_t));
+    draw_chunk_count = chunks;
+}
+
+static void scene_add(const scene_instance *si)
+{
+    uint i = object_store_index(&objects, object_store_add(&objects));
+    uint m = scene_model[si->mesh];
+    vec3 scale = { si->scale, si->scale, si->scale };
+    vec3 trans = { si->pos[0], si->pos[1], si->pos[2] };
+    vec3 rot = {
+        degrees_to_radians(si->rot[0]),
+        degrees_to_radians(si->rot[1]),
+        degrees_to_radians(si->rot[2])
+    };
+    objects.node[i] = scene_graph_add(&scene, SCENE_NODE_NONE);
+    scene_graph_set_trs(&scene, objects.node[i], scale, trans, rot);
+    object_store_set_mesh(&objects, i, m, mo[m].bounds);
+    memcpy(&objects.color[i], si->color, sizeof(uint));
+}
+
+/*
+ * resolve a scene mesh reference relative to the directory of the scene
+ * file, leaving "cube" and absolute paths as they are. returns a string
+ * to be freed by the caller.
+ */
+static char* scene_mesh_path(const char *scene_file, const char *name)
+{
+    const char *slash = strrchr(scene_file, '/');
+    if (!slash || name[0] == '/' || strcmp(name, "cube") == 0) {
+        return strdup(name);
+    }
+    size_t dlen = (size_t)(slash + 1 - scene_file), nlen = strlen(name);
+    char *path = (char*)malloc(dlen + nlen + 1);
+    memcpy(path, scene_file, dlen);
+    memcpy(path + dlen, name, nlen + 1);
+    return path;
+}
+
+/*
+ * open a scene and load its meshes, which are named relative to the scene
+ * file. missing meshes are replaced with the default model. the instances
+ * are added by scene_stream.
+ */
+static bool scene_open(const char *filename)
+{
+    if (scene_reader_open(&scene_in, filename) < 0) {
+        printf("scene: %s: %s\n", filename, strerror(errno));
+        return false;
+    }
+    for (uint k = 0; k < scene_in.mesh_count; k++) {
+        char *path = scene_mesh_path(filename, scene_in.meshes[k]);
+        bool ok = model_count < MODEL_MAX && model_object_open(&mo[model_count], path);
+        free(path);
+        scene_model[k] = 0;
+        if (ok) {
+            scene_model[k] = model_count++;
+        } else {
+            printf("scene: %s: mesh %s not loaded\n", filename, scene_in.meshes[k]);
+        }
+    }
+    scene_batch = (scene_instance*)malloc(SCENE_BATCH * sizeof(scene_instance));
+    return true;
+}
+
+/*
+ * add scene instances to the object store until the frame budget is
+ * spent, so a large scene fills in over several frames instead of
+ * blocking startup, with the reader holding one buffer of the file.
+ * streaming stops with a message if the object store fills first.
+ */
+static void scene_stream()
+{
+    double start = glfwGetTime();
+    size_t n = 0;
+    bool full = false;
+    if (!scene_batch) return;
+    do {
+        size_t room = object_store_room(&objects);
+        if (room == 0) {
+            full = true;
+            break;
+        }
+        n = scene_reader_read(&scene_in, scene_batch, room < SCENE_BATCH ? room : SCENE_BATCH);
+        for (size_t k = 0; k < n; k++) {
+            scene_add(&scene_batch[k]);
+        }
+    } while (n && glfwGetTime() - start < scene_budget);
+    if (full || n == 0) {
+        if (full) {
+            printf("scene: %s: object store full after %llu instances\n",
+                scene_filename, scene_in.read_count);
+        } else if (scene_in.error) {
+            printf("scene: %s: invalid instance after %llu\n",
+                scene_filename, scene_in.read_count);
+        }
+        if (debug) {
+            printf("scene: %s: instances=%zu\n", scene_filename, objects.count);
+        }
+        scene_reader_close(&scene_in);
+        free(scene_batch);
+        scene_batch = NULL;
+    }
 }
 
 static void draw()
@@ -170,16 +1018,36 @@ static void draw()
     glClearColor(0.11f, 0.54f, 0.54f, 1.f);
     glClear(GL_COLOR_BUFFER_BIT | GL_DEPTH_BUFFER_BIT);
 
-    vec3 model_scale = { 1.0f, 1.0f, 1.0f };
-    vec3 model_trans = { 0.0f, 0.0f, 0.0f };
-    vec3 model_rot = { 0.25f * t, 0.5f * t, 0.75f * t };
     vec3 view_scale = { 1.0f, 1.0f, 1.0f };
     vec3 view_trans = { state.origin[0] * 0.01f, state.origin[1] * 0.01f, -state.zoom };
+    model_matrix_transform(v, view_scale, view_trans, state.rotation);
 
-    model_matrix_transform(mo[0].m, model_scale, model_trans, model_rot);
-    model_matrix_transform(mo[0].v, view_scale, view_trans, state.rotation);
-    model_update_matrices(&mo[0]);
-    model_object_draw(&mo[0]);
+    mat4x4 pv;
+    mat4x4_mul(pv, p, v);
+    frustum_from_matrix(&frustum, pv);
+    scene_stream();
+    texture_stream_update(&textures);
+    frame_reserve();
+
+    size_t n = objects.count;
+    job_t *anim = job_create(&jobs, animate_job, NULL, 0, animation ? n : 0, FRAME_GRAIN);
+    job_t *update = job_create(&jobs, update_job, NULL, 0, 0, 0);
+    job_t *prepare = job_create(&jobs, prepare_job, NULL, 0, n, FRAME_GRAIN);
+    job_depends(update, anim);
+    job_depends(prepare, update);
+    job_submit(&jobs, prepare);
+    job_submit(&jobs, update);
+    job_submit(&jobs, anim);
+    job_wait(&jobs, prepare);
+    job_free(&jobs, anim);
+    job_free(&jobs, update);
+    job_free(&jobs, prepare);
+
+    frame_build(n);
+    for (uint m = 0; m < model_count; m++) {
+        model_object_draw(&mo[m]);
+    }
+    mesh_pager_update(&pager);
 }
 
 static float last_time, current_time, delta_time;
@@ -201,7 +1069,7 @@ void reshape( GLFWwindow* window, int width, int height )
 
     glViewport(0, 0, (GLint) width, (GLint) height);
     mat4x4_frustum(p, -1., 1., -h, h, 5.f, 1e9f);
-    memcpy(mo[0].mvp.projection, p, sizeof(p));
+    lod_scale = p[0][0] * (GLfloat) width * 0.5f;
 }
 
 static void scroll(GLFWwindow* window, double xoffset, double yoffset)
@@ -293,25 +1161,47 @@ static void init()
     shaders[1] = compile_shader(GL_FRAGMENT_SHADER, frag_shader_filename);
     program = link_program(shaders, 2, bind);
 
+    /* worker threads for mesh processing and the frame update jobs */
+    job_system_init(&jobs, threads);
+
+    /* instance and draw command buffers, rebuilt each frame */
+    glGenBuffers(1, &instance_buffer);
+    glGenBuffers(1, &command_buffer);
+    glGenBuffers(1, &instance_ids);
+
     /* create cube vertex and index buffers and buffer objects */
+    mesh_cache_key source = { 0, 0 };
+    if (mesh_filename) {
+        mesh_cache_key_file(&source, mesh_filename);
+    }
     model_object_init(&mo[0]);
-    model_object_cube(&mo[0], 3.f, (vec4f){0.3f, 0.3f, 0.3f, 1.f});
-    model_object_freeze(&mo[0]);
+    if (!cache_filename || !model_object_load(&mo[0], cache_filename, &source)) {
+        if (!mesh_filename || !model_object_import(&mo[0], mesh_filename, 3.f)) {
+            model_object_cube(&mo[0], 3.f, (vec4f){0.3f, 0.3f, 0.3f, 1.f});
+        }
+        model_object_freeze(&mo[0], cache_filename, &source);
+    }
 
-    if (debug) {
-        vertex_buffer_dump(&mo[0].vb);
+    /* the scene, or one object drawing the cube mesh */
+    mesh_pager_init(&pager, (mesh_pager_ops){ model_page_load,
+        model_page_upload, model_page_evict, model_page_discard },
+        page_budget << 20);
+    scene_graph_init(&scene, 16);
+    object_store_init(&objects, 16);
+    if (!scene_filename || !scene_open(scene_filename)) {
+        uint i = object_store_index(&objects, object_store_add(&objects));
+        vec3 spin = { 0.25f, 0.5f, 0.75f };
+        objects.node[i] = scene_graph_add(&scene, SCENE_NODE_NONE);
+        object_store_set_mesh(&objects, i, 0, mo[0].bounds);
+        memcpy(objects.spin[i], spin, sizeof(vec3));
     }
 
-    /* create uniform buffer object */
-    glGenBuffers(1, &mo[0].ubo);
-    glBindBuffer(GL_UNIFORM_BUFFER, mo[0].ubo);
-    glBufferData(GL_UNIFORM_BUFFER, sizeof(mo[0].mvp), NULL, GL_DYNAMIC_DRAW);
-    glBindBuffer(GL_UNIFORM_BUFFER, 0);
+    /* textures are decoded and uploaded in the background */
+    if (texture_filename && texture_stream_init(&textures, upload_window, 0) == 0) {
+        mo[0].texture = texture_stream_add(&textures, texture_filename);
+    }
 
-    /* set light position uniform */
     glUseProgram(program);
-    vec4 lightpos = { 5.f, 5.f, 10.f, 0.f };
-    memcpy(mo[0].mvp.lightpos, lightpos, sizeof(lightpos));
 
     /* enable OpenGL capabilities */
     glEnable(GL_CULL_FACE);
@@ -325,6 +1215,15 @@ static void print_help(int argc, char **argv)
         "\n"
         "Options:\n"
         "  -d, --debug                        debug geometry\n"
+        "  -p, --packed                       quantized vertex format\n"
+        "  -l, --lod-pixels <n>               level of detail error (default: 1)\n"
+        "  -m, --mesh <file>                  import an OBJ or PLY mesh\n"
+        "  -s, --scene <file>                 load a scene of mesh instances\n"
+        "  -c, --cache <file>                 load or write a mesh cache\n"
+        "  -z, --compress                     compress the mesh cache\n"
+        "  -b, --budget <MiB>                 scene geometry budget (default: 256)\n"
+        "  -x, --texture <file>               KTX2, DDS or PNG texture\n"
+        "  -t, --threads <n>                  worker threads (default: cpus)\n"
         "  -h, --help                         command line help\n",
         argv[0]);
 }
@@ -341,6 +1240,33 @@ static void parse_options(int argc, char **argv)
         if (match_opt(argv[i], "-d", "--debug")) {
             debug++;
             i++;
+        } else if (match_opt(argv[i], "-p", "--packed")) {
+            packed = 1;
+            i++;
+        } else if (match_opt(argv[i], "-l", "--lod-pixels") && i + 1 < argc) {
+            lod_pixels = (float)atof(argv[i+1]);
+            i += 2;
+        } else if (match_opt(argv[i], "-m", "--mesh") && i + 1 < argc) {
+            mesh_filename = argv[i+1];
+            i += 2;
+        } else if (match_opt(argv[i], "-s", "--scene") && i + 1 < argc) {
+            scene_filename = argv[i+1];
+            i += 2;
+        } else if (match_opt(argv[i], "-c", "--cache") && i + 1 < argc) {
+            cache_filename = argv[i+1];
+            i += 2;
+        } else if (match_opt(argv[i], "-z", "--compress")) {
+            compress = 1;
+            i++;
+        } else if (match_opt(argv[i], "-x", "--texture") && i + 1 < argc) {
+            texture_filename = argv[i+1];
+            i += 2;
+        } else if (match_opt(argv[i], "-b", "--budget") && i + 1 < argc) {
+            page_budget = (size_t)atol(argv[i+1]);
+            i += 2;
+        } else if (match_opt(argv[i], "-t", "--threads") && i + 1 < argc) {
+            threads = atoi(argv[i+1]);
+            i += 2;
         } else if (match_opt(argv[i], "-h", "--help")) {
             help++;
             i++;
@@ -357,12 +1283,26 @@ static void parse_options(int argc, char **argv)
     }
 }
 
+static void mount_assets()
+{
+#if defined(HAVE_PACK_EMBED)
+    int ret = pack_file_open_memory(&asset_pack, glcube_pack_data,
+        sizeof(glcube_pack_data));
+#else
+    int ret = pack_file_open_exe(&asset_pack, "glcube.pack");
+#endif
+    if (ret == 0) {
+        pack_file_mount(&asset_pack);
+    }
+}
+
 int main(int argc, char *argv[])
 {
     GLFWwindow* window;
     int width, height;
 
     parse_options(argc, argv);
+    mount_assets();
 
     if( !glfwInit() )
     {
@@ -386,6 +1326,12 @@ int main(int argc, char *argv[])
 
     glfwMakeContextCurrent(window);
 
+    /* a hidden window with a shared context for texture uploads */
+    if (texture_filename) {
+        glfwWindowHint(GLFW_VISIBLE, GLFW_FALSE);
+        upload_window = glfwCreateWindow(1, 1, "upload", NULL, window);
+    }
+
 #ifdef HAVE_GLAD
     gladLoadGL();
 #endif
@@ -409,6 +1355,9 @@ int main(int argc, char *argv[])
         glfwSwapBuffers(window);
         glfwPollEvents();
     }
+    texture_stream_destroy(&textures);
+    mesh_pager_destroy(&pager);
+    job_system_destroy(&jobs);
     glfwTerminate();
 
     exit(EXIT_SUCCESS);
@@ -0,0 +1,1034 @@
+/*
+ * glcube_bench
+ *
+ * microbenchmarks for the CPU hot paths in linmath.h and gl2_util.h.
+ * each benchmark is run once to warm up and then timed for a number of
+ * repetitions, reporting the best and median ns/op and cycles/op.
+ */
+
+#define _GNU_SOURCE
+#include <stdlib.h>
+#include <stdio.h>
+#include <string.h>
+#include <assert.h>
+#include <errno.h>
+#include <time.h>
+#include <sys/stat.h>
+#include <sys/mman.h>
+#include <fcntl.h>
+
+#define _USE_MATH_DEFINES
+#include <math.h>
+#include <stdbool.h>
+#include <pthread.h>
+#include <stdatomic.h>
+#include <sched.h>
+#include <unistd.h>
+
+#if defined(__x86_64__) || defined(__i386__)
+#include <x86intrin.h>
+#define HAVE_RDTSC 1
+#endif
+
+#define GL2_UTIL_NO_GL
+#include "linmath.h"
+#include "gl2_util.h"
+#include "frustum.h"
+#include "scene_graph.h"
+#include "object_store.h"
+#include "job_system.h"
+#include "mesh_opt.h"
+#include "meshlet.h"
+#include "mesh_simplify.h"
+#include "mesh_codec.h"
+#include "mesh_cache.h"
+#include "mesh_import.h"
+#include "scene_file.h"
+#include "texture_file.h"
+#include "pack_file.h"
+
+typedef struct bench_def {
+    const char *name;
+    size_t (*fn)(size_t n);
+} bench_def_t;
+
+typedef struct bench_result {
+    const char *name;
+    size_t ops;
+    double ns_min, ns_median;
+    double cycles_min, cycles_median;
+} bench_result_t;
+
+enum { BENCH_SET = 256 };
+
+static size_t opt_ops = 1 << 20;
+static int opt_reps = 10;
+static bool opt_json = 0;
+static bool help = 0;
+static const char *opt_filter = NULL;
+static int opt_threads = 0;
+static job_system_t jobs;
+
+static volatile float sink;
+static mat4x4 mat_a[BENCH_SET], mat_b[BENCH_SET], mat_r[BENCH_SET];
+static quat quat_a[BENCH_SET], quat_b[BENCH_SET], quat_r[BENCH_SET];
+static vec3 trs_s[BENCH_SET], trs_t[BENCH_SET], trs_r[BENCH_SET];
+static float soa_x[BENCH_SET], soa_y[BENCH_SET], soa_z[BENCH_SET], soa_w[BENCH_SET];
+static uint visible[BENCH_SET];
+
+static float frand() { return (float)rand() / (float)RAND_MAX * 2.f - 1.f; }
+
+static void bench_init()
+{
+    srand(1);
+    for (size_t i = 0; i < BENCH_SET; i++) {
+        for (int j = 0; j < 4; j++) {
+            for (int k = 0; k < 4; k++) {
+                mat_a[i][j][k] = frand() + (j == k ? 4.f : 0.f);
+                mat_b[i][j][k] = frand() + (j == k ? 4.f : 0.f);
+            }
+            quat_a[i][j] = frand();
+            quat_b[i][j] = frand();
+        }
+        quat_norm(quat_a[i], quat_a[i]);
+        quat_norm(quat_b[i], quat_b[i]);
+        for (int k = 0; k < 3; k++) {
+            trs_s[i][k] = 1.f + frand() * 0.5f;
+            trs_t[i][k] = frand() * 100.f;
+            trs_r[i][k] = frand() * (float)M_PI;
+        }
+        soa_x[i] = frand() * 100.f;
+        soa_y[i] = frand() * 100.f;
+        soa_z[i] = frand() * 100.f;
+        soa_w[i] = 1.f + fabsf(frand());
+    }
+}
+
+static double now_ns()
+{
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec * 1e9 + ts.tv_nsec;
+}
+
+static unsigned long long now_cycles()
+{
+#if defined(HAVE_RDTSC)
+    return __rdtsc();
+#else
+    return 0;
+#endif
+}
+
+/*
+ * benchmarks return the number of operations they performed
+ */
+
+static size_t bench_mat4x4_mul(size_t n)
+{
+    for (size_t i = 0; i < n; i++) {
+        size_t j = i & (BENCH_SET-1);
+        mat4x4_mul(mat_r[j], mat_a[j], mat_b[j]);
+    }
+    sink = mat_r[0][0][0];
+    return n;
+}
+
+static size_t bench_mat4x4_mul_vec4(size_t n)
+{
+    vec4 r = { 0 };
+    for (size_t i = 0; i < n; i++) {
+        size_t j = i & (BENCH_SET-1);
+        mat4x4_mul_vec4(r, mat_a[j], quat_a[j]);
+        quat_r[j][0] += r[0];
+    }
+    sink = quat_r[0][0];
+    return n;
+}
+
+static size_t bench_mat4x4_invert(size_t n)
+{
+    for (size_t i = 0; i < n; i++) {
+        size_t j = i & (BENCH_SET-1);
+        mat4x4_invert(mat_r[j], mat_a[j]);
+    }
+    sink = mat_r[0][0][0];
+    return n;
+}
+
+static size_t bench_mat4x4_rotate(size_t n)
+{
+    for (size_t i = 0; i < n; i++) {
+        size_t j = i & (BENCH_SET-1);
+        mat4x4_rotate_X(mat_r[j], mat_a[j], trs_r[j][0]);
+        mat4x4_rotate_Y(mat_r[j], mat_r[j], trs_r[j][1]);
+        mat4x4_rotate_Z(mat_r[j], mat_r[j], trs_r[j][2]);
+    }
+    sink = mat_r[0][0][0];
+    return n;
+}
+
+static size_t bench_quat_mul(size_t n)
+{
+    for (size_t i = 0; i < n; i++) {
+        size_t j = i & (BENCH_SET-1);
+        quat_mul(quat_r[j], quat_a[j], quat_b[j]);
+    }
+    sink = quat_r[0][0];
+    return n;
+}
+
+static size_t bench_mat4x4_from_quat(size_t n)
+{
+    for (size_t i = 0; i < n; i++) {
+        size_t j = i & (BENCH_SET-1);
+        mat4x4_from_quat(mat_r[j], quat_a[j]);
+    }
+    sink = mat_r[0][0][0];
+    return n;
+}
+
+static size_t bench_model_matrix_transform(size_t n)
+{
+    for (size_t i = 0; i < n; i++) {
+        size_t j = i & (BENCH_SET-1);
+        mat4x4_identity(mat_r[j]);
+        mat4x4_scale_aniso(mat_r[j], mat_r[j], trs_s[j][0], trs_s[j][1], trs_s[j][2]);
+        mat4x4_translate_in_place(mat_r[j], trs_t[j][0], trs_t[j][1], trs_t[j][2]);
+        mat4x4_rotate_X(mat_r[j], mat_r[j], trs_r[j][0]);
+        mat4x4_rotate_Y(mat_r[j], mat_r[j], trs_r[j][1]);
+        mat4x4_rotate_Z(mat_r[j], mat_r[j], trs_r[j][2]);
+    }
+    sink = mat_r[0][0][0];
+    return n;
+}
+
+/* the same matrices as model_matrix_transform, composed in batches */
+static size_t bench_mat4x4_compose_euler_n(size_t n)
+{
+    for (size_t i = 0; i < n; i += BENCH_SET) {
+        mat4x4_compose_euler_n(mat_r, NULL, trs_s, trs_t, trs_r, BENCH_SET);
+    }
+    sink = mat_r[0][0][0];
+    return (n + BENCH_SET - 1) & ~(size_t)(BENCH_SET-1);
+}
+
+/* with normal matrices, as scene_graph_update composes them */
+static size_t bench_mat4x4_compose_euler_n_normal(size_t n)
+{
+    for (size_t i = 0; i < n; i += BENCH_SET) {
+        mat4x4_compose_euler_n(mat_r, mat_b, trs_s, trs_t, trs_r, BENCH_SET);
+    }
+    sink = mat_r[0][0][0] + mat_b[0][0][0];
+    return (n + BENCH_SET - 1) & ~(size_t)(BENCH_SET-1);
+}
+
+static size_t bench_mat4x4_mul_vec3_soa(size_t n)
+{
+    static float x[BENCH_SET], y[BENCH_SET], z[BENCH_SET];
+    for (size_t i = 0; i < n; i += BENCH_SET) {
+        mat4x4_mul_vec3_soa(x, y, z, mat_a[i & (BENCH_SET-1)],
+            soa_x, soa_y, soa_z, 1.f, BENCH_SET);
+    }
+    sink = x[0];
+    return (n + BENCH_SET - 1) & ~(size_t)(BENCH_SET-1);
+}
+
+static size_t bench_frustum_cull_spheres(size_t n)
+{
+    mat4x4 p, v, pv;
+    frustum_t f;
+    size_t count = 0;
+    mat4x4_frustum(p, -1.f, 1.f, -1.f, 1.f, 5.f, 1e9f);
+    mat4x4_translate(v, 0.f, 0.f, -100.f);
+    mat4x4_mul(pv, p, v);
+    frustum_from_matrix(&f, pv);
+    for (size_t i = 0; i < n; i += BENCH_SET) {
+        count += frustum_cull_spheres(&f, visible, soa_x, soa_y, soa_z,
+            soa_w, BENCH_SET);
+    }
+    sink = (float)count;
+    return (n + BENCH_SET - 1) & ~(size_t)(BENCH_SET-1);
+}
+
+/* a 4-ary tree of BENCH_SET * 16 nodes with one in 64 nodes animated */
+static size_t bench_scene_graph_update(size_t n)
+{
+    scene_graph_t sg;
+    size_t nodes = BENCH_SET * 16, moved = 0;
+    scene_graph_init(&sg, nodes);
+    for (size_t i = 0; i < nodes; i++) {
+        uint k = scene_graph_add(&sg, i == 0 ? SCENE_NODE_NONE : (uint)(i - 1) / 4);
+        size_t j = i & (BENCH_SET-1);
+        scene_graph_set_trs(&sg, k, trs_s[j], trs_t[j], trs_r[j]);
+    }
+    scene_graph_update(&sg);
+    for (size_t i = 0; moved < n; i++) {
+        for (size_t j = i & 63; j < nodes; j += 64) {
+            scene_graph_set_rotation(&sg, (uint)j, trs_r[(i + j) & (BENCH_SET-1)]);
+        }
+        moved += scene_graph_update(&sg);
+    }
+    sink = sg.world[nodes-1][3][0];
+    scene_graph_destroy(&sg);
+    return moved;
+}
+
+/* steady state churn: each op adds one object and removes another */
+static size_t bench_object_store_add_remove(size_t n)
+{
+    object_store_t os;
+    object_id ids[BENCH_SET];
+    object_store_init(&os, BENCH_SET);
+    for (size_t i = 0; i < BENCH_SET; i++) {
+        ids[i] = object_store_add(&os);
+    }
+    for (size_t i = 0; i < n; i++) {
+        size_t j = (i * 97) & (BENCH_SET-1);
+        object_store_remove(&os, ids[j]);
+        ids[j] = object_store_add(&os);
+    }
+    sink = (float)object_store_count(&os);
+    object_store_destroy(&os);
+    return n;
+}
+
+static void bench_compose_job(job_t *job, void *arg, size_t begin, size_t end)
+{
+    mat4x4 *m = (mat4x4*)arg;
+    for (size_t i = begin; i < end; i += BENCH_SET) {
+        mat4x4_compose_euler_n(m + i, NULL, trs_s, trs_t, trs_r, BENCH_SET);
+    }
+}
+
+/* mat4x4_compose_euler_n split across the job system in 1024 item chunks */
+static size_t bench_job_parallel_for(size_t n)
+{
+    size_t items = BENCH_SET * 64, done = 0;
+    mat4x4 *m = (mat4x4*)malloc(items * sizeof(mat4x4));
+    for (; done < n; done += items) {
+        job_parallel_for(&jobs, bench_compose_job, m, items, 1024);
+    }
+    sink = m[items-1][0][0];
+    free(m);
+    return done;
+}
+
+static size_t bench_array_buffer_add_with(size_t n, array_allocator *alloc,
+    size_t reserve)
+{
+    array_buffer ab;
+    float v[4] = { 1.f, 2.f, 3.f, 4.f };
+    array_buffer_init_alloc(&ab, sizeof(v), 16, alloc);
+    array_buffer_reserve(&ab, reserve);
+    for (size_t i = 0; i < n; i++) {
+        array_buffer_add(&ab, v);
+    }
+    sink = ((float*)array_buffer_data(&ab))[n-1];
+    array_buffer_destroy(&ab);
+    return n;
+}
+
+static size_t bench_array_buffer_add(size_t n)
+{
+    return bench_array_buffer_add_with(n, NULL, 0);
+}
+
+static size_t bench_array_buffer_add_reserve(size_t n)
+{
+    return bench_array_buffer_add_with(n, NULL, n);
+}
+
+static size_t bench_array_buffer_add_arena(size_t n)
+{
+    array_arena arena;
+    array_arena_init(&arena, 0);
+    bench_array_buffer_add_with(n, &arena.alloc, 0);
+    array_arena_destroy(&arena);
+    return n;
+}
+
+static size_t bench_array_buffer_add_vm(size_t n)
+{
+    return bench_array_buffer_add_with(n, array_allocator_vm(), 0);
+}
+
+static size_t bench_vertex_buffer_push(size_t n)
+{
+    vertex_buffer vb;
+    vertex v = { { 1, 2, 3 }, { 0, 0, 1 }, { 0, 1 }, { 1, 1, 1, 1 } };
+    vertex_buffer_init(&vb);
+    for (size_t i = 0; i < n; i++) {
+        vertex_buffer_push(&vb, v);
+    }
+    sink = vertex_buffer_at(&vb, n-1).pos.x;
+    vertex_buffer_destroy(&vb);
+    return n;
+}
+
+static size_t bench_index_buffer_narrow(size_t n)
+{
+    index_buffer ib;
+    index_buffer_init(&ib);
+    index_buffer_add_primitves(&ib, primitive_topology_quads, (uint)(n / 6), 0);
+    for (size_t i = 0; i < ib.count; i++) {
+        index_buffer_at(&ib, i) &= 0xffff;
+    }
+    ib.max_index = 0xffff;
+    index_buffer_narrow(&ib);
+    sink = (float)index_buffer_get(&ib, ib.count - 1);
+    index_buffer_destroy(&ib);
+    return n;
+}
+
+static size_t bench_vertex_pack_n(size_t n)
+{
+    size_t items = BENCH_SET * 16, done = 0;
+    vertex *src = (vertex*)malloc(items * sizeof(vertex));
+    vertex_packed *dst = (vertex_packed*)malloc(items * sizeof(vertex_packed));
+    vec3 center = { 0.f, 0.f, 0.f }, extent = { 2.f, 2.f, 2.f };
+    vec4 uv_dequant = { 1.f, 1.f, 0.f, 0.f };
+    for (size_t i = 0; i < items; i++) {
+        float a = (float)i * 0.01f;
+        src[i] = (vertex){ { sinf(a), cosf(a), a - floorf(a) },
+            { cosf(a), 0.f, sinf(a) }, { a - floorf(a), 0.5f }, { 1, 1, 1, 1 } };
+    }
+    for (; done < n; done += items) {
+        vertex_pack_n(dst, src, center, extent, uv_dequant, items);
+    }
+    sink = (float)dst[items-1].norm[0];
+    free(src);
+    free(dst);
+    return done;
+}
+
+static size_t bench_index_offset_n(size_t n)
+{
+    size_t items = BENCH_SET * 16, done = 0;
+    uint *src = (uint*)malloc(items * sizeof(uint));
+    uint *dst = (uint*)malloc(items * sizeof(uint));
+    for (size_t i = 0; i < items; i++) src[i] = (uint)i;
+    for (; done < n; done += items) {
+        index_offset_n(dst, src, (uint)done, items);
+    }
+    sink = (float)dst[items-1];
+    free(src);
+    free(dst);
+    return done;
+}
+
+static size_t bench_index_buffer_add_primitves(size_t n)
+{
+    index_buffer ib;
+    index_buffer_init(&ib);
+    index_buffer_add_primitves(&ib, primitive_topology_quads, (uint)n, 0);
+    sink = (float)((uint*)index_buffer_data(&ib))[index_buffer_count(&ib)-1];
+    index_buffer_destroy(&ib);
+    return n;
+}
+
+/* the face loop of model_object_cube, repeated to build a larger mesh */
+static void bench_mesh_cube(vertex_buffer *vb, index_buffer *ib, float s)
+{
+    const float f[6][3][3] = {
+        /* front */  { { 1, 0, 0 }, { 0, 1, 0 }, { 0, 0, 1 }, },
+        /* right */  { { 0, 0, 1 }, { 1, 0, 0 }, { 0, 1, 0 }, },
+        /* top */    { { 0, 1, 0 }, { 0, 0, 1 }, { 1, 0, 0 }, },
+        /* rear */   { { 0, 1, 0 }, { 1, 0, 0 }, { 0, 0,-1 }, },
+        /* left */   { { 0, 0,-1 }, { 0, 1, 0 }, { 1, 0, 0 }, },
+        /* bottom */ { { 1, 0, 0 }, { 0, 0,-1 }, { 0, 1, 0 }, },
+    };
+
+    const vertex t[4] = {
+        { { -s,  s,  s }, { 0, 0, 1 }, { 0, 1 }, { 1, 1, 1, 1 } },
+        { { -s, -s,  s }, { 0, 0, 1 }, { 0, 0 }, { 1, 1, 1, 1 } },
+        { {  s, -s,  s }, { 0, 0, 1 }, { 1, 0 }, { 1, 1, 1, 1 } },
+        { {  s,  s,  s }, { 0, 0, 1 }, { 1, 1 }, { 1, 1, 1, 1 } },
+    };
+
+    uint idx = vertex_buffer_count(vb);
+    for (int i = 0; i < 6; i++) {
+        mat4x4 m = {
+            { f[i][0][0], f[i][1][0], f[i][2][0], 0 },
+            { f[i][0][1], f[i][1][1], f[i][2][1], 0 },
+            { f[i][0][2], f[i][1][2], f[i][2][2], 0 },
+            { 0, 0, 0, 1 },
+        };
+        uint face = vertex_buffer_add_n(vb, t, 4);
+        vertex_buffer_transform(vb, m, m, face, 4);
+    }
+    index_buffer_add_primitves(ib, primitive_topology_quads, 6, idx);
+}
+
+static size_t bench_mesh_cubes(size_t n)
+{
+    vertex_buffer vb;
+    index_buffer ib;
+    size_t cubes = (n + 23) / 24;
+    vertex_buffer_init(&vb);
+    index_buffer_init(&ib);
+    for (size_t i = 0; i < cubes; i++) {
+        bench_mesh_cube(&vb, &ib, 1.f);
+    }
+    sink = ((vertex*)vertex_buffer_data(&vb))->pos.x;
+    vertex_buffer_destroy(&vb);
+    index_buffer_destroy(&ib);
+    return cubes * 24;
+}
+
+/* an n by n grid of quads with its triangles shuffled */
+static void bench_mesh_grid(vertex_buffer *vb, index_buffer *ib, uint n)
+{
+    vertex_buffer_reserve(vb, (n + 1) * (n + 1));
+    for (uint y = 0; y <= n; y++) {
+        for (uint x = 0; x <= n; x++) {
+            vertex v = { { (float)x, (float)y, 0 }, { 0, 0, 1 },
+                { (float)x / n, (float)y / n }, { 1, 1, 1, 1 } };
+            vertex_buffer_push(vb, v);
+        }
+    }
+    for (uint y = 0; y < n; y++) {
+        for (uint x = 0; x < n; x++) {
+            uint a = y * (n + 1) + x, b = a + n + 1;
+            uint quad[6] = { a, b, b + 1, a, b + 1, a + 1 };
+            index_buffer_add(ib, quad, 6, 0);
+        }
+    }
+    uint *tri = (uint*)index_buffer_data(ib), seed = 1;
+    for (size_t i = index_buffer_count(ib) / 3 - 1; i > 0; i--) {
+        seed = seed * 1103515245u + 12345u;
+        size_t j = (seed >> 8) % (i + 1);
+        for (int k = 0; k < 3; k++) {
+            uint t = tri[i * 3 + k];
+            tri[i * 3 + k] = tri[j * 3 + k];
+            tri[j * 3 + k] = t;
+        }
+    }
+}
+
+/* ops are triangles */
+static size_t bench_mesh_optimize(size_t n)
+{
+    vertex_buffer vb;
+    index_buffer ib;
+    uint side = (uint)sqrt((double)(n / 2)) + 1;
+    vertex_buffer_init(&vb);
+    index_buffer_init(&ib);
+    bench_mesh_grid(&vb, &ib, side);
+    mesh_optimize(&vb, &ib, NULL, NULL);
+    sink = (float)index_buffer_get(&ib, 0);
+    vertex_buffer_destroy(&vb);
+    index_buffer_destroy(&ib);
+    return (size_t)side * side * 2;
+}
+
+/* ops are vertices, the grid is unwelded with four vertices per quad */
+static size_t bench_mesh_weld(size_t n)
+{
+    vertex_buffer vb;
+    index_buffer ib;
+    uint side = (uint)sqrt((double)(n / 4)) + 1;
+    vertex_buffer_init(&vb);
+    index_buffer_init(&ib);
+    for (uint y = 0; y < side; y++) {
+        for (uint x = 0; x < side; x++) {
+            uint base = vertex_buffer_count(&vb);
+            for (uint k = 0; k < 4; k++) {
+                vertex v = { { (float)(x + (k >> 1)), (float)(y + ((k ^ (k >> 1)) & 1)), 0 },
+                    { 0, 0, 1 }, { 0, 0 }, { 1, 1, 1, 1 } };
+                vertex_buffer_push(&vb, v);
+            }
+            index_buffer_add_primitves(&ib, primitive_topology_quads, 1, base);
+        }
+    }
+    sink = (float)mesh_weld(&vb, &ib, 0.f, &jobs);
+    vertex_buffer_destroy(&vb);
+    index_buffer_destroy(&ib);
+    return (size_t)side * side * 4;
+}
+
+/* ops are triangles, clustered in shuffled order */
+static size_t bench_meshlet_build(size_t n)
+{
+    vertex_buffer vb;
+    index_buffer ib;
+    meshlet_set ms;
+    uint side = (uint)sqrt((double)(n / 2)) + 1;
+    vertex_buffer_init(&vb);
+    index_buffer_init(&ib);
+    meshlet_set_init(&ms);
+    bench_mesh_grid(&vb, &ib, side);
+    sink = (float)meshlet_build(&ms, &vb, &ib,
+        MESHLET_MAX_VERTICES, MESHLET_MAX_TRIANGLES);
+    meshlet_set_destroy(&ms);
+    vertex_buffer_destroy(&vb);
+    index_buffer_destroy(&ib);
+    return (size_t)side * side * 2;
+}
+
+/* ops are input triangles, simplified to a quarter of the triangles */
+static size_t bench_mesh_simplify(size_t n)
+{
+    vertex_buffer vb;
+    index_buffer ib;
+    uint side = (uint)sqrt((double)(n / 2)) + 1;
+    vertex_buffer_init(&vb);
+    index_buffer_init(&ib);
+    bench_mesh_grid(&vb, &ib, side);
+    uint *dst = (uint*)malloc(ib.count * sizeof(uint));
+    sink = (float)mesh_simplify(dst, (const uint*)ib.data, ib.count,
+        (const vertex*)vb.data, vb.count, ib.count / 4, 1.f, NULL);
+    free(dst);
+    vertex_buffer_destroy(&vb);
+    index_buffer_destroy(&ib);
+    return (size_t)side * side * 2;
+}
+
+/* ops are vertices, written to a cache file, mapped and read back */
+static size_t bench_mesh_cache(size_t n)
+{
+    static const char *filename = "glcube_bench.mesh";
+    vertex_buffer vb;
+    index_buffer ib;
+    mesh_cache mc;
+    mat4x4 dequant;
+    vec4 uv_dequant, bounds = { 0.f, 0.f, 0.f, 1.f };
+    uint side = (uint)sqrt((double)n);
+    vertex_buffer_init(&vb);
+    index_buffer_init(&ib);
+    bench_mesh_grid(&vb, &ib, side > 1 ? side - 1 : 1);
+    vertex_dequant_identity(dequant, uv_dequant);
+    if (mesh_cache_write(filename, mesh_layout_vertex, MESH_LAYOUT_ATTRIBS,
+            &vb, &ib, NULL, NULL, bounds, dequant, uv_dequant, NULL, 0) == 0 &&
+            mesh_cache_map(&mc, filename) == 0) {
+        const vertex *v = (const vertex*)mc.vertices;
+        for (uint i = 0; i < mc.header->vertex_count; i++) {
+            sink += v[i].pos.x;
+        }
+        mesh_cache_unmap(&mc);
+    }
+    remove(filename);
+    size_t count = vb.count;
+    vertex_buffer_destroy(&vb);
+    index_buffer_destroy(&ib);
+    return count;
+}
+
+/* a grid mesh and its encoded streams, kept between repetitions */
+typedef struct bench_encoded {
+    uint side;
+    size_t vertex_count, index_count;
+    unsigned char *vertices, *indices;
+    size_t vertex_size, index_size;
+} bench_encoded_t;
+
+static const bench_encoded_t* bench_mesh_encoded(uint side)
+{
+    static bench_encoded_t e;
+    if (e.side != side) {
+        vertex_buffer vb;
+        index_buffer ib;
+        vertex_buffer_init(&vb);
+        index_buffer_init(&ib);
+        bench_mesh_grid(&vb, &ib, side);
+        size_t vbound = mesh_encode_vertex_bound(vb.count, sizeof(vertex));
+        size_t ibound = mesh_encode_index_bound(ib.count);
+        e.vertices = (unsigned char*)realloc(e.vertices, vbound);
+        e.indices = (unsigned char*)realloc(e.indices, ibound);
+        e.vertex_size = mesh_encode_vertices(e.vertices, vbound, vb.data,
+            vb.count, sizeof(vertex));
+        e.index_size = mesh_encode_indices(e.indices, ibound,
+            (const uint*)ib.data, ib.count);
+        e.vertex_count = vb.count;
+        e.index_count = ib.count;
+        e.side = side;
+        vertex_buffer_destroy(&vb);
+        index_buffer_destroy(&ib);
+    }
+    return &e;
+}
+
+/* ops are vertices, decoded from a compressed vertex stream */
+static size_t bench_mesh_decode_vertices(size_t n)
+{
+    uint side = (uint)sqrt((double)n);
+    const bench_encoded_t *e = bench_mesh_encoded(side > 1 ? side - 1 : 1);
+    static vertex *dst;
+    static size_t dst_count;
+    if (dst_count < e->vertex_count) {
+        dst = (vertex*)realloc(dst, e->vertex_count * sizeof(vertex));
+        dst_count = e->vertex_count;
+    }
+    sink += (float)mesh_decode_vertices(dst, e->vertex_count, sizeof(vertex),
+        e->vertices, e->vertex_size);
+    sink += dst[e->vertex_count - 1].pos.x;
+    return e->vertex_count;
+}
+
+/* ops are triangles, decoded from a compressed index stream */
+static size_t bench_mesh_decode_indices(size_t n)
+{
+    uint side = (uint)sqrt((double)(n / 2)) + 1;
+    const bench_encoded_t *e = bench_mesh_encoded(side);
+    static uint *dst;
+    static size_t dst_count;
+    if (dst_count < e->index_count) {
+        dst = (uint*)realloc(dst, e->index_count * sizeof(uint));
+        dst_count = e->index_count;
+    }
+    sink += (float)mesh_decode_indices(dst, e->index_count, sizeof(uint),
+        e->vertex_count, e->indices, e->index_size);
+    return e->index_count / 3;
+}
+
+/* a grid of side squares as OBJ text, kept between repetitions */
+static const char* bench_obj_grid(uint side, size_t *size)
+{
+    static char *text;
+    static size_t text_size;
+    static uint text_side;
+    if (text_side != side) {
+        size_t cap = ((size_t)(side + 1) * (side + 1) + (size_t)side * side * 2) * 48;
+        text = (char*)realloc(text, cap);
+        text_size = 0;
+        for (uint y = 0; y <= side; y++) {
+            for (uint x = 0; x <= side; x++) {
+                text_size += snprintf(text + text_size, cap - text_size,
+                    "v %.6f %.6f %.6f\n", x * 0.01f, y * 0.01f, sinf(x * 0.1f));
+            }
+        }
+        for (uint y = 0; y < side; y++) {
+            for (uint x = 0; x < side; x++) {
+                uint a = y * (side + 1) + x + 1, b = a + side + 1;
+                text_size += snprintf(text + text_size, cap - text_size,
+                    "f %u %u %u\nf %u %u %u\n", a, a + 1, b + 1, a, b + 1, b);
+            }
+        }
+        text_side = side;
+    }
+    *size = text_size;
+    return text;
+}
+
+/* ops are triangles, parsed from OBJ text */
+static size_t bench_mesh_import_obj(size_t n)
+{
+    vertex_buffer vb;
+    index_buffer ib;
+    size_t size;
+    uint side = (uint)sqrt((double)(n / 2)) + 1;
+    const char *text = bench_obj_grid(side, &size);
+    vertex_buffer_init(&vb);
+    index_buffer_init(&ib);
+    sink += (float)mesh_import_obj(&vb, &ib, text, size, &jobs);
+    size_t count = ib.count / 3;
+    vertex_buffer_destroy(&vb);
+    index_buffer_destroy(&ib);
+    return count;
+}
+
+/* ops are instances, written to a binary scene and streamed back */
+static size_t bench_scene_read(size_t n)
+{
+    static const char *filename = "glcube_bench.scene";
+    static const char * const meshes[] = { "cube" };
+    scene_writer sw;
+    scene_reader sr;
+    scene_instance *batch = (scene_instance*)calloc(4096, sizeof(scene_instance));
+    size_t count = 0;
+    for (size_t i = 0; i < 4096; i++) {
+        batch[i].pos[0] = (float)i;
+        batch[i].scale = 1.f;
+    }
+    if (scene_writer_open(&sw, filename, meshes, 1) == 0) {
+        for (size_t i = 0; i < n; i += 4096) {
+            scene_writer_add(&sw, batch, n - i < 4096 ? n - i : 4096);
+        }
+        scene_writer_close(&sw);
+    }
+    if (scene_reader_open(&sr, filename) == 0) {
+        size_t k;
+        while ((k = scene_reader_read(&sr, batch, 4096)) > 0) {
+            sink += batch[k - 1].pos[0];
+            count += k;
+        }
+        scene_reader_close(&sr);
+    }
+    remove(filename);
+    free(batch);
+    return count;
+}
+
+/* ops are level 0 pixels, filtered down to a full rgba8 mip chain */
+static size_t bench_texture_build_mips(size_t n)
+{
+    texture_image ti;
+    uint side = (uint)sqrt((double)n);
+    if (side > TEXTURE_SIZE_MAX) side = TEXTURE_SIZE_MAX;
+    if (side < 1) side = 1;
+    memset(&ti, 0, sizeof(ti));
+    if (texture_image_alloc(&ti, texture_rgba8, side, side, 1) < 0) return 0;
+    for (size_t i = 0; i < ti.size; i++) {
+        ti.data[i] = (unsigned char)(i * 7);
+    }
+    texture_image_build_mips(&ti);
+    sink += ti.data[ti.size - 1];
+    texture_image_destroy(&ti);
+    return (size_t)side * side;
+}
+
+/*
+ * a mapped pack of 64 small files, built once in a scratch directory.
+ * the pack stays mapped after its files and directory are removed.
+ */
+typedef struct bench_pack {
+    int built, ok;
+    char names[64][32];
+    const char *list[64];
+    pack_file pk;
+} bench_pack_t;
+
+static const bench_pack_t* bench_pack()
+{
+    static bench_pack_t b;
+    char dir[64], path[128];
+    if (b.built) return &b;
+    b.built = 1;
+    snprintf(dir, sizeof(dir), "%s/glcube_bench.XXXXXX",
+        getenv("TMPDIR") ? getenv("TMPDIR") : "/tmp");
+    if (!mkdtemp(dir)) {
+        fprintf(stderr, "error: %s: %s\n", dir, strerror(errno));
+        return &b;
+    }
+    for (int i = 0; i < 64; i++) {
+        snprintf(b.names[i], sizeof(b.names[i]), "glcube_bench.%d.fsh", i);
+        b.list[i] = b.names[i];
+        snprintf(path, sizeof(path), "%s/%s", dir, b.names[i]);
+        FILE *f = fopen(path, "w");
+        if (f) {
+            fprintf(f, "// %d\n", i);
+            fclose(f);
+        }
+    }
+    snprintf(path, sizeof(path), "%s/glcube_bench.pack", dir);
+    b.ok = pack_file_write(path, dir, b.list, 64) == 0 &&
+        pack_file_open(&b.pk, path) == 0;
+    if (!b.ok) {
+        fprintf(stderr, "error: %s: %s\n", path, strerror(errno));
+    }
+    remove(path);
+    for (int i = 0; i < 64; i++) {
+        snprintf(path, sizeof(path), "%s/%s", dir, b.names[i]);
+        remove(path);
+    }
+    rmdir(dir);
+    return &b;
+}
+
+/* ops are lookups by name in a mapped pack of 64 small files */
+static size_t bench_pack_find(size_t n)
+{
+    const bench_pack_t *b = bench_pack();
+    buffer view;
+    size_t count = 0;
+    if (!b->ok) return 0;
+    for (size_t i = 0; i < n; i++) {
+        if (pack_file_find(&b->pk, b->list[i & 63], &view) == 0) {
+            sink += (float)view.length;
+            count++;
+        }
+    }
+    return count;
+}
+
+static const bench_def_t benchmarks[] = {
+    { "mat4x4_mul", bench_mat4x4_mul },
+    { "mat4x4_mul_vec4", bench_mat4x4_mul_vec4 },
+    { "mat4x4_invert", bench_mat4x4_invert },
+    { "mat4x4_rotate_xyz", bench_mat4x4_rotate },
+    { "quat_mul", bench_quat_mul },
+    { "mat4x4_from_quat", bench_mat4x4_from_quat },
+    { "model_matrix_transform", bench_model_matrix_transform },
+    { "mat4x4_compose_euler_n", bench_mat4x4_compose_euler_n },
+    { "mat4x4_compose_euler_normal", bench_mat4x4_compose_euler_n_normal },
+    { "mat4x4_mul_vec3_soa", bench_mat4x4_mul_vec3_soa },
+    { "frustum_cull_spheres", bench_frustum_cull_spheres },
+    { "scene_graph_update", bench_scene_graph_update },
+    { "object_store_add_remove", bench_object_store_add_remove },
+    { "job_parallel_for", bench_job_parallel_for },
+    { "array_buffer_add", bench_array_buffer_add },
+    { "array_buffer_add_reserve", bench_array_buffer_add_reserve },
+    { "array_buffer_add_arena", bench_array_buffer_add_arena },
+    { "array_buffer_add_vm", bench_array_buffer_add_vm },
+    { "vertex_buffer_push", bench_vertex_buffer_push },
+    { "index_offset_n", bench_index_offset_n },
+    { "vertex_pack_n", bench_vertex_pack_n },
+    { "index_buffer_narrow", bench_index_buffer_narrow },
+    { "index_buffer_add_primitves", bench_index_buffer_add_primitves },
+    { "mesh_cube_vertices", bench_mesh_cubes },
+    { "mesh_optimize", bench_mesh_optimize },
+    { "mesh_weld", bench_mesh_weld },
+    { "meshlet_build", bench_meshlet_build },
+    { "mesh_simplify", bench_mesh_simplify },
+    { "mesh_cache", bench_mesh_cache },
+    { "mesh_decode_vertices", bench_mesh_decode_vertices },
+    { "mesh_decode_indices", bench_mesh_decode_indices },
+    { "mesh_import_obj", bench_mesh_import_obj },
+    { "scene_read", bench_scene_read },
+    { "texture_build_mips", bench_texture_build_mips },
+    { "pack_find", bench_pack_find },
+};
+
+static int compare_double(const void *a, const void *b)
+{
+    double x = *(const double*)a, y = *(const double*)b;
+    return x < y ? -1 : x > y ? 1 : 0;
+}
+
+static bench_result_t bench_run(const bench_def_t *def)
+{
+    bench_result_t r = { def->name };
+    double *ns = (double*)malloc(sizeof(double) * opt_reps);
+    double *cy = (double*)malloc(sizeof(double) * opt_reps);
+
+    def->fn(opt_ops);
+    for (int i = 0; i < opt_reps; i++) {
+        double t0 = now_ns();
+        unsigned long long c0 = now_cycles();
+        size_t ops = def->fn(opt_ops);
+        unsigned long long c1 = now_cycles();
+        double t1 = now_ns();
+        ns[i] = (t1 - t0) / (double)ops;
+        cy[i] = (double)(c1 - c0) / (double)ops;
+        r.ops = ops;
+    }
+    qsort(ns, opt_reps, sizeof(double), compare_double);
+    qsort(cy, opt_reps, sizeof(double), compare_double);
+    r.ns_min = ns[0];
+    r.ns_median = ns[opt_reps/2];
+    r.cycles_min = cy[0];
+    r.cycles_median = cy[opt_reps/2];
+
+    free(ns);
+    free(cy);
+    return r;
+}
+
+static const char* bench_simd()
+{
+#if defined(LINMATH_AVX2)
+    return "avx2";
+#elif defined(LINMATH_SSE2)
+    return "sse2";
+#else
+    return "scalar";
+#endif
+}
+
+static void print_result(const bench_result_t *r, bool first)
+{
+    if (opt_json) {
+        printf("%s    { \"name\": \"%s\", \"ops\": %zu, "
+            "\"ns_per_op\": %.3f, \"ns_per_op_median\": %.3f, "
+            "\"cycles_per_op\": %.3f, \"cycles_per_op_median\": %.3f }",
+            first ? "" : ",\n", r->name, r->ops, r->ns_min, r->ns_median,
+            r->cycles_min, r->cycles_median);
+    } else {
+        printf("%-28s %12zu %10.3f %10.3f %10.3f %10.3f\n",
+            r->name, r->ops, r->ns_min, r->ns_median,
+            r->cycles_min, r->cycles_median);
+    }
+}
+
+static void print_help(int argc, char **argv)
+{
+    fprintf(stderr,
+        "Usage: %s [options]\n"
+        "\n"
+        "Options:\n"
+        "  -n, --ops <count>                  operations per repetition\n"
+        "  -r, --reps <count>                 timed repetitions\n"
+        "  -f, --filter <substring>           run matching benchmarks\n"
+        "  -t, --threads <count>              job system threads (default: cpus)\n"
+        "  -j, --json                         JSON output\n"
+        "  -h, --help                         command line help\n",
+        argv[0]);
+}
+
+static int match_opt(const char *arg, const char *opt, const char *longopt)
+{
+    return strcmp(arg, opt) == 0 || strcmp(arg, longopt) == 0;
+}
+
+static void parse_options(int argc, char **argv)
+{
+    int i = 1;
+    while (i < argc) {
+        if (match_opt(argv[i], "-n", "--ops") && i + 1 < argc) {
+            opt_ops = (size_t)strtoull(argv[i+1], NULL, 10);
+            i += 2;
+        } else if (match_opt(argv[i], "-r", "--reps") && i + 1 < argc) {
+            opt_reps = atoi(argv[i+1]);
+            i += 2;
+        } else if (match_opt(argv[i], "-f", "--filter") && i + 1 < argc) {
+            opt_filter = argv[i+1];
+            i += 2;
+        } else if (match_opt(argv[i], "-t", "--threads") && i + 1 < argc) {
+            opt_threads = atoi(argv[i+1]);
+            i += 2;
+        } else if (match_opt(argv[i], "-j", "--json")) {
+            opt_json = 1;
+            i++;
+        } else if (match_opt(argv[i], "-h", "--help")) {
+            help = 1;
+            i++;
+        } else {
+            fprintf(stderr, "error: unknown option: %s\n", argv[i]);
+            help = 1;
+            break;
+        }
+    }
+
+    if (opt_ops == 0 || opt_reps <= 0) {
+        fprintf(stderr, "error: ops and reps must be positive\n");
+        help = 1;
+    }
+
+    if (help) {
+        print_help(argc, argv);
+        exit(1);
+    }
+}
+
+int main(int argc, char *argv[])
+{
+    bool first = 1;
+
+    parse_options(argc, argv);
+    bench_init();
+    job_system_init(&jobs, opt_threads);
+
+    if (opt_json) {
+        printf("{\n  \"simd\": \"%s\",\n  \"reps\": %d,\n  \"threads\": %d,\n"
+            "  \"results\": [\n", bench_simd(), opt_reps, job_system_threads(&jobs));
+    } else {
+        printf("# simd=%s reps=%d threads=%d\n", bench_simd(), opt_reps,
+            job_system_threads(&jobs));
+        printf("%-28s %12s %10s %10s %10s %10s\n", "benchmark", "ops",
+            "ns/op", "ns/op(med)", "cyc/op", "cyc/op(med)");
+    }
+
+    for (size_t i = 0; i < sizeof(benchmarks)/sizeof(benchmarks[0]); i++) {
+        if (opt_filter && !strstr(benchmarks[i].name, opt_filter)) continue;
+        bench_result_t r = bench_run(&benchmarks[i]);
+        print_result(&r, first);
+        first = 0;
+    }
+
+    if (opt_json) {
+        printf("\n  ]\n}\n");
+    }
+
+    job_system_destroy(&jobs);
+    exit(EXIT_SUCCESS);
+}
@@ -0,0 +1,111 @@
+/*
+ * glcube_pack
+ *
+ * builds the asset pack read by pack_file.h from files named relative to
+ * a root directory, and optionally a C array of the pack for embedding.
+ */
+
+#include <stdlib.h>
+#include <stdio.h>
+#include <string.h>
+#include <assert.h>
+#include <errno.h>
+#include <sys/stat.h>
+#include <sys/mman.h>
+#include <fcntl.h>
+#include <unistd.h>
+
+#include <math.h>
+#include <stdbool.h>
+
+#define GL2_UTIL_NO_GL
+#include "linmath.h"
+#include "gl2_util.h"
+#include "pack_file.h"
+
+static const char *opt_output;
+static const char *opt_source;
+static const char *opt_symbol = "glcube_pack_data";
+static const char *opt_root;
+
+static void print_help(int argc, char **argv)
+{
+    fprintf(stderr,
+        "Usage: %s [options] <file>...\n"
+        "\n"
+        "Options:\n"
+        "  -o, --output <file>                pack file to write\n"
+        "  -C, --root <dir>                   directory files are read from\n"
+        "  -e, --embed <file>                 also write the pack as a C array\n"
+        "  -n, --symbol <name>                name of the C array\n"
+        "  -h, --help                         command line help\n",
+        argv[0]);
+}
+
+static int match_opt(const char *arg, const char *opt, const char *longopt)
+{
+    return strcmp(arg, opt) == 0 || strcmp(arg, longopt) == 0;
+}
+
+static int parse_options(int argc, char **argv)
+{
+    int i = 1;
+    bool help = false;
+    while (i < argc && argv[i][0] == '-') {
+        if (match_opt(argv[i], "-o", "--output") && i + 1 < argc) {
+            opt_output = argv[i+1];
+            i += 2;
+        } else if (match_opt(argv[i], "-C", "--root") && i + 1 < argc) {
+            opt_root = argv[i+1];
+            i += 2;
+        } else if (match_opt(argv[i], "-e", "--embed") && i + 1 < argc) {
+            opt_source = argv[i+1];
+            i += 2;
+        } else if (match_opt(argv[i], "-n", "--symbol") && i + 1 < argc) {
+            opt_symbol = argv[i+1];
+            i += 2;
+        } else if (match_opt(argv[i], "-h", "--help")) {
+            help = true;
+            i++;
+        } else {
+            fprintf(stderr, "error: unknown option: %s\n", argv[i]);
+            help = true;
+            break;
+        }
+    }
+
+    if (!help && !opt_output) {
+        fprintf(stderr, "error: missing output file\n");
+        help = true;
+    }
+
+    if (help) {
+        print_help(argc, argv);
+        exit(1);
+    }
+    return i;
+}
+
+int main(int argc, char *argv[])
+{
+    pack_file pk;
+    int first = parse_options(argc, argv);
+
+    if (pack_file_write(opt_output, opt_root, (const char * const *)argv + first,
+            (uint)(argc - first)) < 0) {
+        fprintf(stderr, "error: writing %s: %s\n", opt_output, strerror(errno));
+        exit(1);
+    }
+    if (opt_source) {
+        if (pack_file_open(&pk, opt_output) < 0) {
+            fprintf(stderr, "error: reading %s: %s\n", opt_output, strerror(errno));
+            exit(1);
+        }
+        if (pack_file_write_source(opt_source, opt_symbol, &pk) < 0) {
+            fprintf(stderr, "error: writing %s: %s\n", opt_source, strerror(errno));
+            exit(1);
+        }
+        pack_file_close(&pk);
+    }
+    exit(0);
+}
@@ -0,0 +1,2089 @@
+/*
+ * glcube_test
+ *
+ * deterministic checks for the linmath.h kernels, the job system and the
+ * file formats and codecs in the headers. each test is run by ctest by
+ * name, and with no arguments every test is run. a failed check prints its
+ * location and the test exits with a non-zero status.
+ */
+
+#define _GNU_SOURCE
+
+#include <stdlib.h>
+#include <stdio.h>
+#include <string.h>
+#include <assert.h>
+#include <errno.h>
+#include <time.h>
+#include <sys/stat.h>
+#include <sys/mman.h>
+#include <fcntl.h>
+
+#define _USE_MATH_DEFINES
+#include <math.h>
+#include <stdbool.h>
+#include <pthread.h>
+#include <stdatomic.h>
+#include <sched.h>
+#include <unistd.h>
+
+#define GL2_UTIL_NO_GL
+#include "linmath.h"
+#include "gl2_util.h"
+#include "frustum.h"
+#include "scene_graph.h"
+#include "object_store.h"
+#include "job_system.h"
+#include "mesh_opt.h"
+#include "meshlet.h"
+#include "mesh_simplify.h"
+#include "mesh_codec.h"
+#include "mesh_cache.h"
+#include "mesh_import.h"
+#include "texture_file.h"
+#include "pack_file.h"
+
+typedef struct test_def {
+    const char *name;
+    int (*fn)();
+} test_def_t;
+
+static int failures;
+static char test_dir[64];
+
+#define CHECK(cond) do { if (!(cond)) { \
+    fprintf(stderr, "%s:%d: check failed: %s\n", __FILE__, __LINE__, #cond); \
+    failures++; } } while (0)
+
+/* a path in the scratch directory, which is created on first use */
+static const char* test_path(char *buf, size_t size, const char *name)
+{
+    if (!test_dir[0]) {
+        snprintf(test_dir, sizeof(test_dir), "%s/glcube_test.XXXXXX",
+            getenv("TMPDIR") ? getenv("TMPDIR") : "/tmp");
+        if (!mkdtemp(test_dir)) {
+            perror("mkdtemp");
+            exit(1);
+        }
+    }
+    snprintf(buf, size, "%s/%s", test_dir, name);
+    return buf;
+}
+
+/* write a file, returning 0 on success */
+static int test_write(const char *filename, const void *data, size_t size)
+{
+    FILE *f = fopen(filename, "wb");
+    if (!f) return -1;
+    int ret = fwrite(data, 1, size, f) == size ? 0 : -1;
+    return fclose(f) == 0 ? ret : -1;
+}
+
+static void test_put32(unsigned char *p, uint v)
+{
+    p[0] = (unsigned char)v;
+    p[1] = (unsigned char)(v >> 8);
+    p[2] = (unsigned char)(v >> 16);
+    p[3] = (unsigned char)(v >> 24);
+}
+
+/*
+ * linmath
+ */
+
+/* the LINMATH_NO_SIMD kernels, from glcube_test_ref.c */
+void ref_mat4x4_transpose(mat4x4 M, mat4x4 N);
+void ref_mat4x4_scale_aniso(mat4x4 M, mat4x4 a, float x, float y, float z);
+void ref_mat4x4_mul(mat4x4 M, mat4x4 a, mat4x4 b);
+void ref_mat4x4_mul_vec4(vec4 r, mat4x4 M, vec4 v);
+void ref_mat4x4_translate_in_place(mat4x4 M, float x, float y, float z);
+void ref_mat4x4_rotate_X(mat4x4 Q, mat4x4 M, float angle);
+void ref_mat4x4_rotate_Y(mat4x4 Q, mat4x4 M, float angle);
+void ref_mat4x4_rotate_Z(mat4x4 Q, mat4x4 M, float angle);
+void ref_mat4x4_invert(mat4x4 T, mat4x4 M);
+void ref_mat4x4_mul_vec3_soa(float *ox, float *oy, float *oz, mat4x4 M,
+    float const *x, float const *y, float const *z, float w, size_t n);
+void ref_mat4x4_mul_vec3_stride(void *out, size_t ostride, mat4x4 M,
+    void const *in, size_t istride, float w, size_t n);
+void ref_vec3_soa_bounds(vec3 lo, vec3 hi,
+    float const *x, float const *y, float const *z, size_t n);
+void ref_quat_mul(quat r, quat p, quat q);
+void ref_mat4x4_compose_euler_n(mat4x4 *M, mat4x4 *N,
+    vec3 *scale, vec3 *trans, vec3 *rot, size_t n);
+void ref_mat4x4_compose_quat_n(mat4x4 *M, mat4x4 *N,
+    vec3 *scale, vec3 *trans, quat *rot, size_t n);
+
+/* deterministic values in [lo, hi) */
+static float test_rand(uint *seed, float lo, float hi)
+{
+    *seed = *seed * 1664525u + 1013904223u;
+    return lo + (hi - lo) * (float)(*seed >> 8) * (1.f / 16777216.f);
+}
+
+/* a and b agree to a relative tolerance of eps */
+static int test_close(const float *a, const float *b, size_t n, float eps)
+{
+    for (size_t i = 0; i < n; i++) {
+        float d = fabsf(a[i] - b[i]), m = fmaxf(1.f, fabsf(b[i]));
+        if (!(d <= eps * m)) {
+            fprintf(stderr, "[%zu] %g != %g\n", i, a[i], b[i]);
+            return 0;
+        }
+    }
+    return 1;
+}
+
+/* an invertible transform with scales in [0.5, 2) */
+static void test_rand_trs(uint *seed, mat4x4 M)
+{
+    vec3 s, t, r;
+    for (int k = 0; k < 3; k++) {
+        s[k] = test_rand(seed, 0.5f, 2.f);
+        t[k] = test_rand(seed, -10.f, 10.f);
+        r[k] = test_rand(seed, -4.f, 4.f);
+    }
+    ref_mat4x4_compose_euler_n((mat4x4*)M, NULL, &s, &t, &r, 1);
+}
+
+/* the SSE2 and AVX2 kernels give the scalar results */
+static int test_linmath_simd()
+{
+    enum { N = 37 };
+    uint seed = 1;
+    mat4x4 a, b, r, e;
+
+    for (int iter = 0; iter < 100; iter++) {
+        for (int i = 0; i < 16; i++) {
+            a[i / 4][i % 4] = test_rand(&seed, -2.f, 2.f);
+            b[i / 4][i % 4] = test_rand(&seed, -2.f, 2.f);
+        }
+        float x = test_rand(&seed, -3.f, 3.f), y = test_rand(&seed, -3.f, 3.f);
+        float z = test_rand(&seed, -3.f, 3.f);
+
+        mat4x4_mul(r, a, b);
+        ref_mat4x4_mul(e, a, b);
+        CHECK(test_close(&r[0][0], &e[0][0], 16, 1e-6f));
+        mat4x4_transpose(r, a);
+        ref_mat4x4_transpose(e, a);
+        CHECK(test_close(&r[0][0], &e[0][0], 16, 0.f));
+        mat4x4_scale_aniso(r, a, x, y, z);
+        ref_mat4x4_scale_aniso(e, a, x, y, z);
+        CHECK(test_close(&r[0][0], &e[0][0], 16, 1e-6f));
+        mat4x4_dup(r, a);
+        mat4x4_dup(e, a);
+        mat4x4_translate_in_place(r, x, y, z);
+        ref_mat4x4_translate_in_place(e, x, y, z);
+        CHECK(test_close(&r[0][0], &e[0][0], 16, 1e-6f));
+        mat4x4_rotate_X(r, a, x);
+        ref_mat4x4_rotate_X(e, a, x);
+        CHECK(test_close(&r[0][0], &e[0][0], 16, 1e-6f));
+        mat4x4_rotate_Y(r, a, y);
+        ref_mat4x4_rotate_Y(e, a, y);
+        CHECK(test_close(&r[0][0], &e[0][0], 16, 1e-6f));
+        mat4x4_rotate_Z(r, a, z);
+        ref_mat4x4_rotate_Z(e, a, z);
+        CHECK(test_close(&r[0][0], &e[0][0], 16, 1e-6f));
+
+        vec4 v = { x, y, z, 1.f }, rv, ev;
+        mat4x4_mul_vec4(rv, a, v);
+        ref_mat4x4_mul_vec4(ev, a, v);
+        CHECK(test_close(rv, ev, 4, 1e-6f));
+
+        test_rand_trs(&seed, a);
+        mat4x4_invert(r, a);
+        ref_mat4x4_invert(e, a);
+        CHECK(test_close(&r[0][0], &e[0][0], 16, 1e-5f));
+
+        quat p, q, rq, eq;
+        for (int k = 0; k < 4; k++) {
+            p[k] = test_rand(&seed, -1.f, 1.f);
+            q[k] = test_rand(&seed, -1.f, 1.f);
+        }
+        quat_mul(rq, p, q);
+        ref_quat_mul(eq, p, q);
+        CHECK(test_close(rq, eq, 4, 1e-6f));
+    }
+
+    /* N is not a multiple of 4 or 8, so the tails run too */
+    vec3 *s = (vec3*)malloc(N * sizeof(vec3)), *t = (vec3*)malloc(N * sizeof(vec3));
+    vec3 *rot = (vec3*)malloc(N * sizeof(vec3));
+    quat *q = (quat*)malloc(N * sizeof(quat));
+    mat4x4 *m = (mat4x4*)malloc(N * sizeof(mat4x4)), *n = (mat4x4*)malloc(N * sizeof(mat4x4));
+    mat4x4 *em = (mat4x4*)malloc(N * sizeof(mat4x4)), *en = (mat4x4*)malloc(N * sizeof(mat4x4));
+    for (size_t i = 0; i < N; i++) {
+        for (int k = 0; k < 3; k++) {
+            s[i][k] = test_rand(&seed, 0.5f, 2.f);
+            t[i][k] = test_rand(&seed, -10.f, 10.f);
+            rot[i][k] = test_rand(&seed, -4.f, 4.f);
+        }
+        vec3 axis;
+        vec3_norm(axis, t[i]);
+        quat_rotate(q[i], rot[i][0], axis);
+    }
+    mat4x4_compose_euler_n(m, n, s, t, rot, N);
+    ref_mat4x4_compose_euler_n(em, en, s, t, rot, N);
+    CHECK(test_close(&m[0][0][0], &em[0][0][0], N * 16, 1e-5f));
+    CHECK(test_close(&n[0][0][0], &en[0][0][0], N * 16, 1e-5f));
+    mat4x4_compose_euler_n(m, NULL, s, t, rot, N);
+    CHECK(test_close(&m[0][0][0], &em[0][0][0], N * 16, 1e-5f));
+    mat4x4_compose_quat_n(m, n, s, t, q, N);
+    ref_mat4x4_compose_quat_n(em, en, s, t, q, N);
+    CHECK(test_close(&m[0][0][0], &em[0][0][0], N * 16, 1e-5f));
+    CHECK(test_close(&n[0][0][0], &en[0][0][0], N * 16, 1e-5f));
+
+    free(s);
+    free(t);
+    free(rot);
+    free(q);
+    free(m);
+    free(n);
+    free(em);
+    free(en);
+    return failures;
+}
+
+/*
+ * batched points and directions, in structure-of-arrays form and strided
+ * through an array of vertices, give the results of mat4x4_mul_vec4 and
+ * of the scalar kernels, including in place and in the 4 and 8 wide tails
+ */
+static int test_vec3_batch()
+{
+    enum { N = 45 };
+    typedef struct { float pos[3]; float uv[2]; float norm[3]; } vert_t;
+    uint seed = 7;
+    float x[N], y[N], z[N], ox[N], oy[N], oz[N], ex[N], ey[N], ez[N];
+    vert_t in[N], out[N], want[N];
+    mat4x4 M;
+
+    test_rand_trs(&seed, M);
+    for (size_t i = 0; i < N; i++) {
+        x[i] = test_rand(&seed, -5.f, 5.f);
+        y[i] = test_rand(&seed, -5.f, 5.f);
+        z[i] = test_rand(&seed, -5.f, 5.f);
+        memcpy(in[i].pos, (float[3]){ x[i], y[i], z[i] }, sizeof(in[i].pos));
+        memcpy(in[i].norm, (float[3]){ z[i], x[i], y[i] }, sizeof(in[i].norm));
+        in[i].uv[0] = in[i].uv[1] = (float)i;
+    }
+
+    for (int w = 0; w < 2; w++) {
+        for (size_t n = N - 8; n <= N; n++) {
+            mat4x4_mul_vec3_soa(ox, oy, oz, M, x, y, z, (float)w, n);
+            ref_mat4x4_mul_vec3_soa(ex, ey, ez, M, x, y, z, (float)w, n);
+            CHECK(test_close(ox, ex, n, 1e-6f));
+            CHECK(test_close(oy, ey, n, 1e-6f));
+            CHECK(test_close(oz, ez, n, 1e-6f));
+        }
+        for (size_t i = 0; i < N; i++) {
+            vec4 v = { x[i], y[i], z[i], (float)w }, r;
+            mat4x4_mul_vec4(r, M, v);
+            CHECK(test_close(r, (float[3]){ ox[i], oy[i], oz[i] }, 3, 1e-5f));
+        }
+
+        memcpy(out, in, sizeof(out));
+        memcpy(want, in, sizeof(want));
+        mat4x4_mul_vec3_stride(out[0].norm, sizeof(vert_t), M,
+            in[0].norm, sizeof(vert_t), (float)w, N);
+        ref_mat4x4_mul_vec3_stride(want[0].norm, sizeof(vert_t), M,
+            in[0].norm, sizeof(vert_t), (float)w, N);
+        CHECK(test_close((float*)out, (float*)want, N * 8, 1e-6f));
+    }
+
+    /* output aliasing input */
+    memcpy(ox, x, sizeof(x));
+    memcpy(oy, y, sizeof(y));
+    memcpy(oz, z, sizeof(z));
+    mat4x4_mul_vec3_soa(ox, oy, oz, M, ox, oy, oz, 1.f, N);
+    ref_mat4x4_mul_vec3_soa(ex, ey, ez, M, x, y, z, 1.f, N);
+    CHECK(test_close(ox, ex, N, 1e-6f));
+    CHECK(test_close(oy, ey, N, 1e-6f));
+    CHECK(test_close(oz, ez, N, 1e-6f));
+    memcpy(out, in, sizeof(out));
+    mat4x4_mul_vec3_stride(out[0].pos, sizeof(vert_t), M,
+        out[0].pos, sizeof(vert_t), 1.f, N);
+    for (size_t i = 0; i < N; i++) {
+        CHECK(test_close(out[i].pos, (float[3]){ ex[i], ey[i], ez[i] }, 3, 1e-6f));
+    }
+
+    for (size_t n = 1; n <= N; n += 11) {
+        vec3 lo, hi, elo, ehi;
+        vec3_soa_bounds(lo, hi, x, y, z, n);
+        ref_vec3_soa_bounds(elo, ehi, x, y, z, n);
+        CHECK(test_close(lo, elo, 3, 0.f) && test_close(hi, ehi, 3, 0.f));
+    }
+    return failures;
+}
+
+/*
+ * job system
+ */
+
+typedef struct
+{
+    atomic_uchar *seen;
+    size_t grain;
+    atomic_int bad;
+} job_cover_t;
+
+static void job_cover_fn(job_t *job, void *arg, size_t begin, size_t end)
+{
+    job_cover_t *c = (job_cover_t*)arg;
+    if (begin % c->grain != 0 || end - begin > c->grain) {
+        atomic_fetch_add(&c->bad, 1);
+    }
+    for (size_t i = begin; i < end; i++) {
+        atomic_fetch_add(&c->seen[i], 1);
+    }
+}
+
+/* every index is run exactly once, in grain aligned chunks */
+static int job_cover(int threads, size_t n, size_t grain)
+{
+    job_system_t js;
+    job_cover_t c = { (atomic_uchar*)calloc(n, 1), grain };
+    size_t wrong = 0;
+
+    atomic_init(&c.bad, 0);
+    job_system_init(&js, threads);
+    job_parallel_for(&js, job_cover_fn, &c, n, grain);
+    job_system_destroy(&js);
+    for (size_t i = 0; i < n; i++) {
+        wrong += atomic_load(&c.seen[i]) != 1;
+    }
+    free(c.seen);
+    if (wrong || atomic_load(&c.bad)) {
+        fprintf(stderr, "threads=%d n=%zu grain=%zu: %zu indices wrong, %d bad chunks\n",
+            threads, n, grain, wrong, atomic_load(&c.bad));
+    }
+    return wrong == 0 && atomic_load(&c.bad) == 0;
+}
+
+/* ranges splitting into many more chunks than JOB_POOL_SIZE */
+static int test_job_chunks()
+{
+    CHECK(job_cover(1, 100000, 1));
+    CHECK(job_cover(1, 5000000, 1024));
+    CHECK(job_cover(4, 1000000, 64));
+    CHECK(job_cover(3, 300000, 7));
+    return failures;
+}
+
+static atomic_int job_order[3];
+static atomic_int job_clock;
+
+static void job_stamp_fn(job_t *job, void *arg, size_t begin, size_t end)
+{
+    atomic_store(&job_order[(size_t)arg], atomic_fetch_add(&job_clock, 1));
+}
+
+/* dependencies, and more live jobs from job_create than the pool holds */
+static int test_job_graph()
+{
+    job_system_t js;
+    job_system_init(&js, 2);
+    for (int frame = 0; frame < 1000; frame++) {
+        job_t *a = job_create(&js, job_stamp_fn, (void*)0, 0, 0, 0);
+        job_t *b = job_create(&js, job_stamp_fn, (void*)1, 0, 0, 0);
+        job_t *c = job_create(&js, job_stamp_fn, (void*)2, 0, 0, 0);
+        job_depends(b, a);
+        job_depends(c, b);
+        job_submit(&js, c);
+        job_submit(&js, b);
+        job_submit(&js, a);
+        job_wait(&js, c);
+        CHECK(atomic_load(&job_order[0]) < atomic_load(&job_order[1]));
+        CHECK(atomic_load(&job_order[1]) < atomic_load(&job_order[2]));
+        job_free(&js, a);
+        job_free(&js, b);
+        job_free(&js, c);
+    }
+
+    size_t count = JOB_POOL_SIZE * 2;
+    job_t **held = (job_t**)malloc(count * sizeof(job_t*));
+    for (size_t i = 0; i < count; i++) {
+        held[i] = job_create(&js, job_stamp_fn, (void*)0, 0, 0, 0);
+        job_submit(&js, held[i]);
+    }
+    for (size_t i = 0; i < count; i++) {
+        job_wait(&js, held[i]);
+        job_free(&js, held[i]);
+    }
+    free(held);
+    job_system_destroy(&js);
+    return failures;
+}
+
+enum { JOB_TEST_AFTER = JOB_SUCCESSORS_MAX * 4 + 1 };
+
+static atomic_int job_after[1 + JOB_TEST_AFTER];
+
+static void job_after_fn(job_t *job, void *arg, size_t begin, size_t end)
+{
+    atomic_store(&job_after[(size_t)arg], atomic_fetch_add(&job_clock, 1) + 1);
+}
+
+/* more dependents on one job than JOB_SUCCESSORS_MAX */
+static int test_job_successors()
+{
+    job_system_t js;
+    job_t *after[JOB_TEST_AFTER];
+    job_system_init(&js, 3);
+    for (int frame = 0; frame < 200; frame++) {
+        for (size_t i = 0; i <= JOB_TEST_AFTER; i++) {
+            atomic_store(&job_after[i], 0);
+        }
+        job_t *first = job_create(&js, job_after_fn, (void*)0, 0, 0, 0);
+        for (size_t i = 0; i < JOB_TEST_AFTER; i++) {
+            after[i] = job_create(&js, job_after_fn, (void*)(i + 1), 0, 0, 0);
+            job_depends(after[i], first);
+            job_submit(&js, after[i]);
+        }
+        job_submit(&js, first);
+        for (size_t i = 0; i < JOB_TEST_AFTER; i++) {
+            job_wait(&js, after[i]);
+            CHECK(atomic_load(&job_after[0]) != 0);
+            CHECK(atomic_load(&job_after[i + 1]) > atomic_load(&job_after[0]));
+            job_free(&js, after[i]);
+        }
+        job_free(&js, first);
+    }
+    job_system_destroy(&js);
+    return failures;
+}
+
+/*
+ * objects
+ */
+
+/*
+ * boxes and spheres fully inside the [-10, 10] cube of an orthographic
+ * frustum are kept, those outside any one plane are culled and those
+ * straddling a plane are kept. against a perspective frustum the batch
+ * culls agree with the single object tests in the vector loops and tails.
+ */
+static int test_frustum_cull()
+{
+    enum { N = 1000 };
+    float *cx = (float*)malloc(N * sizeof(float)), *cy = (float*)malloc(N * sizeof(float));
+    float *cz = (float*)malloc(N * sizeof(float)), *e = (float*)malloc(N * sizeof(float));
+    uint *visible = (uint*)malloc(N * sizeof(uint));
+    uint seed = 3;
+    size_t n = 0, count;
+    frustum_t f;
+    mat4x4 pv, proj, view;
+
+    /* per plane: inside, outside, straddling, with extent and radius 1 */
+    static const float offsets[3] = { 8.f, 12.f, 10.5f };
+    mat4x4_ortho(pv, -10.f, 10.f, -10.f, 10.f, -10.f, 10.f);
+    frustum_from_matrix(&f, pv);
+    for (int a = 0; a < 3; a++) {
+        for (int sign = -1; sign <= 1; sign += 2) {
+            for (int k = 0; k < 3; k++, n++) {
+                cx[n] = cy[n] = cz[n] = 0.f;
+                (a == 0 ? cx : a == 1 ? cy : cz)[n] = sign * offsets[k];
+                e[n] = 1.f;
+            }
+        }
+    }
+    count = frustum_cull_aabbs(&f, visible, cx, cy, cz, e, e, e, n);
+    CHECK(count == 12);
+    for (size_t k = 0; k < count; k++) {
+        CHECK(visible[k] % 3 != 1);
+    }
+    count = frustum_cull_spheres(&f, visible, cx, cy, cz, e, n);
+    CHECK(count == 12);
+    for (size_t k = 0; k < count; k++) {
+        CHECK(visible[k] % 3 != 1);
+    }
+
+    vec3 eye = { 0.f, 0.f, 10.f }, center = { 0.f, 0.f, 0.f }, up = { 0.f, 1.f, 0.f };
+    mat4x4_perspective(proj, 1.f, 1.5f, 0.1f, 100.f);
+    mat4x4_look_at(view, eye, center, up);
+    mat4x4_mul(pv, proj, view);
+    frustum_from_matrix(&f, pv);
+    for (size_t i = 0; i < N; i++) {
+        cx[i] = test_rand(&seed, -60.f, 60.f);
+        cy[i] = test_rand(&seed, -60.f, 60.f);
+        cz[i] = test_rand(&seed, -100.f, 20.f);
+        e[i] = test_rand(&seed, 0.f, 10.f);
+    }
+    for (n = N - 9; n <= N; n++) {
+        size_t k = 0;
+        count = frustum_cull_spheres(&f, visible, cx, cy, cz, e, n);
+        for (size_t i = 0; i < n; i++) {
+            float c[3] = { cx[i], cy[i], cz[i] };
+            if (frustum_test_sphere(&f, c, e[i])) {
+                CHECK(k < count && visible[k] == i);
+                k++;
+            }
+        }
+        CHECK(k == count);
+        k = 0;
+        count = frustum_cull_aabbs(&f, visible, cx, cy, cz, e, e, e, n);
+        for (size_t i = 0; i < n; i++) {
+            float c[3] = { cx[i], cy[i], cz[i] }, ext[3] = { e[i], e[i], e[i] };
+            if (frustum_test_aabb(&f, c, ext)) {
+                CHECK(k < count && visible[k] == i);
+                k++;
+            }
+        }
+        CHECK(k == count && count > 0 && count < n);
+    }
+
+    free(cx);
+    free(cy);
+    free(cz);
+    free(e);
+    free(visible);
+    return failures;
+}
+
+/* the world matrix of a node composed from scratch along its parents */
+static void test_world(scene_graph_t *sg, uint node, mat4x4 W)
+{
+    mat4x4 L, P;
+    mat4x4_compose_euler(L, sg->scale[node], sg->trans[node], sg->rot[node]);
+    if (sg->parent[node] == SCENE_NODE_NONE) {
+        mat4x4_dup(W, L);
+    } else {
+        test_world(sg, sg->parent[node], P);
+        mat4x4_mul(W, P, L);
+    }
+}
+
+static int test_worlds(scene_graph_t *sg)
+{
+    int ok = 1;
+    for (uint i = 0; i < sg->count; i++) {
+        mat4x4 W;
+        test_world(sg, i, W);
+        ok &= test_close(&sg->world[i][0][0], &W[0][0], 16, 1e-5f);
+    }
+    return ok;
+}
+
+/* the nodes in the moved list, as a bit mask */
+static uint test_moved(scene_graph_t *sg)
+{
+    uint mask = 0;
+    for (size_t i = 0; i < sg->moved_count; i++) {
+        mask |= 1u << sg->moved[i];
+    }
+    return mask;
+}
+
+/*
+ * moving a parent updates the world matrices of it and its descendants
+ * and leaves the rest of the scene alone, with the nodes recomputed left
+ * in the moved list, including after a breadth-first sort
+ */
+static int test_scene_graph()
+{
+    /* 0 -> { 1 -> { 3 -> 5 }, 2 }, 4 -> 6 */
+    static const uint parents[] = { SCENE_NODE_NONE, 0, 0, 1, SCENE_NODE_NONE, 3, 4 };
+    enum { N = sizeof(parents) / sizeof(parents[0]) };
+    scene_graph_t sg;
+    uint seed = 5, remap[N];
+    mat4x4 before[N];
+
+    scene_graph_init(&sg, 2);
+    for (uint i = 0; i < N; i++) {
+        vec3 s, t, r;
+        for (int k = 0; k < 3; k++) {
+            s[k] = test_rand(&seed, 0.5f, 2.f);
+            t[k] = test_rand(&seed, -10.f, 10.f);
+            r[k] = test_rand(&seed, -4.f, 4.f);
+        }
+        CHECK(scene_graph_add(&sg, parents[i]) == i);
+        scene_graph_set_trs(&sg, i, s, t, r);
+    }
+    CHECK(scene_graph_update(&sg) == N);
+    CHECK(test_worlds(&sg));
+    CHECK(scene_graph_update(&sg) == 0);
+
+    vec3 t = { 1.f, -2.f, 3.f };
+    memcpy(before, sg.world, sizeof(before));
+    scene_graph_set_translation(&sg, 1, t);
+    CHECK(scene_graph_update(&sg) == 3);
+    CHECK(test_moved(&sg) == ((1u << 1) | (1u << 3) | (1u << 5)));
+    CHECK(test_worlds(&sg));
+    for (uint i = 0; i < N; i++) {
+        if (!(test_moved(&sg) & (1u << i))) {
+            CHECK(memcmp(before[i], sg.world[i], sizeof(mat4x4)) == 0);
+        }
+    }
+
+    /* as the parallel animation jobs do: flag nodes, then mark the first */
+    vec3 r = { 0.5f, 0.25f, -1.f };
+    scene_graph_put_rotation(&sg, 4, r);
+    scene_graph_put_rotation(&sg, 0, r);
+    scene_graph_mark(&sg, 0);
+    CHECK(scene_graph_update(&sg) == N);
+    CHECK(test_worlds(&sg));
+
+    scene_graph_sort(&sg, remap);
+    for (uint i = 0; i < N; i++) {
+        CHECK(sg.parent[i] == SCENE_NODE_NONE || sg.parent[i] < i);
+        CHECK(sg.parent[remap[i]] ==
+            (parents[i] == SCENE_NODE_NONE ? SCENE_NODE_NONE : remap[parents[i]]));
+    }
+    CHECK(test_worlds(&sg));
+    scene_graph_set_rotation(&sg, remap[3], r);
+    CHECK(scene_graph_update(&sg) == 2);
+    CHECK(test_moved(&sg) == ((1u << remap[3]) | (1u << remap[5])));
+    CHECK(test_worlds(&sg));
+
+    scene_graph_destroy(&sg);
+    return failures;
+}
+
+/* removed ids stay invalid and slots retire before the generation wraps */
+static int test_object_store()
+{
+    object_store_t os;
+    object_store_init(&os, 4);
+
+    object_id first = object_store_add(&os), keep = object_store_add(&os);
+    object_id id = first;
+    size_t room = object_store_room(&os);
+    uint s = first & OBJECT_INDEX_MASK;
+    CHECK(object_store_index(&os, first) == 0 && object_store_index(&os, keep) == 1);
+
+    /* reuse slots until four are retired */
+    uint reused = 0;
+    for (uint i = 0; i < 1100; i++) {
+        object_store_remove(&os, id);
+        CHECK(object_store_index(&os, id) == OBJECT_NONE);
+        id = object_store_add(&os);
+        CHECK(id != OBJECT_NONE && (id >> OBJECT_INDEX_BITS) != OBJECT_GEN_RETIRED);
+        CHECK(object_store_index(&os, first) == OBJECT_NONE);
+        CHECK(object_store_index(&os, keep) == 0);
+        reused += (id & OBJECT_INDEX_MASK) == s;
+    }
+    CHECK(reused == OBJECT_GEN_RETIRED - 1);
+    CHECK(object_store_index(&os, OBJECT_NONE) == OBJECT_NONE);
+
+    /* retired slots are not room, and the slot table outgrows the columns */
+    CHECK(object_store_count(&os) == 2 && os.slots == 6 && os.capacity == 4);
+    CHECK(object_store_room(&os) == room - 4);
+    object_store_destroy(&os);
+    return failures;
+}
+
+/*
+ * vertices
+ */
+
+/* tiled uvs survive packing through the uv scale and offset */
+static int test_vertex_pack()
+{
+    vertex_buffer vb;
+    array_buffer pb;
+    mat4x4 dequant;
+    vec4 uv_dequant;
+    vertex_buffer_init(&vb);
+    for (int i = 0; i < 64; i++) {
+        float t = (float)i / 63.f;
+        vertex_buffer_add(&vb, (vertex){ { t, 2.f * t, -t }, { 0.f, 0.f, 1.f },
+            { -2.f + 6.f * t, 4.f * t * t }, { 1.f, t, 0.f, 1.f } });
+    }
+    array_buffer_init(&pb, sizeof(vertex_packed), vb.count);
+    vertex_buffer_pack(&pb, &vb, dequant, uv_dequant);
+    CHECK(uv_dequant[0] == 6.f && uv_dequant[1] == 4.f);
+    CHECK(uv_dequant[2] == -2.f && uv_dequant[3] == 0.f);
+
+    vec3 center = { dequant[3][0], dequant[3][1], dequant[3][2] };
+    vec3 extent = { dequant[0][0], dequant[1][1], dequant[2][2] };
+    vertex *out = (vertex*)malloc(vb.count * sizeof(vertex));
+    vertex_unpack_n(out, (vertex_packed*)pb.data, center, extent, uv_dequant, vb.count);
+    for (size_t i = 0; i < vb.count; i++) {
+        const vertex *v = (const vertex*)vb.data + i;
+        CHECK(fabsf(out[i].uv.x - v->uv.x) < 1e-4f);
+        CHECK(fabsf(out[i].uv.y - v->uv.y) < 1e-4f);
+        CHECK(fabsf(out[i].pos.y - v->pos.y) < 1e-4f);
+    }
+    free(out);
+    array_buffer_destroy(&pb);
+
+    /* uvs within [0,1] keep the identity */
+    vb.count = 0;
+    vertex_buffer_add(&vb, (vertex){ { 0.f }, { 0.f, 0.f, 1.f }, { 0.25f, 0.5f }, { 1.f } });
+    array_buffer_init(&pb, sizeof(vertex_packed), vb.count);
+    vertex_buffer_pack(&pb, &vb, dequant, uv_dequant);
+    CHECK(uv_dequant[0] == 1.f && uv_dequant[1] == 1.f);
+    CHECK(uv_dequant[2] == 0.f && uv_dequant[3] == 0.f);
+    CHECK(((vertex_packed*)pb.data)->uv[1] == 32768);
+    array_buffer_destroy(&pb);
+    vertex_buffer_destroy(&vb);
+    return failures;
+}
+
+/*
+ * meshes
+ */
+
+/* an n x n grid of quads */
+static void test_mesh_grid(vertex_buffer *vb, index_buffer *ib, uint n)
+{
+    for (uint y = 0; y <= n; y++) {
+        for (uint x = 0; x <= n; x++) {
+            vertex_buffer_add(vb, (vertex){ { (float)x, (float)y, 0.f }, { 0.f, 0.f, 1.f },
+                { (float)x / n, (float)y / n }, { 1.f, 1.f, 1.f, 1.f } });
+        }
+    }
+    for (uint y = 0; y < n; y++) {
+        for (uint x = 0; x < n; x++) {
+            uint a = y * (n + 1) + x, b = a + n + 1;
+            uint quad[6] = { a, b, b + 1, a, b + 1, a + 1 };
+            index_buffer_add(ib, quad, 6, 0);
+        }
+    }
+}
+
+/* a triangle as grid positions, rotated to start at its smallest, keeping its winding */
+static void test_triangle_key(uint key[3], const vertex *v, const uint *tri, uint n)
+{
+    uint k[3], r = 0;
+    for (int c = 0; c < 3; c++) {
+        const float *p = v[tri[c]].pos.vec;
+        k[c] = (uint)p[1] * (n + 1) + (uint)p[0];
+        if (k[c] < k[r]) r = c;
+    }
+    for (int c = 0; c < 3; c++) {
+        key[c] = k[(r + c) % 3];
+    }
+}
+
+static int test_triangle_cmp(const void *a, const void *b)
+{
+    const uint *x = (const uint*)a, *y = (const uint*)b;
+    for (int c = 0; c < 3; c++) {
+        if (x[c] != y[c]) return x[c] < y[c] ? -1 : 1;
+    }
+    return 0;
+}
+
+/* the sorted triangles of a grid mesh */
+static uint* test_triangles(vertex_buffer *vb, index_buffer *ib, uint n)
+{
+    size_t count = ib->count / 3;
+    uint *keys = (uint*)malloc(count * 3 * sizeof(uint));
+    for (size_t t = 0; t < count; t++) {
+        test_triangle_key(keys + t * 3, (const vertex*)vb->data,
+            (const uint*)ib->data + t * 3, n);
+    }
+    qsort(keys, count, 3 * sizeof(uint), test_triangle_cmp);
+    return keys;
+}
+
+/*
+ * mesh_optimize permutes the triangles of a shuffled grid, keeping each
+ * with its winding, and renumbers the vertices in order of first use
+ * without dropping any, lowering ACMR
+ */
+static int test_mesh_optimize()
+{
+    enum { N = 24 };
+    vertex_buffer vb;
+    index_buffer ib;
+    mesh_stats before, after;
+    uint seed = 11;
+
+    vertex_buffer_init(&vb);
+    index_buffer_init(&ib);
+    test_mesh_grid(&vb, &ib, N);
+    uint *idx = (uint*)ib.data;
+    size_t count = ib.count / 3, vertices = vb.count;
+    for (size_t t = count - 1; t > 0; t--) {
+        size_t u = (size_t)test_rand(&seed, 0.f, (float)(t + 1));
+        uint tri[3];
+        memcpy(tri, idx + t * 3, sizeof(tri));
+        memcpy(idx + t * 3, idx + u * 3, sizeof(tri));
+        memcpy(idx + u * 3, tri, sizeof(tri));
+    }
+    uint *keys = test_triangles(&vb, &ib, N);
+
+    mesh_optimize(&vb, &ib, &before, &after);
+    uint *opt = test_triangles(&vb, &ib, N);
+    CHECK(ib.count == count * 3);
+    CHECK(memcmp(keys, opt, count * 3 * sizeof(uint)) == 0);
+    CHECK(vb.count == vertices && ib.max_index == vertices - 1);
+    CHECK(after.triangles == count && after.vertices == vertices);
+    CHECK(after.acmr < before.acmr);
+
+    uint next = 0;
+    idx = (uint*)ib.data;
+    for (size_t i = 0; i < ib.count; i++) {
+        CHECK(idx[i] <= next);
+        if (idx[i] == next) next++;
+    }
+    CHECK(next == vertices);
+
+    free(keys);
+    free(opt);
+    vertex_buffer_destroy(&vb);
+    index_buffer_destroy(&ib);
+    return failures;
+}
+
+/* meshlets within the limits tile the index buffer, enclosing their vertices */
+static int test_meshlets(meshlet_set *ms, vertex_buffer *vb, index_buffer *ib,
+    uint max_vertices, uint max_triangles)
+{
+    const vertex *v = (const vertex*)vb->data;
+    const uint *idx = (const uint*)ib->data;
+    uint *stamp = (uint*)calloc(vb->count, sizeof(uint));
+    uint next = 0;
+    int ok = 1;
+
+    for (size_t i = 0; i < ms->count; i++) {
+        meshlet *ml = &ms->meshlets[i];
+        uint verts = 0;
+        for (uint k = ml->index_offset; k < ml->index_offset + ml->index_count; k++) {
+            if (stamp[idx[k]] != i + 1) {
+                stamp[idx[k]] = (uint)i + 1;
+                verts++;
+            }
+            vec3 d = { v[idx[k]].pos.vec[0] - ms->cx[i],
+                v[idx[k]].pos.vec[1] - ms->cy[i], v[idx[k]].pos.vec[2] - ms->cz[i] };
+            ok &= vec3_len(d) <= ms->r[i] * 1.0001f;
+        }
+        ok &= ml->index_offset == next && ml->index_count > 0;
+        ok &= ml->index_count % 3 == 0 && ml->index_count / 3 <= max_triangles;
+        ok &= ml->vertex_count == verts && verts <= max_vertices;
+        next = ml->index_offset + ml->index_count;
+    }
+    free(stamp);
+    return ok && next == ib->count;
+}
+
+/*
+ * meshlets of an ordered and a shuffled grid keep to the vertex and
+ * triangle limits and cover every triangle exactly once. the grid winds
+ * to face -z, so from +z all its meshlets are culled by their normal cones.
+ */
+static int test_meshlet_build()
+{
+    enum { N = 40 };
+    vertex_buffer vb;
+    index_buffer ib;
+    meshlet_set ms;
+    uint seed = 13, visible[2 * N * N];
+    mat4x4 pv, proj, view;
+
+    vertex_buffer_init(&vb);
+    index_buffer_init(&ib);
+    test_mesh_grid(&vb, &ib, N);
+    for (int pass = 0; pass < 2; pass++) {
+        meshlet_set_init(&ms);
+        CHECK(meshlet_build(&ms, &vb, &ib, MESHLET_MAX_VERTICES,
+            MESHLET_MAX_TRIANGLES) == ms.count);
+        CHECK(ms.count >= ib.count / 3 / MESHLET_MAX_TRIANGLES);
+        CHECK(test_meshlets(&ms, &vb, &ib, MESHLET_MAX_VERTICES, MESHLET_MAX_TRIANGLES));
+        meshlet_set_destroy(&ms);
+
+        /* 3 fresh vertices always fit, so 9 allows 1 to 3 triangles */
+        meshlet_set_init(&ms);
+        meshlet_build(&ms, &vb, &ib, 9, 16);
+        CHECK(test_meshlets(&ms, &vb, &ib, 9, 16));
+        meshlet_set_destroy(&ms);
+
+        uint *idx = (uint*)ib.data;
+        for (size_t t = ib.count / 3 - 1; t > 0; t--) {
+            size_t u = (size_t)test_rand(&seed, 0.f, (float)(t + 1));
+            uint tri[3];
+            memcpy(tri, idx + t * 3, sizeof(tri));
+            memcpy(idx + t * 3, idx + u * 3, sizeof(tri));
+            memcpy(idx + u * 3, tri, sizeof(tri));
+        }
+    }
+
+    meshlet_set_init(&ms);
+    index_buffer_destroy(&ib);
+    vertex_buffer_destroy(&vb);
+    vertex_buffer_init(&vb);
+    index_buffer_init(&ib);
+    test_mesh_grid(&vb, &ib, N);
+    meshlet_build(&ms, &vb, &ib, MESHLET_MAX_VERTICES, MESHLET_MAX_TRIANGLES);
+    for (int side = -1; side <= 1; side += 2) {
+        vec3 eye = { N * 0.5f, N * 0.5f, side * 50.f };
+        vec3 center = { N * 0.5f, N * 0.5f, 0.f }, up = { 0.f, 1.f, 0.f };
+        mat4x4_perspective(proj, 1.f, 1.f, 0.1f, 1000.f);
+        mat4x4_look_at(view, eye, center, up);
+        mat4x4_mul(pv, proj, view);
+        size_t count = meshlet_cull(&ms, visible, pv, eye);
+        CHECK(side > 0 ? count == 0 : count == ms.count);
+    }
+    meshlet_set_destroy(&ms);
+    vertex_buffer_destroy(&vb);
+    index_buffer_destroy(&ib);
+    return failures;
+}
+
+/* epsilon welds, including coordinates with cells out of int range */
+static int test_mesh_weld()
+{
+    static const float xs[] = { 0.f, 0.0004f, 1.f, 3e9f, -3e9f, 1e30f, -1e30f };
+    vertex_buffer vb;
+    index_buffer ib;
+    vertex_buffer_init(&vb);
+    index_buffer_init(&ib);
+    for (int pass = 0; pass < 2; pass++) {
+        for (size_t i = 0; i < sizeof(xs) / sizeof(xs[0]); i++) {
+            uint idx = (uint)vb.count;
+            vertex_buffer_add(&vb, (vertex){ { xs[i], 0.f, 0.f }, { 0.f, 0.f, 1.f },
+                { 0.f, 0.f }, { 1.f, 1.f, 1.f, 1.f } });
+            index_buffer_add(&ib, &idx, 1, 0);
+        }
+    }
+    /* 0 and 0.0004 share a cell, and each pass repeats the first */
+    CHECK(mesh_weld(&vb, &ib, 1e-3f, NULL) == 6);
+    CHECK(index_buffer_get(&ib, 0) == index_buffer_get(&ib, 1));
+    CHECK(index_buffer_get(&ib, 3) != index_buffer_get(&ib, 4));
+    CHECK(index_buffer_get(&ib, 5) != index_buffer_get(&ib, 6));
+    for (size_t i = 0; i < 7; i++) {
+        CHECK(index_buffer_get(&ib, i) == index_buffer_get(&ib, i + 7));
+    }
+    vertex_buffer_destroy(&vb);
+    index_buffer_destroy(&ib);
+    return failures;
+}
+
+/*
+ * a bumpy grid with a uv seam down column n / 2: the triangles to the
+ * right of the seam use copies of its vertices, appended after the grid
+ */
+static void test_mesh_seam(vertex_buffer *vb, index_buffer *ib, uint n)
+{
+    uint seam = n / 2, copies = (n + 1) * (n + 1);
+    for (uint y = 0; y <= n; y++) {
+        for (uint x = 0; x <= n; x++) {
+            float z = 2.f * sinf(x * 0.3f) * cosf(y * 0.3f);
+            vertex_buffer_add(vb, (vertex){ { (float)x, (float)y, z }, { 0.f, 0.f, 1.f },
+                { (float)x / n, (float)y / n }, { 1.f, 1.f, 1.f, 1.f } });
+        }
+    }
+    for (uint y = 0; y <= n; y++) {
+        vertex v = ((vertex*)vb->data)[y * (n + 1) + seam];
+        v.uv.vec[0] += 1.f;
+        vertex_buffer_add(vb, v);
+    }
+    for (uint y = 0; y < n; y++) {
+        for (uint x = 0; x < n; x++) {
+            uint a = y * (n + 1) + x, b = a + n + 1;
+            uint quad[6] = { a, b, b + 1, a, b + 1, a + 1 };
+            for (int k = 0; x == seam && k < 6; k++) {
+                if (quad[k] % (n + 1) == seam) {
+                    quad[k] = copies + quad[k] / (n + 1);
+                }
+            }
+            index_buffer_add(ib, quad, 6, 0);
+        }
+    }
+}
+
+/*
+ * the simplifier meets target triangle counts and keeps the vertices of a
+ * seam, which are locked. mesh_lod_build appends levels with fewer
+ * triangles at growing errors, keeping max_index in range.
+ */
+static int test_mesh_simplify()
+{
+    enum { N = 32 };
+    vertex_buffer vb;
+    index_buffer ib;
+    mesh_lod lod;
+    float error;
+
+    vertex_buffer_init(&vb);
+    index_buffer_init(&ib);
+    test_mesh_seam(&vb, &ib, N);
+    size_t count = ib.count, vertices = vb.count;
+    uint *dst = (uint*)malloc(count * sizeof(uint));
+    unsigned char *used = (unsigned char*)malloc(vertices);
+
+    for (size_t div = 2; div <= 8; div *= 2) {
+        size_t target = count / div / 3 * 3;
+        size_t n = mesh_simplify(dst, (uint*)ib.data, count, (vertex*)vb.data,
+            vertices, target, 1.f, &error);
+        CHECK(n % 3 == 0 && n <= target && n >= target / 2);
+        CHECK(error > 0.f && error < 1.f);
+        memset(used, 0, vertices);
+        size_t bad = 0;
+        for (size_t i = 0; i < n; i++) {
+            bad += dst[i] >= vertices;
+            if (dst[i] < vertices) used[dst[i]] = 1;
+        }
+        CHECK(bad == 0);
+        for (uint y = 0; y <= N; y++) {
+            CHECK(used[y * (N + 1) + N / 2] && used[(N + 1) * (N + 1) + y]);
+        }
+    }
+    /* a target error of zero stops before any collapse that moves the surface */
+    CHECK(mesh_simplify(dst, (uint*)ib.data, count, (vertex*)vb.data,
+        vertices, 0, 0.f, &error) <= count && error == 0.f);
+
+    static const float errors[] = { 1e-3f, 1e-2f, 5e-2f, 2e-1f };
+    CHECK(mesh_lod_build(&lod, &vb, &ib, errors, 4) > 2);
+    CHECK(lod.levels[0].index_offset == 0 && lod.levels[0].index_count == count);
+    for (uint l = 1; l < lod.count; l++) {
+        mesh_lod_level *a = &lod.levels[l - 1], *b = &lod.levels[l];
+        CHECK(b->index_offset == a->index_offset + a->index_count);
+        CHECK(b->index_count % 3 == 0 && b->index_count < a->index_count);
+        CHECK(b->error >= a->error);
+    }
+    mesh_lod_level *last = &lod.levels[lod.count - 1];
+    CHECK(ib.count == last->index_offset + last->index_count);
+    CHECK(ib.max_index == index_max_n((uint*)ib.data, ib.count));
+    CHECK(ib.max_index < vertices);
+    CHECK(mesh_lod_select(&lod, 1e9f, 1.f) == 0);
+    CHECK(mesh_lod_select(&lod, 1e-9f, 1.f) == lod.count - 1);
+
+    free(used);
+    free(dst);
+    vertex_buffer_destroy(&vb);
+    index_buffer_destroy(&ib);
+    return failures;
+}
+
+/* round trips, index validation and the source key */
+static int test_mesh_cache()
+{
+    char filename[128];
+    vertex_buffer vb;
+    index_buffer ib;
+    mesh_cache mc;
+    mat4x4 dequant;
+    vec4 uv_dequant, bounds = { 4.f, 4.f, 0.f, 6.f };
+    mesh_cache_key key = { 1234, 5678 }, edited = { 1234, 5679 };
+
+    test_path(filename, sizeof(filename), "grid.mesh");
+    vertex_buffer_init(&vb);
+    index_buffer_init(&ib);
+    test_mesh_grid(&vb, &ib, 8);
+    index_buffer_narrow(&ib);
+    vertex_dequant_identity(dequant, uv_dequant);
+
+    for (uint flags = 0; flags <= mesh_cache_compressed; flags++) {
+        CHECK(mesh_cache_write(filename, mesh_layout_vertex, MESH_LAYOUT_ATTRIBS,
+            &vb, &ib, NULL, NULL, bounds, dequant, uv_dequant, &key, flags) == 0);
+        CHECK(mesh_cache_map(&mc, filename) == 0);
+        if (!mc.header) continue;
+        CHECK(mesh_cache_match(&mc, mesh_layout_vertex, MESH_LAYOUT_ATTRIBS, sizeof(vertex)));
+        CHECK(mesh_cache_fresh(&mc, &key));
+        CHECK(!mesh_cache_fresh(&mc, &edited));
+        CHECK(mc.header->vertex_count == vb.count && mc.header->index_count == ib.count);
+        void *vertices = malloc(vb.count * vb.stride), *indices = malloc(ib.count * ib.stride);
+        CHECK(mesh_cache_decode_vertices(&mc, vertices) == 0);
+        CHECK(mesh_cache_decode_indices(&mc, indices) == 0);
+        CHECK(memcmp(vertices, vb.data, vb.count * vb.stride) == 0);
+        CHECK(memcmp(indices, ib.data, ib.count * ib.stride) == 0);
+        free(vertices);
+        free(indices);
+        mesh_cache_unmap(&mc);
+    }
+
+    /* an uncompressed index past the vertices is rejected on map */
+    CHECK(mesh_cache_write(filename, mesh_layout_vertex, MESH_LAYOUT_ATTRIBS,
+        &vb, &ib, NULL, NULL, bounds, dequant, uv_dequant, NULL, 0) == 0);
+    CHECK(mesh_cache_map(&mc, filename) == 0);
+    if (mc.header) {
+        unsigned long long offset = mc.header->index_offset + 10 * sizeof(unsigned short);
+        unsigned short bad = (unsigned short)mc.header->vertex_count;
+        mesh_cache_key none = { 0, 0 };
+        CHECK(mesh_cache_fresh(&mc, &none));
+        mesh_cache_unmap(&mc);
+        int fd = open(filename, O_WRONLY);
+        CHECK(fd >= 0 && pwrite(fd, &bad, sizeof(bad), (off_t)offset) == sizeof(bad));
+        close(fd);
+        CHECK(mesh_cache_map(&mc, filename) == -1);
+    }
+
+    /* the source key follows the file size and modification time */
+    mesh_cache_key a, b;
+    CHECK(mesh_cache_key_file(&a, filename) == 0);
+    CHECK(mesh_cache_key_file(&b, filename) == 0 && memcmp(&a, &b, sizeof(a)) == 0);
+    CHECK(a.size > 0 && a.mtime > 0);
+    CHECK(truncate(filename, (off_t)a.size - 1) == 0);
+    CHECK(mesh_cache_key_file(&b, filename) == 0 && b.size == a.size - 1);
+    CHECK(mesh_cache_key_file(&b, "/nonexistent/grid.obj") == -1 && b.size == 0);
+    remove(filename);
+    vertex_buffer_destroy(&vb);
+    index_buffer_destroy(&ib);
+    return failures;
+}
+
+/* vertex and index streams decode exactly, and damaged streams fail */
+static int test_mesh_codec()
+{
+    vertex_buffer vb;
+    index_buffer ib;
+    vertex_buffer_init(&vb);
+    index_buffer_init(&ib);
+    test_mesh_grid(&vb, &ib, 8);
+
+    /* vertices at the vertex stride, and at a narrow stride */
+    size_t strides[2] = { sizeof(vertex), 8 };
+    size_t bytes = vb.count * sizeof(vertex);
+    void *out = malloc(bytes);
+    for (int k = 0; k < 2; k++) {
+        size_t stride = strides[k], count = bytes / stride;
+        size_t bound = mesh_encode_vertex_bound(count, stride);
+        unsigned char *enc = (unsigned char*)malloc(bound);
+        size_t size = mesh_encode_vertices(enc, bound, vb.data, count, stride);
+        CHECK(size > MESH_CODEC_PAD && size <= bound);
+        CHECK(mesh_encode_vertices(enc, bound - 1, vb.data, count, stride) == 0);
+        memset(out, 0, bytes);
+        CHECK(mesh_decode_vertices(out, count, stride, enc, size) == 0);
+        CHECK(memcmp(out, vb.data, bytes) == 0);
+        CHECK(mesh_decode_vertices(out, count, stride, enc, size - MESH_CODEC_PAD - 1) == -1);
+        CHECK(mesh_decode_vertices(out, count, stride + 2, enc, size) == -1);
+        enc[0] = MESH_CODEC_INDEX;
+        CHECK(mesh_decode_vertices(out, count, stride, enc, size) == -1);
+        free(enc);
+    }
+    free(out);
+
+    /* shared edges from the grid, then scattered triangles coded explicitly */
+    uint rng = 1;
+    for (uint i = 0; i < 96; i++) {
+        rng = rng * 1103515245u + 12345u;
+        uint a = (rng >> 8) % vb.count;
+        uint tri[3] = { a, (a + 7) % (uint)vb.count, (a * 5 + 3) % (uint)vb.count };
+        if (tri[1] != a && tri[2] != a && tri[1] != tri[2]) {
+            index_buffer_add(&ib, tri, 3, 0);
+        }
+    }
+    size_t bound = mesh_encode_index_bound(ib.count);
+    unsigned char *enc = (unsigned char*)malloc(bound);
+    size_t size = mesh_encode_indices(enc, bound, (const uint*)ib.data, ib.count);
+    uint *idx = (uint*)malloc(ib.count * sizeof(uint));
+    unsigned short *idx16 = (unsigned short*)malloc(ib.count * sizeof(unsigned short));
+    CHECK(size > 1 && size < ib.count * sizeof(uint));
+    CHECK(mesh_decode_indices(idx, ib.count, sizeof(uint), vb.count, enc, size) == 0);
+    CHECK(memcmp(idx, ib.data, ib.count * sizeof(uint)) == 0);
+    CHECK(mesh_decode_indices(idx16, ib.count, sizeof(unsigned short),
+        vb.count, enc, size) == 0);
+    for (size_t i = 0; i < ib.count; i++) {
+        CHECK(idx16[i] == ((const uint*)ib.data)[i]);
+    }
+    CHECK(mesh_decode_indices(idx, ib.count, sizeof(uint), vb.count - 1, enc, size) == -1);
+    CHECK(mesh_decode_indices(idx, ib.count, sizeof(uint), vb.count, enc, size - 1) == -1);
+    CHECK(mesh_decode_indices(idx, ib.count + 1, sizeof(uint), vb.count, enc, size) == -1);
+    CHECK(mesh_decode_indices(idx, ib.count, 1, vb.count, enc, size) == -1);
+    free(idx);
+    free(idx16);
+    free(enc);
+    vertex_buffer_destroy(&vb);
+    index_buffer_destroy(&ib);
+    return failures;
+}
+
+static int test_vec_eq(const float *a, float x, float y, float z)
+{
+    return fabsf(a[0] - x) < 1e-6f && fabsf(a[1] - y) < 1e-6f && fabsf(a[2] - z) < 1e-6f;
+}
+
+static const char test_obj_quad[] =
+    "# quad with a colored corner\n"
+    "v 0 0 0\n"
+    "v 1 0 0\n"
+    "v 1 1 0\n"
+    "v 0 1 0 1 0.5 0\n"
+    "f 1 2 3 4\n";
+
+static const char test_obj_corners[] =
+    "v 0 0 0\r\n"
+    "v 2 0 0\r\n"
+    "v 0 2 0\r\n"
+    "vt 0.5 0.25\r\n"
+    "vn 0 0 -1\r\n"
+    "f -3/1/1 -2/1/1 -1/1/1\r\n";
+
+/* OBJ fans, relative indices, corner attributes and errors */
+static int test_mesh_import_obj()
+{
+    vertex_buffer vb;
+    index_buffer ib;
+    vertex_buffer_init(&vb);
+    index_buffer_init(&ib);
+
+    CHECK(mesh_import_obj(&vb, &ib, test_obj_quad, sizeof(test_obj_quad) - 1, NULL) == 0);
+    const vertex *v = (const vertex*)vb.data;
+    const uint *idx = (const uint*)ib.data;
+    CHECK(vb.count == 4 && ib.count == 6);
+    CHECK(idx[0] == 0 && idx[1] == 1 && idx[2] == 2 && idx[3] == 0 && idx[4] == 2 && idx[5] == 3);
+    CHECK(test_vec_eq(v[2].pos.vec, 1.f, 1.f, 0.f) && test_vec_eq(v[0].norm.vec, 0.f, 0.f, 1.f));
+    CHECK(test_vec_eq(v[3].col.vec, 1.f, 0.5f, 0.f) && v[3].col.vec[3] == 1.f);
+    CHECK(test_vec_eq(v[0].col.vec, 1.f, 1.f, 1.f));
+
+    /* appended after the quad, with every corner a vertex */
+    CHECK(mesh_import_obj(&vb, &ib, test_obj_corners,
+        sizeof(test_obj_corners) - 1, NULL) == 0);
+    v = (const vertex*)vb.data;
+    idx = (const uint*)ib.data;
+    CHECK(vb.count == 7 && ib.count == 9 && ib.max_index == 6);
+    CHECK(idx[6] == 4 && idx[7] == 5 && idx[8] == 6);
+    CHECK(test_vec_eq(v[5].pos.vec, 2.f, 0.f, 0.f) && test_vec_eq(v[5].norm.vec, 0.f, 0.f, -1.f));
+    CHECK(v[6].uv.vec[0] == 0.5f && v[6].uv.vec[1] == 0.25f);
+
+    /* malformed files leave the buffers as they were */
+    static const char *bad[] = {
+        "v 0 0 0\nv 1 0 0\nv 0 1 0\nf 1 2 4\n",
+        "v 0 0 0\nv 1 0 0\nv 0 1 0\nf 1 2 0\n",
+        "v 0 0 0\nv 1 0 0\nv 0 1\nf 1 2 3\n",
+        "v 0 0 0\nv 1 0 0\nv 0 1 0\nf 1/2 2 3\n",
+        "v 0 0 0\nv 1 0 0\nv 0 1 0\nf 1 2 3x\n",
+        "v 0 0 0\nv 1 0 0\nv 0 1 0\n",
+    };
+    for (size_t i = 0; i < sizeof(bad) / sizeof(bad[0]); i++) {
+        errno = 0;
+        CHECK(mesh_import_obj(&vb, &ib, bad[i], strlen(bad[i]), NULL) == -1 && errno == EINVAL);
+        CHECK(vb.count == 7 && ib.count == 9);
+    }
+
+    /* from a file, on the job system */
+    char filename[128];
+    job_system_t js;
+    mesh_import_stats stats;
+    test_path(filename, sizeof(filename), "quad.obj");
+    CHECK(test_write(filename, test_obj_quad, sizeof(test_obj_quad) - 1) == 0);
+    job_system_init(&js, 2);
+    CHECK(mesh_import(&vb, &ib, filename, &js, &stats) == 0);
+    CHECK(stats.format == mesh_format_obj && stats.vertices == 4 && stats.triangles == 2);
+    CHECK(vb.count == 11 && ((const uint*)ib.data)[ib.count - 1] == 10);
+    job_system_destroy(&js);
+    remove(filename);
+    CHECK(mesh_import(&vb, &ib, filename, NULL, NULL) == -1 && errno == ENOENT);
+
+    vertex_buffer_destroy(&vb);
+    index_buffer_destroy(&ib);
+    return failures;
+}
+
+static const char test_ply_ascii[] =
+    "ply\n"
+    "format ascii 1.0\n"
+    "comment quad with vertex colors\n"
+    "element vertex 4\n"
+    "property float x\n"
+    "property float y\n"
+    "property float z\n"
+    "property uchar red\n"
+    "property uchar green\n"
+    "property uchar blue\n"
+    "element face 1\n"
+    "property list uchar int vertex_indices\n"
+    "end_header\n"
+    "0 0 0 255 0 0\n"
+    "1 0 0 0 255 0\n"
+    "1 1 0 0 0 255\n"
+    "0 1 0 255 255 255\n"
+    "4 0 1 2 3\n";
+
+static const char test_ply_binary[] =
+    "ply\n"
+    "format binary_little_endian 1.0\n"
+    "element vertex 3\n"
+    "property float x\n"
+    "property float y\n"
+    "property float z\n"
+    "property float nx\n"
+    "property float ny\n"
+    "property float nz\n"
+    "element face 1\n"
+    "property list uchar uint vertex_indices\n"
+    "end_header\n";
+
+/* a binary triangle, with normals given so none are generated */
+static size_t test_ply_binary_build(unsigned char *ply, uint third)
+{
+    static const float f[3][6] = {
+        { 0.f, 0.f, 0.f, 0.f, 1.f, 0.f },
+        { 0.f, 0.f, 1.f, 0.f, 1.f, 0.f },
+        { 1.f, 0.f, 0.f, 0.f, 1.f, 0.f },
+    };
+    size_t size = sizeof(test_ply_binary) - 1;
+    memcpy(ply, test_ply_binary, size);
+    for (uint i = 0; i < 3; i++) {
+        for (uint k = 0; k < 6; k++, size += 4) {
+            uint bits;
+            memcpy(&bits, &f[i][k], 4);
+            test_put32(ply + size, bits);
+        }
+    }
+    ply[size++] = 3;
+    test_put32(ply + size, 0);
+    test_put32(ply + size + 4, 1);
+    test_put32(ply + size + 8, third);
+    return size + 12;
+}
+
+/* ASCII and binary PLY, colors, given normals and errors */
+static int test_mesh_import_ply()
+{
+    vertex_buffer vb;
+    index_buffer ib;
+    unsigned char ply[512];
+    vertex_buffer_init(&vb);
+    index_buffer_init(&ib);
+
+    CHECK(mesh_import_ply(&vb, &ib, test_ply_ascii, sizeof(test_ply_ascii) - 1, NULL) == 0);
+    const vertex *v = (const vertex*)vb.data;
+    const uint *idx = (const uint*)ib.data;
+    CHECK(vb.count == 4 && ib.count == 6);
+    CHECK(idx[0] == 0 && idx[1] == 1 && idx[2] == 2 && idx[3] == 0 && idx[4] == 2 && idx[5] == 3);
+    CHECK(test_vec_eq(v[1].col.vec, 0.f, 1.f, 0.f) && v[1].col.vec[3] == 1.f);
+    CHECK(test_vec_eq(v[3].col.vec, 1.f, 1.f, 1.f));
+    CHECK(test_vec_eq(v[2].norm.vec, 0.f, 0.f, 1.f));
+
+    size_t size = test_ply_binary_build(ply, 2);
+    CHECK(mesh_import_ply(&vb, &ib, (const char*)ply, size, NULL) == 0);
+    v = (const vertex*)vb.data;
+    idx = (const uint*)ib.data;
+    CHECK(vb.count == 7 && ib.count == 9);
+    CHECK(idx[6] == 4 && idx[7] == 5 && idx[8] == 6);
+    CHECK(test_vec_eq(v[5].pos.vec, 0.f, 0.f, 1.f) && test_vec_eq(v[5].norm.vec, 0.f, 1.f, 0.f));
+
+    /* an index past the vertices, a short body, and a bad format */
+    CHECK(mesh_import_ply(&vb, &ib, (const char*)ply, test_ply_binary_build(ply, 3),
+        NULL) == -1 && errno == EINVAL);
+    CHECK(mesh_import_ply(&vb, &ib, (const char*)ply, test_ply_binary_build(ply, 2) - 1,
+        NULL) == -1 && errno == EINVAL);
+    memcpy(strstr((char*)ply, "binary_little"), "binary_middle", 13);
+    CHECK(mesh_import_ply(&vb, &ib, (const char*)ply, size, NULL) == -1 && errno == EINVAL);
+    CHECK(mesh_import_ply(&vb, &ib, test_ply_ascii, sizeof(test_ply_ascii) - 3,
+        NULL) == -1 && errno == EINVAL);
+    CHECK(vb.count == 7 && ib.count == 9);
+
+    /* the format is chosen from the file */
+    char filename[128];
+    mesh_import_stats stats;
+    test_path(filename, sizeof(filename), "quad.ply");
+    CHECK(test_write(filename, test_ply_ascii, sizeof(test_ply_ascii) - 1) == 0);
+    CHECK(mesh_import(&vb, &ib, filename, NULL, &stats) == 0);
+    CHECK(stats.format == mesh_format_ply && stats.vertices == 4 && stats.triangles == 2);
+    remove(filename);
+
+    vertex_buffer_destroy(&vb);
+    index_buffer_destroy(&ib);
+    return failures;
+}
+
+/*
+ * textures
+ *
+ * PNG vectors are written here with a small deflate encoder, so stored,
+ * fixed and dynamic blocks and each filter are checked against the
+ * expected pixels for every supported color type and bit depth.
+ */
+
+typedef struct
+{
+    unsigned char *buf;
+    size_t pos;
+    unsigned long long bits;
+    uint nbits;
+} test_bits_t;
+
+/* write n bits, least significant first as deflate packs them */
+static void test_put_bits(test_bits_t *w, uint v, uint n)
+{
+    w->bits |= (unsigned long long)v << w->nbits;
+    w->nbits += n;
+    while (w->nbits >= 8) {
+        w->buf[w->pos++] = (unsigned char)w->bits;
+        w->bits >>= 8;
+        w->nbits -= 8;
+    }
+}
+
+static void test_flush_bits(test_bits_t *w)
+{
+    if (w->nbits) test_put_bits(w, 0, 8 - w->nbits);
+}
+
+/* huffman codes are sent most significant bit first */
+static void test_put_code(test_bits_t *w, uint code, uint len)
+{
+    uint rev = 0;
+    for (uint b = 0; b < len; b++) {
+        rev |= ((code >> b) & 1) << (len - 1 - b);
+    }
+    test_put_bits(w, rev, len);
+}
+
+/* canonical codes from code lengths */
+static void test_huffman_codes(const unsigned char *lengths, uint n, unsigned short *codes)
+{
+    uint count[16] = { 0 }, next[16], code = 0;
+    for (uint i = 0; i < n; i++) count[lengths[i]]++;
+    count[0] = 0;
+    for (uint len = 1; len < 16; len++) {
+        code = (code + count[len - 1]) << 1;
+        next[len] = code;
+    }
+    for (uint i = 0; i < n; i++) {
+        if (lengths[i]) codes[i] = (unsigned short)next[lengths[i]]++;
+    }
+}
+
+enum { test_stored, test_fixed, test_dynamic };
+
+static size_t test_matches;
+
+/* write the symbols of src with greedy matches of up to 258 bytes back */
+static void test_deflate_symbols(test_bits_t *w, const unsigned char *src, size_t n,
+    const unsigned char *lit_len, const unsigned char *dist_len)
+{
+    static const unsigned short len_base[29] = {
+        3, 4, 5, 6, 7, 8, 9, 10, 11, 13, 15, 17, 19, 23, 27, 31,
+        35, 43, 51, 59, 67, 83, 99, 115, 131, 163, 195, 227, 258
+    };
+    static const unsigned short dist_base[30] = {
+        1, 2, 3, 4, 5, 7, 9, 13, 17, 25, 33, 49, 65, 97, 129, 193,
+        257, 385, 513, 769, 1025, 1537, 2049, 3073, 4097, 6145,
+        8193, 12289, 16385, 24577
+    };
+    unsigned short lit[288], dist[30];
+    test_huffman_codes(lit_len, 288, lit);
+    test_huffman_codes(dist_len, 30, dist);
+    for (size_t i = 0; i < n; ) {
+        size_t best = 0, best_d = 0;
+        for (size_t d = 1; d <= i && d <= 258; d++) {
+            size_t len = 0;
+            while (len < 258 && i + len < n && src[i + len] == src[i + len - d]) len++;
+            if (len > best) {
+                best = len;
+                best_d = d;
+            }
+        }
+        if (best < 3) {
+            test_put_code(w, lit[src[i]], lit_len[src[i]]);
+            i++;
+            continue;
+        }
+        uint l = 28, d = 29;
+        while (len_base[l] > best) l--;
+        while (dist_base[d] > best_d) d--;
+        uint l_extra = l < 8 || l == 28 ? 0 : l / 4 - 1;
+        uint d_extra = d < 4 ? 0 : d / 2 - 1;
+        test_put_code(w, lit[257 + l], lit_len[257 + l]);
+        test_put_bits(w, (uint)best - len_base[l], l_extra);
+        test_put_code(w, dist[d], dist_len[d]);
+        test_put_bits(w, (uint)best_d - dist_base[d], d_extra);
+        test_matches++;
+        i += best;
+    }
+    test_put_code(w, lit[256], lit_len[256]);
+}
+
+/* the dynamic block code lengths, sent with repeats of the previous length */
+static void test_deflate_lengths(test_bits_t *w, const unsigned char *lengths, uint n)
+{
+    static const unsigned char order[19] = {
+        16, 17, 18, 0, 8, 7, 9, 6, 10, 5, 11, 4, 12, 3, 13, 2, 14, 1, 15
+    };
+    unsigned char cl_len[19] = { 0 };
+    unsigned short cl[19];
+    cl_len[4] = cl_len[5] = 3;
+    cl_len[8] = cl_len[9] = cl_len[16] = 2;
+    test_huffman_codes(cl_len, 19, cl);
+    test_put_bits(w, 12 - 4, 4);
+    for (uint i = 0; i < 12; i++) {
+        test_put_bits(w, cl_len[order[i]], 3);
+    }
+    for (uint i = 0; i < n; ) {
+        uint rep = 0;
+        test_put_code(w, cl[lengths[i]], cl_len[lengths[i]]);
+        while (rep < 6 && i + 1 + rep < n && lengths[i + 1 + rep] == lengths[i]) rep++;
+        if (rep >= 3) {
+            test_put_code(w, cl[16], cl_len[16]);
+            test_put_bits(w, rep - 3, 2);
+            i += rep;
+        }
+        i++;
+    }
+}
+
+/* a zlib stream of src using one type of deflate block */
+static size_t test_deflate(unsigned char *dst, const unsigned char *src, size_t n, int type)
+{
+    test_bits_t w = { dst, 0, 0, 0 };
+    unsigned char lit_len[288], dist_len[30];
+    uint a = 1, b = 0;
+
+    test_put_bits(&w, 0x78, 8);
+    test_put_bits(&w, 0x01, 8);
+    if (type == test_stored) {
+        /* several blocks, to check blocks are joined */
+        size_t i = 0;
+        do {
+            uint len = n - i < 100 ? (uint)(n - i) : 100;
+            test_put_bits(&w, i + len == n, 1);
+            test_put_bits(&w, 0, 2);
+            test_flush_bits(&w);
+            test_put_bits(&w, len, 16);
+            test_put_bits(&w, ~len & 0xffff, 16);
+            for (uint k = 0; k < len; k++) test_put_bits(&w, src[i + k], 8);
+            i += len;
+        } while (i < n);
+    } else if (type == test_fixed) {
+        memset(lit_len, 8, 144);
+        memset(lit_len + 144, 9, 112);
+        memset(lit_len + 256, 7, 24);
+        memset(lit_len + 280, 8, 8);
+        memset(dist_len, 5, 30);
+        test_put_bits(&w, 1, 1);
+        test_put_bits(&w, 1, 2);
+        test_deflate_symbols(&w, src, n, lit_len, dist_len);
+    } else {
+        /* complete codes over all 286 literal/length and 30 distance codes */
+        memset(lit_len, 8, 226);
+        memset(lit_len + 226, 9, 60);
+        lit_len[286] = lit_len[287] = 0;
+        memset(dist_len, 4, 2);
+        memset(dist_len + 2, 5, 28);
+        test_put_bits(&w, 1, 1);
+        test_put_bits(&w, 2, 2);
+        test_put_bits(&w, 286 - 257, 5);
+        test_put_bits(&w, 30 - 1, 5);
+        unsigned char lengths[316];
+        memcpy(lengths, lit_len, 286);
+        memcpy(lengths + 286, dist_len, 30);
+        test_deflate_lengths(&w, lengths, 316);
+        test_deflate_symbols(&w, src, n, lit_len, dist_len);
+    }
+    test_flush_bits(&w);
+    for (size_t i = 0; i < n; i++) {
+        a = (a + src[i]) % 65521;
+        b = (b + a) % 65521;
+    }
+    test_put_bits(&w, b >> 8, 8);
+    test_put_bits(&w, b & 0xff, 8);
+    test_put_bits(&w, a >> 8, 8);
+    test_put_bits(&w, a & 0xff, 8);
+    return w.pos;
+}
+
+static void test_put32be(unsigned char *p, uint v)
+{
+    p[0] = (unsigned char)(v >> 24);
+    p[1] = (unsigned char)(v >> 16);
+    p[2] = (unsigned char)(v >> 8);
+    p[3] = (unsigned char)v;
+}
+
+static size_t test_png_chunk(unsigned char *dst, const char *type,
+    const unsigned char *data, uint len)
+{
+    uint crc = 0xffffffff;
+    test_put32be(dst, len);
+    memcpy(dst + 4, type, 4);
+    if (len) memcpy(dst + 8, data, len);
+    for (uint i = 4; i < len + 8; i++) {
+        crc ^= dst[i];
+        for (int k = 0; k < 8; k++) crc = crc >> 1 ^ (0xedb88320 & -(crc & 1));
+    }
+    test_put32be(dst + 8 + len, ~crc);
+    return (size_t)len + 12;
+}
+
+typedef struct
+{
+    uint color;
+    uint depth;
+    uint width;
+    uint height;
+    uint filter;
+    int block;
+} test_png_t;
+
+/* a deterministic sample with runs, so matches are found */
+static uint test_sample(uint x, uint y, uint c, uint depth)
+{
+    uint h = (x / 3) * 2654435761u ^ y * 40503u ^ c * 2246822519u;
+    h ^= h >> 13;
+    h *= 0x5bd1e995;
+    h ^= h >> 15;
+    return h & ((1u << depth) - 1);
+}
+
+/*
+ * write the PNG described by t into png and its decoded pixels into rgba.
+ * filter 5 uses a different filter on each row, and filter types above
+ * 5 are written as is.
+ */
+static size_t test_png_build(const test_png_t *t, unsigned char *png, unsigned char *rgba)
+{
+    static const uint channels_of[7] = { 1, 0, 3, 1, 2, 0, 4 };
+    uint channels = channels_of[t->color], depth = t->depth;
+    size_t stride = ((size_t)t->width * channels * depth + 7) / 8;
+    uint bpp = (channels * depth + 7) / 8;
+    unsigned char *rows = (unsigned char*)calloc(stride * t->height, 1);
+    unsigned char *filtered = (unsigned char*)malloc((stride + 1) * t->height);
+    unsigned char *z = (unsigned char*)malloc((stride + 1) * t->height * 2 + 64);
+    unsigned char palette[256][4];
+    size_t pos = 8;
+
+    for (uint i = 0; i < 256; i++) {
+        palette[i][0] = (unsigned char)(i * 7);
+        palette[i][1] = (unsigned char)(i * 13 + 1);
+        palette[i][2] = (unsigned char)(255 - i);
+        palette[i][3] = i < 3 ? (unsigned char)(i * 100) : 255;
+    }
+    for (uint y = 0; y < t->height; y++) {
+        unsigned char *row = rows + y * stride;
+        for (uint x = 0; x < t->width; x++) {
+            unsigned char *out = rgba + ((size_t)y * t->width + x) * 4;
+            uint v[4];
+            for (uint c = 0; c < channels; c++) {
+                v[c] = test_sample(x, y, c, depth);
+                size_t bit = ((size_t)x * channels + c) * depth;
+                if (depth == 16) {
+                    row[bit / 8] = (unsigned char)(v[c] >> 8);
+                    row[bit / 8 + 1] = (unsigned char)v[c];
+                    v[c] >>= 8;
+                } else {
+                    row[bit / 8] |= (unsigned char)(v[c] << (8 - depth - bit % 8));
+                }
+            }
+            switch (t->color) {
+            case texture_png_gray: v[1] = v[2] = v[0]; v[3] = 255; break;
+            case texture_png_gray_alpha: v[3] = v[1]; v[1] = v[2] = v[0]; break;
+            case texture_png_rgb: v[3] = 255; break;
+            case texture_png_palette:
+                for (uint c = 4; c-- > 0; ) v[c] = palette[v[0]][c];
+                break;
+            }
+            for (uint c = 0; c < 4; c++) out[c] = (unsigned char)v[c];
+        }
+    }
+    for (uint y = 0; y < t->height; y++) {
+        const unsigned char *cur = rows + y * stride;
+        const unsigned char *prev = y ? cur - stride : NULL;
+        unsigned char *out = filtered + y * (stride + 1);
+        uint f = t->filter == 5 ? y % 5 : t->filter;
+        out[0] = (unsigned char)f;
+        for (size_t i = 0; i < stride; i++) {
+            uint a = i >= bpp ? cur[i - bpp] : 0, b = prev ? prev[i] : 0;
+            uint c = i >= bpp && prev ? prev[i - bpp] : 0;
+            switch (f) {
+            case 1: out[i + 1] = (unsigned char)(cur[i] - a); break;
+            case 2: out[i + 1] = (unsigned char)(cur[i] - b); break;
+            case 3: out[i + 1] = (unsigned char)(cur[i] - ((a + b) >> 1)); break;
+            case 4:
+                out[i + 1] = (unsigned char)(cur[i] - texture_paeth((unsigned char)a,
+                    (unsigned char)b, (unsigned char)c));
+                break;
+            default: out[i + 1] = cur[i]; break;
+            }
+        }
+    }
+    size_t zsize = test_deflate(z, filtered, (stride + 1) * t->height, t->block);
+
+    memcpy(png, "\x89PNG\r\n\x1a\n", 8);
+    unsigned char ihdr[13] = { 0 };
+    test_put32be(ihdr, t->width);
+    test_put32be(ihdr + 4, t->height);
+    ihdr[8] = (unsigned char)depth;
+    ihdr[9] = (unsigned char)t->color;
+    pos += test_png_chunk(png + pos, "IHDR", ihdr, 13);
+    if (t->color == texture_png_palette) {
+        unsigned char plte[768], trns[3];
+        uint count = depth < 8 ? 1u << depth : 256;
+        for (uint i = 0; i < count; i++) memcpy(plte + i * 3, palette[i], 3);
+        for (uint i = 0; i < 3; i++) trns[i] = palette[i][3];
+        pos += test_png_chunk(png + pos, "PLTE", plte, count * 3);
+        pos += test_png_chunk(png + pos, "tRNS", trns, 3);
+    }
+    /* two IDAT chunks, to check they are joined */
+    pos += test_png_chunk(png + pos, "IDAT", z, (uint)(zsize / 2));
+    pos += test_png_chunk(png + pos, "IDAT", z + zsize / 2, (uint)(zsize - zsize / 2));
+    pos += test_png_chunk(png + pos, "IEND", NULL, 0);
+    free(rows);
+    free(filtered);
+    free(z);
+    return pos;
+}
+
+/* every color type and depth, with each filter and block type */
+static int test_texture_png()
+{
+    static const uint formats[][2] = {
+        { texture_png_gray, 8 }, { texture_png_gray, 16 },
+        { texture_png_rgb, 8 }, { texture_png_rgb, 16 },
+        { texture_png_palette, 1 }, { texture_png_palette, 2 },
+        { texture_png_palette, 4 }, { texture_png_palette, 8 },
+        { texture_png_gray_alpha, 8 }, { texture_png_gray_alpha, 16 },
+        { texture_png_rgba, 8 }, { texture_png_rgba, 16 },
+    };
+    enum { width = 13, height = 7 };
+    unsigned char *png = (unsigned char*)malloc(8192);
+    unsigned char rgba[width * height * 4];
+    texture_image ti;
+
+    test_matches = 0;
+    for (size_t i = 0; i < sizeof(formats) / sizeof(formats[0]); i++) {
+        for (uint filter = 0; filter <= 5; filter++) {
+            for (int block = test_stored; block <= test_dynamic; block++) {
+                test_png_t t = { formats[i][0], formats[i][1], width, height, filter, block };
+                size_t size = test_png_build(&t, png, rgba);
+                int ret = texture_image_decode(&ti, png, size, 0);
+                CHECK(ret == 0);
+                if (ret < 0) {
+                    fprintf(stderr, "color=%u depth=%u filter=%u block=%d: %s\n",
+                        t.color, t.depth, filter, block, strerror(errno));
+                    continue;
+                }
+                CHECK(ti.format == texture_rgba8 && ti.srgb == 1);
+                CHECK(ti.width == width && ti.height == height && ti.level_count == 1);
+                CHECK(memcmp(ti.data, rgba, sizeof(rgba)) == 0);
+                texture_image_destroy(&ti);
+            }
+        }
+    }
+    CHECK(test_matches > 0);
+
+    /* the mip chain is built down to 1x1 from level 0 */
+    test_png_t t = { texture_png_rgba, 8, width, height, 0, test_fixed };
+    size_t size = test_png_build(&t, png, rgba);
+    CHECK(texture_image_decode(&ti, png, size, 1) == 0);
+    CHECK(ti.level_count == 4);
+    CHECK(ti.levels[3].width == 1 && ti.levels[3].height == 1);
+    CHECK(ti.levels[1].width == 6 && ti.levels[1].height == 3);
+    CHECK(ti.data[ti.levels[1].offset] == (rgba[0] + rgba[4] +
+        rgba[width * 4] + rgba[width * 4 + 4] + 2) >> 2);
+    texture_image_destroy(&ti);
+    free(png);
+    return failures;
+}
+
+static int test_png_error(const test_png_t *t, size_t offset, unsigned char value,
+    size_t cut, int err)
+{
+    unsigned char *png = (unsigned char*)malloc(8192);
+    unsigned char rgba[64 * 64 * 4];
+    texture_image ti;
+    size_t size = test_png_build(t, png, rgba);
+    if (offset) png[offset] = value;
+    int ret = texture_image_decode(&ti, png, size - cut, 0);
+    free(png);
+    return ret == -1 && errno == err && ti.data == NULL;
+}
+
+/* unsupported headers and corrupt streams are rejected */
+static int test_texture_png_errors()
+{
+    /* IHDR depth, color type and interlace are at 24, 25 and 28 */
+    test_png_t palette = { texture_png_palette, 8, 8, 8, 0, test_dynamic };
+    test_png_t gray = { texture_png_gray, 8, 8, 8, 1, test_fixed };
+    test_png_t bad_filter = { texture_png_rgba, 8, 8, 8, 7, test_stored };
+    CHECK(test_png_error(&palette, 24, 16, 0, ENOTSUP));
+    CHECK(test_png_error(&palette, 24, 3, 0, ENOTSUP));
+    CHECK(test_png_error(&gray, 24, 4, 0, ENOTSUP));
+    CHECK(test_png_error(&gray, 25, 5, 0, EINVAL));
+    CHECK(test_png_error(&gray, 28, 1, 0, ENOTSUP));
+    CHECK(test_png_error(&bad_filter, 0, 0, 0, EINVAL));
+    /* cuts into the IDAT chunks, past the 12 byte IEND */
+    for (size_t cut = 13; cut < 200; cut += 7) {
+        CHECK(test_png_error(&palette, 0, 0, cut, EINVAL));
+    }
+    return failures;
+}
+
+/* a KTX2 header and level index, with the levels stored smallest first */
+static size_t test_ktx2_build(unsigned char *ktx, uint vk, uint width, uint height,
+    uint level_count, const texture_image *layout)
+{
+    static const unsigned char magic[12] = {
+        0xab, 'K', 'T', 'X', ' ', '2', '0', 0xbb, '\r', '\n', 0x1a, '\n'
+    };
+    uint stored = level_count ? level_count : 1;
+    size_t offset = 80 + stored * 24;
+    memset(ktx, 0, offset);
+    memcpy(ktx, magic, sizeof(magic));
+    test_put32(ktx + 12, vk);
+    test_put32(ktx + 20, width);
+    test_put32(ktx + 24, height);
+    test_put32(ktx + 36, 1);
+    test_put32(ktx + 40, level_count);
+    for (uint l = stored; l-- > 0; ) {
+        const texture_level *lv = &layout->levels[l];
+        unsigned char *e = ktx + 80 + l * 24;
+        test_put32(e, (uint)offset);
+        test_put32(e + 8, (uint)lv->size);
+        test_put32(e + 16, (uint)lv->size);
+        for (size_t i = 0; i < lv->size; i++) {
+            ktx[offset + i] = (unsigned char)(l * 31 + i);
+        }
+        offset += lv->size;
+    }
+    return offset;
+}
+
+static int test_ktx2_levels(const unsigned char *ktx, const texture_image *ti)
+{
+    int ok = 1;
+    for (uint l = 0; l < ti->level_count; l++) {
+        const texture_level *lv = &ti->levels[l];
+        const unsigned char *e = ktx + 80 + l * 24;
+        ok &= memcmp(ti->data + lv->offset, ktx + texture_get32(e), lv->size) == 0;
+        ok &= ti->data[lv->offset] == (unsigned char)(l * 31);
+    }
+    return ok;
+}
+
+static int test_texture_ktx2()
+{
+    unsigned char *ktx = (unsigned char*)malloc(4096);
+    texture_image layout, ti;
+    size_t size;
+
+    /* rgba8 with three levels down to 1x1 */
+    texture_image_alloc(&layout, texture_rgba8, 4, 2, 3);
+    size = test_ktx2_build(ktx, texture_vk_r8g8b8a8_unorm, 4, 2, 3, &layout);
+    CHECK(texture_image_decode(&ti, ktx, size, 1) == 0);
+    CHECK(ti.format == texture_rgba8 && ti.srgb == 0 && ti.level_count == 3);
+    CHECK(ti.levels[2].width == 1 && ti.levels[2].height == 1 && ti.levels[2].size == 4);
+    CHECK(test_ktx2_levels(ktx, &ti));
+    texture_image_destroy(&ti);
+
+    /* a short level length and a supercompressed file */
+    ktx[80 + 2 * 24 + 8] = 3;
+    CHECK(texture_image_decode(&ti, ktx, size, 1) == -1 && errno == EINVAL);
+    ktx[80 + 2 * 24 + 8] = 4;
+    CHECK(texture_image_decode(&ti, ktx, size - 1, 1) == -1 && errno == EINVAL);
+    test_put32(ktx + 44, 1);
+    CHECK(texture_image_decode(&ti, ktx, size, 1) == -1 && errno == ENOTSUP);
+    texture_image_destroy(&layout);
+
+    /* bc7 srgb, 8x8 in four blocks */
+    texture_image_alloc(&layout, texture_bc7, 8, 8, 1);
+    size = test_ktx2_build(ktx, texture_vk_bc7_srgb, 8, 8, 1, &layout);
+    CHECK(texture_image_decode(&ti, ktx, size, 1) == 0);
+    CHECK(ti.format == texture_bc7 && ti.srgb == 1 && ti.level_count == 1);
+    CHECK(ti.size == 64 && test_ktx2_levels(ktx, &ti));
+    texture_image_destroy(&ti);
+    texture_image_destroy(&layout);
+
+    /* no levels stored below level 0, the rest are built */
+    texture_image_alloc(&layout, texture_rgba8, 4, 4, 1);
+    size = test_ktx2_build(ktx, texture_vk_r8g8b8a8_srgb, 4, 4, 0, &layout);
+    CHECK(texture_image_decode(&ti, ktx, size, 1) == 0);
+    CHECK(ti.srgb == 1 && ti.level_count == 3);
+    texture_image_destroy(&ti);
+    texture_image_destroy(&layout);
+    free(ktx);
+    return failures;
+}
+
+/* a DDS header with either a fourcc or a 32 bit rgb pixel format */
+static size_t test_dds_build(unsigned char *dds, uint width, uint height,
+    uint level_count, uint fourcc, uint rmask, uint dxgi, size_t data_size)
+{
+    size_t offset = 128;
+    memset(dds, 0, 148);
+    memcpy(dds, "DDS ", 4);
+    test_put32(dds + 4, 124);
+    test_put32(dds + 8, texture_dds_mipmapcount);
+    test_put32(dds + 12, height);
+    test_put32(dds + 16, width);
+    test_put32(dds + 28, level_count);
+    test_put32(dds + 76, 32);
+    if (fourcc) {
+        test_put32(dds + 80, texture_dds_fourcc);
+        test_put32(dds + 84, fourcc);
+    } else {
+        test_put32(dds + 80, texture_dds_rgb);
+        test_put32(dds + 88, 32);
+        test_put32(dds + 92, rmask);
+    }
+    if (dxgi) {
+        test_put32(dds + 128, dxgi);
+        test_put32(dds + 132, 3);
+        test_put32(dds + 140, 1);
+        offset += 20;
+    }
+    for (size_t i = 0; i < data_size; i++) {
+        dds[offset + i] = (unsigned char)(i * 17);
+    }
+    return offset + data_size;
+}
+
+static int test_texture_dds()
+{
+    unsigned char *dds = (unsigned char*)malloc(4096);
+    texture_image ti;
+    size_t size;
+
+    size = test_dds_build(dds, 4, 4, 3, 0, 0x000000ff, 0, 64 + 16 + 4);
+    CHECK(texture_image_decode(&ti, dds, size, 1) == 0);
+    CHECK(ti.format == texture_rgba8 && ti.level_count == 3 && ti.size == 84);
+    CHECK(ti.levels[2].offset == 80 && ti.data[80] == (unsigned char)(80 * 17));
+    texture_image_destroy(&ti);
+    CHECK(texture_image_decode(&ti, dds, size - 1, 1) == -1 && errno == EINVAL);
+    test_put32(dds + 112, 0x200);
+    CHECK(texture_image_decode(&ti, dds, size, 1) == -1 && errno == ENOTSUP);
+
+    size = test_dds_build(dds, 4, 4, 1, 0, 0x00ff0000, 0, 64);
+    CHECK(texture_image_decode(&ti, dds, size, 1) == 0);
+    CHECK(ti.format == texture_bgra8 && ti.level_count == 1);
+    texture_image_destroy(&ti);
+
+    size = test_dds_build(dds, 8, 8, 2, texture_fourcc('D','X','T','1'), 0, 0, 32 + 8);
+    CHECK(texture_image_decode(&ti, dds, size, 1) == 0);
+    CHECK(ti.format == texture_bc1 && ti.level_count == 2 && ti.levels[1].size == 8);
+    CHECK(memcmp(ti.data, dds + 128, 40) == 0);
+    texture_image_destroy(&ti);
+
+    size = test_dds_build(dds, 8, 4, 1, texture_fourcc('D','X','1','0'), 0,
+        texture_dxgi_bc7_srgb, 32);
+    CHECK(texture_image_decode(&ti, dds, size, 1) == 0);
+    CHECK(ti.format == texture_bc7 && ti.srgb == 1 && ti.size == 32);
+    CHECK(memcmp(ti.data, dds + 148, 32) == 0);
+    texture_image_destroy(&ti);
+
+    size = test_dds_build(dds, 8, 4, 1, texture_fourcc('D','X','1','0'), 0, 2, 32);
+    CHECK(texture_image_decode(&ti, dds, size, 1) == -1 && errno == ENOTSUP);
+    free(dds);
+    return failures;
+}
+
+/*
+ * pack files
+ */
+
+/* a pack built from the scratch directory serves each file by name */
+static int test_pack_file()
+{
+    static const char *names[] = { "a.txt", "dir/b.bin", "empty" };
+    unsigned char bin[100];
+    char filename[128], packname[128];
+    pack_file pk;
+    buffer view;
+
+    for (uint i = 0; i < sizeof(bin); i++) {
+        bin[i] = (unsigned char)(i * 7);
+    }
+    test_path(filename, sizeof(filename), "dir");
+    CHECK(mkdir(filename, 0755) == 0);
+    CHECK(test_write(test_path(filename, sizeof(filename), names[0]), "alpha", 5) == 0);
+    CHECK(test_write(test_path(filename, sizeof(filename), names[1]), bin, sizeof(bin)) == 0);
+    CHECK(test_write(test_path(filename, sizeof(filename), names[2]), "", 0) == 0);
+    test_path(packname, sizeof(packname), "test.pack");
+    CHECK(pack_file_write(packname, test_dir, names, 3) == 0);
+
+    CHECK(pack_file_open(&pk, packname) == 0);
+    CHECK(pack_file_find(&pk, "a.txt", &view) == 0 && view.length == 5 &&
+        strcmp((const char*)view.data, "alpha") == 0);
+    CHECK(pack_file_find(&pk, "dir/b.bin", &view) == 0 && view.length == sizeof(bin) &&
+        memcmp(view.data, bin, sizeof(bin)) == 0 && ((const char*)view.data)[100] == 0);
+    CHECK((size_t)view.data % PACK_FILE_ALIGN == 0);
+    CHECK(pack_file_find(&pk, "empty", &view) == 0 && view.length == 0);
+    CHECK(pack_file_find(&pk, "b.bin", &view) == -1 && errno == ENOENT);
+    CHECK(pack_file_find(&pk, "a.tx", &view) == -1 && errno == ENOENT);
+
+    /* a copy in memory serves the same views, and damage is rejected */
+    size_t size = pk.size;
+    unsigned long long *copy = (unsigned long long*)malloc(size);
+    unsigned char *p = (unsigned char*)copy;
+    memcpy(copy, pk.base, size);
+    pack_file_close(&pk);
+    CHECK(pack_file_find(&pk, "a.txt", &view) == -1 && errno == ENOENT);
+    CHECK(pack_file_open_memory(&pk, copy, size) == 0);
+    CHECK(pack_file_find(&pk, "empty", &view) == 0 && view.length == 0);
+
+    pack_file_header *h = (pack_file_header*)p;
+    pack_file_entry *e = (pack_file_entry*)(h + 1);
+    CHECK(pack_file_open_memory(&pk, copy, size - 1) == -1 && errno == EINVAL);
+    CHECK(pack_file_open_memory(&pk, p + 8, size - 8) == -1 && errno == EINVAL);
+    h->magic ^= 1;
+    CHECK(pack_file_open_memory(&pk, copy, size) == -1);
+    h->magic ^= 1;
+    h->entry_count = 0x10000000u;
+    CHECK(pack_file_open_memory(&pk, copy, size) == -1);
+    h->entry_count = 3;
+    e[1].size += PACK_FILE_ALIGN;
+    CHECK(pack_file_open_memory(&pk, copy, size) == -1);
+    e[1].size -= PACK_FILE_ALIGN;
+    p[h->names_offset] ^= 1;
+    CHECK(pack_file_open_memory(&pk, copy, size) == -1);
+    p[h->names_offset] ^= 1;
+    p[e[0].offset + e[0].size] = 'x';
+    CHECK(pack_file_open_memory(&pk, copy, size) == -1);
+    p[e[0].offset + e[0].size] = 0;
+    CHECK(pack_file_open_memory(&pk, copy, size) == 0);
+    free(copy);
+
+    /* a failed write leaves the previous pack in place */
+    static const char *missing[] = { "a.txt", "missing" }, *twice[] = { "a.txt", "a.txt" };
+    CHECK(pack_file_write(packname, test_dir, missing, 2) == -1 && errno == ENOENT);
+    CHECK(pack_file_write(packname, test_dir, twice, 2) == -1 && errno == EEXIST);
+    CHECK(pack_file_open(&pk, packname) == 0 && pk.header->entry_count == 3);
+    pack_file_close(&pk);
+
+    /* a truncated file fails to open */
+    struct stat st;
+    CHECK(stat(packname, &st) == 0 && truncate(packname, st.st_size - 1) == 0);
+    CHECK(pack_file_open(&pk, packname) == -1 && errno == EINVAL && !pk.header);
+
+    remove(packname);
+    for (uint i = 0; i < 3; i++) {
+        remove(test_path(filename, sizeof(filename), names[i]));
+    }
+    rmdir(test_path(filename, sizeof(filename), "dir"));
+    return failures;
+}
+
+static const test_def_t tests[] = {
+    { "linmath_simd", test_linmath_simd },
+    { "vec3_batch", test_vec3_batch },
+    { "job_chunks", test_job_chunks },
+    { "job_graph", test_job_graph },
+    { "job_successors", test_job_successors },
+    { "frustum_cull", test_frustum_cull },
+    { "scene_graph", test_scene_graph },
+    { "object_store", test_object_store },
+    { "vertex_pack", test_vertex_pack },
+    { "mesh_optimize", test_mesh_optimize },
+    { "mesh_weld", test_mesh_weld },
+    { "meshlet_build", test_meshlet_build },
+    { "mesh_simplify", test_mesh_simplify },
+    { "mesh_cache", test_mesh_cache },
+    { "mesh_codec", test_mesh_codec },
+    { "mesh_import_obj", test_mesh_import_obj },
+    { "mesh_import_ply", test_mesh_import_ply },
+    { "texture_png", test_texture_png },
+    { "texture_png_errors", test_texture_png_errors },
+    { "texture_ktx2", test_texture_ktx2 },
+    { "texture_dds", test_texture_dds },
+    { "pack_file", test_pack_file },
+};
+
+int main(int argc, char *argv[])
+{
+    int failed = 0, found = 0;
+    size_t count = sizeof(tests) / sizeof(tests[0]);
+
+    for (size_t i = 0; i < count; i++) {
+        int run = argc < 2;
+        for (int k = 1; k < argc; k++) {
+            run |= strcmp(argv[k], tests[i].name) == 0;
+        }
+        if (!run) continue;
+        found++;
+        failures = 0;
+        int ret = tests[i].fn();
+        printf("%-28s %s\n", tests[i].name, ret ? "FAIL" : "ok");
+        failed += ret != 0;
+    }
+    if (test_dir[0]) {
+        rmdir(test_dir);
+    }
+    if (!found) {
+        fprintf(stderr, "error: no tests match\n");
+        exit(1);
+    }
+    exit(failed ? EXIT_FAILURE : EXIT_SUCCESS);
+}
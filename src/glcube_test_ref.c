@@ -0,0 +1,52 @@
+/*
+ * glcube_test_ref
+ *
+ * the scalar linmath.h kernels, built with LINMATH_NO_SIMD as the
+ * reference glcube_test checks the SSE2 and AVX2 kernels against. the
+ * functions in linmath.h are static, so each is wrapped with a ref_ name.
+ */
+
+#define LINMATH_NO_SIMD
+#include "linmath.h"
+
+void ref_mat4x4_transpose(mat4x4 M, mat4x4 N) { mat4x4_transpose(M, N); }
+void ref_mat4x4_scale_aniso(mat4x4 M, mat4x4 a, float x, float y, float z)
+{
+    mat4x4_scale_aniso(M, a, x, y, z);
+}
+void ref_mat4x4_mul(mat4x4 M, mat4x4 a, mat4x4 b) { mat4x4_mul(M, a, b); }
+void ref_mat4x4_mul_vec4(vec4 r, mat4x4 M, vec4 v) { mat4x4_mul_vec4(r, M, v); }
+void ref_mat4x4_translate_in_place(mat4x4 M, float x, float y, float z)
+{
+    mat4x4_translate_in_place(M, x, y, z);
+}
+void ref_mat4x4_rotate_X(mat4x4 Q, mat4x4 M, float angle) { mat4x4_rotate_X(Q, M, angle); }
+void ref_mat4x4_rotate_Y(mat4x4 Q, mat4x4 M, float angle) { mat4x4_rotate_Y(Q, M, angle); }
+void ref_mat4x4_rotate_Z(mat4x4 Q, mat4x4 M, float angle) { mat4x4_rotate_Z(Q, M, angle); }
+void ref_mat4x4_invert(mat4x4 T, mat4x4 M) { mat4x4_invert(T, M); }
+void ref_mat4x4_mul_vec3_soa(float *ox, float *oy, float *oz, mat4x4 M,
+    float const *x, float const *y, float const *z, float w, size_t n)
+{
+    mat4x4_mul_vec3_soa(ox, oy, oz, M, x, y, z, w, n);
+}
+void ref_mat4x4_mul_vec3_stride(void *out, size_t ostride, mat4x4 M,
+    void const *in, size_t istride, float w, size_t n)
+{
+    mat4x4_mul_vec3_stride(out, ostride, M, in, istride, w, n);
+}
+void ref_vec3_soa_bounds(vec3 lo, vec3 hi,
+    float const *x, float const *y, float const *z, size_t n)
+{
+    vec3_soa_bounds(lo, hi, x, y, z, n);
+}
+void ref_quat_mul(quat r, quat p, quat q) { quat_mul(r, p, q); }
+void ref_mat4x4_compose_euler_n(mat4x4 *M, mat4x4 *N,
+    vec3 *scale, vec3 *trans, vec3 *rot, size_t n)
+{
+    mat4x4_compose_euler_n(M, N, scale, trans, rot, n);
+}
+void ref_mat4x4_compose_quat_n(mat4x4 *M, mat4x4 *N,
+    vec3 *scale, vec3 *trans, quat *rot, size_t n)
+{
+    mat4x4_compose_quat_n(M, N, scale, trans, rot, n);
+}
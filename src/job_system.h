@@ -0,0 +1,469 @@
+/*
+ * Copyright (c) 2020 Michael Clark <michaeljclark@mac.com>
+ *
+ * Permission to use, copy, modify, and/or distribute this software for any
+ * purpose with or without fee is hereby granted, provided that the above
+ * copyright notice and this permission notice appear in all copies.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS" AND THE AUTHOR DISCLAIMS ALL WARRANTIES
+ * WITH REGARD TO THIS SOFTWARE INCLUDING ALL IMPLIED WARRANTIES OF
+ * MERCHANTABILITY AND FITNESS. IN NO EVENT SHALL THE AUTHOR BE LIABLE FOR
+ * ANY SPECIAL, DIRECT, INDIRECT, OR CONSEQUENTIAL DAMAGES OR ANY DAMAGES
+ * WHATSOEVER RESULTING FROM LOSS OF USE, DATA OR PROFITS, WHETHER IN AN
+ * ACTION OF CONTRACT, NEGLIGENCE OR OTHER TORTIOUS ACTION, ARISING OUT OF
+ * OR IN CONNECTION WITH THE USE OR PERFORMANCE OF THIS SOFTWARE.
+ */
+
+#pragma once
+
+/*
+ * job system interface
+ *
+ * a pool of worker threads, each with a work-stealing deque (Chase-Lev,
+ * with the C11 memory orderings of Le et al.). the thread that calls
+ * job_system_init is worker 0 and runs jobs while it waits in job_wait,
+ * so jobs that touch the OpenGL context can stay on that thread.
+ *
+ * a job calls fn(job, arg, begin, end). jobs created with a grain split
+ * themselves in halves aligned to the grain, pushing the right halves for
+ * other workers to steal, so fn is called on chunks of at most grain items
+ * starting at multiples of grain, and the job is done when all chunks are.
+ * job_depends makes a job wait for another before it runs; jobs only run
+ * once submitted, so a frame can be built as a graph and then released.
+ * the first JOB_SUCCESSORS_MAX dependents of a job are kept in the job
+ * and the list moves to the heap when more are added.
+ *
+ * jobs come from a per-thread pool of JOB_POOL_SIZE entries and a slot is
+ * only reused once its job has completed. chunks hold the only reference
+ * to themselves, while jobs from job_create also hold one for the caller,
+ * which job_free drops, so the caller can wait on and add dependencies to
+ * a job until it frees it. when the pool is full a job stops splitting and
+ * runs its remaining chunks itself, and job_create falls back to malloc.
+ * requires pthreads and C11 atomics (pthread.h, stdatomic.h, sched.h and
+ * unistd.h).
+ */
+
+enum {
+    JOB_DEQUE_SIZE = 4096,
+    JOB_POOL_SIZE = 4096,
+    JOB_SUCCESSORS_MAX = 8,
+    JOB_WORKERS_MAX = 64,
+    JOB_SPIN_COUNT = 64,
+};
+
+typedef struct job job_t;
+typedef struct job_system job_system_t;
+typedef void (*job_fn)(job_t *job, void *arg, size_t begin, size_t end);
+
+struct job
+{
+    job_fn fn;
+    void *arg;
+    size_t begin, end, grain;
+    job_t *parent;
+    atomic_int unfinished;      /* this job plus its unfinished chunks */
+    atomic_int pending;         /* prerequisites, plus one until submitted */
+    atomic_int done;
+    atomic_int refs;            /* zero when the slot is free */
+    atomic_flag lock;
+    int pooled;
+    int nsucc;
+    int succ_max;
+    job_t **succ;               /* succ_inline, or a heap array */
+    job_t *succ_inline[JOB_SUCCESSORS_MAX];
+};
+
+typedef struct
+{
+    atomic_long top;
+    atomic_long bottom;
+    _Atomic(job_t*) ring[JOB_DEQUE_SIZE];
+} job_deque;
+
+typedef struct
+{
+    job_deque deque;
+    job_t pool[JOB_POOL_SIZE];
+    size_t next;
+    uint rng;
+    int id;
+    job_system_t *js;
+} job_worker;
+
+struct job_system
+{
+    int nworkers;
+    job_worker *workers;
+    pthread_t *threads;
+    atomic_int quit;
+    atomic_int queued;
+    atomic_int sleepers;
+    pthread_mutex_t mutex;
+    pthread_cond_t cond;
+};
+
+static void job_system_init(job_system_t *js, int nthreads);
+static void job_system_destroy(job_system_t *js);
+static int job_system_threads(job_system_t *js);
+static job_t* job_create(job_system_t *js, job_fn fn, void *arg,
+    size_t begin, size_t end, size_t grain);
+static void job_depends(job_t *job, job_t *prerequisite);
+static void job_submit(job_system_t *js, job_t *job);
+static void job_wait(job_system_t *js, job_t *job);
+static void job_free(job_system_t *js, job_t *job);
+static void job_parallel_for(job_system_t *js, job_fn fn, void *arg,
+    size_t n, size_t grain);
+
+/*
+ * job system implementation
+ */
+
+static _Thread_local int job_worker_id;
+
+static int job_deque_push(job_deque *q, job_t *j)
+{
+    long b = atomic_load_explicit(&q->bottom, memory_order_relaxed);
+    long t = atomic_load_explicit(&q->top, memory_order_acquire);
+    if (b - t >= JOB_DEQUE_SIZE) return 0;
+    atomic_store_explicit(&q->ring[b & (JOB_DEQUE_SIZE-1)], j, memory_order_relaxed);
+    atomic_store_explicit(&q->bottom, b + 1, memory_order_release);
+    return 1;
+}
+
+static job_t* job_deque_pop(job_deque *q)
+{
+    long b = atomic_load_explicit(&q->bottom, memory_order_relaxed) - 1;
+    atomic_store_explicit(&q->bottom, b, memory_order_relaxed);
+    atomic_thread_fence(memory_order_seq_cst);
+    long t = atomic_load_explicit(&q->top, memory_order_relaxed);
+    job_t *j = NULL;
+    if (t <= b) {
+        j = atomic_load_explicit(&q->ring[b & (JOB_DEQUE_SIZE-1)], memory_order_relaxed);
+        if (t == b) {
+            /* last entry, race against thieves */
+            if (!atomic_compare_exchange_strong_explicit(&q->top, &t, t + 1,
+                    memory_order_seq_cst, memory_order_relaxed)) {
+                j = NULL;
+            }
+            atomic_store_explicit(&q->bottom, b + 1, memory_order_relaxed);
+        }
+    } else {
+        atomic_store_explicit(&q->bottom, b + 1, memory_order_relaxed);
+    }
+    return j;
+}
+
+static job_t* job_deque_steal(job_deque *q)
+{
+    long t = atomic_load_explicit(&q->top, memory_order_acquire);
+    atomic_thread_fence(memory_order_seq_cst);
+    long b = atomic_load_explicit(&q->bottom, memory_order_acquire);
+    if (t >= b) return NULL;
+    job_t *j = atomic_load_explicit(&q->ring[t & (JOB_DEQUE_SIZE-1)], memory_order_relaxed);
+    if (!atomic_compare_exchange_strong_explicit(&q->top, &t, t + 1,
+            memory_order_seq_cst, memory_order_relaxed)) {
+        return NULL;
+    }
+    return j;
+}
+
+/*
+ * take a free slot from this thread's pool, or NULL if every slot holds a
+ * job that has not completed. only the owning thread takes slots, while
+ * any thread may free them, so a slot seen free stays free.
+ */
+static job_t* job_alloc(job_system_t *js, job_fn fn, void *arg,
+    size_t begin, size_t end, size_t grain, job_t *parent, int pending, int refs)
+{
+    job_worker *w = &js->workers[job_worker_id];
+    job_t *j = NULL;
+    for (size_t i = 0; i < JOB_POOL_SIZE; i++) {
+        job_t *k = &w->pool[w->next++ & (JOB_POOL_SIZE-1)];
+        if (atomic_load_explicit(&k->refs, memory_order_acquire) == 0) {
+            j = k;
+            break;
+        }
+    }
+    if (!j) return NULL;
+    j->pooled = 1;
+    j->fn = fn;
+    j->arg = arg;
+    j->begin = begin;
+    j->end = end;
+    j->grain = grain;
+    j->parent = parent;
+    atomic_init(&j->unfinished, 1);
+    atomic_init(&j->pending, pending);
+    atomic_init(&j->done, 0);
+    atomic_store_explicit(&j->refs, refs, memory_order_relaxed);
+    atomic_flag_clear(&j->lock);
+    j->nsucc = 0;
+    j->succ_max = JOB_SUCCESSORS_MAX;
+    j->succ = j->succ_inline;
+    return j;
+}
+
+static void job_execute(job_system_t *js, job_t *j);
+
+static void job_unref(job_t *j)
+{
+    if (atomic_fetch_sub_explicit(&j->refs, 1, memory_order_acq_rel) == 1 && !j->pooled) {
+        free(j);
+    }
+}
+
+static void job_push(job_system_t *js, job_t *j)
+{
+    if (!job_deque_push(&js->workers[job_worker_id].deque, j)) {
+        job_execute(js, j);
+        return;
+    }
+    atomic_fetch_add(&js->queued, 1);
+    if (atomic_load(&js->sleepers) > 0) {
+        pthread_mutex_lock(&js->mutex);
+        pthread_cond_broadcast(&js->cond);
+        pthread_mutex_unlock(&js->mutex);
+    }
+}
+
+static void job_release(job_system_t *js, job_t *j)
+{
+    if (atomic_fetch_sub(&j->pending, 1) == 1) {
+        job_push(js, j);
+    }
+}
+
+static void job_finish(job_system_t *js, job_t *j)
+{
+    if (atomic_fetch_sub(&j->unfinished, 1) != 1) return;
+
+    /* once done is set no successors are added, and j is ours until unref */
+    job_t *parent = j->parent;
+    while (atomic_flag_test_and_set_explicit(&j->lock, memory_order_acquire));
+    atomic_store_explicit(&j->done, 1, memory_order_release);
+    atomic_flag_clear_explicit(&j->lock, memory_order_release);
+
+    for (int i = 0; i < j->nsucc; i++) {
+        job_release(js, j->succ[i]);
+    }
+    if (j->succ != j->succ_inline) {
+        free(j->succ);
+        j->succ = j->succ_inline;
+    }
+    if (parent) {
+        job_finish(js, parent);
+    }
+    job_unref(j);
+}
+
+static void job_execute(job_system_t *js, job_t *j)
+{
+    size_t begin = j->begin, end = j->end, grain = j->grain;
+    if (grain) {
+        while (end - begin > grain) {
+            size_t mid = begin + (end - begin + grain - 1) / grain / 2 * grain;
+            job_t *chunk = job_alloc(js, j->fn, j->arg, mid, end, grain, j, 0, 1);
+            if (!chunk) break;
+            atomic_fetch_add(&j->unfinished, 1);
+            job_push(js, chunk);
+            end = mid;
+        }
+        /* the pool is full, so run the remaining chunks here */
+        for (; end - begin > grain; begin += grain) {
+            j->fn(j, j->arg, begin, begin + grain);
+        }
+    }
+    if (!grain || end > begin) {
+        j->fn(j, j->arg, begin, end);
+    }
+    job_finish(js, j);
+}
+
+static job_t* job_next(job_system_t *js)
+{
+    job_worker *w = &js->workers[job_worker_id];
+    job_t *j = job_deque_pop(&w->deque);
+    for (int i = 0; !j && i < js->nworkers; i++) {
+        w->rng ^= w->rng << 13;
+        w->rng ^= w->rng >> 17;
+        w->rng ^= w->rng << 5;
+        int victim = (int)(w->rng % (uint)js->nworkers);
+        if (victim != job_worker_id) {
+            j = job_deque_steal(&js->workers[victim].deque);
+        }
+    }
+    if (j) {
+        atomic_fetch_sub(&js->queued, 1);
+    }
+    return j;
+}
+
+static void* job_worker_main(void *arg)
+{
+    job_worker *w = (job_worker*)arg;
+    job_system_t *js = w->js;
+    int spins = 0;
+
+    job_worker_id = w->id;
+    while (!atomic_load(&js->quit)) {
+        job_t *j = job_next(js);
+        if (j) {
+            job_execute(js, j);
+            spins = 0;
+        } else if (++spins < JOB_SPIN_COUNT) {
+            sched_yield();
+        } else {
+            pthread_mutex_lock(&js->mutex);
+            atomic_fetch_add(&js->sleepers, 1);
+            while (!atomic_load(&js->quit) && atomic_load(&js->queued) == 0) {
+                pthread_cond_wait(&js->cond, &js->mutex);
+            }
+            atomic_fetch_sub(&js->sleepers, 1);
+            pthread_mutex_unlock(&js->mutex);
+            spins = 0;
+        }
+    }
+    return NULL;
+}
+
+/* nthreads of zero or less uses one thread per online processor */
+static void job_system_init(job_system_t *js, int nthreads)
+{
+    if (nthreads <= 0) {
+        nthreads = (int)sysconf(_SC_NPROCESSORS_ONLN);
+    }
+    if (nthreads < 1) nthreads = 1;
+    if (nthreads > JOB_WORKERS_MAX) nthreads = JOB_WORKERS_MAX;
+
+    js->nworkers = nthreads;
+    js->workers = (job_worker*)calloc(nthreads, sizeof(job_worker));
+    js->threads = (pthread_t*)calloc(nthreads, sizeof(pthread_t));
+    atomic_init(&js->quit, 0);
+    atomic_init(&js->queued, 0);
+    atomic_init(&js->sleepers, 0);
+    pthread_mutex_init(&js->mutex, NULL);
+    pthread_cond_init(&js->cond, NULL);
+
+    for (int i = 0; i < nthreads; i++) {
+        job_worker *w = &js->workers[i];
+        atomic_init(&w->deque.top, 0);
+        atomic_init(&w->deque.bottom, 0);
+        w->rng = 2654435761u * (uint)(i + 1);
+        w->id = i;
+        w->js = js;
+    }
+    job_worker_id = 0;
+    for (int i = 1; i < nthreads; i++) {
+        pthread_create(&js->threads[i], NULL, job_worker_main, &js->workers[i]);
+    }
+}
+
+static void job_system_destroy(job_system_t *js)
+{
+    pthread_mutex_lock(&js->mutex);
+    atomic_store(&js->quit, 1);
+    pthread_cond_broadcast(&js->cond);
+    pthread_mutex_unlock(&js->mutex);
+    for (int i = 1; i < js->nworkers; i++) {
+        pthread_join(js->threads[i], NULL);
+    }
+    pthread_cond_destroy(&js->cond);
+    pthread_mutex_destroy(&js->mutex);
+    free(js->threads);
+    free(js->workers);
+    js->threads = NULL;
+    js->workers = NULL;
+}
+
+static int job_system_threads(job_system_t *js)
+{
+    return js->nworkers;
+}
+
+/* grain of zero calls fn once with the whole range; release with job_free */
+static job_t* job_create(job_system_t *js, job_fn fn, void *arg,
+    size_t begin, size_t end, size_t grain)
+{
+    job_t *j = job_alloc(js, fn, arg, begin, end, grain, NULL, 1, 2);
+    if (!j) {
+        j = (job_t*)calloc(1, sizeof(job_t));
+        j->fn = fn;
+        j->arg = arg;
+        j->begin = begin;
+        j->end = end;
+        j->grain = grain;
+        atomic_init(&j->unfinished, 1);
+        atomic_init(&j->pending, 1);
+        atomic_init(&j->done, 0);
+        atomic_init(&j->refs, 2);
+        atomic_flag_clear(&j->lock);
+        j->succ_max = JOB_SUCCESSORS_MAX;
+        j->succ = j->succ_inline;
+    }
+    return j;
+}
+
+/* double the successor list, moving it to the heap; called with the lock held */
+static void job_successors_grow(job_t *j)
+{
+    job_t **succ = (job_t**)malloc(j->succ_max * 2 * sizeof(job_t*));
+    memcpy(succ, j->succ, j->nsucc * sizeof(job_t*));
+    if (j->succ != j->succ_inline) {
+        free(j->succ);
+    }
+    j->succ = succ;
+    j->succ_max *= 2;
+}
+
+/* job will not run before prerequisite is done; call before submitting job */
+static void job_depends(job_t *job, job_t *prerequisite)
+{
+    int added = 0;
+    atomic_fetch_add(&job->pending, 1);
+    while (atomic_flag_test_and_set_explicit(&prerequisite->lock, memory_order_acquire));
+    if (!atomic_load_explicit(&prerequisite->done, memory_order_relaxed)) {
+        if (prerequisite->nsucc == prerequisite->succ_max) {
+            job_successors_grow(prerequisite);
+        }
+        prerequisite->succ[prerequisite->nsucc++] = job;
+        added = 1;
+    }
+    atomic_flag_clear_explicit(&prerequisite->lock, memory_order_release);
+    if (!added) {
+        atomic_fetch_sub(&job->pending, 1);
+    }
+}
+
+static void job_submit(job_system_t *js, job_t *job)
+{
+    job_release(js, job);
+}
+
+/* run jobs on this thread until job is done */
+static void job_wait(job_system_t *js, job_t *job)
+{
+    while (!atomic_load_explicit(&job->done, memory_order_acquire)) {
+        job_t *j = job_next(js);
+        if (j) {
+            job_execute(js, j);
+        } else {
+            sched_yield();
+        }
+    }
+}
+
+/* drop the caller's reference, the job may still be running */
+static void job_free(job_system_t *js, job_t *job)
+{
+    (void)js;
+    job_unref(job);
+}
+
+static void job_parallel_for(job_system_t *js, job_fn fn, void *arg,
+    size_t n, size_t grain)
+{
+    job_t *j = job_create(js, fn, arg, 0, n, grain ? grain : 1);
+    job_submit(js, j);
+    job_wait(js, j);
+    job_free(js, j);
+}
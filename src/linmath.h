@@ -2,11 +2,118 @@
 #define LINMATH_H
 
 #include <math.h>
+#include <stddef.h>
 
 #ifdef _MSC_VER
 #define inline __inline
 #endif
 
+/*
+ * SIMD backend selection
+ *
+ * the matrix and quaternion kernels are selected at compile time from the
+ * target instruction set: AVX2 (with FMA when available), SSE2 or scalar.
+ * define LINMATH_NO_SIMD to force the scalar implementation. mat4x4 storage
+ * is 16-byte aligned so columns can be loaded with aligned vector loads.
+ */
+
+#if !defined(LINMATH_NO_SIMD)
+#if defined(__AVX2__)
+#define LINMATH_AVX2 1
+#endif
+#if defined(__SSE2__) || defined(_M_X64) || (defined(_M_IX86_FP) && _M_IX86_FP >= 2)
+#define LINMATH_SSE2 1
+#endif
+#endif
+
+#if defined(LINMATH_AVX2)
+#include <immintrin.h>
+#elif defined(LINMATH_SSE2)
+#include <emmintrin.h>
+#endif
+
+#ifdef _MSC_VER
+#define LINMATH_ALIGN(n) __declspec(align(n))
+#else
+#define LINMATH_ALIGN(n) __attribute__((aligned(n)))
+#endif
+
+#if defined(LINMATH_SSE2)
+#define LINMATH_SPLAT(v,i) _mm_shuffle_ps((v), (v), _MM_SHUFFLE(i,i,i,i))
+static inline __m128 linmath_madd(__m128 a, __m128 b, __m128 c)
+{
+#if defined(__FMA__)
+	return _mm_fmadd_ps(a, b, c);
+#else
+	return _mm_add_ps(_mm_mul_ps(a, b), c);
+#endif
+}
+static inline __m128 linmath_lincomb(__m128 v, __m128 c0, __m128 c1, __m128 c2, __m128 c3)
+{
+	__m128 r = _mm_mul_ps(c0, LINMATH_SPLAT(v, 0));
+	r = linmath_madd(c1, LINMATH_SPLAT(v, 1), r);
+	r = linmath_madd(c2, LINMATH_SPLAT(v, 2), r);
+	r = linmath_madd(c3, LINMATH_SPLAT(v, 3), r);
+	return r;
+}
+/*
+ * four-wide sine and cosine: Cody-Waite reduction by pi/2 followed by
+ * the Cephes minimax polynomials on [-pi/4,pi/4] and quadrant fix-up.
+ */
+static inline void linmath_sincos4(__m128 x, __m128 *s, __m128 *c)
+{
+	__m128i j = _mm_cvtps_epi32(_mm_mul_ps(x, _mm_set1_ps(0.63661977236758134f)));
+	__m128 fj = _mm_cvtepi32_ps(j);
+	__m128 r = _mm_sub_ps(x, _mm_mul_ps(fj, _mm_set1_ps(1.5703125f)));
+	r = _mm_sub_ps(r, _mm_mul_ps(fj, _mm_set1_ps(4.837512969970703125e-4f)));
+	r = _mm_sub_ps(r, _mm_mul_ps(fj, _mm_set1_ps(7.54978995489188216e-8f)));
+	__m128 r2 = _mm_mul_ps(r, r);
+	__m128 ps = linmath_madd(r2, _mm_set1_ps(-1.9515295891e-4f), _mm_set1_ps(8.3321608736e-3f));
+	ps = linmath_madd(r2, ps, _mm_set1_ps(-1.6666654611e-1f));
+	ps = linmath_madd(_mm_mul_ps(r2, r), ps, r);
+	__m128 pc = linmath_madd(r2, _mm_set1_ps(2.443315711809948e-5f), _mm_set1_ps(-1.388731625493765e-3f));
+	pc = linmath_madd(r2, pc, _mm_set1_ps(4.166664568298827e-2f));
+	pc = linmath_madd(_mm_mul_ps(r2, r2), pc, _mm_sub_ps(_mm_set1_ps(1.f), _mm_mul_ps(r2, _mm_set1_ps(0.5f))));
+	__m128 swap = _mm_castsi128_ps(_mm_cmpeq_epi32(_mm_and_si128(j, _mm_set1_epi32(1)), _mm_set1_epi32(1)));
+	__m128 ssign = _mm_castsi128_ps(_mm_slli_epi32(_mm_and_si128(j, _mm_set1_epi32(2)), 30));
+	__m128 csign = _mm_castsi128_ps(_mm_slli_epi32(_mm_and_si128(_mm_add_epi32(j, _mm_set1_epi32(1)), _mm_set1_epi32(2)), 30));
+	*s = _mm_xor_ps(_mm_or_ps(_mm_and_ps(swap, pc), _mm_andnot_ps(swap, ps)), ssign);
+	*c = _mm_xor_ps(_mm_or_ps(_mm_and_ps(swap, ps), _mm_andnot_ps(swap, pc)), csign);
+}
+#endif
+
+#if defined(LINMATH_AVX2)
+static inline __m256 linmath_madd256(__m256 a, __m256 b, __m256 c)
+{
+#if defined(__FMA__)
+	return _mm256_fmadd_ps(a, b, c);
+#else
+	return _mm256_add_ps(_mm256_mul_ps(a, b), c);
+#endif
+}
+/* eight-wide linmath_sincos4 */
+static inline void linmath_sincos8(__m256 x, __m256 *s, __m256 *c)
+{
+	__m256i j = _mm256_cvtps_epi32(_mm256_mul_ps(x, _mm256_set1_ps(0.63661977236758134f)));
+	__m256 fj = _mm256_cvtepi32_ps(j);
+	__m256 r = _mm256_sub_ps(x, _mm256_mul_ps(fj, _mm256_set1_ps(1.5703125f)));
+	r = _mm256_sub_ps(r, _mm256_mul_ps(fj, _mm256_set1_ps(4.837512969970703125e-4f)));
+	r = _mm256_sub_ps(r, _mm256_mul_ps(fj, _mm256_set1_ps(7.54978995489188216e-8f)));
+	__m256 r2 = _mm256_mul_ps(r, r);
+	__m256 ps = linmath_madd256(r2, _mm256_set1_ps(-1.9515295891e-4f), _mm256_set1_ps(8.3321608736e-3f));
+	ps = linmath_madd256(r2, ps, _mm256_set1_ps(-1.6666654611e-1f));
+	ps = linmath_madd256(_mm256_mul_ps(r2, r), ps, r);
+	__m256 pc = linmath_madd256(r2, _mm256_set1_ps(2.443315711809948e-5f), _mm256_set1_ps(-1.388731625493765e-3f));
+	pc = linmath_madd256(r2, pc, _mm256_set1_ps(4.166664568298827e-2f));
+	pc = linmath_madd256(_mm256_mul_ps(r2, r2), pc, _mm256_sub_ps(_mm256_set1_ps(1.f), _mm256_mul_ps(r2, _mm256_set1_ps(0.5f))));
+	__m256 swap = _mm256_castsi256_ps(_mm256_cmpeq_epi32(_mm256_and_si256(j, _mm256_set1_epi32(1)), _mm256_set1_epi32(1)));
+	__m256 ssign = _mm256_castsi256_ps(_mm256_slli_epi32(_mm256_and_si256(j, _mm256_set1_epi32(2)), 30));
+	__m256 csign = _mm256_castsi256_ps(_mm256_slli_epi32(_mm256_and_si256(_mm256_add_epi32(j, _mm256_set1_epi32(1)), _mm256_set1_epi32(2)), 30));
+	*s = _mm256_xor_ps(_mm256_blendv_ps(ps, pc, swap), ssign);
+	*c = _mm256_xor_ps(_mm256_blendv_ps(pc, ps, swap), csign);
+}
+#endif
+
 #define LINMATH_H_DEFINE_VEC(n) \
 typedef float vec##n[n]; \
 static inline void vec##n##_add(vec##n r, vec##n const a, vec##n const b) \
@@ -80,7 +187,11 @@ static inline void vec4_reflect(vec4 r, vec4 v, vec4 n)
 		r[i] = v[i] - p*n[i];
 }
 
-typedef vec4 mat4x4[4];
+#ifdef _MSC_VER
+typedef LINMATH_ALIGN(16) vec4 mat4x4[4];
+#else
+typedef vec4 mat4x4[4] LINMATH_ALIGN(16);
+#endif
 static inline void mat4x4_identity(mat4x4 M)
 {
 	int i, j;
@@ -109,10 +220,20 @@ static inline void mat4x4_col(vec4 r, mat4x4 M, int i)
 }
 static inline void mat4x4_transpose(mat4x4 M, mat4x4 N)
 {
+#if defined(LINMATH_SSE2)
+	__m128 c0 = _mm_load_ps(N[0]), c1 = _mm_load_ps(N[1]);
+	__m128 c2 = _mm_load_ps(N[2]), c3 = _mm_load_ps(N[3]);
+	_MM_TRANSPOSE4_PS(c0, c1, c2, c3);
+	_mm_store_ps(M[0], c0);
+	_mm_store_ps(M[1], c1);
+	_mm_store_ps(M[2], c2);
+	_mm_store_ps(M[3], c3);
+#else
 	int i, j;
 	for(j=0; j<4; ++j)
 		for(i=0; i<4; ++i)
 			M[i][j] = N[j][i];
+#endif
 }
 static inline void mat4x4_add(mat4x4 M, mat4x4 a, mat4x4 b)
 {
@@ -134,6 +255,12 @@ static inline void mat4x4_scale(mat4x4 M, mat4x4 a, float k)
 }
 static inline void mat4x4_scale_aniso(mat4x4 M, mat4x4 a, float x, float y, float z)
 {
+#if defined(LINMATH_SSE2)
+	_mm_store_ps(M[0], _mm_mul_ps(_mm_load_ps(a[0]), _mm_set1_ps(x)));
+	_mm_store_ps(M[1], _mm_mul_ps(_mm_load_ps(a[1]), _mm_set1_ps(y)));
+	_mm_store_ps(M[2], _mm_mul_ps(_mm_load_ps(a[2]), _mm_set1_ps(z)));
+	_mm_store_ps(M[3], _mm_load_ps(a[3]));
+#else
 	int i;
 	vec4_scale(M[0], a[0], x);
 	vec4_scale(M[1], a[1], y);
@@ -141,9 +268,40 @@ static inline void mat4x4_scale_aniso(mat4x4 M, mat4x4 a, float x, float y, floa
 	for(i = 0; i < 4; ++i) {
 		M[3][i] = a[3][i];
 	}
+#endif
 }
 static inline void mat4x4_mul(mat4x4 M, mat4x4 a, mat4x4 b)
 {
+#if defined(LINMATH_AVX2)
+	/* two result columns per 256-bit register, a[k] broadcast to both lanes */
+	__m256 a0 = _mm256_broadcast_ps((__m128 const*)a[0]);
+	__m256 a1 = _mm256_broadcast_ps((__m128 const*)a[1]);
+	__m256 a2 = _mm256_broadcast_ps((__m128 const*)a[2]);
+	__m256 a3 = _mm256_broadcast_ps((__m128 const*)a[3]);
+	__m256 b01 = _mm256_loadu_ps(b[0]);
+	__m256 b23 = _mm256_loadu_ps(b[2]);
+	__m256 r01 = _mm256_mul_ps(a0, _mm256_shuffle_ps(b01, b01, 0x00));
+	__m256 r23 = _mm256_mul_ps(a0, _mm256_shuffle_ps(b23, b23, 0x00));
+	r01 = linmath_madd256(a1, _mm256_shuffle_ps(b01, b01, 0x55), r01);
+	r23 = linmath_madd256(a1, _mm256_shuffle_ps(b23, b23, 0x55), r23);
+	r01 = linmath_madd256(a2, _mm256_shuffle_ps(b01, b01, 0xaa), r01);
+	r23 = linmath_madd256(a2, _mm256_shuffle_ps(b23, b23, 0xaa), r23);
+	r01 = linmath_madd256(a3, _mm256_shuffle_ps(b01, b01, 0xff), r01);
+	r23 = linmath_madd256(a3, _mm256_shuffle_ps(b23, b23, 0xff), r23);
+	_mm256_storeu_ps(M[0], r01);
+	_mm256_storeu_ps(M[2], r23);
+#elif defined(LINMATH_SSE2)
+	__m128 a0 = _mm_load_ps(a[0]), a1 = _mm_load_ps(a[1]);
+	__m128 a2 = _mm_load_ps(a[2]), a3 = _mm_load_ps(a[3]);
+	__m128 r0 = linmath_lincomb(_mm_load_ps(b[0]), a0, a1, a2, a3);
+	__m128 r1 = linmath_lincomb(_mm_load_ps(b[1]), a0, a1, a2, a3);
+	__m128 r2 = linmath_lincomb(_mm_load_ps(b[2]), a0, a1, a2, a3);
+	__m128 r3 = linmath_lincomb(_mm_load_ps(b[3]), a0, a1, a2, a3);
+	_mm_store_ps(M[0], r0);
+	_mm_store_ps(M[1], r1);
+	_mm_store_ps(M[2], r2);
+	_mm_store_ps(M[3], r3);
+#else
 	mat4x4 temp;
 	int k, r, c;
 	for(c=0; c<4; ++c) for(r=0; r<4; ++r) {
@@ -152,15 +310,25 @@ static inline void mat4x4_mul(mat4x4 M, mat4x4 a, mat4x4 b)
 			temp[c][r] += a[k][r] * b[c][k];
 	}
 	mat4x4_dup(M, temp);
+#endif
 }
 static inline void mat4x4_mul_vec4(vec4 r, mat4x4 M, vec4 v)
 {
+#if defined(LINMATH_SSE2)
+	_mm_storeu_ps(r, linmath_lincomb(_mm_loadu_ps(v),
+		_mm_load_ps(M[0]), _mm_load_ps(M[1]),
+		_mm_load_ps(M[2]), _mm_load_ps(M[3])));
+#else
+	vec4 t;
 	int i, j;
 	for(j=0; j<4; ++j) {
-		r[j] = 0.f;
+		t[j] = 0.f;
 		for(i=0; i<4; ++i)
-			r[j] += M[i][j] * v[i];
+			t[j] += M[i][j] * v[i];
 	}
+	for(j=0; j<4; ++j)
+		r[j] = t[j];
+#endif
 }
 static inline void mat4x4_translate(mat4x4 T, float x, float y, float z)
 {
@@ -171,6 +339,13 @@ static inline void mat4x4_translate(mat4x4 T, float x, float y, float z)
 }
 static inline void mat4x4_translate_in_place(mat4x4 M, float x, float y, float z)
 {
+#if defined(LINMATH_SSE2)
+	__m128 r = _mm_load_ps(M[3]);
+	r = linmath_madd(_mm_load_ps(M[0]), _mm_set1_ps(x), r);
+	r = linmath_madd(_mm_load_ps(M[1]), _mm_set1_ps(y), r);
+	r = linmath_madd(_mm_load_ps(M[2]), _mm_set1_ps(z), r);
+	_mm_store_ps(M[3], r);
+#else
 	vec4 t = {x, y, z, 0};
 	vec4 r;
 	int i;
@@ -178,6 +353,7 @@ static inline void mat4x4_translate_in_place(mat4x4 M, float x, float y, float z
 		mat4x4_row(r, M, i);
 		M[3][i] += vec4_mul_inner(r, t);
 	}
+#endif
 }
 static inline void mat4x4_from_vec3_mul_outer(mat4x4 M, vec3 a, vec3 b)
 {
@@ -220,44 +396,107 @@ static inline void mat4x4_rotate(mat4x4 R, mat4x4 M, float x, float y, float z,
 		mat4x4_dup(R, M);
 	}
 }
-static inline void mat4x4_rotate_X(mat4x4 Q, mat4x4 M, float angle)
+/*
+ * rotation about a principal axis only mixes two columns of M, so instead
+ * of a full matrix multiply we compute Q[i] = c*M[i] + s*M[j] and
+ * Q[j] = c*M[j] - s*M[i] and copy the remaining columns.
+ */
+static inline void mat4x4_rotate_cols(mat4x4 Q, mat4x4 M, int i, int j, float angle)
 {
 	float s = sinf(angle);
 	float c = cosf(angle);
-	mat4x4 R = {
-		{1.f, 0.f, 0.f, 0.f},
-		{0.f,   c,   s, 0.f},
-		{0.f,  -s,   c, 0.f},
-		{0.f, 0.f, 0.f, 1.f}
-	};
-	mat4x4_mul(Q, M, R);
+	int k;
+#if defined(LINMATH_SSE2)
+	__m128 vs = _mm_set1_ps(s), vc = _mm_set1_ps(c);
+	__m128 mi = _mm_load_ps(M[i]), mj = _mm_load_ps(M[j]);
+	__m128 qi = linmath_madd(mj, vs, _mm_mul_ps(mi, vc));
+	__m128 qj = _mm_sub_ps(_mm_mul_ps(mj, vc), _mm_mul_ps(mi, vs));
+	if (Q != M) {
+		for(k=0; k<4; ++k)
+			_mm_store_ps(Q[k], _mm_load_ps(M[k]));
+	}
+	_mm_store_ps(Q[i], qi);
+	_mm_store_ps(Q[j], qj);
+#else
+	vec4 qi, qj;
+	for(k=0; k<4; ++k) {
+		qi[k] = c*M[i][k] + s*M[j][k];
+		qj[k] = c*M[j][k] - s*M[i][k];
+	}
+	if (Q != M)
+		mat4x4_dup(Q, M);
+	for(k=0; k<4; ++k) {
+		Q[i][k] = qi[k];
+		Q[j][k] = qj[k];
+	}
+#endif
+}
+static inline void mat4x4_rotate_X(mat4x4 Q, mat4x4 M, float angle)
+{
+	mat4x4_rotate_cols(Q, M, 1, 2, angle);
 }
 static inline void mat4x4_rotate_Y(mat4x4 Q, mat4x4 M, float angle)
 {
-	float s = sinf(angle);
-	float c = cosf(angle);
-	mat4x4 R = {
-		{   c, 0.f,   s, 0.f},
-		{ 0.f, 1.f, 0.f, 0.f},
-		{  -s, 0.f,   c, 0.f},
-		{ 0.f, 0.f, 0.f, 1.f}
-	};
-	mat4x4_mul(Q, M, R);
+	mat4x4_rotate_cols(Q, M, 0, 2, angle);
 }
 static inline void mat4x4_rotate_Z(mat4x4 Q, mat4x4 M, float angle)
 {
-	float s = sinf(angle);
-	float c = cosf(angle);
-	mat4x4 R = {
-		{   c,   s, 0.f, 0.f},
-		{  -s,   c, 0.f, 0.f},
-		{ 0.f, 0.f, 1.f, 0.f},
-		{ 0.f, 0.f, 0.f, 1.f}
-	};
-	mat4x4_mul(Q, M, R);
+	mat4x4_rotate_cols(Q, M, 0, 1, angle);
 }
 static inline void mat4x4_invert(mat4x4 T, mat4x4 M)
 {
+#if defined(LINMATH_SSE2)
+	/*
+	 * block-wise inverse using 2x2 sub-matrices A B C D held one per
+	 * register, adjugates computed with shuffles. see Eric Zhang's
+	 * "Fast 4x4 Matrix Inverse with SSE SIMD, Explained".
+	 */
+#define LINMATH_SWZ(v,x,y,z,w) _mm_shuffle_ps((v), (v), _MM_SHUFFLE(w,z,y,x))
+#define LINMATH_SHUF(a,b,x,y,z,w) _mm_shuffle_ps((a), (b), _MM_SHUFFLE(w,z,y,x))
+#define LINMATH_MAT2MUL(a,b) _mm_add_ps(_mm_mul_ps((a), LINMATH_SWZ(b,0,3,0,3)), \
+	_mm_mul_ps(LINMATH_SWZ(a,1,0,3,2), LINMATH_SWZ(b,2,1,2,1)))
+#define LINMATH_MAT2ADJMUL(a,b) _mm_sub_ps(_mm_mul_ps(LINMATH_SWZ(a,3,3,0,0), (b)), \
+	_mm_mul_ps(LINMATH_SWZ(a,1,1,2,2), LINMATH_SWZ(b,2,3,0,1)))
+#define LINMATH_MAT2MULADJ(a,b) _mm_sub_ps(_mm_mul_ps((a), LINMATH_SWZ(b,3,0,3,0)), \
+	_mm_mul_ps(LINMATH_SWZ(a,1,0,3,2), LINMATH_SWZ(b,2,1,2,1)))
+	__m128 m0 = _mm_load_ps(M[0]), m1 = _mm_load_ps(M[1]);
+	__m128 m2 = _mm_load_ps(M[2]), m3 = _mm_load_ps(M[3]);
+	__m128 A = _mm_movelh_ps(m0, m1);
+	__m128 B = _mm_movehl_ps(m1, m0);
+	__m128 C = _mm_movelh_ps(m2, m3);
+	__m128 D = _mm_movehl_ps(m3, m2);
+	__m128 det = _mm_sub_ps(
+		_mm_mul_ps(LINMATH_SHUF(m0, m2, 0,2,0,2), LINMATH_SHUF(m1, m3, 1,3,1,3)),
+		_mm_mul_ps(LINMATH_SHUF(m0, m2, 1,3,1,3), LINMATH_SHUF(m1, m3, 0,2,0,2)));
+	__m128 detA = LINMATH_SPLAT(det, 0), detB = LINMATH_SPLAT(det, 1);
+	__m128 detC = LINMATH_SPLAT(det, 2), detD = LINMATH_SPLAT(det, 3);
+	__m128 D_C = LINMATH_MAT2ADJMUL(D, C);
+	__m128 A_B = LINMATH_MAT2ADJMUL(A, B);
+	__m128 X_ = _mm_sub_ps(_mm_mul_ps(detD, A), LINMATH_MAT2MUL(B, D_C));
+	__m128 W_ = _mm_sub_ps(_mm_mul_ps(detA, D), LINMATH_MAT2MUL(C, A_B));
+	__m128 Y_ = _mm_sub_ps(_mm_mul_ps(detB, C), LINMATH_MAT2MULADJ(D, A_B));
+	__m128 Z_ = _mm_sub_ps(_mm_mul_ps(detC, B), LINMATH_MAT2MULADJ(A, D_C));
+	__m128 detM = _mm_add_ps(_mm_mul_ps(detA, detD), _mm_mul_ps(detB, detC));
+	__m128 tr = _mm_mul_ps(A_B, LINMATH_SWZ(D_C, 0,2,1,3));
+	tr = _mm_add_ps(tr, _mm_movehl_ps(tr, tr));
+	tr = _mm_add_ps(tr, LINMATH_SPLAT(tr, 1));
+	detM = _mm_sub_ps(detM, LINMATH_SPLAT(tr, 0));
+	/* Assumes it is invertible */
+	__m128 rdet = _mm_div_ps(_mm_setr_ps(1.f, -1.f, -1.f, 1.f), detM);
+	X_ = _mm_mul_ps(X_, rdet);
+	Y_ = _mm_mul_ps(Y_, rdet);
+	Z_ = _mm_mul_ps(Z_, rdet);
+	W_ = _mm_mul_ps(W_, rdet);
+	_mm_store_ps(T[0], LINMATH_SHUF(X_, Y_, 3,1,3,1));
+	_mm_store_ps(T[1], LINMATH_SHUF(X_, Y_, 2,0,2,0));
+	_mm_store_ps(T[2], LINMATH_SHUF(Z_, W_, 3,1,3,1));
+	_mm_store_ps(T[3], LINMATH_SHUF(Z_, W_, 2,0,2,0));
+#undef LINMATH_MAT2MULADJ
+#undef LINMATH_MAT2ADJMUL
+#undef LINMATH_MAT2MUL
+#undef LINMATH_SHUF
+#undef LINMATH_SWZ
+#else
 	float idet;
 	float s[6];
 	float c[6];
@@ -297,6 +536,7 @@ static inline void mat4x4_invert(mat4x4 T, mat4x4 M)
 	T[3][1] = ( M[0][0] * c[3] - M[0][1] * c[1] + M[0][2] * c[0]) * idet;
 	T[3][2] = (-M[3][0] * s[3] + M[3][1] * s[1] - M[3][2] * s[0]) * idet;
 	T[3][3] = ( M[2][0] * s[3] - M[2][1] * s[1] + M[2][2] * s[0]) * idet;
+#endif
 }
 static inline void mat4x4_orthonormalize(mat4x4 R, mat4x4 M)
 {
@@ -322,6 +562,136 @@ static inline void mat4x4_orthonormalize(mat4x4 R, mat4x4 M)
 	vec3_norm(R[0], R[0]);
 }
 
+/*
+ * batched transforms
+ *
+ * transform n points or directions held in structure-of-arrays form, or
+ * interleaved with a byte stride such as the pos and norm fields of an
+ * array of vertices. the SoA kernels process 4 (SSE2) or 8 (AVX2) points
+ * per iteration with the matrix broadcast once; w is 1 for points and 0
+ * for directions. output may alias input.
+ */
+static inline void mat4x4_mul_vec3_soa(float *ox, float *oy, float *oz, mat4x4 M,
+	float const *x, float const *y, float const *z, float w, size_t n)
+{
+	size_t i = 0;
+#if defined(LINMATH_AVX2)
+	for(; i < (n & ~(size_t)7); i += 8) {
+		__m256 vx = _mm256_loadu_ps(x + i);
+		__m256 vy = _mm256_loadu_ps(y + i);
+		__m256 vz = _mm256_loadu_ps(z + i);
+		__m256 rx = _mm256_set1_ps(M[3][0]*w);
+		__m256 ry = _mm256_set1_ps(M[3][1]*w);
+		__m256 rz = _mm256_set1_ps(M[3][2]*w);
+		rx = linmath_madd256(_mm256_set1_ps(M[0][0]), vx, rx);
+		ry = linmath_madd256(_mm256_set1_ps(M[0][1]), vx, ry);
+		rz = linmath_madd256(_mm256_set1_ps(M[0][2]), vx, rz);
+		rx = linmath_madd256(_mm256_set1_ps(M[1][0]), vy, rx);
+		ry = linmath_madd256(_mm256_set1_ps(M[1][1]), vy, ry);
+		rz = linmath_madd256(_mm256_set1_ps(M[1][2]), vy, rz);
+		rx = linmath_madd256(_mm256_set1_ps(M[2][0]), vz, rx);
+		ry = linmath_madd256(_mm256_set1_ps(M[2][1]), vz, ry);
+		rz = linmath_madd256(_mm256_set1_ps(M[2][2]), vz, rz);
+		_mm256_storeu_ps(ox + i, rx);
+		_mm256_storeu_ps(oy + i, ry);
+		_mm256_storeu_ps(oz + i, rz);
+	}
+#endif
+#if defined(LINMATH_SSE2)
+	for(; i < (n & ~(size_t)3); i += 4) {
+		__m128 vx = _mm_loadu_ps(x + i);
+		__m128 vy = _mm_loadu_ps(y + i);
+		__m128 vz = _mm_loadu_ps(z + i);
+		__m128 rx = _mm_set1_ps(M[3][0]*w);
+		__m128 ry = _mm_set1_ps(M[3][1]*w);
+		__m128 rz = _mm_set1_ps(M[3][2]*w);
+		rx = linmath_madd(_mm_set1_ps(M[0][0]), vx, rx);
+		ry = linmath_madd(_mm_set1_ps(M[0][1]), vx, ry);
+		rz = linmath_madd(_mm_set1_ps(M[0][2]), vx, rz);
+		rx = linmath_madd(_mm_set1_ps(M[1][0]), vy, rx);
+		ry = linmath_madd(_mm_set1_ps(M[1][1]), vy, ry);
+		rz = linmath_madd(_mm_set1_ps(M[1][2]), vy, rz);
+		rx = linmath_madd(_mm_set1_ps(M[2][0]), vz, rx);
+		ry = linmath_madd(_mm_set1_ps(M[2][1]), vz, ry);
+		rz = linmath_madd(_mm_set1_ps(M[2][2]), vz, rz);
+		_mm_storeu_ps(ox + i, rx);
+		_mm_storeu_ps(oy + i, ry);
+		_mm_storeu_ps(oz + i, rz);
+	}
+#endif
+	for(; i < n; ++i) {
+		float px = x[i], py = y[i], pz = z[i];
+		ox[i] = M[0][0]*px + M[1][0]*py + M[2][0]*pz + M[3][0]*w;
+		oy[i] = M[0][1]*px + M[1][1]*py + M[2][1]*pz + M[3][1]*w;
+		oz[i] = M[0][2]*px + M[1][2]*py + M[2][2]*pz + M[3][2]*w;
+	}
+}
+static inline void mat4x4_mul_vec3_stride(void *out, size_t ostride, mat4x4 M,
+	void const *in, size_t istride, float w, size_t n)
+{
+	char *o = (char*)out;
+	char const *p = (char const*)in;
+	size_t i;
+#if defined(LINMATH_SSE2)
+	__m128 m0 = _mm_load_ps(M[0]), m1 = _mm_load_ps(M[1]), m2 = _mm_load_ps(M[2]);
+	__m128 m3 = _mm_mul_ps(_mm_load_ps(M[3]), _mm_set1_ps(w));
+	for(i = 0; i < n; ++i, o += ostride, p += istride) {
+		float const *v = (float const*)p;
+		float *r = (float*)o;
+		__m128 t = linmath_madd(m0, _mm_set1_ps(v[0]), m3);
+		t = linmath_madd(m1, _mm_set1_ps(v[1]), t);
+		t = linmath_madd(m2, _mm_set1_ps(v[2]), t);
+		_mm_storel_pi((__m64*)r, t);
+		_mm_store_ss(r + 2, _mm_movehl_ps(t, t));
+	}
+#else
+	for(i = 0; i < n; ++i, o += ostride, p += istride) {
+		float const *v = (float const*)p;
+		float *r = (float*)o;
+		float px = v[0], py = v[1], pz = v[2];
+		r[0] = M[0][0]*px + M[1][0]*py + M[2][0]*pz + M[3][0]*w;
+		r[1] = M[0][1]*px + M[1][1]*py + M[2][1]*pz + M[3][1]*w;
+		r[2] = M[0][2]*px + M[1][2]*py + M[2][2]*pz + M[3][2]*w;
+	}
+#endif
+}
+static inline void vec3_soa_bounds(vec3 lo, vec3 hi,
+	float const *x, float const *y, float const *z, size_t n)
+{
+	size_t i = 0;
+	int k;
+	for(k=0; k<3; ++k) {
+		lo[k] = INFINITY;
+		hi[k] = -INFINITY;
+	}
+#if defined(LINMATH_SSE2)
+	if (n >= 4) {
+		__m128 lx = _mm_loadu_ps(x), ly = _mm_loadu_ps(y), lz = _mm_loadu_ps(z);
+		__m128 hx = lx, hy = ly, hz = lz;
+		vec4 t;
+		for(i = 4; i + 4 <= n; i += 4) {
+			__m128 vx = _mm_loadu_ps(x + i);
+			__m128 vy = _mm_loadu_ps(y + i);
+			__m128 vz = _mm_loadu_ps(z + i);
+			lx = _mm_min_ps(lx, vx); hx = _mm_max_ps(hx, vx);
+			ly = _mm_min_ps(ly, vy); hy = _mm_max_ps(hy, vy);
+			lz = _mm_min_ps(lz, vz); hz = _mm_max_ps(hz, vz);
+		}
+#define LINMATH_HREDUCE(v,op,r) \
+		_mm_storeu_ps(t, v); r = op(op(t[0], t[1]), op(t[2], t[3]));
+		LINMATH_HREDUCE(lx, fminf, lo[0]); LINMATH_HREDUCE(hx, fmaxf, hi[0]);
+		LINMATH_HREDUCE(ly, fminf, lo[1]); LINMATH_HREDUCE(hy, fmaxf, hi[1]);
+		LINMATH_HREDUCE(lz, fminf, lo[2]); LINMATH_HREDUCE(hz, fmaxf, hi[2]);
+#undef LINMATH_HREDUCE
+	}
+#endif
+	for(; i < n; ++i) {
+		lo[0] = fminf(lo[0], x[i]); hi[0] = fmaxf(hi[0], x[i]);
+		lo[1] = fminf(lo[1], y[i]); hi[1] = fmaxf(hi[1], y[i]);
+		lo[2] = fminf(lo[2], z[i]); hi[2] = fmaxf(hi[2], z[i]);
+	}
+}
+
 static inline void mat4x4_frustum(mat4x4 M, float l, float r, float b, float t, float n, float f)
 {
 	M[0][0] = 2.f*n/(r-l);
@@ -443,6 +813,18 @@ static inline void quat_sub(quat r, quat a, quat b)
 }
 static inline void quat_mul(quat r, quat p, quat q)
 {
+#if defined(LINMATH_SSE2)
+	/* r = p.w*q + p.x*(q.wzyx*{+-+-}) + p.y*(q.zwxy*{++--}) + p.z*(q.yxwz*{-++-}) */
+	__m128 vp = _mm_loadu_ps(p), vq = _mm_loadu_ps(q);
+	__m128 qx = _mm_mul_ps(_mm_shuffle_ps(vq, vq, _MM_SHUFFLE(0,1,2,3)),
+		_mm_setr_ps( 1.f, -1.f,  1.f, -1.f));
+	__m128 qy = _mm_mul_ps(_mm_shuffle_ps(vq, vq, _MM_SHUFFLE(1,0,3,2)),
+		_mm_setr_ps( 1.f,  1.f, -1.f, -1.f));
+	__m128 qz = _mm_mul_ps(_mm_shuffle_ps(vq, vq, _MM_SHUFFLE(2,3,0,1)),
+		_mm_setr_ps(-1.f,  1.f,  1.f, -1.f));
+	_mm_storeu_ps(r, linmath_lincomb(_mm_shuffle_ps(vp, vp, _MM_SHUFFLE(2,1,0,3)),
+		vq, qx, qy, qz));
+#else
 	vec3 w;
 	vec3_mul_cross(r, p, q);
 	vec3_scale(w, p, q[3]);
@@ -450,6 +832,7 @@ static inline void quat_mul(quat r, quat p, quat q)
 	vec3_scale(w, q, p[3]);
 	vec3_add(r, r, w);
 	r[3] = p[3]*q[3] - vec3_mul_inner(p, q);
+#endif
 }
 static inline void quat_scale(quat r, quat v, float s)
 {
@@ -571,4 +954,278 @@ static inline void quat_from_mat4x4(quat q, mat4x4 M)
 	q[3] = (M[p[2]][p[1]] - M[p[1]][p[2]])/(2.f*r);
 }
 
+/*
+ * batched TRS composition
+ *
+ * compose n model matrices M = S * T(t) * Rx * Ry * Rz, the order used by
+ * mat4x4_scale_aniso, mat4x4_translate_in_place and mat4x4_rotate_X/Y/Z,
+ * in closed form without intermediate multiplies. angles are radians.
+ * when N is non-null it receives the inverse-transpose normal matrices,
+ * which for a rotation with axis-aligned scale is S^-1 * R. the SSE2 path
+ * composes four objects per iteration using a vectorized sincos, and the
+ * AVX2 path eight, transposing blocks of packed vec3 inputs into one
+ * object per lane with shuffles.
+ */
+static inline void mat4x4_compose_trs(mat4x4 M, mat4x4 N, vec3 s, vec3 t, vec3 R[3])
+{
+	int c, r;
+	for(c=0; c<3; ++c) {
+		for(r=0; r<3; ++r)
+			M[c][r] = R[c][r] * s[r];
+		M[c][3] = 0.f;
+	}
+	for(r=0; r<3; ++r)
+		M[3][r] = t[r] * s[r];
+	M[3][3] = 1.f;
+	if (N) {
+		for(c=0; c<3; ++c) {
+			for(r=0; r<3; ++r)
+				N[c][r] = R[c][r] / s[r];
+			N[c][3] = 0.f;
+		}
+		N[3][0] = N[3][1] = N[3][2] = 0.f;
+		N[3][3] = 1.f;
+	}
+}
+static inline void mat4x4_euler_rotation(vec3 R[3], vec3 rot)
+{
+	float ca = cosf(rot[0]), sa = sinf(rot[0]);
+	float cb = cosf(rot[1]), sb = sinf(rot[1]);
+	float cc = cosf(rot[2]), sc = sinf(rot[2]);
+	R[0][0] = cb*cc;  R[0][1] = ca*sc - sa*sb*cc; R[0][2] = sa*sc + ca*sb*cc;
+	R[1][0] = -cb*sc; R[1][1] = ca*cc + sa*sb*sc; R[1][2] = sa*cc - ca*sb*sc;
+	R[2][0] = -sb;    R[2][1] = -sa*cb;           R[2][2] = ca*cb;
+}
+static inline void mat4x4_quat_rotation(vec3 R[3], quat q)
+{
+	float a = q[3], b = q[0], c = q[1], d = q[2];
+	float a2 = a*a, b2 = b*b, c2 = c*c, d2 = d*d;
+	R[0][0] = a2 + b2 - c2 - d2;
+	R[0][1] = 2.f*(b*c + a*d);
+	R[0][2] = 2.f*(b*d - a*c);
+	R[1][0] = 2.f*(b*c - a*d);
+	R[1][1] = a2 - b2 + c2 - d2;
+	R[1][2] = 2.f*(c*d + a*b);
+	R[2][0] = 2.f*(b*d + a*c);
+	R[2][1] = 2.f*(c*d - a*b);
+	R[2][2] = a2 - b2 - c2 + d2;
+}
+static inline void mat4x4_compose_euler(mat4x4 M, vec3 scale, vec3 trans, vec3 rot)
+{
+	vec3 R[3];
+	mat4x4_euler_rotation(R, rot);
+	mat4x4_compose_trs(M, NULL, scale, trans, R);
+}
+#if defined(LINMATH_SSE2)
+/* R holds the nine rotation terms as R[col][row] with one object per lane */
+static inline void mat4x4_compose4(mat4x4 *M, mat4x4 *N, __m128 const s[3], __m128 const t[3], __m128 R[3][3])
+{
+	__m128 zero = _mm_setzero_ps(), one = _mm_set1_ps(1.f);
+	__m128 c[4][4], n[4][4];
+	int i, k;
+	for(i=0; i<3; ++i) {
+		c[i][0] = _mm_mul_ps(R[i][0], s[0]);
+		c[i][1] = _mm_mul_ps(R[i][1], s[1]);
+		c[i][2] = _mm_mul_ps(R[i][2], s[2]);
+		c[i][3] = zero;
+		_MM_TRANSPOSE4_PS(c[i][0], c[i][1], c[i][2], c[i][3]);
+	}
+	c[3][0] = _mm_mul_ps(t[0], s[0]);
+	c[3][1] = _mm_mul_ps(t[1], s[1]);
+	c[3][2] = _mm_mul_ps(t[2], s[2]);
+	c[3][3] = one;
+	_MM_TRANSPOSE4_PS(c[3][0], c[3][1], c[3][2], c[3][3]);
+	for(k=0; k<4; ++k)
+		for(i=0; i<4; ++i)
+			_mm_storeu_ps(M[k][i], c[i][k]);
+	if (!N)
+		return;
+	__m128 is[3];
+	for(i=0; i<3; ++i)
+		is[i] = _mm_div_ps(one, s[i]);
+	for(i=0; i<3; ++i) {
+		n[i][0] = _mm_mul_ps(R[i][0], is[0]);
+		n[i][1] = _mm_mul_ps(R[i][1], is[1]);
+		n[i][2] = _mm_mul_ps(R[i][2], is[2]);
+		n[i][3] = zero;
+		_MM_TRANSPOSE4_PS(n[i][0], n[i][1], n[i][2], n[i][3]);
+	}
+	for(k=0; k<4; ++k) {
+		for(i=0; i<3; ++i)
+			_mm_storeu_ps(N[k][i], n[i][k]);
+		_mm_storeu_ps(N[k][3], _mm_setr_ps(0.f, 0.f, 0.f, 1.f));
+	}
+}
+/* transpose four packed vec3 from a into x, y and z with one object per lane */
+static inline void linmath_load3x4(vec3 const *a, __m128 v[3])
+{
+	__m128 v0 = _mm_loadu_ps(a[0]), v1 = _mm_loadu_ps(a[1] + 1), v2 = _mm_loadu_ps(a[2] + 2);
+	__m128 x = _mm_shuffle_ps(v0, v1, _MM_SHUFFLE(2,2,3,0));
+	__m128 y = _mm_shuffle_ps(v0, v1, _MM_SHUFFLE(3,0,1,1));
+	__m128 z = _mm_shuffle_ps(v0, v1, _MM_SHUFFLE(1,1,2,2));
+	v[0] = _mm_shuffle_ps(x, _mm_shuffle_ps(x, v2, _MM_SHUFFLE(1,1,2,2)), _MM_SHUFFLE(2,0,1,0));
+	v[1] = _mm_shuffle_ps(y, _mm_shuffle_ps(y, v2, _MM_SHUFFLE(2,2,3,2)), _MM_SHUFFLE(2,1,2,0));
+	v[2] = _mm_shuffle_ps(z, v2, _MM_SHUFFLE(3,0,2,0));
+}
+/* mat4x4_euler_rotation from the sines and cosines of four objects */
+static inline void mat4x4_euler_rotation4(__m128 R[3][3], __m128 const sn[3], __m128 const cs[3])
+{
+	__m128 sa = sn[0], ca = cs[0], sb = sn[1], cb = cs[1], sc = sn[2], cc = cs[2];
+	__m128 sasb = _mm_mul_ps(sa, sb), casb = _mm_mul_ps(ca, sb);
+	R[0][0] = _mm_mul_ps(cb, cc);
+	R[0][1] = _mm_sub_ps(_mm_mul_ps(ca, sc), _mm_mul_ps(sasb, cc));
+	R[0][2] = linmath_madd(casb, cc, _mm_mul_ps(sa, sc));
+	R[1][0] = _mm_sub_ps(_mm_setzero_ps(), _mm_mul_ps(cb, sc));
+	R[1][1] = linmath_madd(sasb, sc, _mm_mul_ps(ca, cc));
+	R[1][2] = _mm_sub_ps(_mm_mul_ps(sa, cc), _mm_mul_ps(casb, sc));
+	R[2][0] = _mm_sub_ps(_mm_setzero_ps(), sb);
+	R[2][1] = _mm_sub_ps(_mm_setzero_ps(), _mm_mul_ps(sa, cb));
+	R[2][2] = _mm_mul_ps(ca, cb);
+}
+#endif
+#if defined(LINMATH_AVX2)
+#define LINMATH_LOAD2(p,q) _mm256_insertf128_ps(_mm256_castps128_ps256(_mm_loadu_ps(p)), _mm_loadu_ps(q), 1)
+/* linmath_load3x4 of a[0..3] in the low lanes and a[4..7] in the high lanes */
+static inline void linmath_load3x8(vec3 const *a, __m256 v[3])
+{
+	__m256 v0 = LINMATH_LOAD2(a[0], a[4]), v1 = LINMATH_LOAD2(a[1] + 1, a[5] + 1);
+	__m256 v2 = LINMATH_LOAD2(a[2] + 2, a[6] + 2);
+	__m256 x = _mm256_shuffle_ps(v0, v1, _MM_SHUFFLE(2,2,3,0));
+	__m256 y = _mm256_shuffle_ps(v0, v1, _MM_SHUFFLE(3,0,1,1));
+	__m256 z = _mm256_shuffle_ps(v0, v1, _MM_SHUFFLE(1,1,2,2));
+	v[0] = _mm256_shuffle_ps(x, _mm256_shuffle_ps(x, v2, _MM_SHUFFLE(1,1,2,2)), _MM_SHUFFLE(2,0,1,0));
+	v[1] = _mm256_shuffle_ps(y, _mm256_shuffle_ps(y, v2, _MM_SHUFFLE(2,2,3,2)), _MM_SHUFFLE(2,1,2,0));
+	v[2] = _mm256_shuffle_ps(z, v2, _MM_SHUFFLE(3,0,2,0));
+}
+#undef LINMATH_LOAD2
+/*
+ * transpose rows a, b, c and d within each half, storing the column of
+ * object k, low half first, to p + k*stride.
+ */
+static inline void linmath_store4x8(float *p, size_t stride, __m256 a, __m256 b, __m256 c, __m256 d)
+{
+	__m256 t0 = _mm256_unpacklo_ps(a, b), t1 = _mm256_unpackhi_ps(a, b);
+	__m256 t2 = _mm256_unpacklo_ps(c, d), t3 = _mm256_unpackhi_ps(c, d);
+	__m256 r[4];
+	int k;
+	r[0] = _mm256_shuffle_ps(t0, t2, _MM_SHUFFLE(1,0,1,0));
+	r[1] = _mm256_shuffle_ps(t0, t2, _MM_SHUFFLE(3,2,3,2));
+	r[2] = _mm256_shuffle_ps(t1, t3, _MM_SHUFFLE(1,0,1,0));
+	r[3] = _mm256_shuffle_ps(t1, t3, _MM_SHUFFLE(3,2,3,2));
+	for(k=0; k<4; ++k) {
+		_mm_storeu_ps(p + k*stride, _mm256_castps256_ps128(r[k]));
+		_mm_storeu_ps(p + (k+4)*stride, _mm256_extractf128_ps(r[k], 1));
+	}
+}
+/* mat4x4_compose4 for eight objects */
+static inline void mat4x4_compose8(mat4x4 *M, mat4x4 *N, __m256 const s[3], __m256 const t[3], __m256 R[3][3])
+{
+	__m256 zero = _mm256_setzero_ps(), one = _mm256_set1_ps(1.f);
+	size_t stride = sizeof(mat4x4) / sizeof(float);
+	int i, k;
+	for(i=0; i<3; ++i)
+		linmath_store4x8(M[0][i], stride, _mm256_mul_ps(R[i][0], s[0]),
+			_mm256_mul_ps(R[i][1], s[1]), _mm256_mul_ps(R[i][2], s[2]), zero);
+	linmath_store4x8(M[0][3], stride, _mm256_mul_ps(t[0], s[0]),
+		_mm256_mul_ps(t[1], s[1]), _mm256_mul_ps(t[2], s[2]), one);
+	if (!N)
+		return;
+	__m256 is[3];
+	for(i=0; i<3; ++i)
+		is[i] = _mm256_div_ps(one, s[i]);
+	for(i=0; i<3; ++i)
+		linmath_store4x8(N[0][i], stride, _mm256_mul_ps(R[i][0], is[0]),
+			_mm256_mul_ps(R[i][1], is[1]), _mm256_mul_ps(R[i][2], is[2]), zero);
+	for(k=0; k<8; ++k)
+		_mm_storeu_ps(N[k][3], _mm_setr_ps(0.f, 0.f, 0.f, 1.f));
+}
+/* mat4x4_euler_rotation from the sines and cosines of eight objects */
+static inline void mat4x4_euler_rotation8(__m256 R[3][3], __m256 const sn[3], __m256 const cs[3])
+{
+	__m256 sa = sn[0], ca = cs[0], sb = sn[1], cb = cs[1], sc = sn[2], cc = cs[2];
+	__m256 sasb = _mm256_mul_ps(sa, sb), casb = _mm256_mul_ps(ca, sb);
+	R[0][0] = _mm256_mul_ps(cb, cc);
+	R[0][1] = _mm256_sub_ps(_mm256_mul_ps(ca, sc), _mm256_mul_ps(sasb, cc));
+	R[0][2] = linmath_madd256(casb, cc, _mm256_mul_ps(sa, sc));
+	R[1][0] = _mm256_sub_ps(_mm256_setzero_ps(), _mm256_mul_ps(cb, sc));
+	R[1][1] = linmath_madd256(sasb, sc, _mm256_mul_ps(ca, cc));
+	R[1][2] = _mm256_sub_ps(_mm256_mul_ps(sa, cc), _mm256_mul_ps(casb, sc));
+	R[2][0] = _mm256_sub_ps(_mm256_setzero_ps(), sb);
+	R[2][1] = _mm256_sub_ps(_mm256_setzero_ps(), _mm256_mul_ps(sa, cb));
+	R[2][2] = _mm256_mul_ps(ca, cb);
+}
+#endif
+static inline void mat4x4_compose_euler_n(mat4x4 *M, mat4x4 *N,
+	vec3 *scale, vec3 *trans, vec3 *rot, size_t n)
+{
+	size_t i = 0;
+	vec3 R[3];
+#if defined(LINMATH_AVX2)
+	for(; i < (n & ~(size_t)7); i += 8) {
+		__m256 s[3], t[3], r[3], sn[3], cs[3], Rv[3][3];
+		int k;
+		linmath_load3x8(scale + i, s);
+		linmath_load3x8(trans + i, t);
+		linmath_load3x8(rot + i, r);
+		for(k=0; k<3; ++k)
+			linmath_sincos8(r[k], &sn[k], &cs[k]);
+		mat4x4_euler_rotation8(Rv, sn, cs);
+		mat4x4_compose8(M + i, N ? N + i : NULL, s, t, Rv);
+	}
+#endif
+#if defined(LINMATH_SSE2)
+	for(; i < (n & ~(size_t)3); i += 4) {
+		__m128 s[3], t[3], r[3], sn[3], cs[3], Rv[3][3];
+		int k;
+		linmath_load3x4(scale + i, s);
+		linmath_load3x4(trans + i, t);
+		linmath_load3x4(rot + i, r);
+		for(k=0; k<3; ++k)
+			linmath_sincos4(r[k], &sn[k], &cs[k]);
+		mat4x4_euler_rotation4(Rv, sn, cs);
+		mat4x4_compose4(M + i, N ? N + i : NULL, s, t, Rv);
+	}
+#endif
+	for(; i < n; ++i) {
+		mat4x4_euler_rotation(R, rot[i]);
+		mat4x4_compose_trs(M[i], N ? N[i] : NULL, scale[i], trans[i], R);
+	}
+}
+static inline void mat4x4_compose_quat_n(mat4x4 *M, mat4x4 *N,
+	vec3 *scale, vec3 *trans, quat *rot, size_t n)
+{
+	size_t i = 0;
+	vec3 R[3];
+#if defined(LINMATH_SSE2)
+	for(; i < (n & ~(size_t)3); i += 4) {
+		__m128 s[3], t[3], Rv[3][3];
+		linmath_load3x4(scale + i, s);
+		linmath_load3x4(trans + i, t);
+		__m128 b = _mm_loadu_ps(rot[i]), c = _mm_loadu_ps(rot[i+1]);
+		__m128 d = _mm_loadu_ps(rot[i+2]), a = _mm_loadu_ps(rot[i+3]);
+		_MM_TRANSPOSE4_PS(b, c, d, a);
+		__m128 two = _mm_set1_ps(2.f);
+		__m128 a2 = _mm_mul_ps(a, a), b2 = _mm_mul_ps(b, b);
+		__m128 c2 = _mm_mul_ps(c, c), d2 = _mm_mul_ps(d, d);
+		__m128 bc = _mm_mul_ps(b, c), ad = _mm_mul_ps(a, d);
+		__m128 bd = _mm_mul_ps(b, d), ac = _mm_mul_ps(a, c);
+		__m128 cd = _mm_mul_ps(c, d), ab = _mm_mul_ps(a, b);
+		Rv[0][0] = _mm_sub_ps(_mm_add_ps(a2, b2), _mm_add_ps(c2, d2));
+		Rv[0][1] = _mm_mul_ps(two, _mm_add_ps(bc, ad));
+		Rv[0][2] = _mm_mul_ps(two, _mm_sub_ps(bd, ac));
+		Rv[1][0] = _mm_mul_ps(two, _mm_sub_ps(bc, ad));
+		Rv[1][1] = _mm_sub_ps(_mm_add_ps(a2, c2), _mm_add_ps(b2, d2));
+		Rv[1][2] = _mm_mul_ps(two, _mm_add_ps(cd, ab));
+		Rv[2][0] = _mm_mul_ps(two, _mm_add_ps(bd, ac));
+		Rv[2][1] = _mm_mul_ps(two, _mm_sub_ps(cd, ab));
+		Rv[2][2] = _mm_sub_ps(_mm_add_ps(a2, d2), _mm_add_ps(b2, c2));
+		mat4x4_compose4(M + i, N ? N + i : NULL, s, t, Rv);
+	}
+#endif
+	for(; i < n; ++i) {
+		mat4x4_quat_rotation(R, rot[i]);
+		mat4x4_compose_trs(M[i], N ? N[i] : NULL, scale[i], trans[i], R);
+	}
+}
+
 #endif
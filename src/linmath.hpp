@@ -0,0 +1,348 @@
+#ifndef LINMATH_HPP
+#define LINMATH_HPP
+
+#include "linmath.h"
+
+/*
+ * C++ layer for linmath.h
+ *
+ * linmath::vec_t<N> (vec2_t, vec3_t, vec4_t), mat4_t and quat_t are
+ * aggregates with the same layout as the C vecN, mat4x4 and quat arrays
+ * and convert implicitly to the pointers the C functions take, so they can
+ * be passed straight to mat4x4_mul and friends. the type names end in _t
+ * so they do not collide with the C typedefs under using namespace
+ * linmath. construction is constexpr (C++11) so constant tables, such as
+ * the cube face rotations, can be built at compile time:
+ *
+ *   constexpr linmath::mat4_t face = linmath::mat4_from_rows3(
+ *       0, 0, 1,  1, 0, 0,  0, 1, 0);
+ *
+ * products of matrices and transforms are expression templates. a chain
+ * such as scale(s) * translate(t) * rotate_x(a) * m is evaluated column by
+ * column, applying each factor right to left to a vector, so it does not
+ * form intermediate matrices, and transforms like rotate_x only touch the
+ * components they change. a chain ending in a vector is evaluated as a
+ * sequence of matrix-vector products. expressions hold mat4_t operands by
+ * reference so they must not outlive the full-expression that built them.
+ */
+
+namespace linmath {
+
+/*
+ * vectors
+ */
+
+template <size_t N> struct vec_t
+{
+	float v[N];
+
+	operator float*() { return v; }
+	constexpr operator const float*() const { return v; }
+};
+
+typedef vec_t<2> vec2_t;
+typedef vec_t<3> vec3_t;
+typedef vec_t<4> vec4_t;
+
+template <typename E, size_t N> struct vec_expr
+{
+	const E& self() const { return static_cast<const E&>(*this); }
+	operator vec_t<N>() const
+	{
+		vec_t<N> r;
+		for (size_t i = 0; i < N; i++)
+			r.v[i] = self().at(i);
+		return r;
+	}
+};
+
+template <size_t N> struct vec_ref : vec_expr<vec_ref<N>, N>
+{
+	const vec_t<N> &a;
+	explicit vec_ref(const vec_t<N> &a) : a(a) {}
+	float at(size_t i) const { return a.v[i]; }
+};
+
+template <typename A, typename B, size_t N> struct vec_add : vec_expr<vec_add<A,B,N>, N>
+{
+	A a; B b;
+	vec_add(const A &a, const B &b) : a(a), b(b) {}
+	float at(size_t i) const { return a.at(i) + b.at(i); }
+};
+
+template <typename A, typename B, size_t N> struct vec_sub : vec_expr<vec_sub<A,B,N>, N>
+{
+	A a; B b;
+	vec_sub(const A &a, const B &b) : a(a), b(b) {}
+	float at(size_t i) const { return a.at(i) - b.at(i); }
+};
+
+template <typename A, size_t N> struct vec_scale : vec_expr<vec_scale<A,N>, N>
+{
+	A a; float s;
+	vec_scale(const A &a, float s) : a(a), s(s) {}
+	float at(size_t i) const { return a.at(i) * s; }
+};
+
+#define LINMATH_HPP_VEC_BINOP(op, node) \
+template <size_t N> node<vec_ref<N>, vec_ref<N>, N> \
+operator op(const vec_t<N> &a, const vec_t<N> &b) \
+{ return node<vec_ref<N>, vec_ref<N>, N>(vec_ref<N>(a), vec_ref<N>(b)); } \
+template <typename E, size_t N> node<E, vec_ref<N>, N> \
+operator op(const vec_expr<E,N> &a, const vec_t<N> &b) \
+{ return node<E, vec_ref<N>, N>(a.self(), vec_ref<N>(b)); } \
+template <typename E, size_t N> node<vec_ref<N>, E, N> \
+operator op(const vec_t<N> &a, const vec_expr<E,N> &b) \
+{ return node<vec_ref<N>, E, N>(vec_ref<N>(a), b.self()); } \
+template <typename E, typename F, size_t N> node<E, F, N> \
+operator op(const vec_expr<E,N> &a, const vec_expr<F,N> &b) \
+{ return node<E, F, N>(a.self(), b.self()); }
+
+LINMATH_HPP_VEC_BINOP(+, vec_add)
+LINMATH_HPP_VEC_BINOP(-, vec_sub)
+
+#undef LINMATH_HPP_VEC_BINOP
+
+template <size_t N> vec_scale<vec_ref<N>, N> operator*(const vec_t<N> &a, float s)
+{ return vec_scale<vec_ref<N>, N>(vec_ref<N>(a), s); }
+template <size_t N> vec_scale<vec_ref<N>, N> operator*(float s, const vec_t<N> &a)
+{ return vec_scale<vec_ref<N>, N>(vec_ref<N>(a), s); }
+template <typename E, size_t N> vec_scale<E, N> operator*(const vec_expr<E,N> &a, float s)
+{ return vec_scale<E, N>(a.self(), s); }
+template <typename E, size_t N> vec_scale<E, N> operator*(float s, const vec_expr<E,N> &a)
+{ return vec_scale<E, N>(a.self(), s); }
+
+template <size_t N> constexpr float dot(const vec_t<N> &a, const vec_t<N> &b, size_t i = 0)
+{
+	return i == N ? 0.f : a.v[i] * b.v[i] + dot(a, b, i + 1);
+}
+
+constexpr vec3_t cross(const vec3_t &a, const vec3_t &b)
+{
+	return vec3_t{{ a.v[1]*b.v[2] - a.v[2]*b.v[1],
+	                a.v[2]*b.v[0] - a.v[0]*b.v[2],
+	                a.v[0]*b.v[1] - a.v[1]*b.v[0] }};
+}
+
+/*
+ * matrices
+ */
+
+struct LINMATH_ALIGN(16) mat4_t
+{
+	float m[4][4];
+
+	operator ::vec4*() { return m; }
+	constexpr operator const ::vec4*() const { return m; }
+};
+
+constexpr mat4_t mat4_identity()
+{
+	return mat4_t{{ {1.f, 0.f, 0.f, 0.f}, {0.f, 1.f, 0.f, 0.f},
+	              {0.f, 0.f, 1.f, 0.f}, {0.f, 0.f, 0.f, 1.f} }};
+}
+
+/* build a mat4_t from a row-major 3x3 rotation, as written in C tables */
+constexpr mat4_t mat4_from_rows3(float a, float b, float c,
+	float d, float e, float f, float g, float h, float i)
+{
+	return mat4_t{{ {a, d, g, 0.f}, {b, e, h, 0.f},
+	              {c, f, i, 0.f}, {0.f, 0.f, 0.f, 1.f} }};
+}
+
+constexpr float mat4_dot(const mat4_t &a, const mat4_t &b, int c, int r)
+{
+	return a.m[0][r]*b.m[c][0] + a.m[1][r]*b.m[c][1] +
+	       a.m[2][r]*b.m[c][2] + a.m[3][r]*b.m[c][3];
+}
+
+/* compile-time product, for constant tables; prefer operator* at runtime */
+constexpr mat4_t mat4_mul(const mat4_t &a, const mat4_t &b)
+{
+	return mat4_t{{
+		{ mat4_dot(a,b,0,0), mat4_dot(a,b,0,1), mat4_dot(a,b,0,2), mat4_dot(a,b,0,3) },
+		{ mat4_dot(a,b,1,0), mat4_dot(a,b,1,1), mat4_dot(a,b,1,2), mat4_dot(a,b,1,3) },
+		{ mat4_dot(a,b,2,0), mat4_dot(a,b,2,1), mat4_dot(a,b,2,2), mat4_dot(a,b,2,3) },
+		{ mat4_dot(a,b,3,0), mat4_dot(a,b,3,1), mat4_dot(a,b,3,2), mat4_dot(a,b,3,3) },
+	}};
+}
+
+constexpr vec4_t mat4_mul_vec4(const mat4_t &a, const vec4_t &v)
+{
+	return vec4_t{{
+		a.m[0][0]*v.v[0] + a.m[1][0]*v.v[1] + a.m[2][0]*v.v[2] + a.m[3][0]*v.v[3],
+		a.m[0][1]*v.v[0] + a.m[1][1]*v.v[1] + a.m[2][1]*v.v[2] + a.m[3][1]*v.v[3],
+		a.m[0][2]*v.v[0] + a.m[1][2]*v.v[1] + a.m[2][2]*v.v[2] + a.m[3][2]*v.v[3],
+		a.m[0][3]*v.v[0] + a.m[1][3]*v.v[1] + a.m[2][3]*v.v[2] + a.m[3][3]*v.v[3],
+	}};
+}
+
+/*
+ * matrix expressions provide column(c), the c-th column of the matrix,
+ * and apply(v), the product of the matrix with a column vector.
+ */
+
+template <typename E> struct mat_expr
+{
+	const E& self() const { return static_cast<const E&>(*this); }
+	operator mat4_t() const
+	{
+		mat4_t r;
+		for (int c = 0; c < 4; c++) {
+			vec4_t col = self().column(c);
+			for (int i = 0; i < 4; i++)
+				r.m[c][i] = col.v[i];
+		}
+		return r;
+	}
+};
+
+struct mat_ref : mat_expr<mat_ref>
+{
+	const mat4_t &a;
+	explicit mat_ref(const mat4_t &a) : a(a) {}
+	vec4_t column(int c) const
+	{
+		return vec4_t{{ a.m[c][0], a.m[c][1], a.m[c][2], a.m[c][3] }};
+	}
+	vec4_t apply(const vec4_t &v) const
+	{
+		vec4_t r;
+		::mat4x4_mul_vec4(r, const_cast<::vec4*>(&a.m[0]), const_cast<float*>(v.v));
+		return r;
+	}
+};
+
+template <typename A, typename B> struct mat_mul : mat_expr<mat_mul<A,B> >
+{
+	A a; B b;
+	mat_mul(const A &a, const B &b) : a(a), b(b) {}
+	vec4_t column(int c) const { return a.apply(b.column(c)); }
+	vec4_t apply(const vec4_t &v) const { return a.apply(b.apply(v)); }
+};
+
+struct translate_t : mat_expr<translate_t>
+{
+	float x, y, z;
+	translate_t(float x, float y, float z) : x(x), y(y), z(z) {}
+	vec4_t column(int c) const
+	{
+		return c == 3 ? vec4_t{{ x, y, z, 1.f }}
+		              : vec4_t{{ c == 0 ? 1.f : 0.f, c == 1 ? 1.f : 0.f,
+		                         c == 2 ? 1.f : 0.f, 0.f }};
+	}
+	vec4_t apply(const vec4_t &v) const
+	{
+		return vec4_t{{ v.v[0] + x*v.v[3], v.v[1] + y*v.v[3], v.v[2] + z*v.v[3], v.v[3] }};
+	}
+};
+
+struct scale_t : mat_expr<scale_t>
+{
+	float x, y, z;
+	scale_t(float x, float y, float z) : x(x), y(y), z(z) {}
+	vec4_t column(int c) const
+	{
+		return vec4_t{{ c == 0 ? x : 0.f, c == 1 ? y : 0.f,
+		                c == 2 ? z : 0.f, c == 3 ? 1.f : 0.f }};
+	}
+	vec4_t apply(const vec4_t &v) const
+	{
+		return vec4_t{{ v.v[0]*x, v.v[1]*y, v.v[2]*z, v.v[3] }};
+	}
+};
+
+/* rotation mixing components J and K, with the sign conventions of
+ * mat4x4_rotate_X/Y/Z */
+template <int J, int K> struct rotate_t : mat_expr<rotate_t<J,K> >
+{
+	float c, s;
+	explicit rotate_t(float angle) : c(cosf(angle)), s(sinf(angle)) {}
+	vec4_t column(int n) const
+	{
+		vec4_t e = {{ 0.f, 0.f, 0.f, 0.f }};
+		e.v[n] = 1.f;
+		return apply(e);
+	}
+	vec4_t apply(const vec4_t &v) const
+	{
+		vec4_t r = v;
+		r.v[J] = c*v.v[J] - s*v.v[K];
+		r.v[K] = s*v.v[J] + c*v.v[K];
+		return r;
+	}
+};
+
+inline translate_t translate(float x, float y, float z) { return translate_t(x, y, z); }
+inline scale_t scale(float x, float y, float z) { return scale_t(x, y, z); }
+inline rotate_t<1,2> rotate_x(float angle) { return rotate_t<1,2>(angle); }
+inline rotate_t<0,2> rotate_y(float angle) { return rotate_t<0,2>(angle); }
+inline rotate_t<0,1> rotate_z(float angle) { return rotate_t<0,1>(angle); }
+
+inline mat_mul<mat_ref, mat_ref> operator*(const mat4_t &a, const mat4_t &b)
+{ return mat_mul<mat_ref, mat_ref>(mat_ref(a), mat_ref(b)); }
+template <typename E> mat_mul<E, mat_ref> operator*(const mat_expr<E> &a, const mat4_t &b)
+{ return mat_mul<E, mat_ref>(a.self(), mat_ref(b)); }
+template <typename E> mat_mul<mat_ref, E> operator*(const mat4_t &a, const mat_expr<E> &b)
+{ return mat_mul<mat_ref, E>(mat_ref(a), b.self()); }
+template <typename E, typename F> mat_mul<E, F> operator*(const mat_expr<E> &a, const mat_expr<F> &b)
+{ return mat_mul<E, F>(a.self(), b.self()); }
+
+inline vec4_t operator*(const mat4_t &a, const vec4_t &v) { return mat_ref(a).apply(v); }
+template <typename E> vec4_t operator*(const mat_expr<E> &a, const vec4_t &v) { return a.self().apply(v); }
+
+/*
+ * quaternions, stored x, y, z, w like the C quat
+ */
+
+struct quat_t
+{
+	float v[4];
+
+	operator float*() { return v; }
+	constexpr operator const float*() const { return v; }
+};
+
+constexpr quat_t quat_identity() { return quat_t{{ 0.f, 0.f, 0.f, 1.f }}; }
+
+constexpr quat_t operator*(const quat_t &p, const quat_t &q)
+{
+	return quat_t{{
+		p.v[3]*q.v[0] + p.v[0]*q.v[3] + p.v[1]*q.v[2] - p.v[2]*q.v[1],
+		p.v[3]*q.v[1] - p.v[0]*q.v[2] + p.v[1]*q.v[3] + p.v[2]*q.v[0],
+		p.v[3]*q.v[2] + p.v[0]*q.v[1] - p.v[1]*q.v[0] + p.v[2]*q.v[3],
+		p.v[3]*q.v[3] - p.v[0]*q.v[0] - p.v[1]*q.v[1] - p.v[2]*q.v[2],
+	}};
+}
+
+constexpr quat_t conj(const quat_t &q)
+{
+	return quat_t{{ -q.v[0], -q.v[1], -q.v[2], q.v[3] }};
+}
+
+/* same as mat4x4_from_quat */
+constexpr mat4_t mat4_from_quat(const quat_t &q)
+{
+	return mat4_t{{
+		{ q.v[3]*q.v[3] + q.v[0]*q.v[0] - q.v[1]*q.v[1] - q.v[2]*q.v[2],
+		  2.f*(q.v[0]*q.v[1] + q.v[3]*q.v[2]),
+		  2.f*(q.v[0]*q.v[2] - q.v[3]*q.v[1]), 0.f },
+		{ 2.f*(q.v[0]*q.v[1] - q.v[3]*q.v[2]),
+		  q.v[3]*q.v[3] - q.v[0]*q.v[0] + q.v[1]*q.v[1] - q.v[2]*q.v[2],
+		  2.f*(q.v[1]*q.v[2] + q.v[3]*q.v[0]), 0.f },
+		{ 2.f*(q.v[0]*q.v[2] + q.v[3]*q.v[1]),
+		  2.f*(q.v[1]*q.v[2] - q.v[3]*q.v[0]),
+		  q.v[3]*q.v[3] - q.v[0]*q.v[0] - q.v[1]*q.v[1] + q.v[2]*q.v[2], 0.f },
+		{ 0.f, 0.f, 0.f, 1.f },
+	}};
+}
+
+inline quat_t quat_rotate(float angle, const vec3_t &axis)
+{
+	float s = sinf(angle / 2);
+	return quat_t{{ axis.v[0]*s, axis.v[1]*s, axis.v[2]*s, cosf(angle / 2) }};
+}
+
+}
+
+#endif
@@ -0,0 +1,131 @@
+/*
+ * linmath_test
+ *
+ * checks the C++ layer in linmath.hpp against the C functions in
+ * linmath.h, with both in scope through using namespace linmath, and
+ * the constexpr constructors at compile time.
+ */
+
+#include <stdlib.h>
+#include <stdio.h>
+#include <string.h>
+#include <math.h>
+
+#include "linmath.h"
+#include "linmath.hpp"
+
+using namespace linmath;
+
+static int failures;
+
+#define CHECK(cond) do { if (!(cond)) { \
+    fprintf(stderr, "%s:%d: check failed: %s\n", __FILE__, __LINE__, #cond); \
+    failures++; } } while (0)
+
+static bool near(const float *a, const float *b, int n)
+{
+    for (int i = 0; i < n; i++) {
+        if (fabsf(a[i] - b[i]) > 1e-5f * (1.f + fabsf(b[i]))) return false;
+    }
+    return true;
+}
+
+/* constant tables are built at compile time */
+constexpr mat4_t face = mat4_from_rows3(0, 0, 1,  1, 0, 0,  0, 1, 0);
+constexpr vec3_t axis_x = {{ 1.f, 0.f, 0.f }}, axis_y = {{ 0.f, 1.f, 0.f }};
+
+static_assert(face.m[0][1] == 1.f && face.m[1][2] == 1.f && face.m[2][0] == 1.f,
+    "mat4_from_rows3 is row-major");
+static_assert(mat4_mul(mat4_identity(), face).m[2][0] == 1.f, "constexpr mat4_mul");
+static_assert(mat4_mul_vec4(face, vec4_t{{ 1.f, 2.f, 3.f, 1.f }}).v[0] == 3.f,
+    "constexpr mat4_mul_vec4");
+static_assert(cross(axis_x, axis_y).v[2] == 1.f, "constexpr cross");
+static_assert(dot(axis_x, axis_x) == 1.f, "constexpr dot");
+static_assert((quat_identity() * quat_identity()).v[3] == 1.f, "constexpr quat product");
+static_assert(mat4_from_quat(quat_identity()).m[3][3] == 1.f, "constexpr mat4_from_quat");
+static_assert(sizeof(mat4_t) == sizeof(mat4x4) && sizeof(quat_t) == sizeof(quat),
+    "same layout as the C types");
+
+/* transform chains match the C matrix products */
+static void test_transforms()
+{
+    mat4x4 id, s, t, r, st, str, expect;
+    mat4_t m = {{ { 1.f, 2.f, 0.f, 0.f }, { 0.f, 1.f, 3.f, 0.f },
+                  { 4.f, 0.f, 1.f, 0.f }, { 1.f, 2.f, 3.f, 1.f } }};
+    mat4x4_identity(id);
+    mat4x4_scale_aniso(s, id, 2.f, 3.f, 4.f);
+    mat4x4_translate(t, 1.f, -2.f, 0.5f);
+    mat4x4_rotate_X(r, id, 0.7f);
+    mat4x4_mul(st, s, t);
+    mat4x4_mul(str, st, r);
+    mat4x4_mul(expect, str, m);
+
+    mat4_t got = scale(2.f, 3.f, 4.f) * translate(1.f, -2.f, 0.5f) * rotate_x(0.7f) * m;
+    CHECK(near(&got.m[0][0], &expect[0][0], 16));
+
+    vec4_t v = {{ 1.f, -1.f, 2.f, 1.f }}, cv;
+    mat4x4_mul_vec4(cv, expect, v);
+    vec4_t gv = scale(2.f, 3.f, 4.f) * translate(1.f, -2.f, 0.5f) * rotate_x(0.7f) * m * v;
+    CHECK(near(gv.v, cv, 4));
+
+    mat4x4 ry, rz;
+    mat4x4_rotate_Y(ry, id, 0.3f);
+    mat4x4_rotate_Z(rz, id, -1.1f);
+    mat4_t gy = rotate_y(0.3f) * mat4_identity(), gz = rotate_z(-1.1f) * mat4_identity();
+    CHECK(near(&gy.m[0][0], &ry[0][0], 16));
+    CHECK(near(&gz.m[0][0], &rz[0][0], 16));
+
+    /* mat4_t goes straight to the C functions */
+    mat4x4 mm;
+    mat4x4_mul(mm, m, m);
+    mat4_t gm = m * m;
+    CHECK(near(&gm.m[0][0], &mm[0][0], 16));
+}
+
+/* quaternions match quat_rotate, quat_mul and mat4x4_from_quat */
+static void test_quats()
+{
+    vec3 axis = { 0.f, 0.6f, 0.8f }, cx = { 1.f, 0.f, 0.f };
+    vec3_t axis_t = {{ 0.f, 0.6f, 0.8f }};
+    quat p, q, pq;
+    mat4x4 mq;
+
+    quat_rotate(p, 0.9f, axis);
+    quat_rotate(q, -0.4f, cx);
+    quat_mul(pq, p, q);
+    mat4x4_from_quat(mq, pq);
+
+    quat_t gp = quat_rotate(0.9f, axis_t), gq = quat_rotate(-0.4f, axis_x);
+    quat_t gpq = gp * gq;
+    CHECK(near(gp.v, p, 4));
+    CHECK(near(gpq.v, pq, 4));
+    mat4_t gm = mat4_from_quat(gpq);
+    CHECK(near(&gm.m[0][0], &mq[0][0], 16));
+    quat_t one = gp * conj(gp);
+    CHECK(near(one.v, quat_identity().v, 4));
+}
+
+/* vector expressions evaluate per component */
+static void test_vectors()
+{
+    vec3_t a = {{ 1.f, 2.f, 3.f }}, b = {{ -4.f, 0.5f, 2.f }};
+    vec3 ca = { 1.f, 2.f, 3.f }, cb = { -4.f, 0.5f, 2.f }, cr, cs;
+    vec3_t r = a + b * 2.f - a * 0.5f;
+    vec3_scale(cr, cb, 2.f);
+    vec3_add(cr, ca, cr);
+    vec3_scale(cs, ca, 0.5f);
+    vec3_sub(cr, cr, cs);
+    CHECK(near(r.v, cr, 3));
+    vec3_mul_cross(cr, ca, cb);
+    CHECK(near(cross(a, b).v, cr, 3));
+    CHECK(dot(a, b) == vec3_mul_inner(ca, cb));
+}
+
+int main()
+{
+    test_transforms();
+    test_quats();
+    test_vectors();
+    printf("%-28s %s\n", "linmath_hpp", failures ? "FAIL" : "ok");
+    exit(failures ? EXIT_FAILURE : EXIT_SUCCESS);
+}
@@ -0,0 +1,475 @@
+/*
+ * Copyright (c) 2020 Michael Clark <michaeljclark@mac.com>
+ *
+ * Permission to use, copy, modify, and/or distribute this software for any
+ * purpose with or without fee is hereby granted, provided that the above
+ * copyright notice and this permission notice appear in all copies.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS" AND THE AUTHOR DISCLAIMS ALL WARRANTIES
+ * WITH REGARD TO THIS SOFTWARE INCLUDING ALL IMPLIED WARRANTIES OF
+ * MERCHANTABILITY AND FITNESS. IN NO EVENT SHALL THE AUTHOR BE LIABLE FOR
+ * ANY SPECIAL, DIRECT, INDIRECT, OR CONSEQUENTIAL DAMAGES OR ANY DAMAGES
+ * WHATSOEVER RESULTING FROM LOSS OF USE, DATA OR PROFITS, WHETHER IN AN
+ * ACTION OF CONTRACT, NEGLIGENCE OR OTHER TORTIOUS ACTION, ARISING OUT OF
+ * OR IN CONNECTION WITH THE USE OR PERFORMANCE OF THIS SOFTWARE.
+ */
+
+#pragma once
+
+/*
+ * mesh cache interface
+ *
+ * a binary container for a frozen mesh in its upload format, so that it
+ * can be mapped and handed to glBufferData without parsing or copying.
+ * the file holds a header, a vertex layout descriptor, and the vertex,
+ * index, level of detail and meshlet blobs, each aligned to
+ * MESH_CACHE_ALIGN bytes. data is stored in host byte order and the
+ * header records the bounds and the position and uv dequantization of
+ * the mesh.
+ *
+ * mesh_cache_write writes to a temporary file and renames it over the
+ * destination, so a cache that is mapped by another process stays intact.
+ * mesh_cache_map checks the header and the extents of every section
+ * against the file size, and the indices of uncompressed caches against
+ * the vertex count, and returns -1 for anything unexpected, including
+ * older versions, leaving the caller to rebuild the mesh. the remaining
+ * sections are used in place.
+ *
+ * the header keeps a key of the size and modification time of the file
+ * the mesh was built from. mesh_cache_fresh compares it with the key of
+ * the source now, so an edited source is not served from a stale cache.
+ *
+ * with mesh_cache_compressed, the vertex and index blobs are coded with
+ * mesh_codec.h and the file records their encoded sizes. such caches
+ * trade the zero-copy upload for less I/O; mesh_cache_decode_vertices and
+ * mesh_cache_decode_indices expand them, or copy uncompressed blobs.
+ * meshlet.h, mesh_simplify.h and mesh_codec.h must be included first,
+ * along with fcntl.h and sys/mman.h.
+ */
+
+enum {
+    MESH_CACHE_MAGIC = 0x4d434c47,      /* "GLCM" */
+    MESH_CACHE_VERSION = 4,
+    MESH_CACHE_ALIGN = 64,
+    MESH_CACHE_ATTRIB_MAX = 16,
+    MESH_CACHE_MESHLET_FLOATS = 8,      /* sphere and cone arrays */
+    MESH_LAYOUT_ATTRIBS = 4,
+};
+
+enum {
+    mesh_cache_compressed = 1,
+};
+
+enum {
+    mesh_attrib_float = 1,
+    mesh_attrib_short,
+    mesh_attrib_ushort,
+    mesh_attrib_ubyte,
+};
+
+typedef struct
+{
+    char name[16];
+    uint components;
+    uint type;
+    uint normalized;
+    uint offset;
+} mesh_cache_attrib;
+
+/* the source a cache was built from, zero if it has none */
+typedef struct
+{
+    unsigned long long size;
+    unsigned long long mtime;           /* nanoseconds since the epoch */
+} mesh_cache_key;
+
+typedef struct
+{
+    uint magic;
+    uint version;
+    uint header_size;
+    uint flags;
+    uint attrib_count;
+    uint vertex_stride;
+    uint vertex_count;
+    uint index_stride;
+    uint index_count;
+    uint lod_count;
+    uint meshlet_count;
+    uint reserved;
+    unsigned long long attrib_offset;
+    unsigned long long vertex_offset;
+    unsigned long long vertex_size;     /* bytes stored, encoded if compressed */
+    unsigned long long index_offset;
+    unsigned long long index_size;
+    unsigned long long lod_offset;
+    unsigned long long meshlet_offset;
+    unsigned long long file_size;
+    mesh_cache_key source;
+    float bounds[4];
+    float dequant[16];
+    float uv_dequant[4];                /* uv scale in xy, offset in zw */
+} mesh_cache_header;
+
+typedef struct
+{
+    void *map;
+    size_t size;
+    const mesh_cache_header *header;
+    const mesh_cache_attrib *attribs;
+    const void *vertices;
+    const void *indices;
+    const mesh_lod_level *lods;
+    const meshlet *meshlets;
+    const float *meshlet_data;          /* cx, cy, cz, r, ax, ay, az, cutoff */
+} mesh_cache;
+
+/* layouts of vertex and vertex_packed */
+static const mesh_cache_attrib mesh_layout_vertex[MESH_LAYOUT_ATTRIBS] = {
+    { "a_pos", 3, mesh_attrib_float, 0, offsetof(vertex,pos) },
+    { "a_normal", 3, mesh_attrib_float, 0, offsetof(vertex,norm) },
+    { "a_uv", 2, mesh_attrib_float, 0, offsetof(vertex,uv) },
+    { "a_color", 4, mesh_attrib_float, 0, offsetof(vertex,col) },
+};
+
+static const mesh_cache_attrib mesh_layout_packed[MESH_LAYOUT_ATTRIBS] = {
+    { "a_pos", 3, mesh_attrib_short, 1, offsetof(vertex_packed,pos) },
+    { "a_normal", 2, mesh_attrib_short, 1, offsetof(vertex_packed,norm) },
+    { "a_uv", 2, mesh_attrib_ushort, 1, offsetof(vertex_packed,uv) },
+    { "a_color", 4, mesh_attrib_ubyte, 1, offsetof(vertex_packed,col) },
+};
+
+static int mesh_cache_write(const char *filename,
+    const mesh_cache_attrib *attribs, uint attrib_count,
+    array_buffer *vb, index_buffer *ib, const mesh_lod *lod,
+    const meshlet_set *ms, const float *bounds, mat4x4 dequant, vec4 uv_dequant,
+    const mesh_cache_key *source, uint flags);
+static int mesh_cache_key_file(mesh_cache_key *key, const char *filename);
+static int mesh_cache_map(mesh_cache *mc, const char *filename);
+static void mesh_cache_unmap(mesh_cache *mc);
+static int mesh_cache_match(const mesh_cache *mc,
+    const mesh_cache_attrib *attribs, uint attrib_count, size_t stride);
+static int mesh_cache_fresh(const mesh_cache *mc, const mesh_cache_key *source);
+static void mesh_cache_read_lod(const mesh_cache *mc, mesh_lod *lod);
+static void mesh_cache_read_meshlets(const mesh_cache *mc, meshlet_set *ms);
+static int mesh_cache_decode_vertices(const mesh_cache *mc, void *dst);
+static int mesh_cache_decode_indices(const mesh_cache *mc, void *dst);
+
+/*
+ * mesh cache implementation
+ */
+
+static unsigned long long mesh_cache_align(unsigned long long offset)
+{
+    return (offset + MESH_CACHE_ALIGN - 1) & ~(unsigned long long)(MESH_CACHE_ALIGN - 1);
+}
+
+static int mesh_cache_put(FILE *f, const void *data, size_t size,
+    unsigned long long offset)
+{
+    static const char zero[MESH_CACHE_ALIGN];
+    long pos = ftell(f);
+    if (pos < 0 || (unsigned long long)pos > offset) return -1;
+    while ((unsigned long long)pos < offset) {
+        size_t pad = offset - pos < sizeof(zero) ? (size_t)(offset - pos) : sizeof(zero);
+        if (fwrite(zero, 1, pad, f) != pad) return -1;
+        pos += (long)pad;
+    }
+    return size && fwrite(data, 1, size, f) != size ? -1 : 0;
+}
+
+static int mesh_cache_write(const char *filename,
+    const mesh_cache_attrib *attribs, uint attrib_count,
+    array_buffer *vb, index_buffer *ib, const mesh_lod *lod,
+    const meshlet_set *ms, const float *bounds, mat4x4 dequant, vec4 uv_dequant,
+    const mesh_cache_key *source, uint flags)
+{
+    mesh_cache_header h;
+    size_t meshlet_count = ms ? ms->count : 0;
+    size_t vertex_size = vb->stride * vb->count, index_size = ib->stride * ib->count;
+    const void *vertex_data = vb->data, *index_data = ib->data;
+    unsigned char *venc = NULL, *ienc = NULL;
+    size_t meshlet_size = meshlet_count * sizeof(meshlet);
+    size_t float_size = meshlet_count * sizeof(float);
+    const float *meshlet_data[MESH_CACHE_MESHLET_FLOATS] = {
+        ms ? ms->cx : NULL, ms ? ms->cy : NULL, ms ? ms->cz : NULL, ms ? ms->r : NULL,
+        ms ? ms->ax : NULL, ms ? ms->ay : NULL, ms ? ms->az : NULL, ms ? ms->cutoff : NULL
+    };
+
+    assert(attrib_count <= MESH_CACHE_ATTRIB_MAX);
+    if (flags & mesh_cache_compressed) {
+        uint *wide = (uint*)malloc(ib->count * sizeof(uint));
+        for (size_t i = 0; i < ib->count; i++) {
+            wide[i] = index_buffer_get(ib, i);
+        }
+        size_t vbound = mesh_encode_vertex_bound(vb->count, vb->stride);
+        size_t ibound = mesh_encode_index_bound(ib->count);
+        venc = (unsigned char*)malloc(vbound);
+        ienc = (unsigned char*)malloc(ibound);
+        vertex_size = mesh_encode_vertices(venc, vbound, vb->data, vb->count, vb->stride);
+        index_size = mesh_encode_indices(ienc, ibound, wide, ib->count);
+        vertex_data = venc;
+        index_data = ienc;
+        free(wide);
+    }
+
+    memset(&h, 0, sizeof(h));
+    h.magic = MESH_CACHE_MAGIC;
+    h.version = MESH_CACHE_VERSION;
+    h.header_size = sizeof(h);
+    h.flags = flags;
+    h.attrib_count = attrib_count;
+    h.vertex_stride = (uint)vb->stride;
+    h.vertex_count = (uint)vb->count;
+    h.index_stride = (uint)ib->stride;
+    h.index_count = (uint)ib->count;
+    h.lod_count = lod ? lod->count : 0;
+    h.meshlet_count = (uint)meshlet_count;
+    h.attrib_offset = mesh_cache_align(sizeof(h));
+    h.vertex_offset = mesh_cache_align(h.attrib_offset + attrib_count * sizeof(mesh_cache_attrib));
+    h.vertex_size = vertex_size;
+    h.index_offset = mesh_cache_align(h.vertex_offset + vertex_size);
+    h.index_size = index_size;
+    h.lod_offset = mesh_cache_align(h.index_offset + index_size);
+    h.meshlet_offset = mesh_cache_align(h.lod_offset + h.lod_count * sizeof(mesh_lod_level));
+    h.file_size = h.meshlet_offset + meshlet_size + MESH_CACHE_MESHLET_FLOATS * float_size;
+    if (source) {
+        h.source = *source;
+    }
+    memcpy(h.bounds, bounds, sizeof(h.bounds));
+    memcpy(h.dequant, dequant, sizeof(h.dequant));
+    memcpy(h.uv_dequant, uv_dequant, sizeof(h.uv_dequant));
+
+    size_t len = strlen(filename);
+    char *tmpname = (char*)malloc(len + 5);
+    memcpy(tmpname, filename, len);
+    memcpy(tmpname + len, ".tmp", 5);
+
+    FILE *f = fopen(tmpname, "wb");
+    if (!f) {
+        free(tmpname);
+        free(ienc);
+        free(venc);
+        return -1;
+    }
+    int ret = mesh_cache_put(f, &h, sizeof(h), 0);
+    ret |= mesh_cache_put(f, attribs, attrib_count * sizeof(mesh_cache_attrib), h.attrib_offset);
+    ret |= mesh_cache_put(f, vertex_data, vertex_size, h.vertex_offset);
+    ret |= mesh_cache_put(f, index_data, index_size, h.index_offset);
+    ret |= mesh_cache_put(f, lod ? lod->levels : NULL,
+        h.lod_count * sizeof(mesh_lod_level), h.lod_offset);
+    ret |= mesh_cache_put(f, ms ? ms->meshlets : NULL, meshlet_size, h.meshlet_offset);
+    for (int k = 0; k < MESH_CACHE_MESHLET_FLOATS; k++) {
+        ret |= mesh_cache_put(f, meshlet_data[k], float_size,
+            h.meshlet_offset + meshlet_size + k * float_size);
+    }
+    ret |= fclose(f);
+    if (ret == 0) {
+        ret = rename(tmpname, filename);
+    }
+    if (ret != 0) {
+        remove(tmpname);
+    }
+    free(tmpname);
+    free(ienc);
+    free(venc);
+    return ret ? -1 : 0;
+}
+
+static int mesh_cache_section(const mesh_cache_header *h, unsigned long long offset,
+    unsigned long long size)
+{
+    return offset % MESH_CACHE_ALIGN == 0 && offset <= h->file_size &&
+        size <= h->file_size - offset;
+}
+
+static int mesh_cache_valid(const mesh_cache_header *h, size_t size)
+{
+    unsigned long long meshlet_size = (unsigned long long)h->meshlet_count *
+        (sizeof(meshlet) + MESH_CACHE_MESHLET_FLOATS * sizeof(float));
+    int raw = !(h->flags & mesh_cache_compressed);
+    return size >= sizeof(*h) &&
+        h->magic == MESH_CACHE_MAGIC &&
+        h->version == MESH_CACHE_VERSION &&
+        h->header_size == sizeof(*h) &&
+        h->file_size == size &&
+        (h->flags & ~(uint)mesh_cache_compressed) == 0 &&
+        h->attrib_count <= MESH_CACHE_ATTRIB_MAX &&
+        h->vertex_stride > 0 &&
+        (h->index_stride == sizeof(unsigned short) || h->index_stride == sizeof(uint)) &&
+        h->lod_count <= MESH_LOD_MAX &&
+        mesh_cache_section(h, h->attrib_offset,
+            (unsigned long long)h->attrib_count * sizeof(mesh_cache_attrib)) &&
+        (!raw || h->vertex_size == (unsigned long long)h->vertex_count * h->vertex_stride) &&
+        (!raw || h->index_size == (unsigned long long)h->index_count * h->index_stride) &&
+        mesh_cache_section(h, h->vertex_offset, h->vertex_size) &&
+        mesh_cache_section(h, h->index_offset, h->index_size) &&
+        mesh_cache_section(h, h->lod_offset,
+            (unsigned long long)h->lod_count * sizeof(mesh_lod_level)) &&
+        mesh_cache_section(h, h->meshlet_offset, meshlet_size);
+}
+
+/* the key of a source file, from its size and modification time */
+static int mesh_cache_key_file(mesh_cache_key *key, const char *filename)
+{
+    struct stat statbuf;
+    memset(key, 0, sizeof(*key));
+    if (stat(filename, &statbuf) < 0) {
+        return -1;
+    }
+#if defined(__APPLE__)
+    const struct timespec *t = &statbuf.st_mtimespec;
+#else
+    const struct timespec *t = &statbuf.st_mtim;
+#endif
+    key->size = (unsigned long long)statbuf.st_size;
+    key->mtime = (unsigned long long)t->tv_sec * 1000000000ull + (unsigned long long)t->tv_nsec;
+    return 0;
+}
+
+/* the largest index of an uncompressed cache must name a vertex */
+static int mesh_cache_indices_valid(const mesh_cache_header *h, const void *indices)
+{
+    uint max = 0;
+    if (h->index_stride == sizeof(unsigned short)) {
+        const unsigned short *p = (const unsigned short*)indices;
+        for (uint i = 0; i < h->index_count; i++) {
+            max = p[i] > max ? p[i] : max;
+        }
+    } else {
+        const uint *p = (const uint*)indices;
+        for (uint i = 0; i < h->index_count; i++) {
+            max = p[i] > max ? p[i] : max;
+        }
+    }
+    return h->index_count == 0 || max < h->vertex_count;
+}
+
+static int mesh_cache_map(mesh_cache *mc, const char *filename)
+{
+    struct stat statbuf;
+    int fd;
+
+    memset(mc, 0, sizeof(*mc));
+    if ((fd = open(filename, O_RDONLY)) < 0) {
+        return -1;
+    }
+    if (fstat(fd, &statbuf) < 0 || (size_t)statbuf.st_size < sizeof(mesh_cache_header)) {
+        close(fd);
+        return -1;
+    }
+    mc->size = (size_t)statbuf.st_size;
+    mc->map = mmap(NULL, mc->size, PROT_READ, MAP_PRIVATE, fd, 0);
+    close(fd);
+    if (mc->map == MAP_FAILED) {
+        mc->map = NULL;
+        return -1;
+    }
+#if defined(MADV_WILLNEED)
+    madvise(mc->map, mc->size, MADV_WILLNEED);
+#endif
+
+    const char *base = (const char*)mc->map;
+    const mesh_cache_header *h = (const mesh_cache_header*)base;
+    if (!mesh_cache_valid(h, mc->size) ||
+            (!(h->flags & mesh_cache_compressed) &&
+            !mesh_cache_indices_valid(h, base + h->index_offset))) {
+        mesh_cache_unmap(mc);
+        return -1;
+    }
+
+    /* ranges drawn by the levels and meshlets must lie in the indices */
+    const mesh_lod_level *lods = (const mesh_lod_level*)(base + h->lod_offset);
+    const meshlet *meshlets = (const meshlet*)(base + h->meshlet_offset);
+    for (uint i = 0; i < h->lod_count; i++) {
+        if (lods[i].index_offset > h->index_count ||
+                lods[i].index_count > h->index_count - lods[i].index_offset) {
+            mesh_cache_unmap(mc);
+            return -1;
+        }
+    }
+    for (uint i = 0; i < h->meshlet_count; i++) {
+        if (meshlets[i].index_offset > h->index_count ||
+                meshlets[i].index_count > h->index_count - meshlets[i].index_offset) {
+            mesh_cache_unmap(mc);
+            return -1;
+        }
+    }
+
+    mc->header = h;
+    mc->attribs = (const mesh_cache_attrib*)(base + h->attrib_offset);
+    mc->vertices = base + h->vertex_offset;
+    mc->indices = base + h->index_offset;
+    mc->lods = lods;
+    mc->meshlets = meshlets;
+    mc->meshlet_data = (const float*)(base + h->meshlet_offset +
+        h->meshlet_count * sizeof(meshlet));
+    return 0;
+}
+
+static void mesh_cache_unmap(mesh_cache *mc)
+{
+    if (mc->map) {
+        munmap(mc->map, mc->size);
+    }
+    memset(mc, 0, sizeof(*mc));
+}
+
+/* is the cache in the vertex layout the caller is set up to draw */
+static int mesh_cache_match(const mesh_cache *mc,
+    const mesh_cache_attrib *attribs, uint attrib_count, size_t stride)
+{
+    return mc->header->vertex_stride == stride &&
+        mc->header->attrib_count == attrib_count &&
+        memcmp(mc->attribs, attribs, attrib_count * sizeof(mesh_cache_attrib)) == 0;
+}
+
+/* was the cache built from the source with this key */
+static int mesh_cache_fresh(const mesh_cache *mc, const mesh_cache_key *source)
+{
+    return memcmp(&mc->header->source, source, sizeof(mesh_cache_key)) == 0;
+}
+
+static void mesh_cache_read_lod(const mesh_cache *mc, mesh_lod *lod)
+{
+    lod->count = mc->header->lod_count;
+    memcpy(lod->levels, mc->lods, lod->count * sizeof(mesh_lod_level));
+}
+
+static void mesh_cache_read_meshlets(const mesh_cache *mc, meshlet_set *ms)
+{
+    size_t n = mc->header->meshlet_count;
+    float *dst[MESH_CACHE_MESHLET_FLOATS];
+    if (n > ms->capacity) {
+        meshlet_set_resize(ms, n);
+    }
+    dst[0] = ms->cx; dst[1] = ms->cy; dst[2] = ms->cz; dst[3] = ms->r;
+    dst[4] = ms->ax; dst[5] = ms->ay; dst[6] = ms->az; dst[7] = ms->cutoff;
+    memcpy(ms->meshlets, mc->meshlets, n * sizeof(meshlet));
+    for (int k = 0; k < MESH_CACHE_MESHLET_FLOATS; k++) {
+        memcpy(dst[k], mc->meshlet_data + k * n, n * sizeof(float));
+    }
+    ms->count = n;
+}
+
+static int mesh_cache_decode_vertices(const mesh_cache *mc, void *dst)
+{
+    const mesh_cache_header *h = mc->header;
+    if (!(h->flags & mesh_cache_compressed)) {
+        memcpy(dst, mc->vertices, h->vertex_size);
+        return 0;
+    }
+    return mesh_decode_vertices(dst, h->vertex_count, h->vertex_stride,
+        (const unsigned char*)mc->vertices, h->vertex_size);
+}
+
+static int mesh_cache_decode_indices(const mesh_cache *mc, void *dst)
+{
+    const mesh_cache_header *h = mc->header;
+    if (!(h->flags & mesh_cache_compressed)) {
+        memcpy(dst, mc->indices, h->index_size);
+        return 0;
+    }
+    return mesh_decode_indices(dst, h->index_count, h->index_stride,
+        h->vertex_count, (const unsigned char*)mc->indices, h->index_size);
+}
@@ -0,0 +1,456 @@
+/*
+ * Copyright (c) 2020 Michael Clark <michaeljclark@mac.com>
+ *
+ * Permission to use, copy, modify, and/or distribute this software for any
+ * purpose with or without fee is hereby granted, provided that the above
+ * copyright notice and this permission notice appear in all copies.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS" AND THE AUTHOR DISCLAIMS ALL WARRANTIES
+ * WITH REGARD TO THIS SOFTWARE INCLUDING ALL IMPLIED WARRANTIES OF
+ * MERCHANTABILITY AND FITNESS. IN NO EVENT SHALL THE AUTHOR BE LIABLE FOR
+ * ANY SPECIAL, DIRECT, INDIRECT, OR CONSEQUENTIAL DAMAGES OR ANY DAMAGES
+ * WHATSOEVER RESULTING FROM LOSS OF USE, DATA OR PROFITS, WHETHER IN AN
+ * ACTION OF CONTRACT, NEGLIGENCE OR OTHER TORTIOUS ACTION, ARISING OUT OF
+ * OR IN CONNECTION WITH THE USE OR PERFORMANCE OF THIS SOFTWARE.
+ */
+
+#pragma once
+
+/*
+ * mesh codec interface
+ *
+ * lossless compression of vertex and index data.
+ *
+ * vertices are coded as 32-bit words, so the stride must be a multiple of
+ * four. each word is replaced by the zigzag encoded difference from the
+ * same word of the previous vertex, and the differences are stored in
+ * groups of four with a control byte holding a 2-bit length code for each
+ * (0, 1, 2 or 4 bytes) followed by the data bytes of the group. control
+ * bytes come first, then data bytes. a group decodes with one shuffle
+ * looked up by its control byte, and since the previous vertex is at
+ * least four words back when the stride is 16 bytes or more, the deltas
+ * of a group are added with one vector add. the vector decoder needs
+ * SSSE3: AVX2 and SSSE3 builds always use it, while SSE2 builds with GCC
+ * or Clang compile it for SSSE3 and use it when the CPU supports it. the
+ * scalar decoder handles the rest. groups are kept at four words in AVX2 builds too: reloading the
+ * previous vertex with 32-byte loads straddles earlier stores and defeats
+ * store forwarding.
+ *
+ * indices are coded per triangle against a FIFO of recent edges and a
+ * FIFO of recent vertices. a triangle sharing an edge with a recent
+ * triangle costs one byte holding its rotation, the edge and a code for
+ * the third vertex: the next unused vertex, a recent vertex, or an
+ * explicit varint relative to the next unused vertex. other triangles are
+ * coded explicitly. rotation is kept, so decoding is exact. the index
+ * decoder is scalar, as each triangle depends on the last.
+ *
+ * decoders check every read against the input size and every index
+ * against the vertex count, and return -1 for malformed input.
+ */
+
+#if defined(LINMATH_AVX2) || defined(__SSSE3__)
+#define MESH_CODEC_SSSE3 1
+#define MESH_CODEC_TARGET
+#elif defined(LINMATH_SSE2) && (defined(__GNUC__) || defined(__clang__))
+#define MESH_CODEC_SSSE3 1
+#define MESH_CODEC_DISPATCH 1
+#define MESH_CODEC_TARGET __attribute__((target("ssse3")))
+#endif
+#if defined(MESH_CODEC_SSSE3) && !defined(LINMATH_AVX2)
+#include <tmmintrin.h>
+#endif
+
+enum {
+    MESH_CODEC_VERTEX = 0xa1,
+    MESH_CODEC_INDEX = 0xb1,
+    MESH_CODEC_PAD = 16,                /* lets the vector decoder run to the end */
+    MESH_CODEC_EDGE_FIFO = 8,
+    MESH_CODEC_VERTEX_FIFO = 8,
+    MESH_CODEC_VERTEX_REFS = 6,         /* vertex FIFO entries a code can name */
+};
+
+static size_t mesh_encode_vertex_bound(size_t vertex_count, size_t stride);
+static size_t mesh_encode_vertices(unsigned char *dst, size_t dst_size,
+    const void *vertices, size_t vertex_count, size_t stride);
+static int mesh_decode_vertices(void *dst, size_t vertex_count, size_t stride,
+    const unsigned char *src, size_t src_size);
+static size_t mesh_encode_index_bound(size_t index_count);
+static size_t mesh_encode_indices(unsigned char *dst, size_t dst_size,
+    const uint *indices, size_t index_count);
+static int mesh_decode_indices(void *dst, size_t index_count, size_t index_stride,
+    size_t vertex_count, const unsigned char *src, size_t src_size);
+
+/*
+ * mesh codec implementation
+ */
+
+static const unsigned char mesh_codec_length[4] = { 0, 1, 2, 4 };
+
+typedef struct
+{
+    unsigned char length[256];
+    LINMATH_ALIGN(16) unsigned char shuffle[256][16];
+} mesh_codec_table;
+
+/* data length and byte shuffle for each control byte */
+static void mesh_codec_table_init(mesh_codec_table *t)
+{
+    for (int c = 0; c < 256; c++) {
+        unsigned char pos = 0;
+        for (int k = 0; k < 4; k++) {
+            unsigned char len = mesh_codec_length[(c >> (k * 2)) & 3];
+            for (int b = 0; b < 4; b++) {
+                t->shuffle[c][k * 4 + b] = b < len ? pos + b : 0x80;
+            }
+            pos += len;
+        }
+        t->length[c] = pos;
+    }
+}
+
+static uint mesh_zigzag(uint d) { return (d << 1) ^ (uint)((int)d >> 31); }
+static uint mesh_unzigzag(uint z) { return (z >> 1) ^ (0u - (z & 1)); }
+
+static size_t mesh_encode_vertex_bound(size_t vertex_count, size_t stride)
+{
+    size_t words = vertex_count * (stride / 4);
+    return 1 + (words + 3) / 4 + words * 4 + MESH_CODEC_PAD;
+}
+
+static size_t mesh_encode_vertices(unsigned char *dst, size_t dst_size,
+    const void *vertices, size_t vertex_count, size_t stride)
+{
+    size_t cols = stride / 4, words = vertex_count * cols, groups = (words + 3) / 4;
+    const unsigned char *src = (const unsigned char*)vertices;
+    unsigned char *ctrl = dst + 1, *data = ctrl + groups;
+
+    assert(stride % 4 == 0);
+    if (dst_size < mesh_encode_vertex_bound(vertex_count, stride)) {
+        return 0;
+    }
+    dst[0] = MESH_CODEC_VERTEX;
+    memset(ctrl, 0, groups);
+    for (size_t j = 0; j < words; j++) {
+        uint w, p = 0, z;
+        memcpy(&w, src + j * 4, 4);
+        if (j >= cols) memcpy(&p, src + (j - cols) * 4, 4);
+        z = mesh_zigzag(w - p);
+        uint code = z == 0 ? 0 : z < 0x100 ? 1 : z < 0x10000 ? 2 : 3;
+        ctrl[j / 4] |= (unsigned char)(code << ((j & 3) * 2));
+        for (uint b = 0; b < mesh_codec_length[code]; b++) {
+            *data++ = (unsigned char)(z >> (b * 8));
+        }
+    }
+    memset(data, 0, MESH_CODEC_PAD);
+    return (size_t)(data - dst) + MESH_CODEC_PAD;
+}
+
+/* decode words [j, end) of a group, one at a time */
+static int mesh_decode_words(unsigned char *out, size_t j, size_t end, size_t cols,
+    uint c, const unsigned char **data, const unsigned char *limit)
+{
+    const unsigned char *d = *data;
+    for (size_t k = 0; j < end; j++, k++) {
+        uint len = mesh_codec_length[(c >> (k * 2)) & 3], z = 0, p = 0, w;
+        if ((size_t)(limit - d) < len) return -1;
+        for (uint b = 0; b < len; b++) {
+            z |= (uint)d[b] << (b * 8);
+        }
+        d += len;
+        if (j >= cols) memcpy(&p, out + (j - cols) * 4, 4);
+        w = p + mesh_unzigzag(z);
+        memcpy(out + j * 4, &w, 4);
+    }
+    *data = d;
+    return 0;
+}
+
+#if defined(MESH_CODEC_SSSE3)
+/* decode whole groups from g with one shuffle each, returning the next group */
+MESH_CODEC_TARGET
+static size_t mesh_decode_groups_ssse3(unsigned char *out, size_t g, size_t full,
+    size_t cols, const unsigned char *ctrl, const unsigned char **data,
+    const unsigned char *limit)
+{
+    mesh_codec_table t;
+    const unsigned char *d = *data;
+    const __m128i one = _mm_set1_epi32(1);
+    mesh_codec_table_init(&t);
+    for (; g < full && (size_t)(limit - d) >= 16; g++) {
+        __m128i z = _mm_loadu_si128((const __m128i*)d);
+        z = _mm_shuffle_epi8(z, _mm_load_si128((const __m128i*)t.shuffle[ctrl[g]]));
+        d += t.length[ctrl[g]];
+        __m128i v = _mm_xor_si128(_mm_srli_epi32(z, 1),
+            _mm_sub_epi32(_mm_setzero_si128(), _mm_and_si128(z, one)));
+        unsigned char *o = out + g * 16;
+        __m128i p = _mm_loadu_si128((const __m128i*)(o - cols * 4));
+        _mm_storeu_si128((__m128i*)o, _mm_add_epi32(p, v));
+    }
+    *data = d;
+    return g;
+}
+
+/* whether the SSSE3 decoder can run, checked once in dispatching builds */
+static int mesh_codec_ssse3()
+{
+#if defined(MESH_CODEC_DISPATCH)
+    static int supported = -1;
+    if (supported < 0) {
+        supported = __builtin_cpu_supports("ssse3") != 0;
+    }
+    return supported;
+#else
+    return 1;
+#endif
+}
+#endif
+
+static int mesh_decode_vertices(void *dst, size_t vertex_count, size_t stride,
+    const unsigned char *src, size_t src_size)
+{
+    size_t cols = stride / 4, words = vertex_count * cols, groups = (words + 3) / 4;
+    unsigned char *out = (unsigned char*)dst;
+    const unsigned char *limit = src + src_size, *ctrl = src + 1, *data, *end;
+    size_t g = 0;
+
+    if (stride % 4 != 0 || src_size < 1 + groups || src[0] != MESH_CODEC_VERTEX) {
+        return -1;
+    }
+    data = ctrl + groups;
+
+    /* the first vertex has no previous vertex, and narrow strides overlap */
+    size_t scalar = cols >= 4 ? (cols + 3) / 4 : groups;
+    for (; g < groups && g < scalar; g++) {
+        size_t j = g * 4, e = j + 4 < words ? j + 4 : words;
+        if (mesh_decode_words(out, j, e, cols, ctrl[g], &data, limit) < 0) return -1;
+    }
+
+#if defined(MESH_CODEC_SSSE3)
+    if (cols >= 4 && mesh_codec_ssse3()) {
+        g = mesh_decode_groups_ssse3(out, g, words / 4, cols, ctrl, &data, limit);
+    }
+#endif
+
+    for (; g < groups; g++) {
+        size_t j = g * 4, e = j + 4 < words ? j + 4 : words;
+        if (mesh_decode_words(out, j, e, cols, ctrl[g], &data, limit) < 0) return -1;
+    }
+    end = data;
+    return (size_t)(limit - end) <= MESH_CODEC_PAD ? 0 : -1;
+}
+
+/*
+ * index coding
+ *
+ * code byte: bits 7-6 rotation, or 3 for an explicit triangle; bits 5-3
+ * edge FIFO entry, most recent first; bits 2-0 third vertex: 0 the next
+ * unused vertex, 1-6 a vertex FIFO entry, 7 an explicit varint. explicit
+ * triangles set bit k when vertex k is the next unused vertex and follow
+ * with varints for the others. varints are LEB128 of the zigzag encoded
+ * difference from the next unused vertex.
+ */
+
+typedef struct
+{
+    uint edge[MESH_CODEC_EDGE_FIFO][2];
+    uint vertex[MESH_CODEC_VERTEX_FIFO];
+    uint edge_head;
+    uint vertex_head;
+    uint next;
+} mesh_index_state;
+
+static void mesh_index_state_init(mesh_index_state *s)
+{
+    memset(s, 0xff, sizeof(s->edge) + sizeof(s->vertex));
+    s->edge_head = s->vertex_head = s->next = 0;
+}
+
+static void mesh_index_push_edge(mesh_index_state *s, uint a, uint b)
+{
+    uint *e = s->edge[s->edge_head++ & (MESH_CODEC_EDGE_FIFO - 1)];
+    e[0] = a;
+    e[1] = b;
+}
+
+static void mesh_index_push_vertex(mesh_index_state *s, uint v)
+{
+    s->vertex[s->vertex_head++ & (MESH_CODEC_VERTEX_FIFO - 1)] = v;
+    s->next = v >= s->next ? v + 1 : s->next;
+}
+
+static const uint* mesh_index_edge(const mesh_index_state *s, uint k)
+{
+    return s->edge[(s->edge_head - 1 - k) & (MESH_CODEC_EDGE_FIFO - 1)];
+}
+
+static uint mesh_index_vertex(const mesh_index_state *s, uint k)
+{
+    return s->vertex[(s->vertex_head - 1 - k) & (MESH_CODEC_VERTEX_FIFO - 1)];
+}
+
+static unsigned char* mesh_put_varint(unsigned char *p, uint v)
+{
+    while (v >= 0x80) {
+        *p++ = (unsigned char)(v | 0x80);
+        v >>= 7;
+    }
+    *p++ = (unsigned char)v;
+    return p;
+}
+
+static int mesh_get_varint(const unsigned char **p, const unsigned char *limit, uint *v)
+{
+    uint r = 0;
+    for (int shift = 0; shift < 35; shift += 7) {
+        if (*p >= limit) return -1;
+        unsigned char b = *(*p)++;
+        r |= (uint)(b & 0x7f) << shift;
+        if (!(b & 0x80)) {
+            *v = r;
+            return 0;
+        }
+    }
+    return -1;
+}
+
+static size_t mesh_encode_index_bound(size_t index_count)
+{
+    return 1 + index_count / 3 * 16;
+}
+
+static size_t mesh_encode_indices(unsigned char *dst, size_t dst_size,
+    const uint *indices, size_t index_count)
+{
+    mesh_index_state s;
+    unsigned char *p = dst;
+
+    assert(index_count % 3 == 0);
+    if (dst_size < mesh_encode_index_bound(index_count)) {
+        return 0;
+    }
+    mesh_index_state_init(&s);
+    *p++ = MESH_CODEC_INDEX;
+    for (size_t i = 0; i < index_count; i += 3) {
+        const uint *t = indices + i;
+        uint rot = 3, edge = 0;
+
+        /* a rotation whose first edge reverses a recent edge */
+        for (uint k = 0; k < MESH_CODEC_EDGE_FIFO && rot == 3; k++) {
+            const uint *e = mesh_index_edge(&s, k);
+            for (uint r = 0; r < 3; r++) {
+                if (t[r] == e[1] && t[(r + 1) % 3] == e[0]) {
+                    rot = r;
+                    edge = k;
+                    break;
+                }
+            }
+        }
+
+        if (rot < 3) {
+            uint a = t[rot], b = t[(rot + 1) % 3], c = t[(rot + 2) % 3], code = 7;
+            if (c == s.next) {
+                code = 0;
+            } else {
+                for (uint k = 0; k < MESH_CODEC_VERTEX_REFS; k++) {
+                    if (mesh_index_vertex(&s, k) == c) {
+                        code = k + 1;
+                        break;
+                    }
+                }
+            }
+            *p++ = (unsigned char)(rot << 6 | edge << 3 | code);
+            if (code == 7) {
+                p = mesh_put_varint(p, mesh_zigzag(c - s.next));
+            }
+            if (code == 0 || code == 7) {
+                mesh_index_push_vertex(&s, c);
+            }
+            mesh_index_push_edge(&s, b, c);
+            mesh_index_push_edge(&s, c, a);
+        } else {
+            unsigned char *code = p++;
+            *code = 0xc0;
+            for (uint k = 0; k < 3; k++) {
+                if (t[k] == s.next) {
+                    *code |= (unsigned char)(1 << k);
+                } else {
+                    p = mesh_put_varint(p, mesh_zigzag(t[k] - s.next));
+                }
+                mesh_index_push_vertex(&s, t[k]);
+            }
+            mesh_index_push_edge(&s, t[0], t[1]);
+            mesh_index_push_edge(&s, t[1], t[2]);
+            mesh_index_push_edge(&s, t[2], t[0]);
+        }
+    }
+    return (size_t)(p - dst);
+}
+
+static int mesh_decode_indices(void *dst, size_t index_count, size_t index_stride,
+    size_t vertex_count, const unsigned char *src, size_t src_size)
+{
+    mesh_index_state s;
+    const unsigned char *p = src + 1, *limit = src + src_size;
+    uint *out32 = (uint*)dst;
+    unsigned short *out16 = (unsigned short*)dst;
+
+    if (index_count % 3 != 0 || src_size < 1 || src[0] != MESH_CODEC_INDEX ||
+            (index_stride != sizeof(uint) && index_stride != sizeof(unsigned short))) {
+        return -1;
+    }
+    mesh_index_state_init(&s);
+    for (size_t i = 0; i < index_count; i += 3) {
+        uint t[3], z;
+        if (p >= limit) return -1;
+        uint code = *p++, rot = code >> 6;
+
+        if (rot < 3) {
+            const uint *e = mesh_index_edge(&s, (code >> 3) & 7);
+            uint a = e[1], b = e[0], c;
+            uint v = code & 7;
+            if (v == 0) {
+                c = s.next;
+            } else if (v < 7) {
+                c = mesh_index_vertex(&s, v - 1);
+            } else {
+                if (mesh_get_varint(&p, limit, &z) < 0) return -1;
+                c = s.next + mesh_unzigzag(z);
+            }
+            if (v == 0 || v == 7) {
+                mesh_index_push_vertex(&s, c);
+            }
+            mesh_index_push_edge(&s, b, c);
+            mesh_index_push_edge(&s, c, a);
+            t[rot] = a;
+            t[(rot + 1) % 3] = b;
+            t[(rot + 2) % 3] = c;
+        } else {
+            for (uint k = 0; k < 3; k++) {
+                if (code & (1u << k)) {
+                    t[k] = s.next;
+                } else {
+                    if (mesh_get_varint(&p, limit, &z) < 0) return -1;
+                    t[k] = s.next + mesh_unzigzag(z);
+                }
+                mesh_index_push_vertex(&s, t[k]);
+            }
+            mesh_index_push_edge(&s, t[0], t[1]);
+            mesh_index_push_edge(&s, t[1], t[2]);
+            mesh_index_push_edge(&s, t[2], t[0]);
+        }
+
+        if (t[0] >= vertex_count || t[1] >= vertex_count || t[2] >= vertex_count) {
+            return -1;
+        }
+        if (index_stride == sizeof(uint)) {
+            out32[i] = t[0];
+            out32[i + 1] = t[1];
+            out32[i + 2] = t[2];
+        } else {
+            out16[i] = (unsigned short)t[0];
+            out16[i + 1] = (unsigned short)t[1];
+            out16[i + 2] = (unsigned short)t[2];
+        }
+    }
+    return p == limit ? 0 : -1;
+}
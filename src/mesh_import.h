@@ -0,0 +1,1194 @@
+/*
+ * Copyright (c) 2020 Michael Clark <michaeljclark@mac.com>
+ *
+ * Permission to use, copy, modify, and/or distribute this software for any
+ * purpose with or without fee is hereby granted, provided that the above
+ * copyright notice and this permission notice appear in all copies.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS" AND THE AUTHOR DISCLAIMS ALL WARRANTIES
+ * WITH REGARD TO THIS SOFTWARE INCLUDING ALL IMPLIED WARRANTIES OF
+ * MERCHANTABILITY AND FITNESS. IN NO EVENT SHALL THE AUTHOR BE LIABLE FOR
+ * ANY SPECIAL, DIRECT, INDIRECT, OR CONSEQUENTIAL DAMAGES OR ANY DAMAGES
+ * WHATSOEVER RESULTING FROM LOSS OF USE, DATA OR PROFITS, WHETHER IN AN
+ * ACTION OF CONTRACT, NEGLIGENCE OR OTHER TORTIOUS ACTION, ARISING OUT OF
+ * OR IN CONNECTION WITH THE USE OR PERFORMANCE OF THIS SOFTWARE.
+ */
+
+#pragma once
+
+/*
+ * mesh import interface
+ *
+ * loads Wavefront OBJ and ASCII or binary PLY triangle meshes, appending
+ * to a vertex buffer and a 32-bit index buffer. the file is mapped and
+ * split into chunks of about MESH_IMPORT_CHUNK bytes ending on line
+ * boundaries, which are parsed in parallel on the job system, or serially
+ * if js is NULL.
+ *
+ * - OBJ: a first pass counts the v, vt and vn records of each chunk, so
+ *   the second pass can store attributes at their final positions and
+ *   resolve relative indices. polygons are triangulated as fans. when no
+ *   face refers to uvs or normals the positions become the vertices;
+ *   otherwise every corner becomes a vertex, to be merged by mesh_weld.
+ *   "v x y z r g b" vertex colors are accepted.
+ * - PLY: binary vertex records are fixed size and are decoded in parallel
+ *   by index, as are faces when every face is a triangle, the common
+ *   case; other faces are read serially. ASCII bodies count the lines of
+ *   each chunk in the first pass to find the element of every line.
+ *
+ * normals missing from the file are generated from area weighted face
+ * normals accumulated over shared positions. floats are read with a
+ * decimal parser that scales a 64-bit mantissa by an exact power of ten,
+ * falling back to strtod for large exponents, infinities and NaNs.
+ *
+ * mesh_import returns -1 with errno set on failure, EINVAL for malformed
+ * files and files without triangles, leaving vb and ib as they were.
+ * job_system.h must be included
+ * first, along with fcntl.h, sys/mman.h and time.h.
+ */
+
+enum {
+    MESH_IMPORT_CHUNK = 1 << 20,        /* bytes per text chunk */
+    MESH_IMPORT_RECORDS = 1 << 16,      /* records per binary chunk */
+    MESH_PLY_ELEMENT_MAX = 8,
+    MESH_PLY_PROPERTY_MAX = 32,
+};
+
+typedef enum
+{
+    mesh_format_unknown,
+    mesh_format_obj,
+    mesh_format_ply,
+} mesh_format;
+
+typedef struct
+{
+    mesh_format format;
+    size_t bytes;
+    size_t vertices;                    /* vertices appended */
+    size_t triangles;
+    double seconds;
+    double mbps;                        /* megabytes per second */
+} mesh_import_stats;
+
+static float mesh_parse_float(const char **s, const char *end);
+static void mesh_generate_normals(vertex *v, size_t vertex_count,
+    const uint *indices, size_t index_count);
+static int mesh_import_obj(vertex_buffer *vb, index_buffer *ib,
+    const char *data, size_t size, job_system_t *js);
+static int mesh_import_ply(vertex_buffer *vb, index_buffer *ib,
+    const char *data, size_t size, job_system_t *js);
+static int mesh_import(vertex_buffer *vb, index_buffer *ib,
+    const char *filename, job_system_t *js, mesh_import_stats *stats);
+
+/*
+ * mesh import implementation
+ */
+
+typedef struct
+{
+    const char *begin, *end;            /* text range */
+    size_t first, count;                /* binary record range */
+    size_t v, vt, vn;                   /* OBJ record counts, then bases */
+    size_t lines;                       /* PLY line count, then first line */
+    size_t corner;                      /* first output corner */
+    array_buffer cv, ct, cn;            /* triangle corners */
+    int attribs;                        /* corners refer to uvs or normals */
+    int unlit;                          /* corners without normals */
+    int error;
+} mesh_import_chunk;
+
+typedef struct
+{
+    const char *name;
+    uint type;                          /* value type, or index type of a list */
+    uint count_type;                    /* list count type, 0 for scalars */
+    int slot;                           /* vertex attribute, or -1 */
+    float scale;
+} mesh_ply_property;
+
+typedef struct
+{
+    const char *name;
+    size_t count;
+    size_t record_size;                 /* binary record size, 0 with lists */
+    size_t line;                        /* first line of an ASCII body */
+    uint property_count;
+    mesh_ply_property properties[MESH_PLY_PROPERTY_MAX];
+} mesh_ply_element;
+
+typedef struct
+{
+    const char *data;
+    size_t size;
+    mesh_import_chunk *chunks;
+    size_t chunk_count;
+    size_t v_count, vt_count, vn_count;
+    vertex *vertices;                   /* positions, colors and normals */
+    vec2f *uvs;
+    vec3f *normals;
+    vertex *out_vertices;
+    uint *out_indices;
+    uint base;                          /* first output vertex */
+    int swap;                           /* PLY byte order differs */
+    mesh_ply_element *vertex_element;
+    mesh_ply_element *face_element;
+    mesh_ply_property *face_list;
+    size_t vertex_offset, face_offset;
+    mesh_ply_element elements[MESH_PLY_ELEMENT_MAX];
+    uint element_count;
+} mesh_import_state;
+
+static const double mesh_pow10[] = {
+    1e0, 1e1, 1e2, 1e3, 1e4, 1e5, 1e6, 1e7, 1e8, 1e9, 1e10, 1e11,
+    1e12, 1e13, 1e14, 1e15, 1e16, 1e17, 1e18, 1e19, 1e20, 1e21, 1e22,
+};
+
+static int mesh_is_digit(char c)
+{
+    return (unsigned)(c - '0') < 10;
+}
+
+static int mesh_is_space(char c)
+{
+    return c == ' ' || c == '\t' || c == '\r';
+}
+
+static const char* mesh_skip_space(const char *s, const char *end)
+{
+    while (s < end && mesh_is_space(*s)) s++;
+    return s;
+}
+
+static const char* mesh_line_end(const char *s, const char *end)
+{
+    const char *nl = (const char*)memchr(s, '\n', end - s);
+    return nl ? nl : end;
+}
+
+static const char* mesh_next_line(const char *s, const char *end)
+{
+    const char *nl = (const char*)memchr(s, '\n', end - s);
+    return nl ? nl + 1 : end;
+}
+
+static float mesh_parse_float_slow(const char **ps, const char *end)
+{
+    char buf[64], *e;
+    size_t n = 0;
+    const char *s = *ps;
+    while (s + n < end && n < sizeof(buf) - 1 && !mesh_is_space(s[n]) && s[n] != '\n') {
+        buf[n] = s[n];
+        n++;
+    }
+    buf[n] = '\0';
+    float f = strtof(buf, &e);
+    *ps = s + (e - buf);
+    return f;
+}
+
+/*
+ * parse a decimal float at *s and advance *s past it, leaving *s where it
+ * was if there is no number. digits past the nineteenth only move the
+ * decimal point, which is far below float precision.
+ */
+static float mesh_parse_float(const char **ps, const char *end)
+{
+    const char *s = *ps;
+    unsigned long long m = 0;
+    int digits = 0, any = 0, scale = 0, neg = 0;
+
+    if (s < end && (*s == '-' || *s == '+')) {
+        neg = *s++ == '-';
+    }
+    for (; s < end && mesh_is_digit(*s); s++, any = 1) {
+        if (digits < 19) {
+            m = m * 10 + (*s - '0');
+            digits += m != 0;
+        } else {
+            scale++;
+        }
+    }
+    if (s < end && *s == '.') {
+        for (s++; s < end && mesh_is_digit(*s); s++, any = 1) {
+            if (digits < 19) {
+                m = m * 10 + (*s - '0');
+                digits += m != 0;
+                scale--;
+            }
+        }
+    }
+    if (!any) {
+        return mesh_parse_float_slow(ps, end);
+    }
+    if (s < end && (*s == 'e' || *s == 'E')) {
+        const char *e = s + 1;
+        int eneg = 0, ex = 0, eany = 0;
+        if (e < end && (*e == '-' || *e == '+')) {
+            eneg = *e++ == '-';
+        }
+        for (; e < end && mesh_is_digit(*e); e++, eany = 1) {
+            ex = ex < 10000 ? ex * 10 + (*e - '0') : ex;
+        }
+        if (eany) {
+            scale += eneg ? -ex : ex;
+            s = e;
+        }
+    }
+    double d = (double)m;
+    if (m != 0 && scale != 0) {
+        if (scale < -22 || scale > 22) {
+            return mesh_parse_float_slow(ps, end);
+        }
+        d = scale < 0 ? d / mesh_pow10[-scale] : d * mesh_pow10[scale];
+    }
+    *ps = s;
+    return (float)(neg ? -d : d);
+}
+
+/* parse a decimal integer, leaving *s where it was if there is none */
+static long long mesh_parse_int(const char **ps, const char *end)
+{
+    const char *s = *ps;
+    long long v = 0;
+    int neg = 0;
+    if (s < end && (*s == '-' || *s == '+')) {
+        neg = *s++ == '-';
+    }
+    if (s == end || !mesh_is_digit(*s)) {
+        return 0;
+    }
+    for (; s < end && mesh_is_digit(*s); s++) {
+        v = v < (1ll << 40) ? v * 10 + (*s - '0') : v;
+    }
+    *ps = s;
+    return neg ? -v : v;
+}
+
+static void mesh_normals_accumulate(vertex *v, const uint *indices, size_t index_count)
+{
+    vec3 e1, e2, n;
+    for (size_t i = 0; i + 2 < index_count; i += 3) {
+        vertex *a = v + indices[i], *b = v + indices[i + 1], *c = v + indices[i + 2];
+        vec3_sub(e1, b->pos.vec, a->pos.vec);
+        vec3_sub(e2, c->pos.vec, a->pos.vec);
+        vec3_mul_cross(n, e1, e2);
+        for (int k = 0; k < 3; k++) {
+            a->norm.vec[k] += n[k];
+            b->norm.vec[k] += n[k];
+            c->norm.vec[k] += n[k];
+        }
+    }
+}
+
+static void mesh_normals_normalize(vertex *v, size_t vertex_count)
+{
+    for (size_t i = 0; i < vertex_count; i++) {
+        float l = vec3_len(v[i].norm.vec);
+        if (l > 0.f) {
+            vec3_scale(v[i].norm.vec, v[i].norm.vec, 1.f / l);
+        } else {
+            v[i].norm = (vec3f){ { 0.f, 0.f, 1.f } };
+        }
+    }
+}
+
+/*
+ * replace the normals of v with the area weighted sum of the normals of
+ * the triangles that use each vertex.
+ */
+static void mesh_generate_normals(vertex *v, size_t vertex_count,
+    const uint *indices, size_t index_count)
+{
+    for (size_t i = 0; i < vertex_count; i++) {
+        v[i].norm = (vec3f){ { 0.f, 0.f, 0.f } };
+    }
+    mesh_normals_accumulate(v, indices, index_count);
+    mesh_normals_normalize(v, vertex_count);
+}
+
+static void mesh_import_run(job_system_t *js, job_fn fn, mesh_import_state *st,
+    size_t count)
+{
+    if (js && count > 1) {
+        job_parallel_for(js, fn, st, count, 1);
+    } else {
+        fn(NULL, st, 0, count);
+    }
+}
+
+static void mesh_import_chunks_free(mesh_import_state *st)
+{
+    for (size_t i = 0; i < st->chunk_count; i++) {
+        array_buffer_destroy(&st->chunks[i].cv);
+        array_buffer_destroy(&st->chunks[i].ct);
+        array_buffer_destroy(&st->chunks[i].cn);
+    }
+    free(st->chunks);
+    st->chunks = NULL;
+    st->chunk_count = 0;
+}
+
+static mesh_import_chunk* mesh_import_chunks(mesh_import_state *st, size_t count)
+{
+    mesh_import_chunks_free(st);
+    st->chunks = (mesh_import_chunk*)calloc(count, sizeof(mesh_import_chunk));
+    st->chunk_count = count;
+    for (size_t i = 0; i < count; i++) {
+        array_buffer_init(&st->chunks[i].cv, sizeof(uint), 64);
+        array_buffer_init(&st->chunks[i].ct, sizeof(uint), 64);
+        array_buffer_init(&st->chunks[i].cn, sizeof(uint), 64);
+    }
+    return st->chunks;
+}
+
+/* split text into chunks that start on line boundaries */
+static void mesh_import_split(mesh_import_state *st, const char *text, const char *end)
+{
+    size_t n = 0;
+    mesh_import_chunk *c = mesh_import_chunks(st, (end - text) / MESH_IMPORT_CHUNK + 1);
+    for (const char *p = text; p < end; n++) {
+        const char *e = end - p > MESH_IMPORT_CHUNK ?
+            mesh_next_line(p + MESH_IMPORT_CHUNK, end) : end;
+        c[n].begin = p;
+        c[n].end = e;
+        p = e;
+    }
+    for (; n < st->chunk_count; n++) {
+        c[n].begin = c[n].end = end;
+    }
+}
+
+static void mesh_import_free(mesh_import_state *st)
+{
+    mesh_import_chunks_free(st);
+    free(st->vertices);
+    free(st->uvs);
+    free(st->normals);
+}
+
+/* append a triangle, with uv and normal indices unless t and n are NULL */
+static void mesh_import_triangle(mesh_import_chunk *c, const uint *v,
+    const uint *t, const uint *n)
+{
+    array_buffer_add_n(&c->cv, v, 3);
+    if (t) {
+        array_buffer_add_n(&c->ct, t, 3);
+        array_buffer_add_n(&c->cn, n, 3);
+    }
+}
+
+static void mesh_import_indexed_job(job_t *job, void *arg, size_t begin, size_t end)
+{
+    mesh_import_state *st = (mesh_import_state*)arg;
+    for (size_t i = begin; i < end; i++) {
+        mesh_import_chunk *c = &st->chunks[i];
+        index_offset_n(st->out_indices + c->corner, (const uint*)c->cv.data,
+            st->base, c->cv.count);
+    }
+}
+
+static void mesh_import_corner_job(job_t *job, void *arg, size_t begin, size_t end)
+{
+    mesh_import_state *st = (mesh_import_state*)arg;
+    for (size_t i = begin; i < end; i++) {
+        mesh_import_chunk *c = &st->chunks[i];
+        const uint *cv = (const uint*)c->cv.data;
+        const uint *ct = (const uint*)c->ct.data;
+        const uint *cn = (const uint*)c->cn.data;
+        for (size_t j = 0; j < c->cv.count; j++) {
+            vertex *o = st->out_vertices + c->corner + j;
+            *o = st->vertices[cv[j]];
+            if (ct[j] != ~0u) o->uv = st->uvs[ct[j]];
+            if (cn[j] != ~0u) o->norm = st->normals[cn[j]];
+            st->out_indices[c->corner + j] = st->base + (uint)(c->corner + j);
+        }
+    }
+}
+
+/*
+ * append the parsed mesh to vb and ib. indexed meshes use the parsed
+ * vertices as they are, otherwise each corner becomes a vertex.
+ */
+static int mesh_import_finish(mesh_import_state *st, vertex_buffer *vb,
+    index_buffer *ib, job_system_t *js, int indexed, int normals)
+{
+    size_t corners = 0, unlit = 0;
+    for (size_t i = 0; i < st->chunk_count; i++) {
+        if (st->chunks[i].error) {
+            errno = EINVAL;
+            return -1;
+        }
+        st->chunks[i].corner = corners;
+        corners += st->chunks[i].cv.count;
+        unlit |= st->chunks[i].unlit;
+    }
+    size_t vertex_count = indexed ? st->v_count : corners;
+    if (corners == 0 || ib->stride != sizeof(uint) ||
+            vb->count + vertex_count > 0xffffffffu) {
+        errno = EINVAL;
+        return -1;
+    }
+
+    if (normals || unlit) {
+        for (size_t i = 0; i < st->chunk_count; i++) {
+            mesh_normals_accumulate(st->vertices, (const uint*)st->chunks[i].cv.data,
+                st->chunks[i].cv.count);
+        }
+        mesh_normals_normalize(st->vertices, st->v_count);
+    }
+
+    st->base = (uint)vb->count;
+    array_buffer_reserve(vb, vb->count + vertex_count);
+    array_buffer_reserve(ib, ib->count + corners);
+    st->out_vertices = (vertex*)vb->data + vb->count;
+    st->out_indices = (uint*)ib->data + ib->count;
+    if (indexed) {
+        memcpy(st->out_vertices, st->vertices, vertex_count * sizeof(vertex));
+        mesh_import_run(js, mesh_import_indexed_job, st, st->chunk_count);
+    } else {
+        mesh_import_run(js, mesh_import_corner_job, st, st->chunk_count);
+    }
+    vb->count += vertex_count;
+    ib->count += corners;
+    if (vertex_count && vb->count - 1 > ib->max_index) {
+        ib->max_index = (uint)vb->count - 1;
+    }
+    return 0;
+}
+
+/*
+ * Wavefront OBJ
+ */
+
+enum { mesh_obj_other, mesh_obj_v, mesh_obj_vt, mesh_obj_vn, mesh_obj_f };
+
+static int mesh_obj_record(const char **ps, const char *end)
+{
+    const char *s = mesh_skip_space(*ps, end);
+    int kind = mesh_obj_other, len = 1;
+    if (s < end && s[0] == 'v') {
+        kind = mesh_obj_v;
+        if (end - s > 1 && s[1] == 't') {
+            kind = mesh_obj_vt;
+            len = 2;
+        } else if (end - s > 1 && s[1] == 'n') {
+            kind = mesh_obj_vn;
+            len = 2;
+        }
+    } else if (s < end && s[0] == 'f') {
+        kind = mesh_obj_f;
+    }
+    if (kind == mesh_obj_other || end - s <= len || (s[len] != ' ' && s[len] != '\t')) {
+        return mesh_obj_other;
+    }
+    *ps = s + len;
+    return kind;
+}
+
+static void mesh_obj_count_job(job_t *job, void *arg, size_t begin, size_t end)
+{
+    mesh_import_state *st = (mesh_import_state*)arg;
+    for (size_t i = begin; i < end; i++) {
+        mesh_import_chunk *c = &st->chunks[i];
+        for (const char *p = c->begin; p < c->end; p = mesh_next_line(p, c->end)) {
+            switch (mesh_obj_record(&p, c->end)) {
+            case mesh_obj_v: c->v++; break;
+            case mesh_obj_vt: c->vt++; break;
+            case mesh_obj_vn: c->vn++; break;
+            }
+        }
+    }
+}
+
+/* resolve a 1-based or relative index against the records seen so far */
+static int mesh_obj_index(const char **ps, const char *end, size_t seen,
+    size_t total, uint *index)
+{
+    const char *s = *ps;
+    long long i = mesh_parse_int(ps, end);
+    if (*ps == s || i == 0) {
+        return 0;
+    }
+    i = i > 0 ? i - 1 : (long long)seen + i;
+    if (i < 0 || (unsigned long long)i >= total) {
+        return 0;
+    }
+    *index = (uint)i;
+    return 1;
+}
+
+static int mesh_obj_face(mesh_import_state *st, mesh_import_chunk *c,
+    const char *s, const char *le, size_t v, size_t vt, size_t vn)
+{
+    uint cv[3], ct[3], cn[3];
+    int n = 0;
+    for (s = mesh_skip_space(s, le); s < le; s = mesh_skip_space(s, le)) {
+        uint iv, it = ~0u, in = ~0u;
+        if (!mesh_obj_index(&s, le, v, st->v_count, &iv)) {
+            return 0;
+        }
+        if (s < le && *s == '/') {
+            s++;
+            if (s < le && *s != '/' && !mesh_obj_index(&s, le, vt, st->vt_count, &it)) {
+                return 0;
+            }
+            if (s < le && *s == '/') {
+                s++;
+                if (!mesh_obj_index(&s, le, vn, st->vn_count, &in)) {
+                    return 0;
+                }
+            }
+        }
+        if (s < le && !mesh_is_space(*s)) {
+            return 0;
+        }
+        c->attribs |= it != ~0u || in != ~0u;
+        c->unlit |= in == ~0u;
+        /* fan around the first corner */
+        int k = n < 2 ? n : 2;
+        cv[k] = iv, ct[k] = it, cn[k] = in;
+        if (++n >= 3) {
+            mesh_import_triangle(c, cv, ct, cn);
+            cv[1] = cv[2], ct[1] = ct[2], cn[1] = cn[2];
+        }
+    }
+    return 1;
+}
+
+static int mesh_parse_floats(const char **ps, const char *end, float *f, int n)
+{
+    int i = 0;
+    for (; i < n; i++) {
+        const char *s = mesh_skip_space(*ps, end);
+        *ps = s;
+        f[i] = mesh_parse_float(ps, end);
+        if (*ps == s) break;
+    }
+    return i;
+}
+
+static void mesh_obj_parse_job(job_t *job, void *arg, size_t begin, size_t end)
+{
+    mesh_import_state *st = (mesh_import_state*)arg;
+    for (size_t i = begin; i < end; i++) {
+        mesh_import_chunk *c = &st->chunks[i];
+        size_t v = c->v, vt = c->vt, vn = c->vn;
+        for (const char *p = c->begin; p < c->end && !c->error;
+                p = mesh_next_line(p, c->end)) {
+            const char *s = p, *le = mesh_line_end(p, c->end);
+            float f[6];
+            switch (mesh_obj_record(&s, le)) {
+            case mesh_obj_v: {
+                vertex *o = st->vertices + v++;
+                int n = mesh_parse_floats(&s, le, f, 6);
+                c->error |= n < 3;
+                o->pos = (vec3f){ { f[0], f[1], f[2] } };
+                o->norm = (vec3f){ { 0.f, 0.f, 0.f } };
+                o->uv = (vec2f){ { 0.f, 0.f } };
+                o->col = n == 6 ? (vec4f){ { f[3], f[4], f[5], 1.f } } :
+                    (vec4f){ { 1.f, 1.f, 1.f, 1.f } };
+                break;
+            }
+            case mesh_obj_vt:
+                c->error |= mesh_parse_floats(&s, le, f, 2) < 1;
+                st->uvs[vt++] = (vec2f){ { f[0], f[1] } };
+                break;
+            case mesh_obj_vn:
+                c->error |= mesh_parse_floats(&s, le, f, 3) < 3;
+                st->normals[vn++] = (vec3f){ { f[0], f[1], f[2] } };
+                break;
+            case mesh_obj_f:
+                c->error |= !mesh_obj_face(st, c, s, le, v, vt, vn);
+                break;
+            }
+        }
+    }
+}
+
+static int mesh_import_obj(vertex_buffer *vb, index_buffer *ib,
+    const char *data, size_t size, job_system_t *js)
+{
+    mesh_import_state st;
+    int ret, indexed = 1;
+
+    memset(&st, 0, sizeof(st));
+    st.data = data;
+    st.size = size;
+    mesh_import_split(&st, data, data + size);
+    mesh_import_run(js, mesh_obj_count_job, &st, st.chunk_count);
+
+    /* the counts of each chunk become the index of its first record */
+    for (size_t i = 0; i < st.chunk_count; i++) {
+        mesh_import_chunk *c = &st.chunks[i];
+        size_t v = c->v, vt = c->vt, vn = c->vn;
+        c->v = st.v_count;
+        c->vt = st.vt_count;
+        c->vn = st.vn_count;
+        st.v_count += v;
+        st.vt_count += vt;
+        st.vn_count += vn;
+    }
+    st.vertices = (vertex*)malloc((st.v_count + 1) * sizeof(vertex));
+    st.uvs = (vec2f*)malloc((st.vt_count + 1) * sizeof(vec2f));
+    st.normals = (vec3f*)malloc((st.vn_count + 1) * sizeof(vec3f));
+    mesh_import_run(js, mesh_obj_parse_job, &st, st.chunk_count);
+
+    for (size_t i = 0; i < st.chunk_count; i++) {
+        indexed &= !st.chunks[i].attribs;
+    }
+    ret = mesh_import_finish(&st, vb, ib, js, indexed, indexed);
+    mesh_import_free(&st);
+    return ret;
+}
+
+/*
+ * Stanford PLY
+ */
+
+enum {
+    mesh_ply_int8 = 1, mesh_ply_uint8, mesh_ply_int16, mesh_ply_uint16,
+    mesh_ply_int32, mesh_ply_uint32, mesh_ply_float32, mesh_ply_float64,
+};
+
+enum {
+    mesh_ply_x, mesh_ply_y, mesh_ply_z, mesh_ply_nx, mesh_ply_ny, mesh_ply_nz,
+    mesh_ply_u, mesh_ply_v, mesh_ply_r, mesh_ply_g, mesh_ply_b, mesh_ply_a,
+    mesh_ply_slots,
+};
+
+static const uint mesh_ply_size[] = { 0, 1, 1, 2, 2, 4, 4, 4, 8 };
+
+static uint mesh_ply_type(const char *name)
+{
+    static const struct { const char *name; uint type; } types[] = {
+        { "char", mesh_ply_int8 }, { "int8", mesh_ply_int8 },
+        { "uchar", mesh_ply_uint8 }, { "uint8", mesh_ply_uint8 },
+        { "short", mesh_ply_int16 }, { "int16", mesh_ply_int16 },
+        { "ushort", mesh_ply_uint16 }, { "uint16", mesh_ply_uint16 },
+        { "int", mesh_ply_int32 }, { "int32", mesh_ply_int32 },
+        { "uint", mesh_ply_uint32 }, { "uint32", mesh_ply_uint32 },
+        { "float", mesh_ply_float32 }, { "float32", mesh_ply_float32 },
+        { "double", mesh_ply_float64 }, { "float64", mesh_ply_float64 },
+    };
+    for (size_t i = 0; i < sizeof(types) / sizeof(types[0]); i++) {
+        if (strcmp(name, types[i].name) == 0) return types[i].type;
+    }
+    return 0;
+}
+
+static int mesh_ply_slot(const char *name)
+{
+    static const struct { const char *name; int slot; } slots[] = {
+        { "x", mesh_ply_x }, { "y", mesh_ply_y }, { "z", mesh_ply_z },
+        { "nx", mesh_ply_nx }, { "ny", mesh_ply_ny }, { "nz", mesh_ply_nz },
+        { "u", mesh_ply_u }, { "s", mesh_ply_u }, { "texture_u", mesh_ply_u },
+        { "texture_s", mesh_ply_u }, { "v", mesh_ply_v }, { "t", mesh_ply_v },
+        { "texture_v", mesh_ply_v }, { "texture_t", mesh_ply_v },
+        { "red", mesh_ply_r }, { "green", mesh_ply_g }, { "blue", mesh_ply_b },
+        { "alpha", mesh_ply_a },
+    };
+    for (size_t i = 0; i < sizeof(slots) / sizeof(slots[0]); i++) {
+        if (strcmp(name, slots[i].name) == 0) return slots[i].slot;
+    }
+    return -1;
+}
+
+static double mesh_ply_read(const unsigned char *p, uint type, int swap)
+{
+    unsigned char b[8];
+    uint n = mesh_ply_size[type];
+    if (swap) {
+        for (uint k = 0; k < n; k++) b[k] = p[n - 1 - k];
+        p = b;
+    }
+    switch (type) {
+    case mesh_ply_int8: return (signed char)p[0];
+    case mesh_ply_uint8: return p[0];
+    case mesh_ply_int16: { short v; memcpy(&v, p, 2); return v; }
+    case mesh_ply_uint16: { unsigned short v; memcpy(&v, p, 2); return v; }
+    case mesh_ply_int32: { int v; memcpy(&v, p, 4); return v; }
+    case mesh_ply_uint32: { uint v; memcpy(&v, p, 4); return v; }
+    case mesh_ply_float32: { float v; memcpy(&v, p, 4); return v; }
+    case mesh_ply_float64: { double v; memcpy(&v, p, 8); return v; }
+    }
+    return 0;
+}
+
+static void mesh_ply_vertex(vertex *o, const float *f)
+{
+    o->pos = (vec3f){ { f[mesh_ply_x], f[mesh_ply_y], f[mesh_ply_z] } };
+    o->norm = (vec3f){ { f[mesh_ply_nx], f[mesh_ply_ny], f[mesh_ply_nz] } };
+    o->uv = (vec2f){ { f[mesh_ply_u], f[mesh_ply_v] } };
+    o->col = (vec4f){ { f[mesh_ply_r], f[mesh_ply_g], f[mesh_ply_b], f[mesh_ply_a] } };
+}
+
+static void mesh_ply_defaults(float *f)
+{
+    for (int k = 0; k < mesh_ply_slots; k++) {
+        f[k] = k >= mesh_ply_r ? 1.f : 0.f;
+    }
+}
+
+/* append the fan of a polygon, checking its indices */
+static void mesh_ply_polygon(mesh_import_state *st, mesh_import_chunk *c,
+    const uint *idx, size_t n)
+{
+    for (size_t k = 0; k < n; k++) {
+        c->error |= idx[k] >= st->v_count;
+    }
+    for (size_t k = 2; k < n && !c->error; k++) {
+        uint tri[3] = { idx[0], idx[k - 1], idx[k] };
+        mesh_import_triangle(c, tri, NULL, NULL);
+    }
+}
+
+static size_t mesh_ply_scalar_size(const mesh_ply_element *e, uint first, uint last)
+{
+    size_t size = 0;
+    for (uint i = first; i < last; i++) {
+        size += mesh_ply_size[e->properties[i].type];
+    }
+    return size;
+}
+
+/* skip a binary record with lists, or return NULL if it overruns */
+static const unsigned char* mesh_ply_skip(const mesh_import_state *st,
+    const mesh_ply_element *e, const unsigned char *p, const unsigned char *end)
+{
+    for (uint i = 0; i < e->property_count; i++) {
+        const mesh_ply_property *pp = &e->properties[i];
+        size_t n = 1;
+        if (pp->count_type) {
+            if ((size_t)(end - p) < mesh_ply_size[pp->count_type]) return NULL;
+            n = (size_t)mesh_ply_read(p, pp->count_type, st->swap);
+            p += mesh_ply_size[pp->count_type];
+        }
+        if ((size_t)(end - p) < n * mesh_ply_size[pp->type]) return NULL;
+        p += n * mesh_ply_size[pp->type];
+    }
+    return p;
+}
+
+static void mesh_ply_vertex_job(job_t *job, void *arg, size_t begin, size_t end)
+{
+    mesh_import_state *st = (mesh_import_state*)arg;
+    const mesh_ply_element *e = st->vertex_element;
+    for (size_t i = begin; i < end; i++) {
+        mesh_import_chunk *c = &st->chunks[i];
+        const unsigned char *p = (const unsigned char*)st->data + st->vertex_offset +
+            c->first * e->record_size;
+        float f[mesh_ply_slots];
+        mesh_ply_defaults(f);
+        for (size_t j = c->first; j < c->first + c->count; j++) {
+            for (uint k = 0; k < e->property_count; k++) {
+                const mesh_ply_property *pp = &e->properties[k];
+                if (pp->slot >= 0) {
+                    f[pp->slot] = (float)mesh_ply_read(p, pp->type, st->swap) * pp->scale;
+                }
+                p += mesh_ply_size[pp->type];
+            }
+            mesh_ply_vertex(st->vertices + j, f);
+        }
+    }
+}
+
+/* faces holding a triangle list and scalars, assuming every face is a triangle */
+static void mesh_ply_triangle_job(job_t *job, void *arg, size_t begin, size_t end)
+{
+    mesh_import_state *st = (mesh_import_state*)arg;
+    const mesh_ply_element *e = st->face_element;
+    const mesh_ply_property *l = st->face_list;
+    uint list = (uint)(l - e->properties);
+    size_t before = mesh_ply_scalar_size(e, 0, list);
+    size_t after = mesh_ply_scalar_size(e, list + 1, e->property_count);
+    size_t cs = mesh_ply_size[l->count_type], is = mesh_ply_size[l->type];
+    size_t record = before + cs + 3 * is + after;
+    for (size_t i = begin; i < end; i++) {
+        mesh_import_chunk *c = &st->chunks[i];
+        const unsigned char *p = (const unsigned char*)st->data + st->face_offset +
+            c->first * record + before;
+        array_buffer_reserve(&c->cv, c->count * 3);
+        for (size_t j = 0; j < c->count && !c->error; j++, p += record) {
+            uint idx[3];
+            c->error |= mesh_ply_read(p, l->count_type, st->swap) != 3.0;
+            for (int k = 0; k < 3; k++) {
+                idx[k] = (uint)mesh_ply_read(p + cs + k * is, l->type, st->swap);
+            }
+            mesh_ply_polygon(st, c, idx, 3);
+        }
+    }
+}
+
+static int mesh_ply_binary(mesh_import_state *st, const unsigned char *p,
+    job_system_t *js)
+{
+    const unsigned char *end = (const unsigned char*)st->data + st->size;
+    mesh_ply_element *ve = st->vertex_element, *fe = st->face_element;
+
+    if (ve > fe) {
+        return -1;
+    }
+    /* find the vertex and face records, skipping other elements */
+    for (uint i = 0; i < st->element_count; i++) {
+        mesh_ply_element *e = &st->elements[i];
+        if (e == ve) st->vertex_offset = p - (const unsigned char*)st->data;
+        if (e == fe) {
+            st->face_offset = p - (const unsigned char*)st->data;
+            break;
+        }
+        if (e->record_size) {
+            if ((size_t)(end - p) / e->record_size < e->count) return -1;
+            p += e->count * e->record_size;
+        } else {
+            for (size_t j = 0; j < e->count; j++) {
+                if (!(p = mesh_ply_skip(st, e, p, end))) return -1;
+            }
+        }
+    }
+    if (!ve->record_size || (size_t)(end - ((const unsigned char*)st->data +
+            st->vertex_offset)) / ve->record_size < ve->count) {
+        return -1;
+    }
+
+    size_t n = ve->count / MESH_IMPORT_RECORDS + 1;
+    mesh_import_chunk *c = mesh_import_chunks(st, n);
+    for (size_t i = 0; i < n; i++) {
+        c[i].first = i * MESH_IMPORT_RECORDS;
+        c[i].count = i + 1 < n ? MESH_IMPORT_RECORDS : ve->count - c[i].first;
+    }
+    mesh_import_run(js, mesh_ply_vertex_job, st, n);
+
+    /* try the triangle fast path, then read polygons serially */
+    const mesh_ply_property *l = st->face_list;
+    uint list = (uint)(l - fe->properties), lists = 0;
+    size_t record = mesh_ply_scalar_size(fe, 0, list) + mesh_ply_size[l->count_type] +
+        3 * mesh_ply_size[l->type] + mesh_ply_scalar_size(fe, list + 1, fe->property_count);
+    for (uint i = 0; i < fe->property_count; i++) {
+        lists += fe->properties[i].count_type != 0;
+    }
+    p = (const unsigned char*)st->data + st->face_offset;
+    if (lists == 1 && (size_t)(end - p) / record >= fe->count) {
+        int error = 0;
+        n = fe->count / MESH_IMPORT_RECORDS + 1;
+        c = mesh_import_chunks(st, n);
+        for (size_t i = 0; i < n; i++) {
+            c[i].first = i * MESH_IMPORT_RECORDS;
+            c[i].count = i + 1 < n ? MESH_IMPORT_RECORDS : fe->count - c[i].first;
+        }
+        mesh_import_run(js, mesh_ply_triangle_job, st, n);
+        for (size_t i = 0; i < n; i++) {
+            error |= c[i].error;
+        }
+        if (!error) return 0;
+    }
+
+    c = mesh_import_chunks(st, 1);
+    uint *idx = NULL;
+    size_t cap = 0;
+    for (size_t j = 0; j < fe->count && !c->error; j++) {
+        for (uint i = 0; i < fe->property_count && !c->error; i++) {
+            const mesh_ply_property *pp = &fe->properties[i];
+            size_t m = 1, s = mesh_ply_size[pp->type];
+            if (pp->count_type) {
+                if ((size_t)(end - p) < mesh_ply_size[pp->count_type]) {
+                    c->error = 1;
+                    break;
+                }
+                m = (size_t)mesh_ply_read(p, pp->count_type, st->swap);
+                p += mesh_ply_size[pp->count_type];
+            }
+            if ((size_t)(end - p) / s < m) {
+                c->error = 1;
+                break;
+            }
+            if (i == list) {
+                if (m > cap) {
+                    cap = m;
+                    idx = (uint*)realloc(idx, cap * sizeof(uint));
+                }
+                for (size_t k = 0; k < m; k++) {
+                    idx[k] = (uint)mesh_ply_read(p + k * s, pp->type, st->swap);
+                }
+                mesh_ply_polygon(st, c, idx, m);
+            }
+            p += m * s;
+        }
+    }
+    free(idx);
+    return c->error ? -1 : 0;
+}
+
+static void mesh_ply_count_job(job_t *job, void *arg, size_t begin, size_t end)
+{
+    mesh_import_state *st = (mesh_import_state*)arg;
+    for (size_t i = begin; i < end; i++) {
+        mesh_import_chunk *c = &st->chunks[i];
+        for (const char *p = c->begin; p < c->end; p = mesh_next_line(p, c->end)) {
+            const char *s = mesh_skip_space(p, c->end);
+            c->lines += s < c->end && *s != '\n';
+        }
+    }
+}
+
+static void mesh_ply_ascii_job(job_t *job, void *arg, size_t begin, size_t end)
+{
+    mesh_import_state *st = (mesh_import_state*)arg;
+    const mesh_ply_element *ve = st->vertex_element, *fe = st->face_element;
+    for (size_t i = begin; i < end; i++) {
+        mesh_import_chunk *c = &st->chunks[i];
+        size_t line = c->lines;
+        uint *idx = NULL;
+        size_t cap = 0;
+        for (const char *p = c->begin; p < c->end && !c->error;
+                p = mesh_next_line(p, c->end)) {
+            const char *le = mesh_line_end(p, c->end), *s = mesh_skip_space(p, le);
+            if (s == le) continue;
+            size_t l = line++;
+            if (l >= ve->line && l < ve->line + ve->count) {
+                float f[mesh_ply_slots];
+                mesh_ply_defaults(f);
+                for (uint k = 0; k < ve->property_count && !c->error; k++) {
+                    const mesh_ply_property *pp = &ve->properties[k];
+                    const char *q = s = mesh_skip_space(s, le);
+                    float x = mesh_parse_float(&s, le);
+                    c->error |= s == q || pp->count_type;
+                    if (pp->slot >= 0) f[pp->slot] = x * pp->scale;
+                }
+                mesh_ply_vertex(st->vertices + (l - ve->line), f);
+            } else if (l >= fe->line && l < fe->line + fe->count) {
+                for (uint k = 0; k < fe->property_count && !c->error; k++) {
+                    const mesh_ply_property *pp = &fe->properties[k];
+                    const char *q = s = mesh_skip_space(s, le);
+                    long long m = pp->count_type ? mesh_parse_int(&s, le) : 1;
+                    c->error |= (pp->count_type && s == q) || m < 0 || m > (1 << 20);
+                    if (c->error) break;
+                    if ((size_t)m > cap) {
+                        cap = (size_t)m;
+                        idx = (uint*)realloc(idx, cap * sizeof(uint));
+                    }
+                    for (long long j = 0; j < m && !c->error; j++) {
+                        q = s = mesh_skip_space(s, le);
+                        long long v = mesh_parse_int(&s, le);
+                        c->error |= s == q || v < 0 || v > 0xffffffffll;
+                        idx[j] = (uint)v;
+                    }
+                    if (pp == st->face_list && !c->error) {
+                        mesh_ply_polygon(st, c, idx, (size_t)m);
+                    }
+                }
+            }
+        }
+        free(idx);
+    }
+}
+
+static int mesh_ply_ascii(mesh_import_state *st, const char *body, job_system_t *js)
+{
+    size_t line = 0;
+    for (uint i = 0; i < st->element_count; i++) {
+        st->elements[i].line = line;
+        line += st->elements[i].count;
+    }
+    mesh_import_split(st, body, st->data + st->size);
+    mesh_import_run(js, mesh_ply_count_job, st, st->chunk_count);
+    line = 0;
+    for (size_t i = 0; i < st->chunk_count; i++) {
+        size_t lines = st->chunks[i].lines;
+        st->chunks[i].lines = line;
+        line += lines;
+    }
+    const mesh_ply_element *fe = st->face_element;
+    if (line < fe->line + fe->count) {
+        return -1;
+    }
+    mesh_import_run(js, mesh_ply_ascii_job, st, st->chunk_count);
+    return 0;
+}
+
+static void mesh_ply_word(const char **ps, const char *end, char *buf, size_t size)
+{
+    const char *s = mesh_skip_space(*ps, end);
+    size_t n = 0;
+    while (s < end && !mesh_is_space(*s)) {
+        if (n + 1 < size) buf[n++] = *s;
+        s++;
+    }
+    buf[n] = '\0';
+    *ps = s;
+}
+
+static const char* mesh_ply_name(char *names, size_t *used, const char *word)
+{
+    char *name = names + *used;
+    size_t n = strlen(word) + 1;
+    memcpy(name, word, n);
+    *used += n;
+    return name;
+}
+
+/* parse the header, returning the start of the body or NULL */
+static const char* mesh_ply_header(mesh_import_state *st, int *binary,
+    char *names, size_t names_size)
+{
+    const char *p = st->data, *end = st->data + st->size;
+    const unsigned one = 1;
+    size_t used = 0;
+    mesh_ply_element *e = NULL;
+    char word[64];
+
+    p = mesh_next_line(p, end);
+    for (; p < end; p = mesh_next_line(p, end)) {
+        const char *le = mesh_line_end(p, end), *s = p;
+        mesh_ply_word(&s, le, word, sizeof(word));
+        if (strcmp(word, "format") == 0) {
+            mesh_ply_word(&s, le, word, sizeof(word));
+            *binary = strcmp(word, "ascii") != 0;
+            if (*binary && strcmp(word, "binary_little_endian") != 0 &&
+                    strcmp(word, "binary_big_endian") != 0) {
+                return NULL;
+            }
+            st->swap = *binary && (word[7] == 'l') != (*(const char*)&one == 1);
+        } else if (strcmp(word, "element") == 0) {
+            if (st->element_count == MESH_PLY_ELEMENT_MAX) return NULL;
+            e = &st->elements[st->element_count++];
+            mesh_ply_word(&s, le, word, sizeof(word));
+            if (used + strlen(word) + 1 > names_size) return NULL;
+            e->name = mesh_ply_name(names, &used, word);
+            s = mesh_skip_space(s, le);
+            const char *q = s;
+            long long count = mesh_parse_int(&s, le);
+            if (s == q || count < 0) return NULL;
+            e->count = (size_t)count;
+        } else if (strcmp(word, "property") == 0) {
+            if (!e || e->property_count == MESH_PLY_PROPERTY_MAX) return NULL;
+            mesh_ply_property *pp = &e->properties[e->property_count++];
+            mesh_ply_word(&s, le, word, sizeof(word));
+            if (strcmp(word, "list") == 0) {
+                mesh_ply_word(&s, le, word, sizeof(word));
+                pp->count_type = mesh_ply_type(word);
+                if (!pp->count_type || pp->count_type >= mesh_ply_float32) return NULL;
+                mesh_ply_word(&s, le, word, sizeof(word));
+            }
+            if (!(pp->type = mesh_ply_type(word))) return NULL;
+            mesh_ply_word(&s, le, word, sizeof(word));
+            if (used + strlen(word) + 1 > names_size) return NULL;
+            pp->name = mesh_ply_name(names, &used, word);
+            pp->slot = mesh_ply_slot(word);
+            pp->scale = pp->slot >= mesh_ply_r && pp->type == mesh_ply_uint8 ? 1.f / 255.f :
+                pp->slot >= mesh_ply_r && pp->type == mesh_ply_uint16 ? 1.f / 65535.f : 1.f;
+        } else if (strcmp(word, "end_header") == 0) {
+            return mesh_next_line(p, end);
+        }
+    }
+    return NULL;
+}
+
+static int mesh_import_ply(vertex_buffer *vb, index_buffer *ib,
+    const char *data, size_t size, job_system_t *js)
+{
+    mesh_import_state st;
+    char names[1024];
+    int binary = 0, normals = 1, ret = -1;
+
+    memset(&st, 0, sizeof(st));
+    st.data = data;
+    st.size = size;
+    const char *body = size > 3 && memcmp(data, "ply", 3) == 0 ?
+        mesh_ply_header(&st, &binary, names, sizeof(names)) : NULL;
+    for (uint i = 0; body && i < st.element_count; i++) {
+        mesh_ply_element *e = &st.elements[i];
+        int lists = 0;
+        for (uint k = 0; k < e->property_count; k++) {
+            mesh_ply_property *pp = &e->properties[k];
+            lists += pp->count_type != 0;
+            if (strcmp(e->name, "vertex") == 0 && pp->slot == mesh_ply_nx) normals = 0;
+            if (strcmp(e->name, "face") == 0 && pp->count_type &&
+                    (strcmp(pp->name, "vertex_indices") == 0 ||
+                     strcmp(pp->name, "vertex_index") == 0)) {
+                st.face_list = pp;
+            }
+        }
+        e->record_size = lists ? 0 : mesh_ply_scalar_size(e, 0, e->property_count);
+        if (strcmp(e->name, "vertex") == 0) st.vertex_element = e;
+        if (strcmp(e->name, "face") == 0) st.face_element = e;
+    }
+    if (body && st.vertex_element && st.face_element && st.face_list &&
+            st.vertex_element->count < 0xffffffffu) {
+        st.v_count = st.vertex_element->count;
+        st.vertices = (vertex*)malloc((st.v_count + 1) * sizeof(vertex));
+        ret = binary ? mesh_ply_binary(&st, (const unsigned char*)body, js) :
+            mesh_ply_ascii(&st, body, js);
+    }
+    if (ret == 0) {
+        ret = mesh_import_finish(&st, vb, ib, js, 1, normals);
+    } else {
+        errno = EINVAL;
+    }
+    mesh_import_free(&st);
+    return ret;
+}
+
+static double mesh_import_time()
+{
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec + ts.tv_nsec * 1e-9;
+}
+
+/*
+ * append the mesh in filename to vb and ib, choosing the format from the
+ * PLY magic. stats may be NULL.
+ */
+static int mesh_import(vertex_buffer *vb, index_buffer *ib,
+    const char *filename, job_system_t *js, mesh_import_stats *stats)
+{
+    struct stat statbuf;
+    double start = mesh_import_time();
+    size_t vertices = vb->count, indices = ib->count;
+    int fd, ret;
+
+    if ((fd = open(filename, O_RDONLY)) < 0) {
+        return -1;
+    }
+    if (fstat(fd, &statbuf) < 0) {
+        close(fd);
+        return -1;
+    }
+    size_t size = (size_t)statbuf.st_size;
+    if (size == 0) {
+        close(fd);
+        errno = EINVAL;
+        return -1;
+    }
+    void *map = mmap(NULL, size, PROT_READ, MAP_PRIVATE, fd, 0);
+    close(fd);
+    if (map == MAP_FAILED) {
+        return -1;
+    }
+#if defined(MADV_WILLNEED)
+    madvise(map, size, MADV_WILLNEED);
+#endif
+
+    const char *data = (const char*)map;
+    mesh_format format = size >= 4 && memcmp(data, "ply", 3) == 0 &&
+        (data[3] == '\n' || data[3] == '\r') ? mesh_format_ply : mesh_format_obj;
+    if (format == mesh_format_ply) {
+        ret = mesh_import_ply(vb, ib, data, size, js);
+    } else {
+        ret = mesh_import_obj(vb, ib, data, size, js);
+    }
+    int err = errno;
+    munmap(map, size);
+    errno = err;
+
+    if (stats) {
+        stats->format = format;
+        stats->bytes = size;
+        stats->vertices = vb->count - vertices;
+        stats->triangles = (ib->count - indices) / 3;
+        stats->seconds = mesh_import_time() - start;
+        stats->mbps = stats->seconds > 0 ? size / stats->seconds * 1e-6 : 0;
+    }
+    return ret;
+}
@@ -0,0 +1,582 @@
+/*
+ * Copyright (c) 2020 Michael Clark <michaeljclark@mac.com>
+ *
+ * Permission to use, copy, modify, and/or distribute this software for any
+ * purpose with or without fee is hereby granted, provided that the above
+ * copyright notice and this permission notice appear in all copies.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS" AND THE AUTHOR DISCLAIMS ALL WARRANTIES
+ * WITH REGARD TO THIS SOFTWARE INCLUDING ALL IMPLIED WARRANTIES OF
+ * MERCHANTABILITY AND FITNESS. IN NO EVENT SHALL THE AUTHOR BE LIABLE FOR
+ * ANY SPECIAL, DIRECT, INDIRECT, OR CONSEQUENTIAL DAMAGES OR ANY DAMAGES
+ * WHATSOEVER RESULTING FROM LOSS OF USE, DATA OR PROFITS, WHETHER IN AN
+ * ACTION OF CONTRACT, NEGLIGENCE OR OTHER TORTIOUS ACTION, ARISING OUT OF
+ * OR IN CONNECTION WITH THE USE OR PERFORMANCE OF THIS SOFTWARE.
+ */
+
+#pragma once
+
+/*
+ * mesh optimization interface
+ *
+ * passes over triangle lists in 32-bit index buffers, run before the index
+ * buffer is narrowed:
+ *
+ * - vertex cache: reorders triangles for post-transform cache locality
+ *   using Forsyth's linear-speed algorithm with a simulated LRU cache.
+ * - overdraw: splits the cache-ordered triangles into clusters at cache
+ *   restarts and sorts the clusters so that outward facing ones, which
+ *   are likely to occlude the rest, are drawn first.
+ * - vertex fetch: renumbers vertices in order of first use, so the vertex
+ *   shader reads the vertex buffer sequentially, and drops vertices that
+ *   are not referenced.
+ *
+ * mesh_cache_stats simulates a FIFO cache, as found in most hardware, and
+ * reports ACMR (transformed vertices per triangle) and ATVR (transformed
+ * vertices per referenced vertex, 1.0 being optimal).
+ *
+ * mesh_weld merges identical vertices, or vertices whose attributes snap
+ * to the same epsilon grid cell, and remaps the index buffer onto them.
+ * large inputs are hashed and partitioned across the job system, which
+ * may be NULL to run serially. job_system.h must be included first.
+ */
+
+enum {
+    MESH_OPT_CACHE_SIZE = 32,       /* LRU size used to order triangles */
+    MESH_OPT_VALENCE_MAX = 32,      /* valence boost table size */
+    MESH_STATS_CACHE_SIZE = 16,     /* FIFO size used to report stats */
+    MESH_WELD_KEY = sizeof(vertex) / sizeof(float),
+    MESH_WELD_PARTITION_BITS = 6,
+    MESH_WELD_PARALLEL_MIN = 1 << 16,
+    MESH_WELD_GRAIN = 4096,
+};
+
+typedef struct
+{
+    size_t triangles;
+    size_t vertices;                /* referenced vertices */
+    size_t transformed;             /* cache misses */
+    float acmr;
+    float atvr;
+} mesh_stats;
+
+static void mesh_cache_stats(mesh_stats *stats, const uint *indices,
+    size_t index_count, size_t vertex_count, uint cache_size);
+static void mesh_optimize_vertex_cache(uint *dst, const uint *indices,
+    size_t index_count, size_t vertex_count);
+static void mesh_optimize_overdraw(uint *dst, const uint *indices,
+    size_t index_count, const vertex *vertices, size_t vertex_count);
+static size_t mesh_optimize_vertex_fetch(vertex *dst, uint *indices,
+    size_t index_count, const vertex *vertices, size_t vertex_count);
+static void mesh_optimize(vertex_buffer *vb, index_buffer *ib,
+    mesh_stats *before, mesh_stats *after);
+static size_t mesh_weld_remap(uint *remap, const vertex *vertices,
+    size_t vertex_count, float epsilon, job_system_t *js);
+static size_t mesh_weld(vertex_buffer *vb, index_buffer *ib,
+    float epsilon, job_system_t *js);
+
+/*
+ * mesh optimization implementation
+ */
+
+static void mesh_cache_stats(mesh_stats *stats, const uint *indices,
+    size_t index_count, size_t vertex_count, uint cache_size)
+{
+    uint *stamp = (uint*)calloc(vertex_count, sizeof(uint));
+    char *seen = (char*)calloc(vertex_count, 1);
+    size_t misses = 0, vertices = 0;
+
+    /* a vertex is in the FIFO if it entered fewer than cache_size misses ago */
+    for (size_t i = 0; i < index_count; i++) {
+        uint v = indices[i];
+        if (!stamp[v] || misses - stamp[v] >= cache_size) {
+            stamp[v] = (uint)++misses;
+        }
+        if (!seen[v]) {
+            seen[v] = 1;
+            vertices++;
+        }
+    }
+
+    stats->triangles = index_count / 3;
+    stats->vertices = vertices;
+    stats->transformed = misses;
+    stats->acmr = stats->triangles ? (float)misses / stats->triangles : 0.f;
+    stats->atvr = vertices ? (float)misses / vertices : 0.f;
+
+    free(seen);
+    free(stamp);
+}
+
+/*
+ * vertex scores follow Forsyth, "Linear-Speed Vertex Cache Optimisation":
+ * the three most recent vertices share a fixed score so the next triangle
+ * does not just reuse the last edge, older cache entries decay with their
+ * position, and vertices with few remaining triangles get a boost so that
+ * fans are finished rather than left behind.
+ */
+typedef struct
+{
+    float cache[MESH_OPT_CACHE_SIZE + 1];   /* indexed by position + 1 */
+    float valence[MESH_OPT_VALENCE_MAX];
+} mesh_score_table;
+
+static void mesh_score_table_init(mesh_score_table *st)
+{
+    const float decay_power = 1.5f, last_tri_score = 0.75f;
+    const float valence_scale = 2.0f, valence_power = -0.5f;
+
+    st->cache[0] = 0.f;
+    for (int i = 0; i < MESH_OPT_CACHE_SIZE; i++) {
+        float s = 1.f - (float)(i - 3) / (MESH_OPT_CACHE_SIZE - 3);
+        st->cache[i + 1] = i < 3 ? last_tri_score : powf(s, decay_power);
+    }
+    st->valence[0] = 0.f;
+    for (int i = 1; i < MESH_OPT_VALENCE_MAX; i++) {
+        st->valence[i] = valence_scale * powf((float)i, valence_power);
+    }
+}
+
+static float mesh_vertex_score(mesh_score_table *st, int cache_pos, uint remaining)
+{
+    if (remaining == 0) return -1.f;
+    return st->cache[cache_pos + 1] + st->valence[
+        remaining < MESH_OPT_VALENCE_MAX ? remaining : MESH_OPT_VALENCE_MAX - 1];
+}
+
+static void mesh_optimize_vertex_cache(uint *dst, const uint *indices,
+    size_t index_count, size_t vertex_count)
+{
+    size_t tri_count = index_count / 3, i, k;
+    uint *start = (uint*)calloc(vertex_count + 1, sizeof(uint));
+    uint *remaining = (uint*)calloc(vertex_count, sizeof(uint));
+    uint *adjacency = (uint*)malloc(index_count * sizeof(uint));
+    uint *fill = (uint*)malloc(vertex_count * sizeof(uint));
+    float *vscore = (float*)malloc(vertex_count * sizeof(float));
+    char *emitted = (char*)calloc(tri_count, 1);
+    uint cache[MESH_OPT_CACHE_SIZE + 3], next[MESH_OPT_CACHE_SIZE + 3];
+    size_t cache_count = 0, cursor = 0;
+    mesh_score_table st;
+
+    mesh_score_table_init(&st);
+
+    /* triangles adjacent to each vertex */
+    for (i = 0; i < index_count; i++) {
+        remaining[indices[i]]++;
+    }
+    for (i = 0; i < vertex_count; i++) {
+        start[i + 1] = start[i] + remaining[i];
+    }
+    memcpy(fill, start, vertex_count * sizeof(uint));
+    for (i = 0; i < tri_count * 3; i++) {
+        uint v = indices[i];
+        adjacency[fill[v]++] = (uint)(i / 3);
+    }
+    for (i = 0; i < vertex_count; i++) {
+        vscore[i] = mesh_vertex_score(&st, -1, remaining[i]);
+    }
+
+    size_t best = tri_count;
+    for (size_t out = 0; out < tri_count; out++) {
+        /* no candidate in the cache, restart at the next unemitted
+         * triangle in input order, so restarts are linear overall */
+        if (best == tri_count) {
+            while (emitted[cursor]) cursor++;
+            best = cursor;
+        }
+
+        const uint *t = indices + best * 3;
+        memcpy(dst + out * 3, t, 3 * sizeof(uint));
+        emitted[best] = 1;
+
+        /* remove the triangle from its vertices' adjacency lists */
+        for (k = 0; k < 3; k++) {
+            uint v = t[k], *adj = adjacency + start[v];
+            for (uint j = 0; j < remaining[v]; j++) {
+                if (adj[j] == best) {
+                    adj[j] = adj[remaining[v] - 1];
+                    break;
+                }
+            }
+            remaining[v]--;
+        }
+
+        /* move the triangle's vertices to the front of the LRU cache */
+        size_t n = 0;
+        for (k = 0; k < 3; k++) next[n++] = t[k];
+        for (i = 0; i < cache_count; i++) {
+            uint v = cache[i];
+            if (v != t[0] && v != t[1] && v != t[2]) next[n++] = v;
+        }
+        for (i = MESH_OPT_CACHE_SIZE; i < n; i++) {
+            vscore[next[i]] = mesh_vertex_score(&st, -1, remaining[next[i]]);
+        }
+        cache_count = n < MESH_OPT_CACHE_SIZE ? n : MESH_OPT_CACHE_SIZE;
+        memcpy(cache, next, cache_count * sizeof(uint));
+
+        /* rescore the cached vertices and their triangles, picking the
+         * best as the next candidate */
+        for (i = 0; i < cache_count; i++) {
+            vscore[cache[i]] = mesh_vertex_score(&st, (int)i, remaining[cache[i]]);
+        }
+        best = tri_count;
+        float best_score = -1.f;
+        for (i = 0; i < cache_count; i++) {
+            uint v = cache[i], *adj = adjacency + start[v];
+            for (uint j = 0; j < remaining[v]; j++) {
+                const uint *a = indices + adj[j] * 3;
+                float s = vscore[a[0]] + vscore[a[1]] + vscore[a[2]];
+                if (s > best_score) {
+                    best_score = s;
+                    best = adj[j];
+                }
+            }
+        }
+    }
+
+    free(emitted);
+    free(vscore);
+    free(fill);
+    free(adjacency);
+    free(remaining);
+    free(start);
+}
+
+typedef struct
+{
+    uint first;
+    uint count;
+    float sort_key;
+} mesh_cluster;
+
+static int mesh_cluster_cmp(const void *a, const void *b)
+{
+    float ka = ((const mesh_cluster*)a)->sort_key;
+    float kb = ((const mesh_cluster*)b)->sort_key;
+    return ka > kb ? -1 : ka < kb ? 1 : 0;
+}
+
+/*
+ * after Sander, Nehab and Barczak, "Fast Triangle Reordering for Vertex
+ * Locality and Reduced Overdraw". the input should already be in vertex
+ * cache order. a cluster ends where a triangle misses the cache on all
+ * three vertices, so reordering whole clusters keeps the cache behaviour.
+ * clusters are sorted by how far their area weighted centroid lies out
+ * along their normal from the mesh centroid.
+ */
+static void mesh_optimize_overdraw(uint *dst, const uint *indices,
+    size_t index_count, const vertex *vertices, size_t vertex_count)
+{
+    size_t tri_count = index_count / 3, cluster_count = 0, i;
+    mesh_cluster *clusters = (mesh_cluster*)malloc(tri_count * sizeof(mesh_cluster));
+    uint *stamp = (uint*)calloc(vertex_count, sizeof(uint));
+    size_t misses = 0;
+    vec3 mesh_centroid = { 0.f, 0.f, 0.f };
+    float mesh_area = 0.f;
+
+    for (i = 0; i < tri_count; i++) {
+        int tri_misses = 0;
+        for (int k = 0; k < 3; k++) {
+            uint v = indices[i * 3 + k];
+            if (!stamp[v] || misses - stamp[v] >= MESH_STATS_CACHE_SIZE) {
+                stamp[v] = (uint)++misses;
+                tri_misses++;
+            }
+        }
+        if (i == 0 || tri_misses == 3) {
+            clusters[cluster_count++] = (mesh_cluster){ (uint)i, 0, 0.f };
+        }
+        clusters[cluster_count - 1].count++;
+    }
+
+    /* area weighted centroid and normal of each cluster */
+    vec3 *centroid = (vec3*)calloc(cluster_count, sizeof(vec3));
+    vec3 *normal = (vec3*)calloc(cluster_count, sizeof(vec3));
+    for (size_t c = 0; c < cluster_count; c++) {
+        float area = 0.f;
+        for (i = clusters[c].first; i < clusters[c].first + clusters[c].count; i++) {
+            const float *p0 = vertices[indices[i * 3 + 0]].pos.vec;
+            const float *p1 = vertices[indices[i * 3 + 1]].pos.vec;
+            const float *p2 = vertices[indices[i * 3 + 2]].pos.vec;
+            vec3 e1, e2, n;
+            vec3_sub(e1, p1, p0);
+            vec3_sub(e2, p2, p0);
+            vec3_mul_cross(n, e1, e2);
+            float a = vec3_len(n) * 0.5f;
+            for (int k = 0; k < 3; k++) {
+                centroid[c][k] += (p0[k] + p1[k] + p2[k]) * (a / 3.f);
+                normal[c][k] += n[k];
+            }
+            area += a;
+        }
+        for (int k = 0; k < 3; k++) {
+            mesh_centroid[k] += centroid[c][k];
+            centroid[c][k] = area > 0.f ? centroid[c][k] / area : 0.f;
+        }
+        mesh_area += area;
+    }
+    for (int k = 0; k < 3; k++) {
+        mesh_centroid[k] = mesh_area > 0.f ? mesh_centroid[k] / mesh_area : 0.f;
+    }
+    for (size_t c = 0; c < cluster_count; c++) {
+        vec3 d;
+        float len = vec3_len(normal[c]);
+        vec3_sub(d, centroid[c], mesh_centroid);
+        clusters[c].sort_key = len > 0.f ? vec3_mul_inner(d, normal[c]) / len : 0.f;
+    }
+
+    qsort(clusters, cluster_count, sizeof(mesh_cluster), mesh_cluster_cmp);
+    size_t out = 0;
+    for (size_t c = 0; c < cluster_count; c++) {
+        size_t n = clusters[c].count * 3;
+        memcpy(dst + out, indices + clusters[c].first * 3, n * sizeof(uint));
+        out += n;
+    }
+
+    free(normal);
+    free(centroid);
+    free(stamp);
+    free(clusters);
+}
+
+/*
+ * renumber vertices in order of first use, rewriting indices in place and
+ * writing the used vertices to dst. returns the number of vertices written.
+ */
+static size_t mesh_optimize_vertex_fetch(vertex *dst, uint *indices,
+    size_t index_count, const vertex *vertices, size_t vertex_count)
+{
+    uint *remap = (uint*)malloc(vertex_count * sizeof(uint));
+    uint next = 0;
+    memset(remap, 0xff, vertex_count * sizeof(uint));
+    for (size_t i = 0; i < index_count; i++) {
+        uint v = indices[i];
+        if (remap[v] == ~0u) {
+            dst[next] = vertices[v];
+            remap[v] = next++;
+        }
+        indices[i] = remap[v];
+    }
+    free(remap);
+    return next;
+}
+
+/*
+ * run the vertex cache, overdraw and vertex fetch passes over a mesh in
+ * place. before and after, if not NULL, receive the cache statistics.
+ */
+static void mesh_optimize(vertex_buffer *vb, index_buffer *ib,
+    mesh_stats *before, mesh_stats *after)
+{
+    size_t index_count = ib->count, vertex_count = vb->count;
+    uint *indices = (uint*)ib->data;
+    uint *tmp = (uint*)malloc(index_count * sizeof(uint));
+    vertex *vtmp = (vertex*)malloc(vertex_count * sizeof(vertex));
+
+    assert(ib->stride == sizeof(uint));
+    if (before) {
+        mesh_cache_stats(before, indices, index_count, vertex_count,
+            MESH_STATS_CACHE_SIZE);
+    }
+
+    mesh_optimize_vertex_cache(tmp, indices, index_count, vertex_count);
+    mesh_optimize_overdraw(indices, tmp, index_count,
+        (const vertex*)vb->data, vertex_count);
+    vb->count = mesh_optimize_vertex_fetch(vtmp, indices, index_count,
+        (const vertex*)vb->data, vertex_count);
+    memcpy(vb->data, vtmp, vb->count * sizeof(vertex));
+    ib->max_index = vb->count ? (uint)vb->count - 1 : 0;
+
+    if (after) {
+        mesh_cache_stats(after, indices, index_count, vb->count,
+            MESH_STATS_CACHE_SIZE);
+    }
+
+    free(vtmp);
+    free(tmp);
+}
+
+/*
+ * vertex welding
+ *
+ * each vertex gets a key of one word per float attribute, its bits when
+ * welding exactly or its grid cell when epsilon is positive, and a hash of
+ * the key. the top bits of the hash pick a partition; each partition is
+ * welded with its own open addressing table by one job, visiting vertices
+ * in index order, so the canonical vertex of each group is the first and
+ * the result does not depend on the number of threads. epsilon welding
+ * snaps to a grid, so vertices within epsilon on either side of a cell
+ * boundary are not merged. cells are keyed by the float bits of the
+ * rounded coordinate, as a cell index can be out of the range of int.
+ */
+
+typedef struct
+{
+    const vertex *vertices;
+    size_t vertex_count;
+    float inv_epsilon;
+    uint *key;
+    uint *hash;
+    uint *order;                /* vertex indices grouped by partition */
+    uint *start;                /* partition offsets into order */
+    uint *remap;
+    uint partition_bits;
+} mesh_weld_state;
+
+static void mesh_weld_hash_job(job_t *job, void *arg, size_t begin, size_t end)
+{
+    mesh_weld_state *ws = (mesh_weld_state*)arg;
+    for (size_t i = begin; i < end; i++) {
+        const float *f = (const float*)(ws->vertices + i);
+        uint *key = ws->key + i * MESH_WELD_KEY, h = 0x9e3779b9u;
+        for (int k = 0; k < MESH_WELD_KEY; k++) {
+            if (ws->inv_epsilon > 0.f) {
+                /* adding zero turns a -0 cell into +0 */
+                float cell = floorf(f[k] * ws->inv_epsilon + 0.5f) + 0.f;
+                memcpy(&key[k], &cell, sizeof(uint));
+            } else {
+                memcpy(&key[k], &f[k], sizeof(uint));
+            }
+            h = (h ^ key[k]) * 0x01000193u;
+            h ^= h >> 15;
+        }
+        h *= 0x85ebca6bu;
+        ws->hash[i] = h ^ (h >> 13);
+    }
+}
+
+static void mesh_weld_partition_job(job_t *job, void *arg, size_t begin, size_t end)
+{
+    mesh_weld_state *ws = (mesh_weld_state*)arg;
+    for (size_t p = begin; p < end; p++) {
+        size_t first = ws->start[p], count = ws->start[p + 1] - first, size = 16;
+        while (size < count * 2) size <<= 1;
+        uint *table = (uint*)malloc(size * sizeof(uint));
+        memset(table, 0xff, size * sizeof(uint));
+        for (size_t j = first; j < first + count; j++) {
+            uint i = ws->order[j], *key = ws->key + (size_t)i * MESH_WELD_KEY;
+            size_t slot = ws->hash[i] & (size - 1);
+            for (;;) {
+                uint c = table[slot];
+                if (c == ~0u) {
+                    table[slot] = i;
+                    ws->remap[i] = i;
+                    break;
+                }
+                if (ws->hash[c] == ws->hash[i] && memcmp(ws->key + (size_t)c *
+                        MESH_WELD_KEY, key, MESH_WELD_KEY * sizeof(uint)) == 0) {
+                    ws->remap[i] = c;
+                    break;
+                }
+                slot = (slot + 1) & (size - 1);
+            }
+        }
+        free(table);
+    }
+}
+
+static void mesh_weld_run(job_system_t *js, job_fn fn, mesh_weld_state *ws,
+    size_t count, size_t grain)
+{
+    if (js) {
+        job_parallel_for(js, fn, ws, count, grain);
+    } else {
+        fn(NULL, ws, 0, count);
+    }
+}
+
+/*
+ * remap[i] receives the new index of vertex i, new indices being assigned
+ * to the first vertex of each group in order. returns the vertex count
+ * after welding.
+ */
+static size_t mesh_weld_remap(uint *remap, const vertex *vertices,
+    size_t vertex_count, float epsilon, job_system_t *js)
+{
+    mesh_weld_state ws;
+    size_t i, next = 0;
+
+    if (vertex_count < MESH_WELD_PARALLEL_MIN) js = NULL;
+    ws.vertices = vertices;
+    ws.vertex_count = vertex_count;
+    ws.inv_epsilon = epsilon > 0.f ? 1.f / epsilon : 0.f;
+    ws.key = (uint*)malloc(vertex_count * MESH_WELD_KEY * sizeof(uint));
+    ws.hash = (uint*)malloc(vertex_count * sizeof(uint));
+    ws.order = (uint*)malloc(vertex_count * sizeof(uint));
+    ws.partition_bits = js ? MESH_WELD_PARTITION_BITS : 0;
+    ws.start = (uint*)calloc(((size_t)1 << ws.partition_bits) + 1, sizeof(uint));
+    ws.remap = remap;
+
+    mesh_weld_run(js, mesh_weld_hash_job, &ws, vertex_count, MESH_WELD_GRAIN);
+
+    /* stable counting sort of vertex indices by partition */
+    size_t partitions = (size_t)1 << ws.partition_bits;
+    uint shift = 32 - ws.partition_bits;
+    for (i = 0; i < vertex_count; i++) {
+        ws.start[ws.partition_bits ? (ws.hash[i] >> shift) + 1 : 1]++;
+    }
+    for (i = 0; i < partitions; i++) {
+        ws.start[i + 1] += ws.start[i];
+    }
+    uint *fill = (uint*)malloc(partitions * sizeof(uint));
+    memcpy(fill, ws.start, partitions * sizeof(uint));
+    for (i = 0; i < vertex_count; i++) {
+        ws.order[fill[ws.partition_bits ? ws.hash[i] >> shift : 0]++] = (uint)i;
+    }
+    free(fill);
+
+    mesh_weld_run(js, mesh_weld_partition_job, &ws, partitions, 1);
+
+    /* canonical vertices precede the vertices merged into them */
+    for (i = 0; i < vertex_count; i++) {
+        remap[i] = remap[i] == i ? (uint)next++ : remap[remap[i]];
+    }
+
+    free(ws.start);
+    free(ws.order);
+    free(ws.hash);
+    free(ws.key);
+    return next;
+}
+
+static void mesh_weld_indices_job(job_t *job, void *arg, size_t begin, size_t end)
+{
+    mesh_weld_state *ws = (mesh_weld_state*)arg;
+    for (size_t i = begin; i < end; i++) {
+        ws->order[i] = ws->remap[ws->order[i]];
+    }
+}
+
+/*
+ * weld the vertices of a mesh in place, with epsilon zero for an exact
+ * weld, and return the new vertex count.
+ */
+static size_t mesh_weld(vertex_buffer *vb, index_buffer *ib,
+    float epsilon, job_system_t *js)
+{
+    size_t vertex_count = vb->count, count;
+    uint *remap = (uint*)malloc(vertex_count * sizeof(uint));
+    vertex *v = (vertex*)vb->data;
+    mesh_weld_state ws;
+
+    assert(ib->stride == sizeof(uint));
+    count = mesh_weld_remap(remap, v, vertex_count, epsilon, js);
+
+    /* canonical vertices are numbered in order, so compact in place */
+    uint next = 0;
+    for (size_t i = 0; i < vertex_count; i++) {
+        if (remap[i] == next) {
+            v[next++] = v[i];
+        }
+    }
+    vb->count = count;
+
+    ws.order = (uint*)ib->data;
+    ws.remap = remap;
+    mesh_weld_run(ib->count < MESH_WELD_PARALLEL_MIN ? NULL : js,
+        mesh_weld_indices_job, &ws, ib->count, MESH_WELD_GRAIN);
+    ib->max_index = count ? (uint)count - 1 : 0;
+
+    free(remap);
+    return count;
+}
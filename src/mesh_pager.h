@@ -0,0 +1,299 @@
+/*
+ * Copyright (c) 2020 Michael Clark <michaeljclark@mac.com>
+ *
+ * Permission to use, copy, modify, and/or distribute this software for any
+ * purpose with or without fee is hereby granted, provided that the above
+ * copyright notice and this permission notice appear in all copies.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS" AND THE AUTHOR DISCLAIMS ALL WARRANTIES
+ * WITH REGARD TO THIS SOFTWARE INCLUDING ALL IMPLIED WARRANTIES OF
+ * MERCHANTABILITY AND FITNESS. IN NO EVENT SHALL THE AUTHOR BE LIABLE FOR
+ * ANY SPECIAL, DIRECT, INDIRECT, OR CONSEQUENTIAL DAMAGES OR ANY DAMAGES
+ * WHATSOEVER RESULTING FROM LOSS OF USE, DATA OR PROFITS, WHETHER IN AN
+ * ACTION OF CONTRACT, NEGLIGENCE OR OTHER TORTIOUS ACTION, ARISING OUT OF
+ * OR IN CONNECTION WITH THE USE OR PERFORMANCE OF THIS SOFTWARE.
+ */
+
+#pragma once
+
+/*
+ * mesh pager interface
+ *
+ * residency for geometry pages under a byte budget. a page is an opaque
+ * user pointer with an estimated resident size. each frame the context
+ * thread calls mesh_pager_use for the pages it wants to draw, with the
+ * distance to the nearest use, and only draws pages that are resident.
+ * mesh_pager_update then uploads pages that finished loading, and queues
+ * absent pages, nearest first, for the I/O thread, evicting the least
+ * recently used pages to make room. pages used in the current frame are
+ * only evicted for a page less than half their distance, so a view with
+ * more geometry than the budget keeps the nearest pages without thrashing.
+ *
+ * the callbacks split the work between the threads: load runs on the
+ * I/O thread and returns host data (NULL on failure), upload and evict
+ * run on the context thread in mesh_pager_update, and discard frees
+ * loaded data that was never uploaded. requires pthreads (pthread.h).
+ */
+
+enum {
+    MESH_PAGE_NONE = 0xffffffffu,
+    MESH_PAGER_QUEUE = 64,
+    MESH_PAGER_UPLOADS = 4,
+};
+
+typedef enum
+{
+    mesh_page_absent,
+    mesh_page_queued,
+    mesh_page_resident,
+    mesh_page_failed,
+} mesh_page_state;
+
+typedef struct
+{
+    void* (*load)(void *user);
+    size_t (*upload)(void *user, void *data);
+    void (*evict)(void *user);
+    void (*discard)(void *user, void *data);
+} mesh_pager_ops;
+
+typedef struct
+{
+    void *user;
+    void *data;                 /* loaded, waiting for upload */
+    uint state;
+    uint last_used;             /* frame of the last use */
+    float distance;             /* nearest use in that frame */
+    size_t size;                /* estimated until uploaded */
+} mesh_page;
+
+typedef struct
+{
+    float distance;
+    uint page;
+} mesh_page_request;
+
+typedef struct
+{
+    mesh_pager_ops ops;
+    mesh_page *pages;
+    uint count, capacity;
+    uint frame;
+    size_t budget;
+    size_t resident;            /* bytes of resident pages */
+    size_t pending;             /* bytes of queued pages */
+    uint inflight;
+    mesh_page_request *wanted;
+    uint wanted_count;
+
+    /* rings shared with the I/O thread, guarded by mutex */
+    uint queue[MESH_PAGER_QUEUE], queue_head, queue_tail;
+    uint done[MESH_PAGER_QUEUE], done_head, done_tail;
+    int quit;
+    pthread_t thread;
+    pthread_mutex_t mutex;
+    pthread_cond_t cond;
+} mesh_pager;
+
+static void mesh_pager_init(mesh_pager *p, mesh_pager_ops ops, size_t budget);
+static void mesh_pager_destroy(mesh_pager *p);
+static uint mesh_pager_add(mesh_pager *p, void *user, size_t size);
+static int mesh_pager_use(mesh_pager *p, uint page, float distance);
+static void mesh_pager_update(mesh_pager *p);
+
+/*
+ * mesh pager implementation
+ */
+
+static void* mesh_pager_main(void *arg)
+{
+    mesh_pager *p = (mesh_pager*)arg;
+    pthread_mutex_lock(&p->mutex);
+    for (;;) {
+        while (!p->quit && p->queue_head == p->queue_tail) {
+            pthread_cond_wait(&p->cond, &p->mutex);
+        }
+        if (p->quit) break;
+        uint page = p->queue[p->queue_tail++ % MESH_PAGER_QUEUE];
+        void *user = p->pages[page].user;
+        pthread_mutex_unlock(&p->mutex);
+        void *data = p->ops.load(user);
+        pthread_mutex_lock(&p->mutex);
+        p->pages[page].data = data;
+        p->done[p->done_head++ % MESH_PAGER_QUEUE] = page;
+    }
+    pthread_mutex_unlock(&p->mutex);
+    return NULL;
+}
+
+static void mesh_pager_init(mesh_pager *p, mesh_pager_ops ops, size_t budget)
+{
+    memset(p, 0, sizeof(mesh_pager));
+    p->ops = ops;
+    p->budget = budget;
+    p->frame = 1;
+    pthread_mutex_init(&p->mutex, NULL);
+    pthread_cond_init(&p->cond, NULL);
+    pthread_create(&p->thread, NULL, mesh_pager_main, p);
+}
+
+static void mesh_pager_destroy(mesh_pager *p)
+{
+    pthread_mutex_lock(&p->mutex);
+    p->quit = 1;
+    pthread_cond_broadcast(&p->cond);
+    pthread_mutex_unlock(&p->mutex);
+    pthread_join(p->thread, NULL);
+    for (uint i = 0; i < p->count; i++) {
+        mesh_page *pg = &p->pages[i];
+        if (pg->data) {
+            p->ops.discard(pg->user, pg->data);
+        }
+        if (pg->state == mesh_page_resident) {
+            p->ops.evict(pg->user);
+        }
+    }
+    pthread_cond_destroy(&p->cond);
+    pthread_mutex_destroy(&p->mutex);
+    free(p->pages);
+    free(p->wanted);
+    memset(p, 0, sizeof(mesh_pager));
+}
+
+/*
+ * add a page with its estimated resident size. pages must be added
+ * before the first mesh_pager_update, as the I/O thread reads the
+ * page array without reallocation.
+ */
+static uint mesh_pager_add(mesh_pager *p, void *user, size_t size)
+{
+    if (p->count == p->capacity) {
+        p->capacity = p->capacity ? p->capacity * 2 : 16;
+        p->pages = (mesh_page*)realloc(p->pages, p->capacity * sizeof(mesh_page));
+        p->wanted = (mesh_page_request*)realloc(p->wanted,
+            p->capacity * sizeof(mesh_page_request));
+    }
+    mesh_page *pg = &p->pages[p->count];
+    memset(pg, 0, sizeof(mesh_page));
+    pg->user = user;
+    pg->size = size;
+    return p->count++;
+}
+
+/* record a use of a page this frame, returning true if it is resident */
+static int mesh_pager_use(mesh_pager *p, uint page, float distance)
+{
+    mesh_page *pg = &p->pages[page];
+    if (distance < 0.f) distance = 0.f;
+    if (pg->last_used != p->frame) {
+        pg->last_used = p->frame;
+        pg->distance = distance;
+        if (pg->state == mesh_page_absent) {
+            p->wanted[p->wanted_count++] = (mesh_page_request){ distance, page };
+        }
+    } else if (distance < pg->distance) {
+        pg->distance = distance;
+    }
+    return pg->state == mesh_page_resident;
+}
+
+static int mesh_pager_compare(const void *a, const void *b)
+{
+    const mesh_page_request *x = (const mesh_page_request*)a;
+    const mesh_page_request *y = (const mesh_page_request*)b;
+    return x->distance < y->distance ? -1 : x->distance > y->distance ? 1 : 0;
+}
+
+/*
+ * find the resident page to evict for a page at distance: the least
+ * recently used, or if all were used this frame, the farthest if it is
+ * more than twice as far away.
+ */
+static uint mesh_pager_victim(mesh_pager *p, float distance)
+{
+    uint victim = MESH_PAGE_NONE;
+    for (uint i = 0; i < p->count; i++) {
+        mesh_page *pg = &p->pages[i];
+        if (pg->state != mesh_page_resident) continue;
+        if (victim == MESH_PAGE_NONE) {
+            victim = i;
+            continue;
+        }
+        mesh_page *v = &p->pages[victim];
+        if (pg->last_used < v->last_used ||
+                (pg->last_used == v->last_used && pg->distance > v->distance)) {
+            victim = i;
+        }
+    }
+    if (victim != MESH_PAGE_NONE && p->pages[victim].last_used == p->frame &&
+            p->pages[victim].distance <= distance * 2.f) {
+        victim = MESH_PAGE_NONE;
+    }
+    return victim;
+}
+
+static void mesh_pager_evict(mesh_pager *p, uint page)
+{
+    mesh_page *pg = &p->pages[page];
+    p->ops.evict(pg->user);
+    p->resident -= pg->size;
+    pg->state = mesh_page_absent;
+}
+
+/*
+ * called once per frame on the context thread, after the uses for the
+ * frame. uploads at most MESH_PAGER_UPLOADS loaded pages, so paging in
+ * does not stall a frame, then queues the wanted pages that fit.
+ */
+static void mesh_pager_update(mesh_pager *p)
+{
+    uint ready[MESH_PAGER_UPLOADS], nready = 0;
+    pthread_mutex_lock(&p->mutex);
+    while (nready < MESH_PAGER_UPLOADS && p->done_tail != p->done_head) {
+        ready[nready++] = p->done[p->done_tail++ % MESH_PAGER_QUEUE];
+    }
+    pthread_mutex_unlock(&p->mutex);
+
+    for (uint k = 0; k < nready; k++) {
+        mesh_page *pg = &p->pages[ready[k]];
+        void *data = pg->data;
+        pg->data = NULL;
+        p->pending -= pg->size;
+        p->inflight--;
+        if (!data) {
+            pg->state = mesh_page_failed;
+            continue;
+        }
+        pg->size = p->ops.upload(pg->user, data);
+        pg->state = mesh_page_resident;
+        p->resident += pg->size;
+    }
+
+    for (uint k = 0; k < p->wanted_count; k++) {
+        p->wanted[k].distance = p->pages[p->wanted[k].page].distance;
+    }
+    qsort(p->wanted, p->wanted_count, sizeof(mesh_page_request), mesh_pager_compare);
+    uint queued = 0;
+    for (uint k = 0; k < p->wanted_count && p->inflight < MESH_PAGER_QUEUE; k++) {
+        mesh_page *pg = &p->pages[p->wanted[k].page];
+        if (pg->size > p->budget) continue;
+        while (p->resident + p->pending + pg->size > p->budget) {
+            uint victim = mesh_pager_victim(p, p->wanted[k].distance);
+            if (victim == MESH_PAGE_NONE) break;
+            mesh_pager_evict(p, victim);
+        }
+        if (p->resident + p->pending + pg->size > p->budget) break;
+        pg->state = mesh_page_queued;
+        p->pending += pg->size;
+        p->inflight++;
+        p->queue[(p->queue_head + queued++) % MESH_PAGER_QUEUE] = p->wanted[k].page;
+    }
+    if (queued) {
+        pthread_mutex_lock(&p->mutex);
+        p->queue_head += queued;
+        pthread_cond_signal(&p->cond);
+        pthread_mutex_unlock(&p->mutex);
+    }
+    p->wanted_count = 0;
+    p->frame++;
+}
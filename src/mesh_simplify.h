@@ -0,0 +1,470 @@
+/*
+ * Copyright (c) 2020 Michael Clark <michaeljclark@mac.com>
+ *
+ * Permission to use, copy, modify, and/or distribute this software for any
+ * purpose with or without fee is hereby granted, provided that the above
+ * copyright notice and this permission notice appear in all copies.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS" AND THE AUTHOR DISCLAIMS ALL WARRANTIES
+ * WITH REGARD TO THIS SOFTWARE INCLUDING ALL IMPLIED WARRANTIES OF
+ * MERCHANTABILITY AND FITNESS. IN NO EVENT SHALL THE AUTHOR BE LIABLE FOR
+ * ANY SPECIAL, DIRECT, INDIRECT, OR CONSEQUENTIAL DAMAGES OR ANY DAMAGES
+ * WHATSOEVER RESULTING FROM LOSS OF USE, DATA OR PROFITS, WHETHER IN AN
+ * ACTION OF CONTRACT, NEGLIGENCE OR OTHER TORTIOUS ACTION, ARISING OUT OF
+ * OR IN CONNECTION WITH THE USE OR PERFORMANCE OF THIS SOFTWARE.
+ */
+
+#pragma once
+
+/*
+ * mesh simplification interface
+ *
+ * mesh_simplify reduces a triangle list with quadric error metric edge
+ * collapses. a vertex only ever collapses onto a neighbouring vertex, so
+ * the simplified index list references the original vertex buffer and
+ * every level of detail can share one vertex buffer object.
+ *
+ * errors are distances relative to the largest extent of the mesh. the
+ * simplifier stops at target_index_count or when the next collapse would
+ * exceed target_error, whichever comes first. vertices sharing a position
+ * with other vertices (attribute seams such as hard edges) are locked, and
+ * vertices on open borders only slide along the border.
+ *
+ * mesh_lod_build appends simplified copies of a mesh to its index buffer,
+ * one per target error, and records their index ranges and errors in
+ * model space. mesh_lod_select picks the coarsest level whose error
+ * projects to at most max_pixels. mesh_opt.h must be included first.
+ */
+
+enum {
+    MESH_LOD_MAX = 8,
+    MESH_SIMPLIFY_BORDER_WEIGHT = 10,
+};
+
+typedef struct
+{
+    uint index_offset;
+    uint index_count;
+    float error;                    /* model space distance */
+} mesh_lod_level;
+
+typedef struct
+{
+    uint count;
+    mesh_lod_level levels[MESH_LOD_MAX];
+} mesh_lod;
+
+static size_t mesh_simplify(uint *dst, const uint *indices, size_t index_count,
+    const vertex *vertices, size_t vertex_count, size_t target_index_count,
+    float target_error, float *result_error);
+static uint mesh_lod_build(mesh_lod *lod, vertex_buffer *vb, index_buffer *ib,
+    const float *errors, uint count);
+static uint mesh_lod_select(const mesh_lod *lod, float pixels_per_unit,
+    float max_pixels);
+
+/*
+ * mesh simplification implementation
+ */
+
+enum {
+    mesh_vertex_manifold,
+    mesh_vertex_border,
+    mesh_vertex_locked,
+};
+
+/* symmetric 3x3 matrix A, vector b, constant c and total weight */
+typedef struct
+{
+    float a00, a11, a22, a01, a02, a12;
+    float b0, b1, b2, c, w;
+} mesh_quadric;
+
+typedef struct
+{
+    uint u, v;
+    float cost;
+} mesh_collapse;
+
+static void mesh_quadric_add_plane(mesh_quadric *q, const float *n, float d, float w)
+{
+    q->a00 += w * n[0] * n[0];
+    q->a11 += w * n[1] * n[1];
+    q->a22 += w * n[2] * n[2];
+    q->a01 += w * n[0] * n[1];
+    q->a02 += w * n[0] * n[2];
+    q->a12 += w * n[1] * n[2];
+    q->b0 += w * n[0] * d;
+    q->b1 += w * n[1] * d;
+    q->b2 += w * n[2] * d;
+    q->c += w * d * d;
+    q->w += w;
+}
+
+static void mesh_quadric_add(mesh_quadric *q, const mesh_quadric *r)
+{
+    q->a00 += r->a00; q->a11 += r->a11; q->a22 += r->a22;
+    q->a01 += r->a01; q->a02 += r->a02; q->a12 += r->a12;
+    q->b0 += r->b0; q->b1 += r->b1; q->b2 += r->b2;
+    q->c += r->c; q->w += r->w;
+}
+
+/* weighted sum of squared plane distances, p'Ap + 2b'p + c */
+static float mesh_quadric_eval(const mesh_quadric *q, const float *p)
+{
+    float x = p[0], y = p[1], z = p[2];
+    float rx = q->a00 * x + q->a01 * y + q->a02 * z + q->b0 * 2.f;
+    float ry = q->a01 * x + q->a11 * y + q->a12 * z + q->b1 * 2.f;
+    float rz = q->a02 * x + q->a12 * y + q->a22 * z + q->b2 * 2.f;
+    float e = rx * x + ry * y + rz * z + q->c;
+    return e > 0.f ? e : 0.f;
+}
+
+static int mesh_collapse_cmp(const void *a, const void *b)
+{
+    const mesh_collapse *x = (const mesh_collapse*)a, *y = (const mesh_collapse*)b;
+    return x->cost < y->cost ? -1 : x->cost > y->cost ? 1 :
+        x->u < y->u ? -1 : x->u > y->u;
+}
+
+/* map each vertex to the first vertex with a bitwise identical position */
+static void mesh_position_remap(uint *remap, const float *pos, size_t vertex_count)
+{
+    size_t size = 16;
+    while (size < vertex_count * 2) size <<= 1;
+    uint *table = (uint*)malloc(size * sizeof(uint));
+    memset(table, 0xff, size * sizeof(uint));
+    for (size_t i = 0; i < vertex_count; i++) {
+        uint key[3], h = 0x9e3779b9u;
+        memcpy(key, pos + i * 3, sizeof(key));
+        for (int k = 0; k < 3; k++) {
+            h = (h ^ key[k]) * 0x01000193u;
+            h ^= h >> 15;
+        }
+        size_t slot = h & (size - 1);
+        for (;;) {
+            uint c = table[slot];
+            if (c == ~0u) {
+                table[slot] = remap[i] = (uint)i;
+                break;
+            }
+            if (memcmp(pos + (size_t)c * 3, key, sizeof(key)) == 0) {
+                remap[i] = c;
+                break;
+            }
+            slot = (slot + 1) & (size - 1);
+        }
+    }
+    free(table);
+}
+
+/* triangles around each vertex in compressed rows */
+static void mesh_adjacency(uint *start, uint *adj, const uint *indices,
+    size_t index_count, size_t vertex_count)
+{
+    memset(start, 0, (vertex_count + 1) * sizeof(uint));
+    for (size_t i = 0; i < index_count; i++) {
+        start[indices[i] + 1]++;
+    }
+    for (size_t i = 0; i < vertex_count; i++) {
+        start[i + 1] += start[i];
+    }
+    for (size_t i = 0; i < index_count; i++) {
+        adj[start[indices[i]]++] = (uint)(i / 3);
+    }
+    for (size_t i = vertex_count; i > 0; i--) {
+        start[i] = start[i - 1];
+    }
+    start[0] = 0;
+}
+
+static void mesh_face_normal(float *n, const float *p0, const float *p1, const float *p2)
+{
+    vec3 e1, e2;
+    vec3_sub(e1, p1, p0);
+    vec3_sub(e2, p2, p0);
+    vec3_mul_cross(n, e1, e2);
+}
+
+/* does moving u to v flip any triangle around u that survives */
+static int mesh_collapse_flips(const float *pos, const uint *indices,
+    const uint *start, const uint *adj, const uint *remap, uint u, uint v)
+{
+    for (uint j = start[u]; j < start[u + 1]; j++) {
+        const uint *tri = indices + (size_t)adj[j] * 3;
+        uint t[3] = { remap[tri[0]], remap[tri[1]], remap[tri[2]] };
+        if (t[0] == v || t[1] == v || t[2] == v) continue;
+        vec3 n0, n1;
+        mesh_face_normal(n0, pos + t[0] * 3, pos + t[1] * 3, pos + t[2] * 3);
+        for (int k = 0; k < 3; k++) {
+            if (t[k] == u) t[k] = v;
+        }
+        mesh_face_normal(n1, pos + t[0] * 3, pos + t[1] * 3, pos + t[2] * 3);
+        if (vec3_mul_inner(n0, n1) < 0.25f * vec3_len(n0) * vec3_len(n1)) {
+            return 1;
+        }
+    }
+    return 0;
+}
+
+/* number of triangles around u with a vertex at the position of w */
+static uint mesh_edge_faces(const uint *indices, const uint *start,
+    const uint *adj, const uint *canon, uint u, uint w)
+{
+    uint count = 0;
+    for (uint j = start[u]; j < start[u + 1]; j++) {
+        const uint *tri = indices + (size_t)adj[j] * 3;
+        count += canon[tri[0]] == canon[w] || canon[tri[1]] == canon[w] ||
+            canon[tri[2]] == canon[w];
+    }
+    return count;
+}
+
+/* face quadrics, border classification and border quadrics */
+static void mesh_simplify_classify(unsigned char *kind, mesh_quadric *q,
+    const float *pos, const uint *canon, const uint *indices, size_t index_count,
+    size_t vertex_count)
+{
+    uint *start = (uint*)malloc((vertex_count + 1) * sizeof(uint));
+    uint *adj = (uint*)malloc(index_count * sizeof(uint));
+    uint *cidx = (uint*)malloc(index_count * sizeof(uint));
+    uint *members = (uint*)calloc(vertex_count, sizeof(uint));
+
+    for (size_t i = 0; i < vertex_count; i++) {
+        members[canon[i]]++;
+    }
+    for (size_t i = 0; i < vertex_count; i++) {
+        kind[i] = members[canon[i]] > 1 ? mesh_vertex_locked : mesh_vertex_manifold;
+    }
+    for (size_t i = 0; i < index_count; i++) {
+        cidx[i] = canon[indices[i]];
+    }
+    mesh_adjacency(start, adj, cidx, index_count, vertex_count);
+
+    memset(q, 0, vertex_count * sizeof(mesh_quadric));
+    for (size_t i = 0; i < index_count; i += 3) {
+        const uint *t = cidx + i;
+        vec3 n;
+        mesh_face_normal(n, pos + t[0] * 3, pos + t[1] * 3, pos + t[2] * 3);
+        float area = vec3_len(n);
+        if (area == 0.f) continue;
+        vec3_scale(n, n, 1.f / area);
+        float d = -vec3_mul_inner(n, pos + t[0] * 3);
+        for (int k = 0; k < 3; k++) {
+            mesh_quadric_add_plane(q + t[k], n, d, area * 0.5f);
+        }
+
+        /* an edge is on a border when no triangle has it reversed */
+        for (int k = 0; k < 3; k++) {
+            uint a = t[k], b = t[(k + 1) % 3];
+            int shared = 0;
+            for (uint j = start[b]; j < start[b + 1] && !shared; j++) {
+                const uint *s = cidx + (size_t)adj[j] * 3;
+                shared = (s[0] == b && s[1] == a) || (s[1] == b && s[2] == a) ||
+                    (s[2] == b && s[0] == a);
+            }
+            if (shared) continue;
+            vec3 e, en;
+            vec3_sub(e, pos + b * 3, pos + a * 3);
+            vec3_mul_cross(en, e, n);
+            float len = vec3_len(en);
+            if (len == 0.f) continue;
+            vec3_scale(en, en, 1.f / len);
+            float ed = -vec3_mul_inner(en, pos + a * 3);
+            float w = vec3_mul_inner(e, e) * MESH_SIMPLIFY_BORDER_WEIGHT;
+            mesh_quadric_add_plane(q + a, en, ed, w);
+            mesh_quadric_add_plane(q + b, en, ed, w);
+            if (kind[a] == mesh_vertex_manifold) kind[a] = mesh_vertex_border;
+            if (kind[b] == mesh_vertex_manifold) kind[b] = mesh_vertex_border;
+        }
+    }
+
+    free(members);
+    free(cidx);
+    free(adj);
+    free(start);
+}
+
+static size_t mesh_simplify(uint *dst, const uint *indices, size_t index_count,
+    const vertex *vertices, size_t vertex_count, size_t target_index_count,
+    float target_error, float *result_error)
+{
+    float *pos = (float*)malloc(vertex_count * 3 * sizeof(float));
+    uint *canon = (uint*)malloc(vertex_count * sizeof(uint));
+    unsigned char *kind = (unsigned char*)malloc(vertex_count);
+    unsigned char *lock = (unsigned char*)malloc(vertex_count);
+    mesh_quadric *q = (mesh_quadric*)malloc(vertex_count * sizeof(mesh_quadric));
+    uint *remap = (uint*)malloc(vertex_count * sizeof(uint));
+    uint *start = (uint*)malloc((vertex_count + 1) * sizeof(uint));
+    uint *adj = (uint*)malloc((index_count + 1) * sizeof(uint));
+    mesh_collapse *cand = (mesh_collapse*)malloc((vertex_count + 1) * sizeof(mesh_collapse));
+    float error_limit = target_error * target_error, result = 0.f;
+    size_t n = index_count;
+
+    /* positions scaled so errors are relative to the largest extent */
+    vec3 lo = { INFINITY, INFINITY, INFINITY }, hi = { -INFINITY, -INFINITY, -INFINITY };
+    for (size_t i = 0; i < vertex_count; i++) {
+        for (int k = 0; k < 3; k++) {
+            float x = vertices[i].pos.vec[k];
+            lo[k] = x < lo[k] ? x : lo[k];
+            hi[k] = x > hi[k] ? x : hi[k];
+        }
+    }
+    float extent = 0.f;
+    for (int k = 0; k < 3; k++) {
+        extent = hi[k] - lo[k] > extent ? hi[k] - lo[k] : extent;
+    }
+    float scale = extent > 0.f ? 1.f / extent : 0.f;
+    for (size_t i = 0; i < vertex_count; i++) {
+        for (int k = 0; k < 3; k++) {
+            pos[i * 3 + k] = (vertices[i].pos.vec[k] - lo[k]) * scale;
+        }
+    }
+
+    memmove(dst, indices, index_count * sizeof(uint));
+    mesh_position_remap(canon, pos, vertex_count);
+    mesh_simplify_classify(kind, q, pos, canon, dst, n, vertex_count);
+
+    while (n > target_index_count) {
+        mesh_adjacency(start, adj, dst, n, vertex_count);
+
+        /* cheapest valid collapse of each free vertex onto a neighbour */
+        size_t cand_count = 0;
+        for (uint u = 0; u < vertex_count; u++) {
+            if (kind[u] == mesh_vertex_locked) continue;
+            mesh_collapse best = { u, u, INFINITY };
+            for (uint j = start[u]; j < start[u + 1]; j++) {
+                const uint *tri = dst + (size_t)adj[j] * 3;
+                for (int k = 0; k < 3; k++) {
+                    uint w = tri[k];
+                    if (w == u) continue;
+                    if (kind[u] == mesh_vertex_border && (kind[w] ==
+                            mesh_vertex_manifold || mesh_edge_faces(dst, start,
+                            adj, canon, u, w) != 1)) continue;
+                    const float *p = pos + w * 3;
+                    mesh_quadric *qu = q + canon[u], *qw = q + canon[w];
+                    float wsum = qu->w + qw->w;
+                    float cost = (mesh_quadric_eval(qu, p) + mesh_quadric_eval(qw, p)) /
+                        (wsum > 0.f ? wsum : 1.f);
+                    if (cost < best.cost) {
+                        best.v = w;
+                        best.cost = cost;
+                    }
+                }
+            }
+            if (best.v != u && best.cost <= error_limit) {
+                cand[cand_count++] = best;
+            }
+        }
+        if (!cand_count) break;
+        qsort(cand, cand_count, sizeof(mesh_collapse), mesh_collapse_cmp);
+
+        /*
+         * each collapse removes about two triangles. collapses are taken in
+         * order of cost up to the goal, but not beyond half again the cost
+         * at the goal, so cheap collapses made possible by this pass get a
+         * chance in the next one. the limit only applies once a collapse is
+         * made, so a pass whose cheapest collapses would all flip triangles
+         * moves on to dearer ones rather than stopping short of the target.
+         */
+        size_t goal = (n - target_index_count) / 6;
+        goal = goal ? goal : 1;
+        float pass_limit = cand[(goal < cand_count ? goal : cand_count) - 1].cost * 1.5f;
+        size_t done = 0;
+        for (size_t i = 0; i < vertex_count; i++) {
+            remap[i] = (uint)i;
+        }
+        memset(lock, 0, vertex_count);
+        for (size_t i = 0; i < cand_count && done < goal; i++) {
+            uint u = cand[i].u, v = cand[i].v;
+            if (done && cand[i].cost > pass_limit) break;
+            if (lock[u] || lock[v]) continue;
+            if (mesh_collapse_flips(pos, dst, start, adj, remap, u, v)) continue;
+            remap[u] = v;
+            lock[u] = lock[v] = 1;
+            mesh_quadric_add(q + canon[v], q + canon[u]);
+            result = cand[i].cost > result ? cand[i].cost : result;
+            done++;
+        }
+        if (!done) break;
+
+        /* drop the triangles that collapsed */
+        size_t k = 0;
+        for (size_t i = 0; i < n; i += 3) {
+            uint a = remap[dst[i]], b = remap[dst[i + 1]], c = remap[dst[i + 2]];
+            if (a == b || b == c || c == a) continue;
+            dst[k++] = a;
+            dst[k++] = b;
+            dst[k++] = c;
+        }
+        n = k;
+    }
+
+    if (result_error) {
+        *result_error = sqrtf(result);
+    }
+
+    free(cand);
+    free(adj);
+    free(start);
+    free(remap);
+    free(q);
+    free(lock);
+    free(kind);
+    free(canon);
+    free(pos);
+    return n;
+}
+
+/*
+ * level 0 is the whole index buffer, which must hold 32-bit indices. each
+ * further level is simplified from level 0 at the next target error, kept
+ * only if it removes at least an eighth of the triangles of the previous
+ * level, ordered for the vertex cache and appended to the index buffer.
+ */
+static uint mesh_lod_build(mesh_lod *lod, vertex_buffer *vb, index_buffer *ib,
+    const float *errors, uint count)
+{
+    size_t base_count = ib->count;
+    uint *base = (uint*)malloc(base_count * sizeof(uint));
+    uint *tmp = (uint*)malloc(base_count * sizeof(uint));
+    uint *opt = (uint*)malloc(base_count * sizeof(uint));
+    vec3 lo, hi;
+    float extent = 0.f;
+
+    assert(ib->stride == sizeof(uint));
+    memcpy(base, ib->data, base_count * sizeof(uint));
+    vertex_buffer_bounds(vb, lo, hi);
+    for (int k = 0; k < 3; k++) {
+        extent = hi[k] - lo[k] > extent ? hi[k] - lo[k] : extent;
+    }
+
+    lod->count = 1;
+    lod->levels[0] = (mesh_lod_level){ 0, (uint)base_count, 0.f };
+    for (uint i = 0; i < count && lod->count < MESH_LOD_MAX; i++) {
+        float error;
+        size_t prev = lod->levels[lod->count - 1].index_count;
+        size_t n = mesh_simplify(tmp, base, base_count, (const vertex*)vb->data,
+            vb->count, 0, errors[i], &error);
+        if (n == 0 || n > prev - prev / 8) continue;
+        mesh_optimize_vertex_cache(opt, tmp, n, vb->count);
+        lod->levels[lod->count++] = (mesh_lod_level){
+            (uint)ib->count, (uint)n, error * extent };
+        index_buffer_add(ib, opt, (uint)n, 0);
+    }
+
+    free(opt);
+    free(tmp);
+    free(base);
+    return lod->count;
+}
+
+static uint mesh_lod_select(const mesh_lod *lod, float pixels_per_unit,
+    float max_pixels)
+{
+    uint k = 0;
+    while (k + 1 < lod->count &&
+            lod->levels[k + 1].error * pixels_per_unit <= max_pixels) {
+        k++;
+    }
+    return k;
+}
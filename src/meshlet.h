@@ -0,0 +1,253 @@
+/*
+ * Copyright (c) 2020 Michael Clark <michaeljclark@mac.com>
+ *
+ * Permission to use, copy, modify, and/or distribute this software for any
+ * purpose with or without fee is hereby granted, provided that the above
+ * copyright notice and this permission notice appear in all copies.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS" AND THE AUTHOR DISCLAIMS ALL WARRANTIES
+ * WITH REGARD TO THIS SOFTWARE INCLUDING ALL IMPLIED WARRANTIES OF
+ * MERCHANTABILITY AND FITNESS. IN NO EVENT SHALL THE AUTHOR BE LIABLE FOR
+ * ANY SPECIAL, DIRECT, INDIRECT, OR CONSEQUENTIAL DAMAGES OR ANY DAMAGES
+ * WHATSOEVER RESULTING FROM LOSS OF USE, DATA OR PROFITS, WHETHER IN AN
+ * ACTION OF CONTRACT, NEGLIGENCE OR OTHER TORTIOUS ACTION, ARISING OUT OF
+ * OR IN CONNECTION WITH THE USE OR PERFORMANCE OF THIS SOFTWARE.
+ */
+
+#pragma once
+
+/*
+ * meshlet interface
+ *
+ * splits a triangle list into clusters of at most max_vertices unique
+ * vertices and max_triangles triangles by scanning the index buffer in
+ * order, so each meshlet is a contiguous index range that can be drawn
+ * with glDrawElements or batched with glMultiDrawElements. run after
+ * mesh_optimize_vertex_cache for compact clusters.
+ *
+ * each meshlet has a bounding sphere and a normal cone in model space,
+ * kept in structure-of-arrays form for frustum_cull_spheres. a meshlet is
+ * back facing from eye when dot(c - eye, axis) >= cutoff * |c - eye| + r;
+ * meshlets whose normals spread too far have a cutoff of 1, which never
+ * culls. frustum.h must be included first.
+ */
+
+enum {
+    MESHLET_MAX_VERTICES = 64,
+    MESHLET_MAX_TRIANGLES = 124,
+};
+
+typedef struct
+{
+    uint index_offset;
+    uint index_count;
+    uint vertex_count;
+} meshlet;
+
+typedef struct
+{
+    size_t count;
+    size_t capacity;
+    meshlet *meshlets;
+    float *cx, *cy, *cz, *r;            /* bounding spheres */
+    float *ax, *ay, *az, *cutoff;       /* normal cones */
+} meshlet_set;
+
+static void meshlet_set_init(meshlet_set *ms);
+static void meshlet_set_destroy(meshlet_set *ms);
+static size_t meshlet_build(meshlet_set *ms, vertex_buffer *vb, index_buffer *ib,
+    uint max_vertices, uint max_triangles);
+static size_t meshlet_cull(const meshlet_set *ms, uint *visible, mat4x4 mvp, vec3 eye);
+
+/*
+ * meshlet implementation
+ */
+
+static void meshlet_set_resize(meshlet_set *ms, size_t capacity)
+{
+    ms->capacity = capacity;
+    ms->meshlets = (meshlet*)realloc(ms->meshlets, capacity * sizeof(meshlet));
+    ms->cx = (float*)realloc(ms->cx, capacity * sizeof(float));
+    ms->cy = (float*)realloc(ms->cy, capacity * sizeof(float));
+    ms->cz = (float*)realloc(ms->cz, capacity * sizeof(float));
+    ms->r = (float*)realloc(ms->r, capacity * sizeof(float));
+    ms->ax = (float*)realloc(ms->ax, capacity * sizeof(float));
+    ms->ay = (float*)realloc(ms->ay, capacity * sizeof(float));
+    ms->az = (float*)realloc(ms->az, capacity * sizeof(float));
+    ms->cutoff = (float*)realloc(ms->cutoff, capacity * sizeof(float));
+}
+
+static void meshlet_set_init(meshlet_set *ms)
+{
+    memset(ms, 0, sizeof(*ms));
+    meshlet_set_resize(ms, 16);
+}
+
+static void meshlet_set_destroy(meshlet_set *ms)
+{
+    free(ms->meshlets);
+    free(ms->cx);
+    free(ms->cy);
+    free(ms->cz);
+    free(ms->r);
+    free(ms->ax);
+    free(ms->ay);
+    free(ms->az);
+    free(ms->cutoff);
+    memset(ms, 0, sizeof(*ms));
+}
+
+/* Ritter's bounding sphere over the vertices of an index range */
+static void meshlet_sphere(vec4 sphere, const vertex *v, const uint *idx, size_t n)
+{
+    const float *p0 = v[idx[0]].pos.vec, *p1 = p0, *p2 = p0;
+    vec3 d;
+    float best = -1.f;
+    for (size_t i = 0; i < n; i++) {
+        vec3_sub(d, v[idx[i]].pos.vec, p0);
+        float l = vec3_mul_inner(d, d);
+        if (l > best) { best = l; p1 = v[idx[i]].pos.vec; }
+    }
+    best = -1.f;
+    for (size_t i = 0; i < n; i++) {
+        vec3_sub(d, v[idx[i]].pos.vec, p1);
+        float l = vec3_mul_inner(d, d);
+        if (l > best) { best = l; p2 = v[idx[i]].pos.vec; }
+    }
+    float r = sqrtf(best) * 0.5f;
+    vec3 c = { (p1[0] + p2[0]) * 0.5f, (p1[1] + p2[1]) * 0.5f, (p1[2] + p2[2]) * 0.5f };
+    for (size_t i = 0; i < n; i++) {
+        const float *p = v[idx[i]].pos.vec;
+        vec3_sub(d, p, c);
+        float l = vec3_len(d);
+        if (l > r) {
+            /* grow to enclose p, keeping the far side of the sphere */
+            float nr = (r + l) * 0.5f, t = (nr - r) / l;
+            for (int k = 0; k < 3; k++) c[k] += d[k] * t;
+            r = nr;
+        }
+    }
+    sphere[0] = c[0];
+    sphere[1] = c[1];
+    sphere[2] = c[2];
+    sphere[3] = r;
+}
+
+/* the mean of the unit face normals and the sine of the widest angle */
+static void meshlet_cone(vec4 cone, const vertex *v, const uint *idx, size_t n)
+{
+    vec3 axis = { 0.f, 0.f, 0.f }, e1, e2, fn;
+    float mindp = 1.f;
+    for (size_t i = 0; i < n; i += 3) {
+        const float *p0 = v[idx[i]].pos.vec;
+        vec3_sub(e1, v[idx[i + 1]].pos.vec, p0);
+        vec3_sub(e2, v[idx[i + 2]].pos.vec, p0);
+        vec3_mul_cross(fn, e1, e2);
+        float l = vec3_len(fn);
+        if (l > 0.f) {
+            for (int k = 0; k < 3; k++) axis[k] += fn[k] / l;
+        }
+    }
+    float l = vec3_len(axis);
+    if (l > 0.f) vec3_scale(axis, axis, 1.f / l);
+    for (size_t i = 0; i < n; i += 3) {
+        const float *p0 = v[idx[i]].pos.vec;
+        vec3_sub(e1, v[idx[i + 1]].pos.vec, p0);
+        vec3_sub(e2, v[idx[i + 2]].pos.vec, p0);
+        vec3_mul_cross(fn, e1, e2);
+        float fl = vec3_len(fn);
+        if (fl > 0.f) {
+            float dp = vec3_mul_inner(fn, axis) / fl;
+            mindp = dp < mindp ? dp : mindp;
+        }
+    }
+    cone[0] = axis[0];
+    cone[1] = axis[1];
+    cone[2] = axis[2];
+    cone[3] = l > 0.f && mindp > 0.1f ? sqrtf(1.f - mindp * mindp) : 1.f;
+}
+
+static void meshlet_emit(meshlet_set *ms, const vertex *v, const uint *indices,
+    uint first, uint count, uint vertex_count)
+{
+    vec4 sphere, cone;
+    if (ms->count >= ms->capacity) {
+        meshlet_set_resize(ms, ms->capacity << 1);
+    }
+    meshlet_sphere(sphere, v, indices + first, count);
+    meshlet_cone(cone, v, indices + first, count);
+    size_t i = ms->count++;
+    ms->meshlets[i] = (meshlet){ first, count, vertex_count };
+    ms->cx[i] = sphere[0];
+    ms->cy[i] = sphere[1];
+    ms->cz[i] = sphere[2];
+    ms->r[i] = sphere[3];
+    ms->ax[i] = cone[0];
+    ms->ay[i] = cone[1];
+    ms->az[i] = cone[2];
+    ms->cutoff[i] = cone[3];
+}
+
+/*
+ * append the meshlets of a mesh to ms and return their number. the
+ * index buffer must hold 32-bit indices.
+ */
+static size_t meshlet_build(meshlet_set *ms, vertex_buffer *vb, index_buffer *ib,
+    uint max_vertices, uint max_triangles)
+{
+    const vertex *v = (const vertex*)vb->data;
+    const uint *indices = (const uint*)ib->data;
+    uint *stamp = (uint*)calloc(vb->count, sizeof(uint));
+    uint first = 0, tris = 0, verts = 0, id = 1;
+    size_t start = ms->count;
+
+    assert(ib->stride == sizeof(uint));
+    for (size_t i = 0; i + 2 < ib->count; i += 3) {
+        uint fresh = 0;
+        for (int k = 0; k < 3; k++) {
+            fresh += stamp[indices[i + k]] != id;
+        }
+        if (tris == max_triangles || verts + fresh > max_vertices) {
+            meshlet_emit(ms, v, indices, first, tris * 3, verts);
+            first = (uint)i;
+            tris = verts = 0;
+            id++;
+        }
+        for (int k = 0; k < 3; k++) {
+            if (stamp[indices[i + k]] != id) {
+                stamp[indices[i + k]] = id;
+                verts++;
+            }
+        }
+        tris++;
+    }
+    if (tris) {
+        meshlet_emit(ms, v, indices, first, tris * 3, verts);
+    }
+
+    free(stamp);
+    return ms->count - start;
+}
+
+/*
+ * frustum and normal cone culling, with mvp the model-view-projection
+ * matrix and eye the camera position in model space. the indices of
+ * visible meshlets are written to visible, which holds ms->count entries,
+ * so several threads can cull the same set.
+ */
+static size_t meshlet_cull(const meshlet_set *ms, uint *visible, mat4x4 mvp, vec3 eye)
+{
+    frustum_t f;
+    frustum_from_matrix(&f, mvp);
+    size_t n = frustum_cull_spheres(&f, visible,
+        ms->cx, ms->cy, ms->cz, ms->r, ms->count), k = 0;
+    for (size_t j = 0; j < n; j++) {
+        uint i = visible[j];
+        vec3 d = { ms->cx[i] - eye[0], ms->cy[i] - eye[1], ms->cz[i] - eye[2] };
+        float dp = d[0] * ms->ax[i] + d[1] * ms->ay[i] + d[2] * ms->az[i];
+        if (dp < ms->cutoff[i] * vec3_len(d) + ms->r[i]) {
+            visible[k++] = i;
+        }
+    }
+    return k;
+}
@@ -0,0 +1,293 @@
+/*
+ * Copyright (c) 2020 Michael Clark <michaeljclark@mac.com>
+ *
+ * Permission to use, copy, modify, and/or distribute this software for any
+ * purpose with or without fee is hereby granted, provided that the above
+ * copyright notice and this permission notice appear in all copies.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS" AND THE AUTHOR DISCLAIMS ALL WARRANTIES
+ * WITH REGARD TO THIS SOFTWARE INCLUDING ALL IMPLIED WARRANTIES OF
+ * MERCHANTABILITY AND FITNESS. IN NO EVENT SHALL THE AUTHOR BE LIABLE FOR
+ * ANY SPECIAL, DIRECT, INDIRECT, OR CONSEQUENTIAL DAMAGES OR ANY DAMAGES
+ * WHATSOEVER RESULTING FROM LOSS OF USE, DATA OR PROFITS, WHETHER IN AN
+ * ACTION OF CONTRACT, NEGLIGENCE OR OTHER TORTIOUS ACTION, ARISING OUT OF
+ * OR IN CONNECTION WITH THE USE OR PERFORMANCE OF THIS SOFTWARE.
+ */
+
+#pragma once
+
+/*
+ * object store interface
+ *
+ * objects are named by an id holding a slot index and a generation count,
+ * so ids of removed objects are detected. the slot table maps ids to dense
+ * indices and components are kept in structure-of-arrays columns indexed
+ * by dense index, so a pass over one component, such as culling the world
+ * bounds, streams only that component. removal moves the last object into
+ * the hole, keeping the columns packed, so add and remove are O(1).
+ *
+ * a slot is retired instead of reused when its generation reaches
+ * OBJECT_GEN_RETIRED, so an id is never valid again once removed, and no
+ * id equals OBJECT_NONE, which has that generation. the slot table grows
+ * apart from the columns as retired slots hold no object, and
+ * object_store_room gives the objects that can still be added.
+ *
+ * components: transform (scene graph node), render (mesh index), bounds
+ * (local sphere, and world sphere split into x, y, z and radius arrays for
+ * frustum_cull_spheres), animation (rotation rate) and color (rgba8 bytes
+ * held in a uint). scene_graph.h must be included first.
+ */
+
+typedef uint object_id;
+
+#define OBJECT_NONE ((uint)~0u)
+
+enum {
+    OBJECT_INDEX_BITS = 24,
+    OBJECT_INDEX_MASK = (1 << OBJECT_INDEX_BITS) - 1,
+    OBJECT_GEN_RETIRED = 255,   /* the generation of OBJECT_NONE */
+};
+
+enum {
+    object_bounds_dirty = 1,    /* world bounds need recomputing */
+};
+
+typedef struct
+{
+    size_t count;
+    size_t capacity;
+    size_t slots;
+    size_t slot_capacity;
+    size_t free_count;
+    uint free_slot;
+
+    /* slot table, indexed by id */
+    uint *slot;                 /* dense index, or next free slot */
+    unsigned char *gen;
+
+    /* components, indexed by dense index */
+    object_id *id;
+    unsigned char *flags;
+    uint *node;
+    uint *mesh;
+    vec4 *extent;
+    float *bx, *by, *bz, *br;
+    vec3 *spin;
+    uint *color;
+
+    /* output of culling, not a component */
+    uint *visible;
+} object_store_t;
+
+typedef struct
+{
+    void **data;
+    size_t size;
+} object_column;
+
+static void object_store_init(object_store_t *os, size_t capacity);
+static void object_store_destroy(object_store_t *os);
+static size_t object_store_count(object_store_t *os);
+static size_t object_store_room(object_store_t *os);
+static object_id object_store_add(object_store_t *os);
+static void object_store_remove(object_store_t *os, object_id id);
+static uint object_store_index(object_store_t *os, object_id id);
+static void object_store_set_mesh(object_store_t *os, uint i, uint mesh, vec4 extent);
+static void object_store_update_bounds(object_store_t *os, scene_graph_t *sg);
+static void object_store_update_bounds_range(object_store_t *os, scene_graph_t *sg,
+    size_t begin, size_t end);
+
+/*
+ * object store implementation
+ */
+
+static size_t object_store_columns(object_store_t *os, object_column *cols)
+{
+    size_t n = 0;
+    cols[n++] = (object_column){ (void**)&os->id, sizeof(object_id) };
+    cols[n++] = (object_column){ (void**)&os->flags, sizeof(unsigned char) };
+    cols[n++] = (object_column){ (void**)&os->node, sizeof(uint) };
+    cols[n++] = (object_column){ (void**)&os->mesh, sizeof(uint) };
+    cols[n++] = (object_column){ (void**)&os->extent, sizeof(vec4) };
+    cols[n++] = (object_column){ (void**)&os->bx, sizeof(float) };
+    cols[n++] = (object_column){ (void**)&os->by, sizeof(float) };
+    cols[n++] = (object_column){ (void**)&os->bz, sizeof(float) };
+    cols[n++] = (object_column){ (void**)&os->br, sizeof(float) };
+    cols[n++] = (object_column){ (void**)&os->spin, sizeof(vec3) };
+    cols[n++] = (object_column){ (void**)&os->color, sizeof(uint) };
+    return n;
+}
+
+enum { OBJECT_COLUMNS_MAX = 16 };
+
+static void object_store_resize(object_store_t *os, size_t capacity)
+{
+    object_column cols[OBJECT_COLUMNS_MAX];
+    size_t ncols = object_store_columns(os, cols);
+    assert(capacity <= (size_t)OBJECT_INDEX_MASK + 1);
+    for (size_t c = 0; c < ncols; c++) {
+        *cols[c].data = realloc(*cols[c].data, cols[c].size * capacity);
+    }
+    os->visible = (uint*)realloc(os->visible, capacity * sizeof(uint));
+    os->capacity = capacity;
+}
+
+/* double a capacity, up to one entry per slot index */
+static size_t object_store_grow(size_t capacity)
+{
+    size_t max = (size_t)OBJECT_INDEX_MASK + 1;
+    return capacity < max / 2 ? capacity << 1 : max;
+}
+
+static void object_store_resize_slots(object_store_t *os, size_t slot_capacity)
+{
+    assert(slot_capacity <= (size_t)OBJECT_INDEX_MASK + 1);
+    os->slot = (uint*)realloc(os->slot, slot_capacity * sizeof(uint));
+    os->gen = (unsigned char*)realloc(os->gen, slot_capacity);
+    os->slot_capacity = slot_capacity;
+}
+
+static void object_store_init(object_store_t *os, size_t capacity)
+{
+    memset(os, 0, sizeof(*os));
+    os->free_slot = OBJECT_NONE;
+    object_store_resize(os, capacity ? capacity : 16);
+    object_store_resize_slots(os, os->capacity);
+}
+
+static void object_store_destroy(object_store_t *os)
+{
+    object_column cols[OBJECT_COLUMNS_MAX];
+    size_t ncols = object_store_columns(os, cols);
+    for (size_t c = 0; c < ncols; c++) {
+        free(*cols[c].data);
+    }
+    free(os->slot);
+    free(os->gen);
+    free(os->visible);
+    memset(os, 0, sizeof(*os));
+}
+
+static size_t object_store_count(object_store_t *os)
+{
+    return os->count;
+}
+
+/* objects that can be added before the slots run out */
+static size_t object_store_room(object_store_t *os)
+{
+    return os->free_count + ((size_t)OBJECT_INDEX_MASK + 1 - os->slots);
+}
+
+static object_id object_store_add(object_store_t *os)
+{
+    uint s;
+    assert(object_store_room(os) > 0);
+    if (object_store_room(os) == 0) {
+        return OBJECT_NONE;
+    }
+    if (os->count >= os->capacity) {
+        object_store_resize(os, object_store_grow(os->capacity));
+    }
+    if (os->free_slot != OBJECT_NONE) {
+        s = os->free_slot;
+        os->free_slot = os->slot[s];
+        os->free_count--;
+    } else {
+        if (os->slots >= os->slot_capacity) {
+            object_store_resize_slots(os, object_store_grow(os->slot_capacity));
+        }
+        s = (uint)os->slots++;
+        os->gen[s] = 0;
+    }
+    uint i = (uint)os->count++;
+    object_id id = ((uint)os->gen[s] << OBJECT_INDEX_BITS) | s;
+    os->slot[s] = i;
+    os->id[i] = id;
+    os->flags[i] = object_bounds_dirty;
+    os->node[i] = OBJECT_NONE;
+    os->mesh[i] = OBJECT_NONE;
+    memset(os->extent[i], 0, sizeof(vec4));
+    os->bx[i] = os->by[i] = os->bz[i] = os->br[i] = 0.f;
+    memset(os->spin[i], 0, sizeof(vec3));
+    os->color[i] = 0xffffffffu;
+    return id;
+}
+
+static uint object_store_index(object_store_t *os, object_id id)
+{
+    uint s = id & OBJECT_INDEX_MASK;
+    if (s >= os->slots || os->gen[s] != (unsigned char)(id >> OBJECT_INDEX_BITS)) {
+        return OBJECT_NONE;
+    }
+    return os->slot[s];
+}
+
+static void object_store_remove(object_store_t *os, object_id id)
+{
+    uint i = object_store_index(os, id), last = (uint)os->count - 1;
+    uint s = id & OBJECT_INDEX_MASK;
+    if (i == OBJECT_NONE) return;
+
+    /* move the last object into the hole */
+    if (i != last) {
+        object_column cols[OBJECT_COLUMNS_MAX];
+        size_t ncols = object_store_columns(os, cols);
+        for (size_t c = 0; c < ncols; c++) {
+            char *d = (char*)*cols[c].data;
+            memcpy(d + i * cols[c].size, d + last * cols[c].size, cols[c].size);
+        }
+        os->slot[os->id[i] & OBJECT_INDEX_MASK] = i;
+    }
+    os->count--;
+
+    /* retire the id, and push its slot on the free list unless retired */
+    if (++os->gen[s] == OBJECT_GEN_RETIRED) {
+        os->slot[s] = OBJECT_NONE;
+        return;
+    }
+    os->slot[s] = os->free_slot;
+    os->free_slot = s;
+    os->free_count++;
+}
+
+static void object_store_set_mesh(object_store_t *os, uint i, uint mesh, vec4 extent)
+{
+    os->mesh[i] = mesh;
+    memcpy(os->extent[i], extent, sizeof(vec4));
+    os->flags[i] |= object_bounds_dirty;
+}
+
+/*
+ * world bounding spheres for objects whose node moved in the last
+ * scene_graph_update, or whose bounds are otherwise dirty. the radius
+ * is scaled by the largest axis scale of the world matrix. disjoint
+ * ranges may be updated in parallel.
+ */
+static void object_store_update_bounds_range(object_store_t *os, scene_graph_t *sg,
+    size_t begin, size_t end)
+{
+    for (size_t i = begin; i < end; i++) {
+        uint node = os->node[i];
+        if (node == OBJECT_NONE) continue;
+        if (!(os->flags[i] & object_bounds_dirty) &&
+            !(sg->flags[node] & scene_node_moved)) continue;
+        vec4 *m = sg->world[node], c, w;
+        c[0] = os->extent[i][0];
+        c[1] = os->extent[i][1];
+        c[2] = os->extent[i][2];
+        c[3] = 1.f;
+        mat4x4_mul_vec4(w, m, c);
+        float s = fmaxf(vec3_len(m[0]), fmaxf(vec3_len(m[1]), vec3_len(m[2])));
+        os->bx[i] = w[0];
+        os->by[i] = w[1];
+        os->bz[i] = w[2];
+        os->br[i] = os->extent[i][3] * s;
+        os->flags[i] &= ~object_bounds_dirty;
+    }
+}
+
+static void object_store_update_bounds(object_store_t *os, scene_graph_t *sg)
+{
+    object_store_update_bounds_range(os, sg, 0, os->count);
+}
@@ -0,0 +1,447 @@
+/*
+ * Copyright (c) 2020 Michael Clark <michaeljclark@mac.com>
+ *
+ * Permission to use, copy, modify, and/or distribute this software for any
+ * purpose with or without fee is hereby granted, provided that the above
+ * copyright notice and this permission notice appear in all copies.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS" AND THE AUTHOR DISCLAIMS ALL WARRANTIES
+ * WITH REGARD TO THIS SOFTWARE INCLUDING ALL IMPLIED WARRANTIES OF
+ * MERCHANTABILITY AND FITNESS. IN NO EVENT SHALL THE AUTHOR BE LIABLE FOR
+ * ANY SPECIAL, DIRECT, INDIRECT, OR CONSEQUENTIAL DAMAGES OR ANY DAMAGES
+ * WHATSOEVER RESULTING FROM LOSS OF USE, DATA OR PROFITS, WHETHER IN AN
+ * ACTION OF CONTRACT, NEGLIGENCE OR OTHER TORTIOUS ACTION, ARISING OUT OF
+ * OR IN CONNECTION WITH THE USE OR PERFORMANCE OF THIS SOFTWARE.
+ */
+
+#pragma once
+
+/*
+ * pack file interface
+ *
+ * a read-only archive of assets addressed by relative path, such as
+ * "shaders/cube.v450.fsh". the file holds a header, an index of entries
+ * sorted by name hash, a block of NUL terminated names, and the file
+ * contents, each aligned to PACK_FILE_ALIGN bytes and followed by a NUL
+ * so text assets can also be used as strings. data is stored in host
+ * byte order.
+ *
+ * pack_file_open maps the archive once and pack_file_find returns views
+ * into the mapping, so a lookup is a binary search with no system calls
+ * or copies. pack_file_open_memory serves the same views from an archive
+ * linked into the executable, which pack_file_write_source emits as a C
+ * array. pack_file_open_exe looks for the archive next to the executable
+ * before the working directory, and pack_file_mount installs a pack as
+ * the load_file_lookup of gl2_util.h, so shaders load from it by their
+ * usual names and fall back to the filesystem for names it lacks.
+ *
+ * pack_file_write builds an archive from files below a root directory,
+ * writing to a temporary file and renaming it over the destination. open
+ * checks the header and the extents of every entry and name against the
+ * size, returning -1 for anything unexpected. requires fcntl.h, unistd.h
+ * and sys/mman.h.
+ */
+
+enum {
+    PACK_FILE_MAGIC = 0x4b504c47,       /* "GLPK" */
+    PACK_FILE_VERSION = 1,
+    PACK_FILE_ALIGN = 64,
+};
+
+typedef struct
+{
+    uint magic;
+    uint version;
+    uint header_size;
+    uint entry_count;
+    unsigned long long names_offset;
+    unsigned long long names_size;
+    unsigned long long file_size;
+} pack_file_header;
+
+typedef struct
+{
+    uint hash;
+    uint name_length;
+    unsigned long long name_offset;     /* relative to names_offset */
+    unsigned long long offset;
+    unsigned long long size;            /* excluding the trailing NUL */
+} pack_file_entry;
+
+typedef struct
+{
+    void *map;                          /* NULL for a pack in memory */
+    size_t size;
+    const char *base;
+    const pack_file_header *header;
+    const pack_file_entry *entries;
+    const char *names;
+} pack_file;
+
+static int pack_file_open(pack_file *pk, const char *filename);
+static int pack_file_open_memory(pack_file *pk, const void *data, size_t size);
+static int pack_file_open_exe(pack_file *pk, const char *filename);
+static void pack_file_close(pack_file *pk);
+static int pack_file_find(const pack_file *pk, const char *name, buffer *view);
+static void pack_file_mount(pack_file *pk);
+static int pack_file_write(const char *filename, const char *root,
+    const char * const *names, uint count);
+static int pack_file_write_source(const char *filename, const char *symbol,
+    const pack_file *pk);
+
+/*
+ * pack file implementation
+ */
+
+/* FNV-1a */
+static uint pack_file_hash(const char *name, size_t len)
+{
+    uint h = 2166136261u;
+    for (size_t i = 0; i < len; i++) {
+        h = (h ^ (unsigned char)name[i]) * 16777619u;
+    }
+    return h;
+}
+
+static unsigned long long pack_file_align(unsigned long long offset)
+{
+    return (offset + PACK_FILE_ALIGN - 1) & ~(unsigned long long)(PACK_FILE_ALIGN - 1);
+}
+
+static int pack_file_entry_compare(const pack_file_entry *x, const char *xname,
+    const pack_file_entry *y, const char *yname)
+{
+    if (x->hash != y->hash) return x->hash < y->hash ? -1 : 1;
+    return strcmp(xname, yname);
+}
+
+static int pack_file_valid(const pack_file_header *h, size_t size)
+{
+    if (size < sizeof(*h) ||
+            h->magic != PACK_FILE_MAGIC ||
+            h->version != PACK_FILE_VERSION ||
+            h->header_size != sizeof(*h) ||
+            h->file_size != size ||
+            h->entry_count > (size - sizeof(*h)) / sizeof(pack_file_entry) ||
+            h->names_offset < sizeof(*h) + h->entry_count * sizeof(pack_file_entry) ||
+            h->names_offset > size || h->names_size > size - h->names_offset ||
+            (h->names_size && ((const char*)h)[h->names_offset + h->names_size - 1])) {
+        return 0;
+    }
+    const pack_file_entry *e = (const pack_file_entry*)(h + 1);
+    const char *names = (const char*)h + h->names_offset;
+    for (uint i = 0; i < h->entry_count; i++) {
+        if (e[i].name_offset >= h->names_size ||
+                e[i].name_length != strlen(names + e[i].name_offset) ||
+                e[i].hash != pack_file_hash(names + e[i].name_offset, e[i].name_length) ||
+                e[i].offset % PACK_FILE_ALIGN != 0 || e[i].offset > size ||
+                e[i].size >= size - e[i].offset ||
+                ((const char*)h)[e[i].offset + e[i].size] != 0) {
+            return 0;
+        }
+        if (i > 0 && pack_file_entry_compare(&e[i-1], names + e[i-1].name_offset,
+                &e[i], names + e[i].name_offset) >= 0) {
+            return 0;
+        }
+    }
+    return 1;
+}
+
+static int pack_file_open_memory(pack_file *pk, const void *data, size_t size)
+{
+    const pack_file_header *h = (const pack_file_header*)data;
+
+    memset(pk, 0, sizeof(*pk));
+    if (((size_t)data & (sizeof(unsigned long long) - 1)) || !pack_file_valid(h, size)) {
+        errno = EINVAL;
+        return -1;
+    }
+    pk->size = size;
+    pk->base = (const char*)data;
+    pk->header = h;
+    pk->entries = (const pack_file_entry*)(h + 1);
+    pk->names = pk->base + h->names_offset;
+    return 0;
+}
+
+static int pack_file_open(pack_file *pk, const char *filename)
+{
+    struct stat statbuf;
+    void *map;
+    size_t size;
+    int fd;
+
+    memset(pk, 0, sizeof(*pk));
+    if ((fd = open(filename, O_RDONLY)) < 0) {
+        return -1;
+    }
+    if (fstat(fd, &statbuf) < 0) {
+        close(fd);
+        return -1;
+    }
+    if ((size_t)statbuf.st_size < sizeof(pack_file_header)) {
+        close(fd);
+        errno = EINVAL;
+        return -1;
+    }
+    size = (size_t)statbuf.st_size;
+    map = mmap(NULL, size, PROT_READ, MAP_PRIVATE, fd, 0);
+    close(fd);
+    if (map == MAP_FAILED) {
+        return -1;
+    }
+    if (pack_file_open_memory(pk, map, size) < 0) {
+        munmap(map, size);
+        return -1;
+    }
+    pk->map = map;
+    return 0;
+}
+
+/*
+ * open filename in the directory of the running executable, found with
+ * /proc/self/exe where it exists, or else relative to the working directory.
+ */
+static int pack_file_open_exe(pack_file *pk, const char *filename)
+{
+    char path[4096];
+    ssize_t len = readlink("/proc/self/exe", path, sizeof(path) - 1);
+    if (len > 0 && filename[0] != '/') {
+        path[len] = '\0';
+        char *slash = strrchr(path, '/');
+        size_t flen = strlen(filename);
+        if (slash && (size_t)(slash + 1 - path) + flen < sizeof(path)) {
+            memcpy(slash + 1, filename, flen + 1);
+            if (pack_file_open(pk, path) == 0) {
+                return 0;
+            }
+        }
+    }
+    return pack_file_open(pk, filename);
+}
+
+static void pack_file_close(pack_file *pk)
+{
+    if (pk->map) {
+        munmap(pk->map, pk->size);
+    }
+    memset(pk, 0, sizeof(*pk));
+}
+
+/*
+ * find an asset by name, returning 0 and a view of its contents, which
+ * is valid until the pack is closed and must not be written or freed.
+ */
+static int pack_file_find(const pack_file *pk, const char *name, buffer *view)
+{
+    if (!pk->header) {
+        errno = ENOENT;
+        return -1;
+    }
+    size_t len = strlen(name);
+    uint hash = pack_file_hash(name, len);
+    uint lo = 0, hi = pk->header->entry_count;
+    while (lo < hi) {
+        uint mid = lo + (hi - lo) / 2;
+        if (pk->entries[mid].hash < hash) lo = mid + 1;
+        else hi = mid;
+    }
+    for (; lo < pk->header->entry_count && pk->entries[lo].hash == hash; lo++) {
+        const pack_file_entry *e = &pk->entries[lo];
+        if (e->name_length == len && memcmp(pk->names + e->name_offset, name, len) == 0) {
+            view->data = (void*)(pk->base + e->offset);
+            view->length = (size_t)e->size;
+            return 0;
+        }
+    }
+    errno = ENOENT;
+    return -1;
+}
+
+static pack_file *pack_file_mounted;
+
+static int pack_file_lookup(const char *filename, buffer *buf)
+{
+    return pack_file_mounted ? pack_file_find(pack_file_mounted, filename, buf) : -1;
+}
+
+/* serve load_file from pk, which must stay open while mounted */
+static void pack_file_mount(pack_file *pk)
+{
+    pack_file_mounted = pk;
+    load_file_lookup = pk ? pack_file_lookup : NULL;
+}
+
+static int pack_file_put(FILE *f, const void *data, size_t size,
+    unsigned long long offset)
+{
+    static const char zero[PACK_FILE_ALIGN];
+    long pos = ftell(f);
+    if (pos < 0 || (unsigned long long)pos > offset) return -1;
+    while ((unsigned long long)pos < offset) {
+        size_t pad = offset - pos < sizeof(zero) ? (size_t)(offset - pos) : sizeof(zero);
+        if (fwrite(zero, 1, pad, f) != pad) return -1;
+        pos += (long)pad;
+    }
+    return size && fwrite(data, 1, size, f) != size ? -1 : 0;
+}
+
+static int pack_file_read(const char *filename, buffer *buf)
+{
+    struct stat statbuf;
+    FILE *f;
+
+    buf->data = NULL;
+    buf->length = 0;
+    if ((f = fopen(filename, "rb")) == NULL) {
+        return -1;
+    }
+    if (fstat(fileno(f), &statbuf) < 0) {
+        fclose(f);
+        return -1;
+    }
+    buf->length = (size_t)statbuf.st_size;
+    buf->data = malloc(buf->length + 1);
+    if (fread(buf->data, 1, buf->length, f) != buf->length) {
+        free(buf->data);
+        buf->data = NULL;
+        fclose(f);
+        errno = EIO;
+        return -1;
+    }
+    fclose(f);
+    return 0;
+}
+
+typedef struct
+{
+    pack_file_entry entry;
+    const char *name;
+    buffer data;
+} pack_file_source;
+
+static int pack_file_source_compare(const void *a, const void *b)
+{
+    const pack_file_source *x = (const pack_file_source*)a;
+    const pack_file_source *y = (const pack_file_source*)b;
+    return pack_file_entry_compare(&x->entry, x->name, &y->entry, y->name);
+}
+
+/*
+ * write an archive of the named files, read relative to root, or to the
+ * working directory if root is NULL, and stored under the names given.
+ * duplicate names fail with EEXIST.
+ */
+static int pack_file_write(const char *filename, const char *root,
+    const char * const *names, uint count)
+{
+    pack_file_source *src = (pack_file_source*)calloc(count ? count : 1,
+        sizeof(pack_file_source));
+    size_t rlen = root ? strlen(root) : 0;
+    pack_file_header h;
+    int ret = 0;
+    uint i;
+
+    memset(&h, 0, sizeof(h));
+    h.magic = PACK_FILE_MAGIC;
+    h.version = PACK_FILE_VERSION;
+    h.header_size = sizeof(h);
+    h.entry_count = count;
+    h.names_offset = sizeof(h) + (unsigned long long)count * sizeof(pack_file_entry);
+
+    for (i = 0; i < count && ret == 0; i++) {
+        size_t nlen = strlen(names[i]), plen = 0;
+        char *path = (char*)malloc(rlen + nlen + 2);
+        if (root) {
+            memcpy(path, root, rlen);
+            path[rlen] = '/';
+            plen = rlen + 1;
+        }
+        memcpy(path + plen, names[i], nlen + 1);
+        ret = pack_file_read(path, &src[i].data);
+        free(path);
+        src[i].name = names[i];
+        src[i].entry.hash = pack_file_hash(names[i], nlen);
+        src[i].entry.name_length = (uint)nlen;
+        src[i].entry.name_offset = h.names_size;
+        h.names_size += nlen + 1;
+    }
+    if (ret == 0) {
+        qsort(src, count, sizeof(pack_file_source), pack_file_source_compare);
+    }
+    for (i = 1; i < count && ret == 0; i++) {
+        if (pack_file_source_compare(&src[i-1], &src[i]) == 0) {
+            errno = EEXIST;
+            ret = -1;
+        }
+    }
+
+    unsigned long long offset = h.names_offset + h.names_size;
+    for (i = 0; i < count; i++) {
+        src[i].entry.offset = pack_file_align(offset);
+        src[i].entry.size = src[i].data.length;
+        offset = src[i].entry.offset + src[i].entry.size + 1;
+    }
+    h.file_size = offset;
+
+    size_t len = strlen(filename);
+    char *tmpname = (char*)malloc(len + 5);
+    memcpy(tmpname, filename, len);
+    memcpy(tmpname + len, ".tmp", 5);
+
+    FILE *f = ret == 0 ? fopen(tmpname, "wb") : NULL;
+    if (f) {
+        static const char nul;
+        ret = pack_file_put(f, &h, sizeof(h), 0);
+        for (i = 0; i < count; i++) {
+            ret |= pack_file_put(f, &src[i].entry, sizeof(pack_file_entry),
+                sizeof(h) + i * sizeof(pack_file_entry));
+        }
+        /* names are written in argument order, matching name_offset */
+        for (i = 0; i < count; i++) {
+            ret |= pack_file_put(f, names[i], strlen(names[i]) + 1,
+                (unsigned long long)ftell(f));
+        }
+        for (i = 0; i < count; i++) {
+            ret |= pack_file_put(f, src[i].data.data, src[i].data.length,
+                src[i].entry.offset);
+            ret |= pack_file_put(f, &nul, 1, src[i].entry.offset + src[i].entry.size);
+        }
+        ret |= fclose(f);
+        if (ret == 0) {
+            ret = rename(tmpname, filename);
+        }
+        if (ret != 0) {
+            remove(tmpname);
+        }
+    } else {
+        ret = -1;
+    }
+    for (i = 0; i < count; i++) {
+        free(src[i].data.data);
+    }
+    free(tmpname);
+    free(src);
+    return ret ? -1 : 0;
+}
+
+/*
+ * write the archive as a C array named symbol, for including in a program
+ * that passes it to pack_file_open_memory. the array is aligned so the
+ * index can be read in place.
+ */
+static int pack_file_write_source(const char *filename, const char *symbol,
+    const pack_file *pk)
+{
+    FILE *f = fopen(filename, "w");
+    if (!f) return -1;
+    fprintf(f, "/* generated by glcube_pack, do not edit */\n\n");
+    fprintf(f, "static const unsigned char %s[%zu] __attribute__((aligned(%d))) = {\n",
+        symbol, pk->size, PACK_FILE_ALIGN);
+    for (size_t i = 0; i < pk->size; i++) {
+        fprintf(f, "%s0x%02x,%s", i % 16 ? " " : "    ",
+            (unsigned char)pk->base[i], i % 16 == 15 || i + 1 == pk->size ? "\n" : "");
+    }
+    fprintf(f, "};\n");
+    return fclose(f) ? -1 : 0;
+}
@@ -0,0 +1,400 @@
+/*
+ * Copyright (c) 2020 Michael Clark <michaeljclark@mac.com>
+ *
+ * Permission to use, copy, modify, and/or distribute this software for any
+ * purpose with or without fee is hereby granted, provided that the above
+ * copyright notice and this permission notice appear in all copies.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS" AND THE AUTHOR DISCLAIMS ALL WARRANTIES
+ * WITH REGARD TO THIS SOFTWARE INCLUDING ALL IMPLIED WARRANTIES OF
+ * MERCHANTABILITY AND FITNESS. IN NO EVENT SHALL THE AUTHOR BE LIABLE FOR
+ * ANY SPECIAL, DIRECT, INDIRECT, OR CONSEQUENTIAL DAMAGES OR ANY DAMAGES
+ * WHATSOEVER RESULTING FROM LOSS OF USE, DATA OR PROFITS, WHETHER IN AN
+ * ACTION OF CONTRACT, NEGLIGENCE OR OTHER TORTIOUS ACTION, ARISING OUT OF
+ * OR IN CONNECTION WITH THE USE OR PERFORMANCE OF THIS SOFTWARE.
+ */
+
+#pragma once
+
+/*
+ * scene file interface
+ *
+ * a scene is a table of mesh references followed by instances, each
+ * naming a mesh with a translation, euler rotation in degrees, uniform
+ * scale and rgba8 color. the binary form is a header, the mesh names as
+ * length prefixed strings padded to four bytes, and packed instance
+ * records in host byte order. the text form, for authoring, has one
+ * record per line, with the mesh lines first:
+ *
+ *   # comment
+ *   mesh <name>
+ *   instance <mesh> <x> <y> <z> [<rx> <ry> <rz> [<scale> [<rrggbbaa>]]]
+ *
+ * where <mesh> is the index of a mesh line. scene_reader_open reads the
+ * mesh table, then scene_reader_read returns batches of instances from a
+ * SCENE_READ_BUFFER byte buffer, so a scene of any size is loaded in
+ * bounded memory and a caller can spread it over several frames. both
+ * return -1 or set sr->error for malformed files or mesh indices out of
+ * range. scene_writer writes the binary form to a temporary file that is
+ * renamed over the destination on close, once the instance count in the
+ * header is known. fcntl.h must be included first.
+ */
+
+enum {
+    SCENE_FILE_MAGIC = 0x53434c47,      /* "GLCS" */
+    SCENE_FILE_VERSION = 1,
+    SCENE_MESH_MAX = 256,
+    SCENE_NAME_MAX = 1024,
+    SCENE_READ_BUFFER = 1 << 20,
+};
+
+typedef struct
+{
+    uint magic;
+    uint version;
+    uint mesh_count;
+    uint instance_size;
+    unsigned long long instance_count;
+} scene_file_header;
+
+typedef struct
+{
+    uint mesh;
+    float pos[3];
+    float rot[3];                       /* degrees */
+    float scale;
+    unsigned char color[4];
+} scene_instance;
+
+typedef struct
+{
+    int fd;
+    int text;
+    int eof;
+    int error;
+    char *buf;
+    size_t pos, len;
+    size_t line;
+    uint mesh_count;
+    char *meshes[SCENE_MESH_MAX];
+    unsigned long long instance_count;  /* zero for text scenes */
+    unsigned long long read_count;
+    int pending;                        /* first text instance */
+    scene_instance first;
+} scene_reader;
+
+typedef struct
+{
+    FILE *f;
+    char *filename;
+    scene_file_header header;
+} scene_writer;
+
+static int scene_reader_open(scene_reader *sr, const char *filename);
+static size_t scene_reader_read(scene_reader *sr, scene_instance *dst, size_t max);
+static void scene_reader_close(scene_reader *sr);
+static int scene_writer_open(scene_writer *sw, const char *filename,
+    const char * const *meshes, uint mesh_count);
+static int scene_writer_add(scene_writer *sw, const scene_instance *src, size_t count);
+static int scene_writer_close(scene_writer *sw);
+
+/*
+ * scene file implementation
+ */
+
+/* read until at least need bytes are buffered or the file ends */
+static size_t scene_reader_fill(scene_reader *sr, size_t need)
+{
+    if (sr->len - sr->pos >= need || sr->eof) {
+        return sr->len - sr->pos;
+    }
+    memmove(sr->buf, sr->buf + sr->pos, sr->len - sr->pos);
+    sr->len -= sr->pos;
+    sr->pos = 0;
+    while (sr->len < need && sr->len < SCENE_READ_BUFFER) {
+        ssize_t n = read(sr->fd, sr->buf + sr->len, SCENE_READ_BUFFER - sr->len);
+        if (n < 0 && errno == EINTR) continue;
+        if (n <= 0) {
+            sr->error |= n < 0;
+            sr->eof = 1;
+            break;
+        }
+        sr->len += (size_t)n;
+    }
+    return sr->len;
+}
+
+/* the next line, without its newline and terminated, or NULL at the end */
+static char* scene_reader_line(scene_reader *sr)
+{
+    char *nl;
+    while (!(nl = (char*)memchr(sr->buf + sr->pos, '\n', sr->len - sr->pos))) {
+        size_t avail = sr->len - sr->pos;
+        if (sr->eof) {
+            if (avail == 0) return NULL;
+            nl = sr->buf + sr->len;
+            break;
+        }
+        if (avail == SCENE_READ_BUFFER) {
+            sr->error = 1;
+            return NULL;
+        }
+        scene_reader_fill(sr, avail + 1);
+    }
+    char *line = sr->buf + sr->pos;
+    *nl = '\0';
+    sr->pos = nl - sr->buf + (nl < sr->buf + sr->len);
+    sr->line++;
+    return line;
+}
+
+static char* scene_text_skip(char *s)
+{
+    while (*s == ' ' || *s == '\t' || *s == '\r') s++;
+    return s;
+}
+
+/* returns the text after keyword and blanks, or NULL if s is not keyword */
+static char* scene_text_keyword(char *s, const char *keyword)
+{
+    size_t n = strlen(keyword);
+    if (strncmp(s, keyword, n) != 0 || (s[n] != ' ' && s[n] != '\t')) {
+        return NULL;
+    }
+    return scene_text_skip(s + n);
+}
+
+static int scene_text_instance(scene_reader *sr, char *s, scene_instance *o)
+{
+    float f[7] = { 0.f, 0.f, 0.f, 0.f, 0.f, 0.f, 1.f };
+    char *e;
+    int n = 0;
+
+    /* translation, then optionally rotation, scale and color in turn */
+    unsigned long mesh = strtoul(s, &e, 10);
+    if (e == s || mesh >= sr->mesh_count) {
+        return 0;
+    }
+    for (s = e; n < 7; n++) {
+        f[n] = strtof(s, &e);
+        if (e == s) break;
+        s = e;
+    }
+    if (n != 3 && n != 6 && n != 7) {
+        return 0;
+    }
+    s = scene_text_skip(s);
+    unsigned long col = 0xffffffffu;
+    if (*s) {
+        if (n != 7) return 0;
+        col = strtoul(s, &e, 16);
+        if (e - s != 8 || *scene_text_skip(e)) return 0;
+    }
+    o->mesh = (uint)mesh;
+    memcpy(o->pos, f, sizeof(o->pos));
+    memcpy(o->rot, f + 3, sizeof(o->rot));
+    o->scale = f[6];
+    for (int k = 0; k < 4; k++) {
+        o->color[k] = (unsigned char)(col >> (24 - k * 8));
+    }
+    return 1;
+}
+
+/* read the mesh lines, keeping the first instance for scene_reader_read */
+static int scene_reader_text_header(scene_reader *sr)
+{
+    for (;;) {
+        char *s = scene_reader_line(sr), *name;
+        if (!s) return sr->error ? -1 : 0;
+        s = scene_text_skip(s);
+        if (*s == '#' || *s == '\0') continue;
+        if ((name = scene_text_keyword(s, "instance"))) {
+            sr->pending = 1;
+            return scene_text_instance(sr, name, &sr->first) ? 0 : -1;
+        }
+        if (!(name = scene_text_keyword(s, "mesh")) || !*name ||
+                sr->mesh_count == SCENE_MESH_MAX) {
+            return -1;
+        }
+        char *e = name + strlen(name);
+        while (e > name && (e[-1] == ' ' || e[-1] == '\t' || e[-1] == '\r')) *--e = '\0';
+        sr->meshes[sr->mesh_count++] = strdup(name);
+    }
+}
+
+static int scene_reader_binary_header(scene_reader *sr)
+{
+    scene_file_header h;
+    if (scene_reader_fill(sr, sizeof(h)) < sizeof(h)) return -1;
+    memcpy(&h, sr->buf + sr->pos, sizeof(h));
+    sr->pos += sizeof(h);
+    if (h.magic != SCENE_FILE_MAGIC || h.version != SCENE_FILE_VERSION ||
+            h.instance_size != sizeof(scene_instance) || h.mesh_count > SCENE_MESH_MAX) {
+        return -1;
+    }
+    for (uint i = 0; i < h.mesh_count; i++) {
+        uint len;
+        if (scene_reader_fill(sr, sizeof(len)) < sizeof(len)) return -1;
+        memcpy(&len, sr->buf + sr->pos, sizeof(len));
+        size_t padded = (sizeof(len) + len + 3) & ~(size_t)3;
+        if (len == 0 || len >= SCENE_NAME_MAX || scene_reader_fill(sr, padded) < padded) {
+            return -1;
+        }
+        char *name = (char*)malloc(len + 1);
+        memcpy(name, sr->buf + sr->pos + sizeof(len), len);
+        name[len] = '\0';
+        sr->meshes[sr->mesh_count++] = name;
+        sr->pos += padded;
+    }
+    sr->instance_count = h.instance_count;
+    return 0;
+}
+
+static int scene_reader_open(scene_reader *sr, const char *filename)
+{
+    memset(sr, 0, sizeof(*sr));
+    if ((sr->fd = open(filename, O_RDONLY)) < 0) {
+        return -1;
+    }
+    sr->buf = (char*)malloc(SCENE_READ_BUFFER + 1);
+    uint magic = 0;
+    if (scene_reader_fill(sr, sizeof(magic)) >= sizeof(magic)) {
+        memcpy(&magic, sr->buf, sizeof(magic));
+    }
+    sr->text = magic != SCENE_FILE_MAGIC;
+    if ((sr->text ? scene_reader_text_header(sr) : scene_reader_binary_header(sr)) < 0) {
+        scene_reader_close(sr);
+        errno = EINVAL;
+        return -1;
+    }
+    return 0;
+}
+
+/*
+ * read up to max instances, returning 0 at the end of the scene or on an
+ * error, which is left in sr->error.
+ */
+static size_t scene_reader_read(scene_reader *sr, scene_instance *dst, size_t max)
+{
+    size_t n = 0;
+    if (sr->error) {
+        return 0;
+    }
+    if (sr->text) {
+        char *s, *arg;
+        if (sr->pending && max > 0) {
+            dst[n++] = sr->first;
+            sr->pending = 0;
+        }
+        while (n < max && (s = scene_reader_line(sr))) {
+            s = scene_text_skip(s);
+            if (*s == '#' || *s == '\0') continue;
+            if (!(arg = scene_text_keyword(s, "instance")) ||
+                    !scene_text_instance(sr, arg, dst + n)) {
+                sr->error = 1;
+                break;
+            }
+            n++;
+        }
+    } else {
+        while (n < max && sr->read_count + n < sr->instance_count) {
+            size_t want = sr->instance_count - sr->read_count - n;
+            want = want < max - n ? want : max - n;
+            size_t avail = scene_reader_fill(sr, sizeof(scene_instance)) /
+                sizeof(scene_instance);
+            if (avail == 0) {
+                sr->error = 1;
+                break;
+            }
+            size_t k = avail < want ? avail : want;
+            memcpy(dst + n, sr->buf + sr->pos, k * sizeof(scene_instance));
+            sr->pos += k * sizeof(scene_instance);
+            for (size_t j = n; j < n + k; j++) {
+                sr->error |= dst[j].mesh >= sr->mesh_count;
+            }
+            n += k;
+        }
+    }
+    sr->read_count += n;
+    return sr->error ? 0 : n;
+}
+
+static void scene_reader_close(scene_reader *sr)
+{
+    if (sr->fd >= 0) {
+        close(sr->fd);
+    }
+    for (uint i = 0; i < sr->mesh_count; i++) {
+        free(sr->meshes[i]);
+    }
+    free(sr->buf);
+    memset(sr, 0, sizeof(*sr));
+    sr->fd = -1;
+}
+
+static int scene_writer_open(scene_writer *sw, const char *filename,
+    const char * const *meshes, uint mesh_count)
+{
+    static const char zero[4];
+    size_t len = strlen(filename);
+    int ret = 0;
+
+    memset(sw, 0, sizeof(*sw));
+    if (mesh_count > SCENE_MESH_MAX) {
+        return -1;
+    }
+    sw->filename = (char*)malloc(len + 5);
+    memcpy(sw->filename, filename, len);
+    memcpy(sw->filename + len, ".tmp", 5);
+    if (!(sw->f = fopen(sw->filename, "wb"))) {
+        free(sw->filename);
+        return -1;
+    }
+    sw->header = (scene_file_header){ SCENE_FILE_MAGIC, SCENE_FILE_VERSION,
+        mesh_count, sizeof(scene_instance), 0 };
+    ret |= fwrite(&sw->header, sizeof(sw->header), 1, sw->f) != 1;
+    for (uint i = 0; i < mesh_count; i++) {
+        uint n = (uint)strlen(meshes[i]);
+        ret |= n == 0 || n >= SCENE_NAME_MAX;
+        ret |= fwrite(&n, sizeof(n), 1, sw->f) != 1;
+        ret |= fwrite(meshes[i], 1, n, sw->f) != n;
+        ret |= fwrite(zero, 1, -n & 3, sw->f) != (-n & 3);
+    }
+    if (ret) {
+        fclose(sw->f);
+        remove(sw->filename);
+        free(sw->filename);
+        return -1;
+    }
+    return 0;
+}
+
+static int scene_writer_add(scene_writer *sw, const scene_instance *src, size_t count)
+{
+    if (fwrite(src, sizeof(scene_instance), count, sw->f) != count) {
+        return -1;
+    }
+    sw->header.instance_count += count;
+    return 0;
+}
+
+static int scene_writer_close(scene_writer *sw)
+{
+    size_t len = strlen(sw->filename) - 4;
+    char *filename = (char*)malloc(len + 1);
+    int ret = 0;
+
+    memcpy(filename, sw->filename, len);
+    filename[len] = '\0';
+    ret |= fseek(sw->f, 0, SEEK_SET);
+    ret |= fwrite(&sw->header, sizeof(sw->header), 1, sw->f) != 1;
+    ret |= fclose(sw->f);
+    if (ret || rename(sw->filename, filename) < 0) {
+        remove(sw->filename);
+        ret = -1;
+    }
+    free(filename);
+    free(sw->filename);
+    memset(sw, 0, sizeof(*sw));
+    return ret ? -1 : 0;
+}
@@ -0,0 +1,290 @@
+/*
+ * Copyright (c) 2020 Michael Clark <michaeljclark@mac.com>
+ *
+ * Permission to use, copy, modify, and/or distribute this software for any
+ * purpose with or without fee is hereby granted, provided that the above
+ * copyright notice and this permission notice appear in all copies.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS" AND THE AUTHOR DISCLAIMS ALL WARRANTIES
+ * WITH REGARD TO THIS SOFTWARE INCLUDING ALL IMPLIED WARRANTIES OF
+ * MERCHANTABILITY AND FITNESS. IN NO EVENT SHALL THE AUTHOR BE LIABLE FOR
+ * ANY SPECIAL, DIRECT, INDIRECT, OR CONSEQUENTIAL DAMAGES OR ANY DAMAGES
+ * WHATSOEVER RESULTING FROM LOSS OF USE, DATA OR PROFITS, WHETHER IN AN
+ * ACTION OF CONTRACT, NEGLIGENCE OR OTHER TORTIOUS ACTION, ARISING OUT OF
+ * OR IN CONNECTION WITH THE USE OR PERFORMANCE OF THIS SOFTWARE.
+ */
+
+#pragma once
+
+/*
+ * scene graph interface
+ *
+ * nodes are stored structure-of-arrays with a parent always preceding its
+ * children; scene_graph_sort reorders them breadth-first. each node has a
+ * local scale, translation and euler rotation (radians) and cached local,
+ * world and normal matrices. setting a transform marks the node dirty and
+ * scene_graph_update recomputes the local matrices of dirty nodes, batched
+ * in runs, then the world matrices of dirty nodes and their descendants in
+ * one forward pass starting at the first dirty node, so static parts of the
+ * scene cost nothing. the indices of the nodes whose world matrix changed
+ * are left in the moved list for the caller to upload.
+ *
+ * the setters track the first dirty node so they are not thread safe.
+ * jobs updating disjoint nodes in parallel use scene_graph_put_rotation,
+ * which only flags the node, then scene_graph_mark the lowest node they
+ * touched before the next update.
+ */
+
+#define SCENE_NODE_NONE ((uint)~0u)
+
+enum {
+    scene_node_dirty = 1,   /* local transform changed since last update */
+    scene_node_moved = 2,   /* world matrix changed in last update */
+};
+
+typedef struct
+{
+    size_t count;
+    size_t capacity;
+    size_t first_dirty;
+    uint *parent;
+    unsigned char *flags;
+    vec3 *scale;
+    vec3 *trans;
+    vec3 *rot;
+    mat4x4 *local;
+    mat4x4 *local_normal;
+    mat4x4 *world;
+    mat4x4 *normal;
+    uint *moved;
+    size_t moved_count;
+} scene_graph_t;
+
+static void scene_graph_init(scene_graph_t *sg, size_t capacity);
+static void scene_graph_destroy(scene_graph_t *sg);
+static size_t scene_graph_count(scene_graph_t *sg);
+static uint scene_graph_add(scene_graph_t *sg, uint parent);
+static void scene_graph_set_trs(scene_graph_t *sg, uint node,
+    vec3 scale, vec3 trans, vec3 rot);
+static void scene_graph_set_rotation(scene_graph_t *sg, uint node, vec3 rot);
+static void scene_graph_set_translation(scene_graph_t *sg, uint node, vec3 trans);
+static void scene_graph_put_rotation(scene_graph_t *sg, uint node, vec3 rot);
+static void scene_graph_mark(scene_graph_t *sg, uint node);
+static size_t scene_graph_update(scene_graph_t *sg);
+static void scene_graph_sort(scene_graph_t *sg, uint *remap);
+
+/*
+ * scene graph implementation
+ */
+
+static void scene_graph_resize(scene_graph_t *sg, size_t capacity)
+{
+    sg->capacity = capacity;
+    sg->parent = (uint*)realloc(sg->parent, capacity * sizeof(uint));
+    sg->flags = (unsigned char*)realloc(sg->flags, capacity);
+    sg->scale = (vec3*)realloc(sg->scale, capacity * sizeof(vec3));
+    sg->trans = (vec3*)realloc(sg->trans, capacity * sizeof(vec3));
+    sg->rot = (vec3*)realloc(sg->rot, capacity * sizeof(vec3));
+    sg->local = (mat4x4*)realloc(sg->local, capacity * sizeof(mat4x4));
+    sg->local_normal = (mat4x4*)realloc(sg->local_normal, capacity * sizeof(mat4x4));
+    sg->world = (mat4x4*)realloc(sg->world, capacity * sizeof(mat4x4));
+    sg->normal = (mat4x4*)realloc(sg->normal, capacity * sizeof(mat4x4));
+    sg->moved = (uint*)realloc(sg->moved, capacity * sizeof(uint));
+}
+
+static void scene_graph_init(scene_graph_t *sg, size_t capacity)
+{
+    memset(sg, 0, sizeof(*sg));
+    scene_graph_resize(sg, capacity ? capacity : 16);
+}
+
+static void scene_graph_destroy(scene_graph_t *sg)
+{
+    free(sg->parent);
+    free(sg->flags);
+    free(sg->scale);
+    free(sg->trans);
+    free(sg->rot);
+    free(sg->local);
+    free(sg->local_normal);
+    free(sg->world);
+    free(sg->normal);
+    free(sg->moved);
+    memset(sg, 0, sizeof(*sg));
+}
+
+static size_t scene_graph_count(scene_graph_t *sg)
+{
+    return sg->count;
+}
+
+static void scene_graph_mark(scene_graph_t *sg, uint node)
+{
+    sg->flags[node] |= scene_node_dirty;
+    if (node < sg->first_dirty) {
+        sg->first_dirty = node;
+    }
+}
+
+static uint scene_graph_add(scene_graph_t *sg, uint parent)
+{
+    assert(parent == SCENE_NODE_NONE || parent < sg->count);
+    if (sg->count >= sg->capacity) {
+        scene_graph_resize(sg, sg->capacity << 1);
+    }
+    uint node = (uint)sg->count++;
+    sg->parent[node] = parent;
+    sg->flags[node] = 0;
+    vec3 one = { 1.f, 1.f, 1.f }, zero = { 0.f, 0.f, 0.f };
+    memcpy(sg->scale[node], one, sizeof(vec3));
+    memcpy(sg->trans[node], zero, sizeof(vec3));
+    memcpy(sg->rot[node], zero, sizeof(vec3));
+    scene_graph_mark(sg, node);
+    return node;
+}
+
+static void scene_graph_set_trs(scene_graph_t *sg, uint node,
+    vec3 scale, vec3 trans, vec3 rot)
+{
+    memcpy(sg->scale[node], scale, sizeof(vec3));
+    memcpy(sg->trans[node], trans, sizeof(vec3));
+    memcpy(sg->rot[node], rot, sizeof(vec3));
+    scene_graph_mark(sg, node);
+}
+
+static void scene_graph_set_rotation(scene_graph_t *sg, uint node, vec3 rot)
+{
+    memcpy(sg->rot[node], rot, sizeof(vec3));
+    scene_graph_mark(sg, node);
+}
+
+static void scene_graph_set_translation(scene_graph_t *sg, uint node, vec3 trans)
+{
+    memcpy(sg->trans[node], trans, sizeof(vec3));
+    scene_graph_mark(sg, node);
+}
+
+static void scene_graph_put_rotation(scene_graph_t *sg, uint node, vec3 rot)
+{
+    memcpy(sg->rot[node], rot, sizeof(vec3));
+    sg->flags[node] |= scene_node_dirty;
+}
+
+static size_t scene_graph_update(scene_graph_t *sg)
+{
+    size_t i, j, n = sg->count;
+
+    /* forget the nodes that moved in the previous update */
+    for (i = 0; i < sg->moved_count; i++) {
+        sg->flags[sg->moved[i]] &= ~scene_node_moved;
+    }
+    sg->moved_count = 0;
+
+    /* local matrices for runs of consecutive dirty nodes */
+    for (i = sg->first_dirty; i < n; i = j) {
+        while (i < n && !(sg->flags[i] & scene_node_dirty)) i++;
+        for (j = i; j < n && (sg->flags[j] & scene_node_dirty); j++);
+        if (j > i) {
+            mat4x4_compose_euler_n(sg->local + i, sg->local_normal + i,
+                sg->scale + i, sg->trans + i, sg->rot + i, j - i);
+        }
+    }
+
+    /* world matrices, parents are updated before their children */
+    for (i = sg->first_dirty; i < n; i++) {
+        uint p = sg->parent[i];
+        int moved = (sg->flags[i] & scene_node_dirty) ||
+            (p != SCENE_NODE_NONE && (sg->flags[p] & scene_node_moved));
+        if (!moved) continue;
+        if (p == SCENE_NODE_NONE) {
+            memcpy(sg->world[i], sg->local[i], sizeof(mat4x4));
+            memcpy(sg->normal[i], sg->local_normal[i], sizeof(mat4x4));
+        } else {
+            mat4x4_mul(sg->world[i], sg->world[p], sg->local[i]);
+            mat4x4_mul(sg->normal[i], sg->normal[p], sg->local_normal[i]);
+        }
+        sg->flags[i] = scene_node_moved;
+        sg->moved[sg->moved_count++] = (uint)i;
+    }
+    sg->first_dirty = n;
+
+    return sg->moved_count;
+}
+
+static void scene_graph_permute(void *data, size_t stride, const uint *order, size_t n)
+{
+    char *src = (char*)data, *tmp = (char*)malloc(stride * n);
+    for (size_t k = 0; k < n; k++) {
+        memcpy(tmp + k * stride, src + order[k] * stride, stride);
+    }
+    memcpy(src, tmp, stride * n);
+    free(tmp);
+}
+
+/*
+ * reorder nodes breadth-first: roots, then their children level by level
+ * with siblings adjacent. remap, if not NULL, receives the new index of
+ * each old node index.
+ */
+static void scene_graph_sort(scene_graph_t *sg, uint *remap)
+{
+    size_t n = sg->count, i, k;
+    uint *start = (uint*)calloc(n + 1, sizeof(uint));
+    uint *fill = (uint*)malloc(n * sizeof(uint));
+    uint *child = (uint*)malloc(n * sizeof(uint));
+    uint *order = (uint*)malloc(n * sizeof(uint));
+    uint *newidx = remap ? remap : (uint*)malloc(n * sizeof(uint));
+
+    /* children of each node in index order */
+    for (i = 0; i < n; i++) {
+        if (sg->parent[i] != SCENE_NODE_NONE) start[sg->parent[i] + 1]++;
+    }
+    for (i = 0; i < n; i++) {
+        start[i + 1] += start[i];
+        fill[i] = start[i];
+    }
+    for (i = 0; i < n; i++) {
+        if (sg->parent[i] != SCENE_NODE_NONE) child[fill[sg->parent[i]]++] = (uint)i;
+    }
+
+    /* breadth-first traversal of the forest */
+    k = 0;
+    for (i = 0; i < n; i++) {
+        if (sg->parent[i] == SCENE_NODE_NONE) order[k++] = (uint)i;
+    }
+    for (i = 0; i < k; i++) {
+        uint u = order[i];
+        for (uint c = start[u]; c < start[u + 1]; c++) {
+            order[k++] = child[c];
+        }
+    }
+    for (i = 0; i < n; i++) {
+        newidx[order[i]] = (uint)i;
+    }
+
+    for (i = 0; i < n; i++) {
+        uint p = sg->parent[order[i]];
+        fill[i] = p == SCENE_NODE_NONE ? SCENE_NODE_NONE : newidx[p];
+    }
+    memcpy(sg->parent, fill, n * sizeof(uint));
+    scene_graph_permute(sg->flags, 1, order, n);
+    scene_graph_permute(sg->scale, sizeof(vec3), order, n);
+    scene_graph_permute(sg->trans, sizeof(vec3), order, n);
+    scene_graph_permute(sg->rot, sizeof(vec3), order, n);
+    scene_graph_permute(sg->local, sizeof(mat4x4), order, n);
+    scene_graph_permute(sg->local_normal, sizeof(mat4x4), order, n);
+    scene_graph_permute(sg->world, sizeof(mat4x4), order, n);
+    scene_graph_permute(sg->normal, sizeof(mat4x4), order, n);
+    for (i = 0; i < sg->moved_count; i++) {
+        sg->moved[i] = newidx[sg->moved[i]];
+    }
+    for (sg->first_dirty = 0; sg->first_dirty < n; sg->first_dirty++) {
+        if (sg->flags[sg->first_dirty] & scene_node_dirty) break;
+    }
+
+    if (!remap) free(newidx);
+    free(order);
+    free(child);
+    free(fill);
+    free(start);
+}
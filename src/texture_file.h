@@ -0,0 +1,895 @@
+/*
+ * Copyright (c) 2020 Michael Clark <michaeljclark@mac.com>
+ *
+ * Permission to use, copy, modify, and/or distribute this software for any
+ * purpose with or without fee is hereby granted, provided that the above
+ * copyright notice and this permission notice appear in all copies.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS" AND THE AUTHOR DISCLAIMS ALL WARRANTIES
+ * WITH REGARD TO THIS SOFTWARE INCLUDING ALL IMPLIED WARRANTIES OF
+ * MERCHANTABILITY AND FITNESS. IN NO EVENT SHALL THE AUTHOR BE LIABLE FOR
+ * ANY SPECIAL, DIRECT, INDIRECT, OR CONSEQUENTIAL DAMAGES OR ANY DAMAGES
+ * WHATSOEVER RESULTING FROM LOSS OF USE, DATA OR PROFITS, WHETHER IN AN
+ * ACTION OF CONTRACT, NEGLIGENCE OR OTHER TORTIOUS ACTION, ARISING OUT OF
+ * OR IN CONNECTION WITH THE USE OR PERFORMANCE OF THIS SOFTWARE.
+ */
+
+#pragma once
+
+/*
+ * texture file interface
+ *
+ * decodes 2D textures into a texture_image: a format, and a chain of mip
+ * levels, finest first, in one buffer. KTX2 and DDS files hold their
+ * levels precompressed (BC1-5, BC7) or as rgba8/bgra8, and are copied
+ * out of the container as is. PNG files are inflated and converted to
+ * rgba8, and with mips set, the rest of the chain is built with a box
+ * filter. KTX2 supercompression, cube maps, arrays and interlaced PNGs
+ * are not supported. functions return -1 and set errno on failure, with
+ * EINVAL for malformed files and ENOTSUP for unsupported features. no
+ * GL calls are made, so decoding can run on any thread. fcntl.h,
+ * sys/stat.h and sys/mman.h must be included first.
+ */
+
+enum {
+    TEXTURE_LEVEL_MAX = 16,
+    TEXTURE_SIZE_MAX = 16384,
+};
+
+typedef enum
+{
+    texture_format_none,
+    texture_rgba8,
+    texture_bgra8,
+    texture_bc1,
+    texture_bc2,
+    texture_bc3,
+    texture_bc4,
+    texture_bc5,
+    texture_bc7,
+} texture_format;
+
+typedef struct
+{
+    size_t offset;
+    size_t size;
+    uint width;
+    uint height;
+} texture_level;
+
+typedef struct
+{
+    uint format;
+    uint srgb;
+    uint width;
+    uint height;
+    uint level_count;
+    texture_level levels[TEXTURE_LEVEL_MAX];
+    unsigned char *data;
+    size_t size;
+} texture_image;
+
+static uint texture_block_size(uint format);
+static size_t texture_level_size(uint format, uint width, uint height);
+static int texture_image_decode(texture_image *ti, const unsigned char *src,
+    size_t size, int mips);
+static int texture_image_load(texture_image *ti, const char *filename, int mips);
+static void texture_image_build_mips(texture_image *ti);
+static void texture_image_destroy(texture_image *ti);
+
+/*
+ * texture file implementation
+ */
+
+/* bytes per 4x4 block, or zero for formats with 4 byte pixels */
+static uint texture_block_size(uint format)
+{
+    switch (format) {
+    case texture_bc1: case texture_bc4: return 8;
+    case texture_bc2: case texture_bc3: case texture_bc5: case texture_bc7: return 16;
+    default: return 0;
+    }
+}
+
+static size_t texture_level_size(uint format, uint width, uint height)
+{
+    uint block = texture_block_size(format);
+    return block ? (size_t)((width + 3) / 4) * ((height + 3) / 4) * block :
+        (size_t)width * height * 4;
+}
+
+static uint texture_get32(const unsigned char *p)
+{
+    return p[0] | (p[1] << 8) | (p[2] << 16) | ((uint)p[3] << 24);
+}
+
+static unsigned long long texture_get64(const unsigned char *p)
+{
+    return texture_get32(p) | ((unsigned long long)texture_get32(p + 4) << 32);
+}
+
+static uint texture_get32be(const unsigned char *p)
+{
+    return ((uint)p[0] << 24) | (p[1] << 16) | (p[2] << 8) | p[3];
+}
+
+static int texture_error(int err)
+{
+    errno = err;
+    return -1;
+}
+
+/* lay out the level chain for the image size and allocate the buffer */
+static int texture_image_alloc(texture_image *ti, uint format, uint width,
+    uint height, uint level_count)
+{
+    size_t offset = 0;
+    if (width == 0 || height == 0 || width > TEXTURE_SIZE_MAX ||
+            height > TEXTURE_SIZE_MAX || level_count == 0) {
+        return texture_error(EINVAL);
+    }
+    ti->format = format;
+    ti->width = width;
+    ti->height = height;
+    ti->level_count = 0;
+    for (uint l = 0; l < level_count && l < TEXTURE_LEVEL_MAX; l++) {
+        texture_level *lv = &ti->levels[ti->level_count++];
+        lv->width = width >> l ? width >> l : 1;
+        lv->height = height >> l ? height >> l : 1;
+        lv->offset = offset;
+        lv->size = texture_level_size(format, lv->width, lv->height);
+        offset += lv->size;
+        if (lv->width == 1 && lv->height == 1) break;
+    }
+    ti->size = offset;
+    ti->data = (unsigned char*)malloc(offset);
+    return ti->data ? 0 : texture_error(ENOMEM);
+}
+
+/* levels in the full chain of a width x height image */
+static uint texture_chain_length(uint width, uint height)
+{
+    uint n = 1;
+    while ((width | height) >> n) n++;
+    return n < TEXTURE_LEVEL_MAX ? n : TEXTURE_LEVEL_MAX;
+}
+
+/*
+ * KTX2: a header, an index of the data format descriptor, key/value and
+ * supercompression sections, then a level index of offsets and lengths.
+ */
+
+enum {
+    texture_vk_r8g8b8a8_unorm = 37,
+    texture_vk_r8g8b8a8_srgb = 43,
+    texture_vk_b8g8r8a8_unorm = 44,
+    texture_vk_b8g8r8a8_srgb = 50,
+    texture_vk_bc1_rgb_unorm = 131,
+    texture_vk_bc7_srgb = 146,
+};
+
+static int texture_ktx2_format(uint vk, uint *format, uint *srgb)
+{
+    static const unsigned char bc[] = {
+        texture_bc1, texture_bc1, texture_bc1, texture_bc1,
+        texture_bc2, texture_bc2, texture_bc3, texture_bc3,
+        texture_bc4, 0, texture_bc5, 0, 0, 0, texture_bc7, texture_bc7,
+    };
+    static const unsigned char bc_srgb[] = {
+        0, 1, 0, 1, 0, 1, 0, 1, 0, 0, 0, 0, 0, 0, 0, 1,
+    };
+    *srgb = 0;
+    switch (vk) {
+    case texture_vk_r8g8b8a8_srgb: *srgb = 1; /* fall through */
+    case texture_vk_r8g8b8a8_unorm: *format = texture_rgba8; return 0;
+    case texture_vk_b8g8r8a8_srgb: *srgb = 1; /* fall through */
+    case texture_vk_b8g8r8a8_unorm: *format = texture_bgra8; return 0;
+    }
+    if (vk < texture_vk_bc1_rgb_unorm || vk > texture_vk_bc7_srgb ||
+            !bc[vk - texture_vk_bc1_rgb_unorm]) {
+        return -1;
+    }
+    *format = bc[vk - texture_vk_bc1_rgb_unorm];
+    *srgb = bc_srgb[vk - texture_vk_bc1_rgb_unorm];
+    return 0;
+}
+
+static int texture_ktx2_decode(texture_image *ti, const unsigned char *src,
+    size_t size, int mips)
+{
+    enum { header_size = 80, level_index_size = 24 };
+    uint format, srgb;
+    if (size < header_size) return texture_error(EINVAL);
+    uint vk = texture_get32(src + 12);
+    uint width = texture_get32(src + 20), height = texture_get32(src + 24);
+    uint depth = texture_get32(src + 28), layers = texture_get32(src + 32);
+    uint faces = texture_get32(src + 36), level_count = texture_get32(src + 40);
+    uint scheme = texture_get32(src + 44);
+    uint stored = level_count ? level_count : 1;
+    if (texture_ktx2_format(vk, &format, &srgb) < 0 || scheme != 0 ||
+            depth > 1 || layers > 1 || faces != 1) {
+        return texture_error(ENOTSUP);
+    }
+    if (height == 0 || stored > TEXTURE_LEVEL_MAX ||
+            header_size + (size_t)stored * level_index_size > size) {
+        return texture_error(EINVAL);
+    }
+    if (texture_image_alloc(ti, format, width, height, stored) < 0) {
+        return -1;
+    }
+    ti->srgb = srgb;
+    for (uint l = 0; l < ti->level_count; l++) {
+        const unsigned char *e = src + header_size + l * level_index_size;
+        unsigned long long offset = texture_get64(e), length = texture_get64(e + 8);
+        texture_level *lv = &ti->levels[l];
+        if (length < lv->size || offset > size || lv->size > size - offset) {
+            texture_image_destroy(ti);
+            return texture_error(EINVAL);
+        }
+        memcpy(ti->data + lv->offset, src + offset, lv->size);
+    }
+    if (level_count == 0 && mips && format == texture_rgba8) {
+        texture_image_build_mips(ti);
+    }
+    return 0;
+}
+
+/*
+ * DDS: a magic, a 124 byte header with a pixel format, an optional DX10
+ * header with a DXGI format, then the levels back to back.
+ */
+
+enum {
+    texture_dds_mipmapcount = 0x20000,
+    texture_dds_fourcc = 0x4,
+    texture_dds_rgb = 0x40,
+    texture_dxgi_r8g8b8a8_unorm = 28,
+    texture_dxgi_r8g8b8a8_srgb = 29,
+    texture_dxgi_bc1_unorm = 71,
+    texture_dxgi_bc5_unorm = 83,
+    texture_dxgi_b8g8r8a8_unorm = 87,
+    texture_dxgi_b8g8r8a8_srgb = 91,
+    texture_dxgi_bc7_unorm = 98,
+    texture_dxgi_bc7_srgb = 99,
+};
+
+#define texture_fourcc(a,b,c,d) ((uint)(a) | ((uint)(b) << 8) | \
+    ((uint)(c) << 16) | ((uint)(d) << 24))
+
+static int texture_dxgi_format(uint dxgi, uint *format, uint *srgb)
+{
+    /* BC1 through BC5 are in groups of typeless, unorm, srgb or snorm */
+    static const unsigned char bc[] = {
+        texture_bc1, texture_bc1, 0, texture_bc2, texture_bc2, 0,
+        texture_bc3, texture_bc3, 0, texture_bc4, 0, 0, texture_bc5,
+    };
+    static const unsigned char bc_srgb[] = {
+        0, 1, 0, 0, 1, 0, 0, 1, 0, 0, 0, 0, 0,
+    };
+    *srgb = 0;
+    switch (dxgi) {
+    case texture_dxgi_r8g8b8a8_srgb: *srgb = 1; /* fall through */
+    case texture_dxgi_r8g8b8a8_unorm: *format = texture_rgba8; return 0;
+    case texture_dxgi_b8g8r8a8_srgb: *srgb = 1; /* fall through */
+    case texture_dxgi_b8g8r8a8_unorm: *format = texture_bgra8; return 0;
+    case texture_dxgi_bc7_srgb: *srgb = 1; /* fall through */
+    case texture_dxgi_bc7_unorm: *format = texture_bc7; return 0;
+    }
+    if (dxgi < texture_dxgi_bc1_unorm || dxgi > texture_dxgi_bc5_unorm ||
+            !bc[dxgi - texture_dxgi_bc1_unorm]) {
+        return -1;
+    }
+    *format = bc[dxgi - texture_dxgi_bc1_unorm];
+    *srgb = bc_srgb[dxgi - texture_dxgi_bc1_unorm];
+    return 0;
+}
+
+static int texture_dds_decode(texture_image *ti, const unsigned char *src, size_t size)
+{
+    enum { header_size = 128, dx10_size = 20 };
+    uint format = 0, srgb = 0;
+    size_t offset = header_size;
+    if (size < header_size || texture_get32(src + 4) != 124) {
+        return texture_error(EINVAL);
+    }
+    uint flags = texture_get32(src + 8);
+    uint height = texture_get32(src + 12), width = texture_get32(src + 16);
+    uint depth = texture_get32(src + 24);
+    uint level_count = flags & texture_dds_mipmapcount ? texture_get32(src + 28) : 1;
+    uint pf_flags = texture_get32(src + 80), fourcc = texture_get32(src + 84);
+    uint bits = texture_get32(src + 88), rmask = texture_get32(src + 92);
+    uint caps2 = texture_get32(src + 112);
+
+    if (pf_flags & texture_dds_fourcc) {
+        switch (fourcc) {
+        case texture_fourcc('D','X','T','1'): format = texture_bc1; break;
+        case texture_fourcc('D','X','T','3'): format = texture_bc2; break;
+        case texture_fourcc('D','X','T','5'): format = texture_bc3; break;
+        case texture_fourcc('A','T','I','1'):
+        case texture_fourcc('B','C','4','U'): format = texture_bc4; break;
+        case texture_fourcc('A','T','I','2'):
+        case texture_fourcc('B','C','5','U'): format = texture_bc5; break;
+        case texture_fourcc('D','X','1','0'):
+            if (size < header_size + dx10_size) return texture_error(EINVAL);
+            if (texture_dxgi_format(texture_get32(src + header_size), &format, &srgb) < 0 ||
+                    texture_get32(src + header_size + 4) != 3 ||
+                    (texture_get32(src + header_size + 8) & 4) ||
+                    texture_get32(src + header_size + 12) > 1) {
+                return texture_error(ENOTSUP);
+            }
+            offset += dx10_size;
+            break;
+        }
+    } else if ((pf_flags & texture_dds_rgb) && bits == 32) {
+        format = rmask == 0x000000ff ? texture_rgba8 :
+            rmask == 0x00ff0000 ? texture_bgra8 : 0;
+    }
+    if (!format || caps2 != 0 || depth > 1) {
+        return texture_error(ENOTSUP);
+    }
+    if (texture_image_alloc(ti, format, width, height, level_count ? level_count : 1) < 0) {
+        return -1;
+    }
+    ti->srgb = srgb;
+    if (offset > size || ti->size > size - offset) {
+        texture_image_destroy(ti);
+        return texture_error(EINVAL);
+    }
+    memcpy(ti->data, src + offset, ti->size);
+    return 0;
+}
+
+/*
+ * inflate (RFC 1950 and 1951) for PNG. huffman codes of up to
+ * TEXTURE_FAST_BITS bits are decoded with one table lookup on the
+ * bit-reversed input, longer codes canonically one bit at a time.
+ */
+
+enum {
+    TEXTURE_FAST_BITS = 10,
+    TEXTURE_HUFFMAN_MAX = 288,
+};
+
+typedef struct
+{
+    unsigned short count[16];
+    unsigned short symbol[TEXTURE_HUFFMAN_MAX];
+    unsigned short fast[1 << TEXTURE_FAST_BITS];    /* symbol << 4 | length */
+} texture_huffman;
+
+typedef struct
+{
+    const unsigned char *src, *end;
+    unsigned long long bits;
+    uint nbits;
+    unsigned char *dst;
+    size_t pos, cap;
+} texture_inflate_state;
+
+static int texture_huffman_build(texture_huffman *h, const unsigned char *lengths, uint n)
+{
+    unsigned short offs[16];
+    int left = 1;
+    memset(h->count, 0, sizeof(h->count));
+    memset(h->fast, 0, sizeof(h->fast));
+    for (uint i = 0; i < n; i++) {
+        h->count[lengths[i]]++;
+    }
+    h->count[0] = 0;
+    for (uint len = 1; len < 16; len++) {
+        left = (left << 1) - h->count[len];
+        if (left < 0) return -1;
+    }
+    offs[1] = 0;
+    for (uint len = 1; len < 15; len++) {
+        offs[len + 1] = offs[len] + h->count[len];
+    }
+    for (uint i = 0; i < n; i++) {
+        if (lengths[i]) h->symbol[offs[lengths[i]]++] = (unsigned short)i;
+    }
+    uint code = 0, index = 0;
+    for (uint len = 1; len <= TEXTURE_FAST_BITS; len++) {
+        for (uint k = 0; k < h->count[len]; k++, code++, index++) {
+            uint rev = 0;
+            for (uint b = 0; b < len; b++) {
+                rev |= ((code >> b) & 1) << (len - 1 - b);
+            }
+            for (uint j = rev; j < (1u << TEXTURE_FAST_BITS); j += 1u << len) {
+                h->fast[j] = (unsigned short)(h->symbol[index] << 4 | len);
+            }
+        }
+        code <<= 1;
+    }
+    return 0;
+}
+
+static void texture_inflate_refill(texture_inflate_state *s)
+{
+    while (s->nbits <= 56 && s->src < s->end) {
+        s->bits |= (unsigned long long)*s->src++ << s->nbits;
+        s->nbits += 8;
+    }
+}
+
+static int texture_inflate_bits(texture_inflate_state *s, uint n, uint *v)
+{
+    if (s->nbits < n) {
+        texture_inflate_refill(s);
+        if (s->nbits < n) return -1;
+    }
+    *v = (uint)(s->bits & ((1ull << n) - 1));
+    s->bits >>= n;
+    s->nbits -= n;
+    return 0;
+}
+
+static int texture_inflate_symbol(texture_inflate_state *s, const texture_huffman *h)
+{
+    if (s->nbits < 15) texture_inflate_refill(s);
+    uint e = h->fast[s->bits & ((1u << TEXTURE_FAST_BITS) - 1)];
+    if (e) {
+        if ((e & 15) > s->nbits) return -1;
+        s->bits >>= e & 15;
+        s->nbits -= e & 15;
+        return e >> 4;
+    }
+    int code = 0, first = 0, index = 0;
+    for (uint len = 1; len < 16; len++) {
+        uint b;
+        if (texture_inflate_bits(s, 1, &b) < 0) return -1;
+        code |= (int)b;
+        int count = h->count[len];
+        if (code - count < first) return h->symbol[index + (code - first)];
+        index += count;
+        first = (first + count) << 1;
+        code <<= 1;
+    }
+    return -1;
+}
+
+static int texture_inflate_codes(texture_inflate_state *s,
+    const texture_huffman *lit, const texture_huffman *dist)
+{
+    static const unsigned short len_base[29] = {
+        3, 4, 5, 6, 7, 8, 9, 10, 11, 13, 15, 17, 19, 23, 27, 31,
+        35, 43, 51, 59, 67, 83, 99, 115, 131, 163, 195, 227, 258
+    };
+    static const unsigned char len_extra[29] = {
+        0, 0, 0, 0, 0, 0, 0, 0, 1, 1, 1, 1, 2, 2, 2, 2,
+        3, 3, 3, 3, 4, 4, 4, 4, 5, 5, 5, 5, 0
+    };
+    static const unsigned short dist_base[30] = {
+        1, 2, 3, 4, 5, 7, 9, 13, 17, 25, 33, 49, 65, 97, 129, 193,
+        257, 385, 513, 769, 1025, 1537, 2049, 3073, 4097, 6145,
+        8193, 12289, 16385, 24577
+    };
+    static const unsigned char dist_extra[30] = {
+        0, 0, 0, 0, 1, 1, 2, 2, 3, 3, 4, 4, 5, 5, 6, 6,
+        7, 7, 8, 8, 9, 9, 10, 10, 11, 11, 12, 12, 13, 13
+    };
+    for (;;) {
+        int sym = texture_inflate_symbol(s, lit);
+        if (sym < 0) return -1;
+        if (sym < 256) {
+            if (s->pos == s->cap) return -1;
+            s->dst[s->pos++] = (unsigned char)sym;
+            continue;
+        }
+        if (sym == 256) return 0;
+        uint len, d, extra;
+        sym -= 257;
+        if (sym >= 29 || texture_inflate_bits(s, len_extra[sym], &extra) < 0) return -1;
+        len = len_base[sym] + extra;
+        sym = texture_inflate_symbol(s, dist);
+        if (sym < 0 || sym >= 30 ||
+                texture_inflate_bits(s, dist_extra[sym], &extra) < 0) {
+            return -1;
+        }
+        d = dist_base[sym] + extra;
+        if (d > s->pos || len > s->cap - s->pos) return -1;
+        unsigned char *out = s->dst + s->pos, *from = out - d;
+        if (d >= len) {
+            memcpy(out, from, len);
+        } else if (d == 1) {
+            memset(out, *from, len);
+        } else {
+            for (uint i = 0; i < len; i++) out[i] = from[i];
+        }
+        s->pos += len;
+    }
+}
+
+static int texture_inflate_dynamic(texture_inflate_state *s,
+    texture_huffman *lit, texture_huffman *dist)
+{
+    static const unsigned char order[19] = {
+        16, 17, 18, 0, 8, 7, 9, 6, 10, 5, 11, 4, 12, 3, 13, 2, 14, 1, 15
+    };
+    unsigned char lengths[320];
+    uint nlen, ndist, ncode, v;
+    if (texture_inflate_bits(s, 5, &nlen) < 0 ||
+            texture_inflate_bits(s, 5, &ndist) < 0 ||
+            texture_inflate_bits(s, 4, &ncode) < 0) {
+        return -1;
+    }
+    nlen += 257;
+    ndist += 1;
+    ncode += 4;
+    if (nlen > 286 || ndist > 30) return -1;
+    memset(lengths, 0, 19);
+    for (uint i = 0; i < ncode; i++) {
+        if (texture_inflate_bits(s, 3, &v) < 0) return -1;
+        lengths[order[i]] = (unsigned char)v;
+    }
+    if (texture_huffman_build(lit, lengths, 19) < 0) return -1;
+    for (uint i = 0; i < nlen + ndist; ) {
+        int sym = texture_inflate_symbol(s, lit);
+        uint rep, value = 0;
+        if (sym < 0) return -1;
+        if (sym < 16) {
+            lengths[i++] = (unsigned char)sym;
+            continue;
+        }
+        if (sym == 16) {
+            if (i == 0 || texture_inflate_bits(s, 2, &rep) < 0) return -1;
+            value = lengths[i - 1];
+            rep += 3;
+        } else if (sym == 17) {
+            if (texture_inflate_bits(s, 3, &rep) < 0) return -1;
+            rep += 3;
+        } else {
+            if (texture_inflate_bits(s, 7, &rep) < 0) return -1;
+            rep += 11;
+        }
+        if (i + rep > nlen + ndist) return -1;
+        while (rep--) lengths[i++] = (unsigned char)value;
+    }
+    if (lengths[256] == 0 ||
+            texture_huffman_build(lit, lengths, nlen) < 0 ||
+            texture_huffman_build(dist, lengths + nlen, ndist) < 0) {
+        return -1;
+    }
+    return 0;
+}
+
+/* inflate a zlib stream into dst, returning the bytes written or -1 */
+static long texture_inflate(unsigned char *dst, size_t cap,
+    const unsigned char *src, size_t size)
+{
+    texture_inflate_state s = { src + 2, src + size, 0, 0, dst, 0, cap };
+    texture_huffman *lit = (texture_huffman*)malloc(2 * sizeof(texture_huffman));
+    texture_huffman *dist = lit + 1;
+    uint last = 0, type, v;
+    int ret = 0;
+    if (size < 2 || (src[0] & 15) != 8 || (src[1] & 32) ||
+            ((src[0] << 8) | src[1]) % 31 != 0) {
+        free(lit);
+        return -1;
+    }
+    while (!last && ret == 0) {
+        if (texture_inflate_bits(&s, 1, &last) < 0 ||
+                texture_inflate_bits(&s, 2, &type) < 0) {
+            ret = -1;
+        } else if (type == 0) {
+            uint len, nlen;
+            texture_inflate_bits(&s, s.nbits & 7, &v);
+            if (texture_inflate_bits(&s, 16, &len) < 0 ||
+                    texture_inflate_bits(&s, 16, &nlen) < 0 ||
+                    len != (~nlen & 0xffff) || len > s.cap - s.pos) {
+                ret = -1;
+                break;
+            }
+            while (len && s.nbits) {
+                texture_inflate_bits(&s, 8, &v);
+                s.dst[s.pos++] = (unsigned char)v;
+                len--;
+            }
+            if (len > (size_t)(s.end - s.src)) {
+                ret = -1;
+                break;
+            }
+            memcpy(s.dst + s.pos, s.src, len);
+            s.src += len;
+            s.pos += len;
+        } else if (type == 1) {
+            unsigned char lengths[320];
+            memset(lengths, 8, 144);
+            memset(lengths + 144, 9, 112);
+            memset(lengths + 256, 7, 24);
+            memset(lengths + 280, 8, 8);
+            memset(lengths + 288, 5, 30);
+            texture_huffman_build(lit, lengths, 288);
+            texture_huffman_build(dist, lengths + 288, 30);
+            ret = texture_inflate_codes(&s, lit, dist);
+        } else if (type == 2) {
+            ret = texture_inflate_dynamic(&s, lit, dist);
+            if (ret == 0) ret = texture_inflate_codes(&s, lit, dist);
+        } else {
+            ret = -1;
+        }
+    }
+    free(lit);
+    return ret < 0 ? -1 : (long)s.pos;
+}
+
+/*
+ * PNG: chunks after the signature, with the image in the concatenated
+ * IDAT chunks as a zlib stream of filtered scanlines, each prefixed by
+ * its filter type. 1, 2 and 4 bit depths are only supported for palette
+ * images, and 16 bit samples are truncated to 8 bits.
+ */
+
+enum {
+    texture_png_gray = 0,
+    texture_png_rgb = 2,
+    texture_png_palette = 3,
+    texture_png_gray_alpha = 4,
+    texture_png_rgba = 6,
+};
+
+static unsigned char texture_paeth(unsigned char a, unsigned char b, unsigned char c)
+{
+    int p = a + b - c, pa = abs(p - a), pb = abs(p - b), pc = abs(p - c);
+    return pa <= pb && pa <= pc ? a : pb <= pc ? b : c;
+}
+
+/* undo the per-row filters in place, with a zero row above the first */
+static int texture_png_unfilter(unsigned char *rows, uint height, size_t stride, uint bpp)
+{
+    unsigned char *zero = (unsigned char*)calloc(stride, 1), *prev = zero;
+    int ret = 0;
+    for (uint y = 0; y < height && ret == 0; y++) {
+        unsigned char *cur = rows + y * (stride + 1) + 1;
+        size_t i;
+        switch (cur[-1]) {
+        case 0:
+            break;
+        case 1:
+            for (i = bpp; i < stride; i++) cur[i] += cur[i - bpp];
+            break;
+        case 2:
+            for (i = 0; i < stride; i++) cur[i] += prev[i];
+            break;
+        case 3:
+            for (i = 0; i < bpp; i++) cur[i] += prev[i] >> 1;
+            for (; i < stride; i++) cur[i] += (unsigned char)((cur[i - bpp] + prev[i]) >> 1);
+            break;
+        case 4:
+            for (i = 0; i < bpp; i++) cur[i] += prev[i];
+            for (; i < stride; i++) {
+                cur[i] += texture_paeth(cur[i - bpp], prev[i], prev[i - bpp]);
+            }
+            break;
+        default:
+            ret = -1;
+            break;
+        }
+        prev = cur;
+    }
+    free(zero);
+    return ret;
+}
+
+static int texture_png_decode(texture_image *ti, const unsigned char *src,
+    size_t size, int mips)
+{
+    unsigned char palette[256][4];
+    uint width = 0, height = 0, depth = 0, color = 0, interlace = 0, channels;
+    size_t idat_size = 0, pos = 8;
+    unsigned char *idat = NULL;
+
+    memset(palette, 0xff, sizeof(palette));
+    while (pos + 12 <= size) {
+        uint len = texture_get32be(src + pos), type = texture_get32(src + pos + 4);
+        const unsigned char *data = src + pos + 8;
+        if (len > size - pos - 12) break;
+        if (type == texture_fourcc('I','H','D','R') && len >= 13) {
+            width = texture_get32be(data);
+            height = texture_get32be(data + 4);
+            depth = data[8];
+            color = data[9];
+            interlace = data[12];
+        } else if (type == texture_fourcc('P','L','T','E')) {
+            for (uint i = 0; i < len / 3 && i < 256; i++) {
+                memcpy(palette[i], data + i * 3, 3);
+            }
+        } else if (type == texture_fourcc('t','R','N','S') && color == texture_png_palette) {
+            for (uint i = 0; i < len && i < 256; i++) {
+                palette[i][3] = data[i];
+            }
+        } else if (type == texture_fourcc('I','D','A','T')) {
+            unsigned char *grown = (unsigned char*)realloc(idat, idat_size + len);
+            if (!grown) {
+                free(idat);
+                return texture_error(ENOMEM);
+            }
+            idat = grown;
+            memcpy(idat + idat_size, data, len);
+            idat_size += len;
+        } else if (type == texture_fourcc('I','E','N','D')) {
+            break;
+        }
+        pos += (size_t)len + 12;
+    }
+
+    switch (color) {
+    case texture_png_gray: channels = 1; break;
+    case texture_png_rgb: channels = 3; break;
+    case texture_png_palette: channels = 1; break;
+    case texture_png_gray_alpha: channels = 2; break;
+    case texture_png_rgba: channels = 4; break;
+    default: channels = 0; break;
+    }
+    if (!idat || !width || !height || width > TEXTURE_SIZE_MAX ||
+            height > TEXTURE_SIZE_MAX || !channels) {
+        free(idat);
+        return texture_error(EINVAL);
+    }
+    /* palette images have 1, 2, 4 or 8 bit indices, the others 8 or 16 bits */
+    if (interlace || (color == texture_png_palette ?
+            depth != 1 && depth != 2 && depth != 4 && depth != 8 :
+            depth != 8 && depth != 16)) {
+        free(idat);
+        return texture_error(ENOTSUP);
+    }
+
+    size_t stride = ((size_t)width * channels * depth + 7) / 8;
+    uint bpp = (channels * depth + 7) / 8;
+    size_t raw_size = (stride + 1) * height;
+    unsigned char *raw = (unsigned char*)malloc(raw_size);
+    if (!raw) {
+        free(idat);
+        return texture_error(ENOMEM);
+    }
+    long n = texture_inflate(raw, raw_size, idat, idat_size);
+    free(idat);
+    if (n != (long)raw_size || texture_png_unfilter(raw, height, stride, bpp) < 0) {
+        free(raw);
+        return texture_error(EINVAL);
+    }
+    if (texture_image_alloc(ti, texture_rgba8, width, height, 1) < 0) {
+        free(raw);
+        return -1;
+    }
+    ti->srgb = 1;
+
+    uint step = depth / 8;
+    for (uint y = 0; y < height; y++) {
+        const unsigned char *in = raw + y * (stride + 1) + 1;
+        unsigned char *out = ti->data + (size_t)y * width * 4;
+        if (color == texture_png_rgba && depth == 8) {
+            memcpy(out, in, stride);
+            continue;
+        }
+        for (uint x = 0; x < width; x++, out += 4) {
+            if (color == texture_png_palette) {
+                uint bit = x * depth, i = (in[bit >> 3] >> (8 - depth - (bit & 7))) &
+                    ((1u << depth) - 1);
+                memcpy(out, palette[i], 4);
+                continue;
+            }
+            const unsigned char *p = in + (size_t)x * channels * step;
+            switch (color) {
+            case texture_png_gray:
+                out[0] = out[1] = out[2] = p[0];
+                out[3] = 255;
+                break;
+            case texture_png_gray_alpha:
+                out[0] = out[1] = out[2] = p[0];
+                out[3] = p[step];
+                break;
+            case texture_png_rgb:
+                out[0] = p[0]; out[1] = p[step]; out[2] = p[2 * step];
+                out[3] = 255;
+                break;
+            case texture_png_rgba:
+                out[0] = p[0]; out[1] = p[step]; out[2] = p[2 * step];
+                out[3] = p[3 * step];
+                break;
+            }
+        }
+    }
+    free(raw);
+    if (mips) {
+        texture_image_build_mips(ti);
+    }
+    return 0;
+}
+
+/*
+ * fill in the levels of an rgba8 image from level 0 with a 2x2 box
+ * filter, extending the chain to 1x1 if it is shorter.
+ */
+static void texture_image_build_mips(texture_image *ti)
+{
+    uint count = texture_chain_length(ti->width, ti->height);
+    if (ti->format != texture_rgba8) return;
+    if (ti->level_count < count) {
+        size_t offset = ti->levels[0].size;
+        for (uint l = 1; l < count; l++) {
+            texture_level *lv = &ti->levels[l];
+            lv->width = ti->width >> l ? ti->width >> l : 1;
+            lv->height = ti->height >> l ? ti->height >> l : 1;
+            lv->offset = offset;
+            lv->size = texture_level_size(ti->format, lv->width, lv->height);
+            offset += lv->size;
+        }
+        ti->data = (unsigned char*)realloc(ti->data, offset);
+        ti->size = offset;
+        ti->level_count = count;
+    }
+    for (uint l = 1; l < ti->level_count; l++) {
+        const texture_level *sl = &ti->levels[l - 1];
+        const texture_level *dl = &ti->levels[l];
+        const unsigned char *s = ti->data + sl->offset;
+        unsigned char *d = ti->data + dl->offset;
+        for (uint y = 0; y < dl->height; y++) {
+            uint y0 = y * 2 < sl->height ? y * 2 : sl->height - 1;
+            uint y1 = y * 2 + 1 < sl->height ? y * 2 + 1 : y0;
+            const unsigned char *r0 = s + (size_t)y0 * sl->width * 4;
+            const unsigned char *r1 = s + (size_t)y1 * sl->width * 4;
+            for (uint x = 0; x < dl->width; x++) {
+                uint x0 = x * 2 < sl->width ? x * 2 : sl->width - 1;
+                uint x1 = x * 2 + 1 < sl->width ? x * 2 + 1 : x0;
+                for (uint c = 0; c < 4; c++) {
+                    d[c] = (unsigned char)((r0[x0 * 4 + c] + r0[x1 * 4 + c] +
+                        r1[x0 * 4 + c] + r1[x1 * 4 + c] + 2) >> 2);
+                }
+                d += 4;
+            }
+        }
+    }
+}
+
+/* decode a KTX2, DDS or PNG file held in memory, detected by its magic */
+static int texture_image_decode(texture_image *ti, const unsigned char *src,
+    size_t size, int mips)
+{
+    static const unsigned char ktx2[12] = {
+        0xab, 'K', 'T', 'X', ' ', '2', '0', 0xbb, '\r', '\n', 0x1a, '\n'
+    };
+    static const unsigned char png[8] = {
+        0x89, 'P', 'N', 'G', '\r', '\n', 0x1a, '\n'
+    };
+    memset(ti, 0, sizeof(texture_image));
+    if (size >= sizeof(ktx2) && memcmp(src, ktx2, sizeof(ktx2)) == 0) {
+        return texture_ktx2_decode(ti, src, size, mips);
+    }
+    if (size >= 4 && texture_get32(src) == texture_fourcc('D','D','S',' ')) {
+        return texture_dds_decode(ti, src, size);
+    }
+    if (size >= sizeof(png) && memcmp(src, png, sizeof(png)) == 0) {
+        return texture_png_decode(ti, src, size, mips);
+    }
+    return texture_error(ENOTSUP);
+}
+
+static int texture_image_load(texture_image *ti, const char *filename, int mips)
+{
+    struct stat st;
+    int fd = open(filename, O_RDONLY);
+    if (fd < 0) return -1;
+    if (fstat(fd, &st) < 0) {
+        int err = errno;
+        close(fd);
+        return texture_error(err);
+    }
+    if (st.st_size == 0) {
+        close(fd);
+        return texture_error(EINVAL);
+    }
+    void *map = mmap(NULL, (size_t)st.st_size, PROT_READ, MAP_PRIVATE, fd, 0);
+    close(fd);
+    if (map == MAP_FAILED) return -1;
+    int ret = texture_image_decode(ti, (const unsigned char*)map, (size_t)st.st_size, mips);
+    int err = errno;
+    munmap(map, (size_t)st.st_size);
+    errno = err;
+    return ret;
+}
+
+static void texture_image_destroy(texture_image *ti)
+{
+    free(ti->data);
+    memset(ti, 0, sizeof(texture_image));
+}
@@ -0,0 +1,421 @@
+/*
+ * Copyright (c) 2020 Michael Clark <michaeljclark@mac.com>
+ *
+ * Permission to use, copy, modify, and/or distribute this software for any
+ * purpose with or without fee is hereby granted, provided that the above
+ * copyright notice and this permission notice appear in all copies.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS" AND THE AUTHOR DISCLAIMS ALL WARRANTIES
+ * WITH REGARD TO THIS SOFTWARE INCLUDING ALL IMPLIED WARRANTIES OF
+ * MERCHANTABILITY AND FITNESS. IN NO EVENT SHALL THE AUTHOR BE LIABLE FOR
+ * ANY SPECIAL, DIRECT, INDIRECT, OR CONSEQUENTIAL DAMAGES OR ANY DAMAGES
+ * WHATSOEVER RESULTING FROM LOSS OF USE, DATA OR PROFITS, WHETHER IN AN
+ * ACTION OF CONTRACT, NEGLIGENCE OR OTHER TORTIOUS ACTION, ARISING OUT OF
+ * OR IN CONNECTION WITH THE USE OR PERFORMANCE OF THIS SOFTWARE.
+ */
+
+#pragma once
+
+/*
+ * texture stream interface
+ *
+ * loads textures without blocking the context thread. decode threads
+ * read files with texture_image_load. an upload thread, current on a
+ * second GL context shared with the context thread, creates each texture
+ * with immutable storage and copies its levels through a persistently
+ * mapped pixel unpack buffer ring of TEXTURE_RING_SLOTS slots, each
+ * fenced so it is only rewritten once the GL has read it. the upload
+ * thread always takes the smallest pending level in bytes of any texture,
+ * so small and coarse levels arrive before large and fine ones. images
+ * with a row, or row of blocks, larger than a ring slot fail to load.
+ *
+ * after each level the upload thread publishes a fence. on the context
+ * thread, texture_stream_update polls the fences without waiting and
+ * lowers GL_TEXTURE_BASE_LEVEL to the finest complete level, so textures
+ * sharpen as levels arrive, and texture_stream_bind returns false until
+ * a texture has a level. requires pthreads, GLFW, texture_file.h and
+ * GL 4.4 for glBufferStorage.
+ */
+
+enum {
+    TEXTURE_STREAM_MAX = 256,
+    TEXTURE_DECODE_THREADS = 2,
+    TEXTURE_RING_SLOTS = 4,
+    TEXTURE_RING_SLOT_SIZE = 4 << 20,
+    TEXTURE_NONE = 0xffffffffu,
+};
+
+typedef enum
+{
+    texture_stream_queued,
+    texture_stream_decoding,
+    texture_stream_uploading,
+    texture_stream_done,
+    texture_stream_failed,
+} texture_stream_state;
+
+typedef struct
+{
+    char *path;
+    uint state;
+    texture_image image;        /* decoded, until the last level is uploaded */
+    GLuint id;
+    uint level_count;
+    uint next_level;            /* upload thread: level and block row to copy */
+    uint next_row;
+
+    /* published by the upload thread, guarded by mutex */
+    uint ready_level;
+    GLsync ready_fence;
+
+    /* context thread */
+    uint wait_level;
+    GLsync wait_fence;
+    uint base;                  /* TEXTURE_LEVEL_MAX until a level is complete */
+} texture_stream_entry;
+
+typedef struct
+{
+    GLFWwindow *context;
+    int srgb;                   /* sample sRGB images as sRGB */
+    uint count;
+    texture_stream_entry entries[TEXTURE_STREAM_MAX];
+    uint decode_next;
+    int quit;
+    pthread_t decoders[TEXTURE_DECODE_THREADS];
+    pthread_t uploader;
+    pthread_mutex_t mutex;
+    pthread_cond_t decode_cond;
+    pthread_cond_t upload_cond;
+
+    /* upload thread */
+    GLuint ring;
+    unsigned char *ring_map;
+    GLsync ring_fence[TEXTURE_RING_SLOTS];
+    uint ring_next;
+} texture_stream;
+
+static int texture_stream_init(texture_stream *ts, GLFWwindow *context, int srgb);
+static void texture_stream_destroy(texture_stream *ts);
+static uint texture_stream_add(texture_stream *ts, const char *path);
+static void texture_stream_update(texture_stream *ts);
+static int texture_stream_bind(texture_stream *ts, uint texture, uint unit);
+
+/*
+ * texture stream implementation
+ */
+
+static void texture_gl_format(uint format, uint srgb, GLenum *internal, GLenum *pixel)
+{
+    *pixel = format == texture_bgra8 ? GL_BGRA : GL_RGBA;
+    switch (format) {
+    case texture_bc1:
+        *internal = srgb ? GL_COMPRESSED_SRGB_ALPHA_S3TC_DXT1_EXT :
+            GL_COMPRESSED_RGBA_S3TC_DXT1_EXT;
+        break;
+    case texture_bc2:
+        *internal = srgb ? GL_COMPRESSED_SRGB_ALPHA_S3TC_DXT3_EXT :
+            GL_COMPRESSED_RGBA_S3TC_DXT3_EXT;
+        break;
+    case texture_bc3:
+        *internal = srgb ? GL_COMPRESSED_SRGB_ALPHA_S3TC_DXT5_EXT :
+            GL_COMPRESSED_RGBA_S3TC_DXT5_EXT;
+        break;
+    case texture_bc4: *internal = GL_COMPRESSED_RED_RGTC1; break;
+    case texture_bc5: *internal = GL_COMPRESSED_RG_RGTC2; break;
+    case texture_bc7:
+        *internal = srgb ? GL_COMPRESSED_SRGB_ALPHA_BPTC_UNORM :
+            GL_COMPRESSED_RGBA_BPTC_UNORM;
+        break;
+    default:
+        *internal = srgb ? GL_SRGB8_ALPHA8 : GL_RGBA8;
+        break;
+    }
+}
+
+/* bytes in a row of pixels, or of 4x4 blocks for compressed formats */
+static size_t texture_row_size(uint format, uint width)
+{
+    uint block = texture_block_size(format);
+    return block ? (size_t)((width + 3) / 4) * block : (size_t)width * 4;
+}
+
+/* bytes of the next level to upload, the upload order */
+static size_t texture_pending_size(const texture_stream_entry *e)
+{
+    return e->image.levels[e->next_level - 1].size;
+}
+
+static void* texture_decode_main(void *arg)
+{
+    texture_stream *ts = (texture_stream*)arg;
+    pthread_mutex_lock(&ts->mutex);
+    for (;;) {
+        while (!ts->quit && ts->decode_next == ts->count) {
+            pthread_cond_wait(&ts->decode_cond, &ts->mutex);
+        }
+        if (ts->quit) break;
+        texture_stream_entry *e = &ts->entries[ts->decode_next++];
+        e->state = texture_stream_decoding;
+        pthread_mutex_unlock(&ts->mutex);
+        texture_image image;
+        int ret = texture_image_load(&image, e->path, 1);
+        if (ret == 0 && texture_row_size(image.format, image.width) >
+                TEXTURE_RING_SLOT_SIZE) {
+            texture_image_destroy(&image);
+            errno = EFBIG;
+            ret = -1;
+        }
+        if (ret < 0) {
+            fprintf(stderr, "texture: %s: %s\n", e->path, strerror(errno));
+        }
+        pthread_mutex_lock(&ts->mutex);
+        if (ret < 0) {
+            e->state = texture_stream_failed;
+            continue;
+        }
+        e->image = image;
+        e->level_count = e->next_level = image.level_count;
+        e->state = texture_stream_uploading;
+        pthread_cond_signal(&ts->upload_cond);
+    }
+    pthread_mutex_unlock(&ts->mutex);
+    return NULL;
+}
+
+/* wait until the next ring slot has been consumed by the GL */
+static uint texture_ring_acquire(texture_stream *ts)
+{
+    uint slot = ts->ring_next++ % TEXTURE_RING_SLOTS;
+    GLsync fence = ts->ring_fence[slot];
+    if (fence) {
+        while (glClientWaitSync(fence, GL_SYNC_FLUSH_COMMANDS_BIT, 100000000) ==
+            GL_TIMEOUT_EXPIRED);
+        glDeleteSync(fence);
+        ts->ring_fence[slot] = 0;
+    }
+    return slot;
+}
+
+static void texture_upload_create(texture_stream *ts, texture_stream_entry *e)
+{
+    GLenum internal, pixel;
+    texture_gl_format(e->image.format, e->image.srgb && ts->srgb, &internal, &pixel);
+    glGenTextures(1, &e->id);
+    glBindTexture(GL_TEXTURE_2D, e->id);
+    glTexStorage2D(GL_TEXTURE_2D, (GLsizei)e->level_count, internal,
+        (GLsizei)e->image.width, (GLsizei)e->image.height);
+    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_LINEAR_MIPMAP_LINEAR);
+    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_LINEAR);
+    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_S, GL_REPEAT);
+    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_T, GL_REPEAT);
+    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_BASE_LEVEL, (GLint)e->level_count - 1);
+}
+
+/*
+ * copy one ring slot of rows of the next level, in blocks for compressed
+ * formats, returning true when the level is complete.
+ */
+static int texture_upload_chunk(texture_stream *ts, texture_stream_entry *e)
+{
+    uint level = e->next_level - 1;
+    const texture_level *lv = &e->image.levels[level];
+    uint block = texture_block_size(e->image.format);
+    uint rows = block ? (lv->height + 3) / 4 : lv->height;
+    size_t row_size = texture_row_size(e->image.format, lv->width);
+    uint n = (uint)(TEXTURE_RING_SLOT_SIZE / row_size);
+    GLenum internal, pixel;
+
+    if (n > rows - e->next_row) n = rows - e->next_row;
+    uint slot = texture_ring_acquire(ts);
+    size_t offset = (size_t)slot * TEXTURE_RING_SLOT_SIZE, size = n * row_size;
+    memcpy(ts->ring_map + offset, e->image.data + lv->offset + e->next_row * row_size, size);
+
+    texture_gl_format(e->image.format, e->image.srgb && ts->srgb, &internal, &pixel);
+    glBindTexture(GL_TEXTURE_2D, e->id);
+    if (block) {
+        uint y = e->next_row * 4, h = n * 4 < lv->height - y ? n * 4 : lv->height - y;
+        glCompressedTexSubImage2D(GL_TEXTURE_2D, (GLint)level, 0, (GLint)y,
+            (GLsizei)lv->width, (GLsizei)h, internal, (GLsizei)size, (void*)offset);
+    } else {
+        glTexSubImage2D(GL_TEXTURE_2D, (GLint)level, 0, (GLint)e->next_row,
+            (GLsizei)lv->width, (GLsizei)n, pixel, GL_UNSIGNED_BYTE, (void*)offset);
+    }
+    ts->ring_fence[slot] = glFenceSync(GL_SYNC_GPU_COMMANDS_COMPLETE, 0);
+    e->next_row += n;
+    return e->next_row == rows;
+}
+
+static void* texture_upload_main(void *arg)
+{
+    texture_stream *ts = (texture_stream*)arg;
+    GLbitfield flags = GL_MAP_WRITE_BIT | GL_MAP_PERSISTENT_BIT | GL_MAP_COHERENT_BIT;
+    GLsizeiptr ring_size = (GLsizeiptr)TEXTURE_RING_SLOTS * TEXTURE_RING_SLOT_SIZE;
+
+    glfwMakeContextCurrent(ts->context);
+    glGenBuffers(1, &ts->ring);
+    glBindBuffer(GL_PIXEL_UNPACK_BUFFER, ts->ring);
+    glBufferStorage(GL_PIXEL_UNPACK_BUFFER, ring_size, NULL, flags);
+    ts->ring_map = (unsigned char*)glMapBufferRange(GL_PIXEL_UNPACK_BUFFER, 0,
+        ring_size, flags);
+    glPixelStorei(GL_UNPACK_ALIGNMENT, 1);
+
+    pthread_mutex_lock(&ts->mutex);
+    for (;;) {
+        texture_stream_entry *e = NULL;
+        while (!ts->quit) {
+            for (uint i = 0; i < ts->count; i++) {
+                texture_stream_entry *c = &ts->entries[i];
+                if (c->state == texture_stream_uploading &&
+                        (!e || texture_pending_size(c) < texture_pending_size(e))) {
+                    e = c;
+                }
+            }
+            if (e) break;
+            pthread_cond_wait(&ts->upload_cond, &ts->mutex);
+        }
+        if (ts->quit) break;
+        pthread_mutex_unlock(&ts->mutex);
+
+        if (!e->id) {
+            texture_upload_create(ts, e);
+        }
+        int complete = texture_upload_chunk(ts, e);
+        GLsync fence = complete ? glFenceSync(GL_SYNC_GPU_COMMANDS_COMPLETE, 0) : 0;
+        if (complete) {
+            glFlush();
+        }
+
+        pthread_mutex_lock(&ts->mutex);
+        if (complete) {
+            if (e->ready_fence) glDeleteSync(e->ready_fence);
+            e->ready_fence = fence;
+            e->ready_level = --e->next_level;
+            e->next_row = 0;
+            if (e->next_level == 0) {
+                texture_image_destroy(&e->image);
+                e->state = texture_stream_done;
+            }
+        }
+    }
+    pthread_mutex_unlock(&ts->mutex);
+
+    for (uint slot = 0; slot < TEXTURE_RING_SLOTS; slot++) {
+        if (ts->ring_fence[slot]) glDeleteSync(ts->ring_fence[slot]);
+    }
+    glBindBuffer(GL_PIXEL_UNPACK_BUFFER, ts->ring);
+    glUnmapBuffer(GL_PIXEL_UNPACK_BUFFER);
+    glBindBuffer(GL_PIXEL_UNPACK_BUFFER, 0);
+    glDeleteBuffers(1, &ts->ring);
+    glFinish();
+    glfwMakeContextCurrent(NULL);
+    return NULL;
+}
+
+/*
+ * start the decode and upload threads. context is a hidden window
+ * created sharing objects with the context thread's window.
+ */
+static int texture_stream_init(texture_stream *ts, GLFWwindow *context, int srgb)
+{
+    memset(ts, 0, sizeof(texture_stream));
+    if (!context) return -1;
+    ts->context = context;
+    ts->srgb = srgb;
+    pthread_mutex_init(&ts->mutex, NULL);
+    pthread_cond_init(&ts->decode_cond, NULL);
+    pthread_cond_init(&ts->upload_cond, NULL);
+    for (int i = 0; i < TEXTURE_DECODE_THREADS; i++) {
+        pthread_create(&ts->decoders[i], NULL, texture_decode_main, ts);
+    }
+    pthread_create(&ts->uploader, NULL, texture_upload_main, ts);
+    return 0;
+}
+
+static void texture_stream_destroy(texture_stream *ts)
+{
+    if (!ts->context) return;
+    pthread_mutex_lock(&ts->mutex);
+    ts->quit = 1;
+    pthread_cond_broadcast(&ts->decode_cond);
+    pthread_cond_broadcast(&ts->upload_cond);
+    pthread_mutex_unlock(&ts->mutex);
+    for (int i = 0; i < TEXTURE_DECODE_THREADS; i++) {
+        pthread_join(ts->decoders[i], NULL);
+    }
+    pthread_join(ts->uploader, NULL);
+    for (uint i = 0; i < ts->count; i++) {
+        texture_stream_entry *e = &ts->entries[i];
+        if (e->ready_fence) glDeleteSync(e->ready_fence);
+        if (e->wait_fence) glDeleteSync(e->wait_fence);
+        if (e->id) glDeleteTextures(1, &e->id);
+        texture_image_destroy(&e->image);
+        free(e->path);
+    }
+    pthread_cond_destroy(&ts->upload_cond);
+    pthread_cond_destroy(&ts->decode_cond);
+    pthread_mutex_destroy(&ts->mutex);
+    memset(ts, 0, sizeof(texture_stream));
+}
+
+/* queue a texture file for decoding, returning its handle */
+static uint texture_stream_add(texture_stream *ts, const char *path)
+{
+    if (!ts->context || ts->count == TEXTURE_STREAM_MAX) return TEXTURE_NONE;
+    pthread_mutex_lock(&ts->mutex);
+    texture_stream_entry *e = &ts->entries[ts->count];
+    memset(e, 0, sizeof(texture_stream_entry));
+    e->path = strdup(path);
+    e->state = texture_stream_queued;
+    e->base = TEXTURE_LEVEL_MAX;
+    ts->count++;
+    pthread_cond_signal(&ts->decode_cond);
+    pthread_mutex_unlock(&ts->mutex);
+    return ts->count - 1;
+}
+
+/*
+ * called once per frame on the context thread. takes the latest level
+ * published for each texture and makes it the base level once its fence
+ * has signalled, polling so the frame never waits on an upload.
+ */
+static void texture_stream_update(texture_stream *ts)
+{
+    if (!ts->count) return;
+    pthread_mutex_lock(&ts->mutex);
+    for (uint i = 0; i < ts->count; i++) {
+        texture_stream_entry *e = &ts->entries[i];
+        if (!e->ready_fence) continue;
+        if (e->wait_fence) glDeleteSync(e->wait_fence);
+        e->wait_fence = e->ready_fence;
+        e->wait_level = e->ready_level;
+        e->ready_fence = 0;
+    }
+    pthread_mutex_unlock(&ts->mutex);
+
+    for (uint i = 0; i < ts->count; i++) {
+        texture_stream_entry *e = &ts->entries[i];
+        if (!e->wait_fence) continue;
+        GLenum status = glClientWaitSync(e->wait_fence, 0, 0);
+        if (status != GL_ALREADY_SIGNALED && status != GL_CONDITION_SATISFIED) {
+            continue;
+        }
+        glDeleteSync(e->wait_fence);
+        e->wait_fence = 0;
+        e->base = e->wait_level;
+        glBindTexture(GL_TEXTURE_2D, e->id);
+        glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_BASE_LEVEL, (GLint)e->base);
+        glBindTexture(GL_TEXTURE_2D, 0);
+    }
+}
+
+/* bind a texture if it has a complete level, returning false if not */
+static int texture_stream_bind(texture_stream *ts, uint texture, uint unit)
+{
+    if (texture >= ts->count || ts->entries[texture].base == TEXTURE_LEVEL_MAX) {
+        return 0;
+    }
+    glActiveTexture(GL_TEXTURE0 + unit);
+    glBindTexture(GL_TEXTURE_2D, ts->entries[texture].id);
+    return 1;
+}